@@ -42,11 +42,26 @@
 // Feb/10/2005  JDR  Removed non-standard open mode from fileExists()
 // Feb/13/2005  JDR  Added LogOutput class
 // May/22/2005  JDR  Added support for multiple log levels.
+// Oct/18/2026       Gave LogOutput per thread settings.
+// Oct/18/2026       Added sub-second file stamps and FileVersion.
+// Oct/18/2026       Added isAbsolutePath() and getAbsolutePath().
 ////////////////////////////////////////////////////////////////////////////////
 
 #include <string>
 #include <ctype.h>
 #include <fstream>
+#include <errno.h>
+#include <sys/stat.h>
+#include <utime.h>
+#include <time.h>
+#include <algorithm>
+#ifdef _WIN32
+#include <direct.h>
+#include <windows.h>
+#else
+#include <glob.h>
+#include <unistd.h>
+#endif
 
 #include "DustyUtil.h"
 
@@ -104,7 +119,309 @@ bool DustyUtil::fileExists(const string filename)
     // Note i's destructor will close file
 }
 
+unsigned long DustyUtil::fileSize(const string filename)
+{
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0) return 0;
+    return info.st_size;
+}
+
+#ifdef _WIN32
+// Converts a FILETIME, in 100 nanosecond units since 1601, to nanoseconds
+// since 1970
+static long long fileTimeToNanoseconds(const FILETIME& t)
+{
+    const long long EPOCH_DIFFERENCE = 116444736000000000LL;
+
+    long long ticks = ((long long) t.dwHighDateTime << 32) | t.dwLowDateTime;
+    return (ticks - EPOCH_DIFFERENCE) * 100;
+}
+#endif
+
+// The current time in nanoseconds since 1970
+static long long currentTime()
+{
+#ifdef _WIN32
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    return fileTimeToNanoseconds(now);
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (long long) now.tv_sec * DustyUtil::NANOSECONDS + now.tv_nsec;
+#endif
+}
+
+// Windows does not have inode numbers or status change times, so there
+// stat() sets st_ino to 0, and the creation time takes the place of the
+// status change time. stat() only has whole seconds on Windows, so the
+// times are read with GetFileAttributesEx() instead.
+DustyUtil::FileStamp DustyUtil::getFileStamp(const string filename)
+{
+    FileStamp stamp;
+    struct stat info;
+
+    stamp.exists = (stat(filename.c_str(), &info) == 0);
+    if (stamp.exists)
+    {
+        stamp.device = info.st_dev;
+        stamp.inode = info.st_ino;
+        stamp.size = info.st_size;
+#ifdef _WIN32
+        WIN32_FILE_ATTRIBUTE_DATA data;
+        if (GetFileAttributesEx(filename.c_str(), GetFileExInfoStandard, &data))
+        {
+            stamp.mtime = fileTimeToNanoseconds(data.ftLastWriteTime);
+            stamp.ctime = fileTimeToNanoseconds(data.ftCreationTime);
+        }
+        else
+        {
+            stamp.mtime = (long long) info.st_mtime * NANOSECONDS;
+            stamp.ctime = (long long) info.st_ctime * NANOSECONDS;
+        }
+#else
+        stamp.mtime = (long long) info.st_mtim.tv_sec * NANOSECONDS + info.st_mtim.tv_nsec;
+        stamp.ctime = (long long) info.st_ctim.tv_sec * NANOSECONDS + info.st_ctim.tv_nsec;
+#endif
+    }
+    else
+    {
+        stamp.device = stamp.inode = stamp.size = 0;
+        stamp.mtime = stamp.ctime = 0;
+    }
+    return stamp;
+}
+
+// The clock file systems stamp times with can lag the current time by a
+// tick, and FAT only keeps modification times to 2 seconds, so anything
+// changed within the last 2 seconds counts as recent. So does anything
+// changed in the future, by a clock that is ahead of this one.
+bool DustyUtil::FileStamp::isRecent() const
+{
+    const long long SETTLE_TIME = 2 * NANOSECONDS;
+
+    if (!exists) return false;
+
+    long long changed = (mtime > ctime) ? mtime : ctime;
+    return changed >= currentTime() - SETTLE_TIME;
+}
+
+bool DustyUtil::isAbsolutePath(const string path)
+{
+#ifdef _WIN32
+    if (path.size() >= 2 && isalpha((unsigned char) path[0]) && path[1] == ':') return true;
+    return !path.empty() && (path[0] == '\\' || path[0] == '/');
+#else
+    return !path.empty() && path[0] == '/';
+#endif
+}
+
+string DustyUtil::getAbsolutePath(const string path)
+{
+    if (path.empty() || isAbsolutePath(path)) return path;
+
+    char dir[4096];
+#ifdef _WIN32
+    if (_getcwd(dir, sizeof(dir)) == NULL) return path;
+    return string(dir) + "\\" + path;
+#else
+    if (getcwd(dir, sizeof(dir)) == NULL) return path;
+    return string(dir) + "/" + path;
+#endif
+}
+
+// Creates a directory, succeeding if it already exists
+bool DustyUtil::makeDirectory(const string dirname)
+{
+#ifdef _WIN32
+    int result = _mkdir(dirname.c_str());
+#else
+    int result = mkdir(dirname.c_str(), 0777);
+#endif
+    return (result == 0 || errno == EEXIST);
+}
+
+bool DustyUtil::expandWildcards(const string pattern, vector<string>& names)
+{
+    if (pattern.find_first_of("*?") == string::npos)
+    {
+        names.push_back(pattern);
+        return true;
+    }
+
+    vector<string> found;
+#ifdef _WIN32
+    // FindFirstFile() only returns the file name, so keep the directory
+    string::size_type slash = pattern.find_last_of("\\/:");
+    string dir = (slash == string::npos) ? "" : pattern.substr(0, slash + 1);
+
+    WIN32_FIND_DATA data;
+    HANDLE h = FindFirstFile(pattern.c_str(), &data);
+    if (h != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+            {
+                found.push_back(dir + data.cFileName);
+            }
+        } while (FindNextFile(h, &data));
+        FindClose(h);
+    }
+#else
+    glob_t g;
+    if (glob(pattern.c_str(), 0, NULL, &g) == 0)
+    {
+        for (size_t i = 0; i < g.gl_pathc; i++)
+        {
+            struct stat info;
+            if (stat(g.gl_pathv[i], &info) == 0 && !S_ISDIR(info.st_mode))
+            {
+                found.push_back(g.gl_pathv[i]);
+            }
+        }
+    }
+    globfree(&g);
+#endif
+
+    sort(found.begin(), found.end());
+    names.insert(names.end(), found.begin(), found.end());
+    return !found.empty();
+}
+
+bool DustyUtil::touchFile(const string filename)
+{
+    return utime(filename.c_str(), NULL) == 0;
+}
+
+void DustyUtil::splitArguments(const string& line, vector<string>& args) throw (runtime_error)
+{
+    string::size_type i = 0;
+    while (i < line.size())
+    {
+        if (isspace((unsigned char) line[i]))
+        {
+            i++;
+            continue;
+        }
+
+        string arg;
+        while (i < line.size() && !isspace((unsigned char) line[i]))
+        {
+            if (line[i] == '"')
+            {
+                string::size_type close = line.find('"', i + 1);
+                if (close == string::npos)
+                {
+                    throw runtime_error("Missing closing quote: " + line);
+                }
+                arg += line.substr(i + 1, close - i - 1);
+                i = close + 1;
+            }
+            else arg += line[i++];
+        }
+        args.push_back(arg);
+    }
+}
+
+//////////////// Hash64 //////////////////////////////////////////////////
+
+// Add a block of bytes to the hash
+void DustyUtil::Hash64::add(const void *data, size_t size)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+
+    for (size_t i = 0; i < size; i++)
+    {
+        value ^= bytes[i];
+        value *= PRIME;
+    }
+}
+
+bool DustyUtil::Hash64::addFile(const string& filename)
+{
+    ifstream theFile(filename.c_str(), ios_base::binary);
+    if (!theFile) return false;
+
+    char buffer[8192];
+    while (theFile.read(buffer, sizeof(buffer)) || theFile.gcount() > 0)
+    {
+        add(buffer, theFile.gcount());
+    }
+    return theFile.eof();
+}
+
+// The digest is taken after the stamp, so a change in between makes the
+// version differ from the file later rather than hiding the change.
+DustyUtil::FileVersion DustyUtil::getFileVersion(const string filename)
+{
+    FileVersion version;
+    version.stamp = getFileStamp(filename);
+    version.hashed = version.stamp.isRecent();
+    version.digest = 0;
+
+    // A file that can't be read never matches its version
+    Hash64 h;
+    if (version.hashed && h.addFile(filename)) version.digest = h.getValue();
+    return version;
+}
+
+bool DustyUtil::isSameVersion(const string filename, FileVersion& version)
+{
+    if (getFileStamp(filename) != version.stamp) return false;
+    if (!version.hashed) return true;
+
+    Hash64 h;
+    if (!h.addFile(filename) || h.getValue() != version.digest) return false;
+
+    // Any change from now on would change the stamp
+    if (!version.stamp.isRecent()) version.hashed = false;
+    return true;
+}
+
+// Return the hash as a fixed width hex string, suitable for file names
+string DustyUtil::Hash64::toString() const
+{
+    static const char digits[] = "0123456789abcdef";
+    string s(16, '0');
+
+    unsigned long long v = value;
+    for (int i = 15; i >= 0; i--)
+    {
+        s[i] = digits[v & 0x0F];
+        v >>= 4;
+    }
+    return s;
+}
+
+//////////////// Memory stream buf ///////////////////////////////////////
+
+streambuf::pos_type DustyUtil::memoryBuf::seekoff(off_type off, ios_base::seekdir dir,
+                                                  ios_base::openmode which)
+{
+    char *p;
+    if (dir == ios_base::beg) p = eback() + off;
+    else if (dir == ios_base::cur) p = gptr() + off;
+    else p = egptr() + off;
+
+    if (!(which & ios_base::in) || p < eback() || p > egptr()) return pos_type(off_type(-1));
+
+    setg(eback(), p, egptr());
+    return pos_type(p - eback());
+}
+
+streambuf::pos_type DustyUtil::memoryBuf::seekpos(pos_type pos, ios_base::openmode which)
+{
+    return seekoff(off_type(pos), ios_base::beg, which);
+}
+
 //////////////// Log output //////////////////////////////////////////////
-ostream* DustyUtil::LogOutput::stream = NULL;
-vector<bool> DustyUtil::LogOutput::enabled;
-ostream DustyUtil::LogOutput::nullStream(new nullBuf());
+namespace
+{
+    // Discards everything, so one can be shared by every thread
+    DustyUtil::nullBuf sharedNullBuf;
+}
+
+DustyUtil::LogOutput::Settings DustyUtil::LogOutput::defaults;
+thread_local DustyUtil::LogOutput::Settings *DustyUtil::LogOutput::current = NULL;
+thread_local ostream DustyUtil::LogOutput::nullStream(&sharedNullBuf);
@@ -42,6 +42,8 @@
 //                    operators.
 // Feb/13/2005  JDR   Added debug output utility class and methods.
 // May/22/2005  JDR   Added support for multiple log levels.
+// Oct/18/2026        Gave LogOutput per thread settings.
+// Oct/18/2026        Made SmartPointer movable and not copyable.
 ////////////////////////////////////////////////////////////////////////////////
 
 #ifndef DUSTYUTIL_H_
@@ -51,6 +53,7 @@
 #include <sstream>
 #include <string>
 #include <vector>
+#include <stdexcept>
 
 using namespace std;
 
@@ -70,9 +73,74 @@ namespace DustyUtil
     // Determine if a file exists
     bool fileExists(const string filename);
 
+    // Size of a file in bytes, or 0 if it does not exist
+    unsigned long fileSize(const string filename);
+
+    // Whether a path starts from the root (or on Windows, a drive or share),
+    // rather than from the current directory
+    bool isAbsolutePath(const string path);
+
+    // A path made absolute by putting the current directory in front of it,
+    // if it is not already absolute
+    string getAbsolutePath(const string path);
+
+    // Create a directory if it does not already exist. Returns false if the
+    // directory could not be created.
+    bool makeDirectory(const string dirname);
+
+    // What a file looked like at some point: whether it existed, which file
+    // it was, when it was last modified or had its status changed (in
+    // nanoseconds since 1970) and its size. Two stamps of the same name that
+    // differ mean the file was changed or replaced in between. The reverse
+    // only holds for a stamp that isRecent() says is old enough.
+    struct FileStamp
+    {
+        bool exists;
+        unsigned long long device;
+        unsigned long long inode;
+        long long mtime;
+        long long ctime;
+        unsigned long long size;
+
+        bool operator==(const FileStamp& s) const
+        {
+            return exists == s.exists && device == s.device &&
+                   inode == s.inode && mtime == s.mtime && ctime == s.ctime &&
+                   size == s.size;
+        }
+        bool operator!=(const FileStamp& s) const { return !(*this == s); }
+
+        // Whether the file was changed so recently that it could be changed
+        // again without changing its times, which file systems only keep to
+        // the tick of their clock, or to 2 seconds on FAT.
+        bool isRecent() const;
+    };
+
+    FileStamp getFileStamp(const string filename);
+
+    // The number of nanoseconds in a second, for the times in a FileStamp
+    const long long NANOSECONDS = 1000000000LL;
+
+    // Adds the names of the files matching a pattern with * and ? wildcards
+    // to names, in sorted order. A pattern without wildcards is added as is.
+    // Returns false if a pattern with wildcards matches nothing.
+    bool expandWildcards(const string pattern, vector<string>& names);
+
+    // Set a file's modification time to now. Returns false if it does not
+    // exist.
+    bool touchFile(const string filename);
+
+    // Splits a line into arguments separated by white space. An argument can
+    // be put in double quotes, for file names with spaces in them. The
+    // arguments are added to the end of args.
+    void splitArguments(const string& line, vector<string>& args) throw (runtime_error);
+
     // A smart pointer class, that destroys its contents with delete
     // The optional argument makes sure that objects constructed with new[] are
     // deleted with delete[])
+    // Only one SmartPointer owns an object at a time. It cannot be copied,
+    // but ownership can be moved to another SmartPointer, leaving the old
+    // one NULL, so they can be kept in containers and returned by value.
     template <class T, bool isArray=false>
     class SmartPointer
     {
@@ -89,6 +157,22 @@ namespace DustyUtil
             pointer=NULL;
         }
 
+        // Take ownership from another SmartPointer
+        SmartPointer(SmartPointer&& other)
+        {
+            pointer=other.releaseControl();
+        }
+
+        SmartPointer& operator=(SmartPointer&& other)
+        {
+            if (pointer != other.pointer)
+            {
+                destroy();
+                pointer=other.releaseControl();
+            }
+            return *this;
+        }
+
         // Release control of a pointer
         // sets this pointer to NULL without deleting it,
         // and returns the old pointer.
@@ -108,13 +192,14 @@ namespace DustyUtil
             return *this;
         }
 
-        // Destroy the contents
+        // Destroy the contents, leaving this pointer NULL
         void destroy()
         {
             if (pointer!=NULL)
             {
                 if (isArray) delete[] pointer;
                 else delete pointer;
+                pointer=NULL;
             }
         }
 
@@ -178,7 +263,7 @@ namespace DustyUtil
         }
 
         // Comparison
-        bool operator == (SmartPointer<T,isArray> sp) const
+        bool operator == (const SmartPointer<T,isArray>& sp) const
         {
             return (pointer == sp.pointer);
         }
@@ -191,6 +276,12 @@ namespace DustyUtil
         protected:
 
         T *pointer;
+
+        private:
+
+        // Not copyable, since both copies would delete the same object
+        SmartPointer(const SmartPointer&);
+        SmartPointer& operator=(const SmartPointer&);
     };
 
     // Utility methods for output that's enabled/disabled by global verbose
@@ -205,46 +296,191 @@ namespace DustyUtil
     // be used.  If the level passed has not been enabled (or has been disabled
     // with disableLevel), then no output is made to the stream set by
     // setOutputStream.  If it has been enabled, then the output is performed.
+    //
+    // The stream and levels are kept in a Settings object. By default every
+    // thread uses the same process wide settings, which should only be
+    // changed while no other thread is logging. A thread can use settings
+    // of its own by creating a LogOutput::Scope; until the scope is
+    // destroyed, the static methods below work on its settings instead.
     class LogOutput
     {
         public:
-       
+
+        struct Settings
+        {
+            Settings() : stream(NULL) { }
+
+            ostream* stream;
+            vector<bool> enabled;
+        };
+
+        // Makes the current thread use a copy of the given settings for as
+        // long as the scope exists. Scopes can be nested.
+        class Scope
+        {
+            public:
+            Scope(const Settings& s) : settings(s), previous(current)
+            { current = &settings; }
+
+            ~Scope()
+            { current = previous; }
+
+            private:
+            Scope(const Scope&);
+            Scope& operator=(const Scope&);
+
+            Settings settings;
+            Settings *previous;
+        };
+
+        // The settings of the current thread's innermost scope, or the
+        // process wide settings if it has none
+        static Settings& getSettings()
+        { return (current != NULL) ? *current : defaults; }
+
         static void setOutputStream(ostream& outputStream)
-        { stream = &outputStream; }
+        { getSettings().stream = &outputStream; }
 
         static void setMaxLevel(const int maxLevel)
-        { enabled.resize(maxLevel+1, false); }
+        { getSettings().enabled.resize(maxLevel+1, false); }
                
         static void enableLevel(const int level)         
         { 
+           vector<bool>& enabled = getSettings().enabled;
            if (level >= enabled.size()) enabled.resize(level+1);
            enabled[level] = true; 
         }
 
         static void disableLevel(const int level)         
         { 
+           vector<bool>& enabled = getSettings().enabled;
            if (level < enabled.size()) enabled[level] = false;
         }
 
         static ostream& log(const int level)
         {
-            if (level < enabled.size() && enabled[level]) return *stream;
+            const Settings& s = getSettings();
+            if (level < s.enabled.size() && s.enabled[level] && s.stream != NULL) return *s.stream;
             else return nullStream;
         }
 
         private:
 
-        static ostream* stream;
-        static ostream nullStream;
-        static vector<bool> enabled;
+        static Settings defaults;
+        static thread_local Settings *current;
+
+        // Each thread has its own, since writing to a stream changes its
+        // state even when nothing is output
+        static thread_local ostream nullStream;
+    };
+
+    // A 64 bit FNV-1a hash, used to build content digests for caches. Data is
+    // added incrementally with add(), and the digest read back with getValue()
+    // or toString(). This is not a cryptographic hash, it is only meant to
+    // tell different inputs apart quickly.
+    class Hash64
+    {
+        public:
+        Hash64() : value(OFFSET_BASIS) { }
+
+        void add(const void *data, size_t size);
+
+        // Add the raw bytes of a plain value (int, struct, etc.)
+        template <class T>
+        void addValue(const T& v)
+        { add(&v, sizeof(T)); }
+
+        void addString(const string& s)
+        { addValue(s.size()); add(s.data(), s.size()); }
+
+        // Add the contents of a file. Returns false if it could not be read.
+        bool addFile(const string& filename);
+
+        unsigned long long getValue() const
+        { return value; }
+
+        // Returns the digest as 16 lower case hex digits
+        string toString() const;
+
+        private:
+
+        static const unsigned long long OFFSET_BASIS = 14695981039346656037ULL;
+        static const unsigned long long PRIME = 1099511628211ULL;
+
+        unsigned long long value;
+    };
+
+    // A version of a file, that can tell whether the file is still the same.
+    // It is a FileStamp, plus a digest of the contents when the stamp is too
+    // recent to show a change.
+    struct FileVersion
+    {
+        FileStamp stamp;
+        bool hashed;
+        unsigned long long digest;
     };
 
+    FileVersion getFileVersion(const string filename);
+
+    // Returns true if a file is still the given version. This reads the file
+    // again if the version had to be hashed. A hashed version found to be
+    // the same once its stamp is no longer recent stops needing the hash.
+    bool isSameVersion(const string filename, FileVersion& version);
+
     // This is a "null" stream buf that reads nothing and writes nothing
     class nullBuf : public streambuf
     {
         public:
             nullBuf() { }
     };
+
+    // A stream buf that adds everything written to it to a Hash64, so that
+    // anything that can be saved to an ostream can be hashed without
+    // keeping it
+    class hashBuf : public streambuf
+    {
+        public:
+            hashBuf(Hash64& h) : hash(h) { }
+
+        protected:
+            int_type overflow(int_type c)
+            {
+                if (c != traits_type::eof())
+                {
+                    char ch = traits_type::to_char_type(c);
+                    hash.add(&ch, 1);
+                }
+                return traits_type::not_eof(c);
+            }
+
+            streamsize xsputn(const char *s, streamsize n)
+            {
+                hash.add(s, n);
+                return n;
+            }
+
+        private:
+            Hash64& hash;
+    };
+
+    // A stream buf that reads from a block of memory owned by someone else,
+    // such as a mapped file, so it can be read with an istream without
+    // copying it first. Seeking is supported.
+    class memoryBuf : public streambuf
+    {
+        public:
+            memoryBuf(const char *data, size_t size)
+            {
+                char *p = const_cast<char *>(data);
+                setg(p, p, p + size);
+            }
+
+        protected:
+            pos_type seekoff(off_type off, ios_base::seekdir dir,
+                             ios_base::openmode which = ios_base::in);
+            pos_type seekpos(pos_type pos,
+                             ios_base::openmode which = ios_base::in);
+    };
 }
 #endif
 
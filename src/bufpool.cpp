@@ -0,0 +1,134 @@
+/*
+ * The contents of this file are subject to the Mozilla Public
+ * License Version 1.1 (the "License"); you may not use this file
+ * except in compliance with the License. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS
+ * IS" basis, WITHOUT WARRANTY OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * rights and limitations under the License.
+ *
+ * The Original Code is MapCopy, a copy utility for Civ2 maps and saved games.
+ *
+ * The Initial Developer of the Original Code is James Dustin Reichwein.
+ * Portions created by James Dustin Reichwein are
+ * Copyright (C) 2000,2005, James Dustin Reichwein.  All
+ * Rights Reserved.
+ *
+ * Contributor(s):
+ */
+
+// bufpool.cpp
+// Description:  Pools of freed buffers. See bufpool.h.
+//
+// Creation Date: Oct/18/2026
+//
+// Revision History:
+
+#include "bufpool.h"
+
+thread_local BufferPool *BufferPool::current = NULL;
+
+BufferPool::BufferPool(size_t maxBytes)
+: free_bytes(0), max_bytes(maxBytes), allocations(0), reuses(0)
+{
+}
+
+BufferPool::~BufferPool()
+{
+    trim();
+}
+
+// The smallest power of two at least size, and no less than 16
+size_t BufferPool::getSizeClass(size_t size)
+{
+    size_t c = 16;
+    while (c < size) c <<= 1;
+    return c;
+}
+
+// Return a free buffer of the right size class, or allocate a new one
+void *BufferPool::allocate(size_t size)
+{
+    size_t c = getSizeClass(size);
+    {
+        lock_guard<mutex> guard(lock);
+        allocations++;
+
+        map< size_t, vector<void *> >::iterator i = free_buffers.find(c);
+        if (i != free_buffers.end() && !i->second.empty())
+        {
+            void *buffer = i->second.back();
+            i->second.pop_back();
+            free_bytes -= c;
+            reuses++;
+            return buffer;
+        }
+    }
+
+    return ::operator new(c);
+}
+
+// Keep a buffer for reuse, unless the pool is already holding as much as
+// it may
+void BufferPool::release(void *buffer, size_t size)
+{
+    size_t c = getSizeClass(size);
+    {
+        lock_guard<mutex> guard(lock);
+        if (free_bytes + c <= max_bytes)
+        {
+            free_buffers[c].push_back(buffer);
+            free_bytes += c;
+            return;
+        }
+    }
+
+    ::operator delete(buffer);
+}
+
+void BufferPool::trim()
+{
+    lock_guard<mutex> guard(lock);
+
+    map< size_t, vector<void *> >::iterator i;
+    for (i = free_buffers.begin(); i != free_buffers.end(); i++)
+    {
+        for (size_t j = 0; j < i->second.size(); j++)
+        {
+            ::operator delete(i->second[j]);
+        }
+    }
+    free_buffers.clear();
+    free_bytes = 0;
+}
+
+unsigned long BufferPool::getAllocations() const
+{
+    lock_guard<mutex> guard(lock);
+    return allocations;
+}
+
+unsigned long BufferPool::getReuses() const
+{
+    lock_guard<mutex> guard(lock);
+    return reuses;
+}
+
+shared_ptr<BufferPool> BufferPool::getCurrent()
+{
+    if (current == NULL) return shared_ptr<BufferPool>();
+    return current->shared_from_this();
+}
+
+BufferPool::Scope::Scope(const shared_ptr<BufferPool>& p)
+: pool(p), previous(current)
+{
+    current = pool.get();
+}
+
+BufferPool::Scope::~Scope()
+{
+    current = previous;
+}
@@ -0,0 +1,383 @@
+/*
+ * The contents of this file are subject to the Mozilla Public
+ * License Version 1.1 (the "License"); you may not use this file
+ * except in compliance with the License. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS
+ * IS" basis, WITHOUT WARRANTY OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * rights and limitations under the License.
+ *
+ * The Original Code is MapCopy, a copy utility for Civ2 maps and saved games.
+ *
+ * The Initial Developer of the Original Code is James Dustin Reichwein.
+ * Portions created by James Dustin Reichwein are
+ * Copyright (C) 2000,2005, James Dustin Reichwein.  All
+ * Rights Reserved.
+ *
+ * Contributor(s):
+ */
+
+// bufpool.h
+// Description:  Pools of freed buffers, so that the maps and saved games
+//               loaded by one job can reuse the memory of those freed by
+//               the jobs before it, and the arrays allocated from them.
+//
+// Creation Date: Oct/18/2026
+//
+// Revision History:
+
+#ifndef BUFPOOL_H_
+#define BUFPOOL_H_
+
+#include <cstddef>
+#include <new>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+using namespace std;
+
+// BufferPool
+// Keeps buffers that have been freed, sorted into size classes of powers of
+// two, and hands them out again instead of allocating new ones. Jobs of a
+// batch load files of the same few sizes over and over, so once the first
+// few jobs are done, the buffers freed by each job are enough for the next
+// one, and loading allocates nothing from the heap.
+//
+// Each worker thread has its own pool, set with a BufferPool::Scope, so the
+// workers do not contend for the heap. A buffer always goes back to the pool
+// it came from, even if it is freed by another thread, such as the writer
+// of a CopyPipeline freeing what a reader loaded. At most maxBytes of free
+// buffers are kept; beyond that they are given back to the heap.
+//
+// A pool can be used by several threads at once.
+class BufferPool : public enable_shared_from_this<BufferPool>
+{
+    public:
+
+        static const size_t DEFAULT_MAX_BYTES = 64 * 1024 * 1024;
+
+        BufferPool(size_t maxBytes = DEFAULT_MAX_BYTES);
+        ~BufferPool();
+
+        // Return a buffer of at least size bytes, and give one back. size
+        // must be the same for both.
+        void *allocate(size_t size);
+        void release(void *buffer, size_t size);
+
+        // Give every free buffer back to the heap
+        void trim();
+
+        // How many buffers have been handed out, and how many of those were
+        // reused rather than allocated
+        unsigned long getAllocations() const;
+        unsigned long getReuses() const;
+
+        // Makes a pool the one used by PooledArrays allocated on this thread
+        // until the scope is destroyed. Scopes can be nested.
+        class Scope
+        {
+            public:
+                Scope(const shared_ptr<BufferPool>& pool);
+                ~Scope();
+
+            private:
+                shared_ptr<BufferPool> pool;
+                BufferPool *previous;
+
+                Scope(const Scope&);
+                Scope& operator=(const Scope&);
+        };
+
+        // The pool of this thread's innermost Scope, or NULL if none
+        static shared_ptr<BufferPool> getCurrent();
+
+    private:
+
+        static size_t getSizeClass(size_t size);
+
+        BufferPool(const BufferPool&);
+        BufferPool& operator=(const BufferPool&);
+
+        mutable mutex lock;
+        map< size_t, vector<void *> > free_buffers;
+        size_t free_bytes;
+        size_t max_bytes;
+        unsigned long allocations;
+        unsigned long reuses;
+
+        static thread_local BufferPool *current;
+};
+
+// PooledArray
+// An array of count objects owned by one handle, like SmartPointer<T, true>,
+// but allocated from the current thread's BufferPool if there is one, and
+// from the heap otherwise. T must not need destroying, since the memory is
+// reused without it. Like SmartPointer, it can be moved but not copied.
+template <class T>
+class PooledArray
+{
+    static_assert(is_trivially_destructible<T>::value,
+                  "PooledArray only holds types that need no destructor");
+
+    public:
+
+        PooledArray() : data(NULL), count(0) { }
+
+        PooledArray(PooledArray&& other)
+            : data(other.data), count(other.count), pool(move(other.pool))
+        {
+            other.data = NULL;
+            other.count = 0;
+        }
+
+        PooledArray& operator=(PooledArray&& other)
+        {
+            if (data != other.data)
+            {
+                release();
+                data = other.data;
+                count = other.count;
+                pool = move(other.pool);
+                other.data = NULL;
+                other.count = 0;
+            }
+            return *this;
+        }
+
+        ~PooledArray()
+        {
+            release();
+        }
+
+        // Replace the contents with n default constructed objects
+        void allocate(size_t n)
+        {
+            release();
+
+            pool = BufferPool::getCurrent();
+            size_t size = (n > 0 ? n : 1) * sizeof(T);
+            void *buffer = pool ? pool->allocate(size) : ::operator new(size);
+
+            data = static_cast<T *>(buffer);
+            count = n;
+            for (size_t i = 0; i < n; i++) new (data + i) T();
+        }
+
+        // Free the contents, leaving the array NULL
+        void release()
+        {
+            if (data == NULL) return;
+
+            size_t size = (count > 0 ? count : 1) * sizeof(T);
+            if (pool) pool->release(data, size);
+            else ::operator delete(data);
+
+            data = NULL;
+            count = 0;
+            pool.reset();
+        }
+
+        bool isNull() const { return data == NULL; }
+        size_t size() const { return count; }
+
+        T* get() { return data; }
+        const T* get() const { return data; }
+
+        operator T*() { return data; }
+        operator const T*() const { return data; }
+
+        T* operator->() { return data; }
+        const T* operator->() const { return data; }
+
+        T& operator*() { return *data; }
+        const T& operator*() const { return *data; }
+
+    private:
+
+        T *data;
+        size_t count;
+        shared_ptr<BufferPool> pool;
+
+        PooledArray(const PooledArray&);
+        PooledArray& operator=(const PooledArray&);
+};
+
+// SharedArray
+// An array allocated like a PooledArray, but which can be copied. Copies
+// share the same elements until one of them asks to change them through
+// getWritable(), which first gives that copy elements of its own. Reading
+// never copies, and the elements can only be changed through
+// getWritable(), so a copy that is never written costs no memory of its
+// own.
+//
+// The count of copies sharing the elements is atomic, so copies may be made
+// and destroyed on several threads at once, but as usual one SharedArray
+// object must not be changed by several threads at once.
+template <class T>
+class SharedArray
+{
+    static_assert(is_trivially_copyable<T>::value,
+                  "SharedArray only holds types that can be copied as bytes");
+
+    public:
+
+        SharedArray() : block(NULL), data(NULL) { }
+
+        SharedArray(const SharedArray& other)
+            : block(other.block), data(other.data)
+        {
+            if (block != NULL) block->refs.fetch_add(1, memory_order_relaxed);
+        }
+
+        SharedArray(SharedArray&& other) : block(other.block), data(other.data)
+        {
+            other.block = NULL;
+            other.data = NULL;
+        }
+
+        SharedArray& operator=(const SharedArray& other)
+        {
+            if (block != other.block)
+            {
+                if (other.block != NULL)
+                {
+                    other.block->refs.fetch_add(1, memory_order_relaxed);
+                }
+                release();
+                block = other.block;
+                data = other.data;
+            }
+            return *this;
+        }
+
+        SharedArray& operator=(SharedArray&& other)
+        {
+            if (block != other.block)
+            {
+                release();
+                block = other.block;
+                data = other.data;
+                other.block = NULL;
+                other.data = NULL;
+            }
+            return *this;
+        }
+
+        ~SharedArray()
+        {
+            release();
+        }
+
+        // Replace the contents with n default constructed objects, not
+        // shared with anything
+        void allocate(size_t n)
+        {
+            release();
+            block = newBlock(n);
+            data = getElements(block);
+            for (size_t i = 0; i < n; i++) new (data + i) T();
+        }
+
+        // Stop using the contents, leaving the array NULL. The last copy to
+        // let go of them frees them.
+        void release()
+        {
+            if (block == NULL) return;
+
+            if (block->refs.fetch_sub(1, memory_order_acq_rel) == 1)
+            {
+                freeBlock(block);
+            }
+            block = NULL;
+            data = NULL;
+        }
+
+        bool isNull() const { return block == NULL; }
+        size_t size() const { return block != NULL ? block->count : 0; }
+
+        // Whether other copies are using the same contents
+        bool isShared() const
+        {
+            return block != NULL && block->refs.load(memory_order_acquire) > 1;
+        }
+
+        const T* get() const { return data; }
+        operator const T*() const { return data; }
+
+        // The contents, for changing them. If they are shared, they are
+        // copied first, so the change is only seen through this array.
+        T* getWritable()
+        {
+            if (isShared())
+            {
+                Block *copy = newBlock(block->count);
+                memcpy(getElements(copy), data, block->count * sizeof(T));
+                release();
+                block = copy;
+                data = getElements(copy);
+            }
+            return data;
+        }
+
+    private:
+
+        // Where the contents came from and how many arrays share them. The
+        // elements follow it in the same buffer.
+        struct Block
+        {
+            atomic<long> refs;
+            size_t count;
+            shared_ptr<BufferPool> pool;
+        };
+
+        static size_t getHeaderSize()
+        {
+            size_t align = alignof(max_align_t);
+            return (sizeof(Block) + align - 1) / align * align;
+        }
+
+        static size_t getBufferSize(size_t n)
+        {
+            return getHeaderSize() + n * sizeof(T);
+        }
+
+        static T *getElements(Block *b)
+        {
+            return reinterpret_cast<T *>(reinterpret_cast<char *>(b) + getHeaderSize());
+        }
+
+        static Block *newBlock(size_t n)
+        {
+            shared_ptr<BufferPool> pool = BufferPool::getCurrent();
+            size_t size = getBufferSize(n);
+            void *buffer = pool ? pool->allocate(size) : ::operator new(size);
+
+            Block *b = new (buffer) Block();
+            b->refs.store(1, memory_order_relaxed);
+            b->count = n;
+            b->pool = move(pool);
+            return b;
+        }
+
+        static void freeBlock(Block *b)
+        {
+            shared_ptr<BufferPool> pool = move(b->pool);
+            size_t size = getBufferSize(b->count);
+            b->~Block();
+
+            if (pool) pool->release(b, size);
+            else ::operator delete(b);
+        }
+
+        Block *block;
+        T *data;
+};
+
+#endif
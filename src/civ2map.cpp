@@ -43,7 +43,11 @@
 
 #include <iostream>
 #include <iomanip>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
 #include "civ2sav.h"
+#include "fertrace.h"
 
 /////////////////////// Civ2Map Constants ///////////////////////////////
 
@@ -53,12 +57,32 @@ const unsigned char NO_RESOURCE_FLAG = 0x40;
 const unsigned char TERRAIN_TYPE_MASK = 0x3F;
 
 
+/////////////////////// FertilityWeights Methods ////////////////////////////
+
+// The default weights. These were found empirically.
+FertilityWeights::FertilityWeights()
+{
+    selfWeight = 4.0;
+    innerWeight = 2.0;
+    outerWeight = 1.0;
+
+    foodWeight = 3.0;
+    shieldsWeight = 2.0;
+    tradeWeight = 1.0;
+
+    divisor = 16.0;
+
+    minFertility = 8;
+    maxFertility = 15;
+}
+
 /////////////////////// Civ2Map Constructor ////////////////////////////////
 
 // Private constructor called only by Civ2SavedGame
 Civ2Map::Civ2Map(int x_dim, int y_dim, int area, bool has_civ_view_map,
-                 int ma_pos, bool fe, Civ2Rules& in_rules) throw (runtime_error)
-: rules(in_rules)
+                 int ma_pos, bool fe, const Civ2TerrainRules& in_rules)
+    throw (runtime_error)
+: terrain_rules(in_rules), fert_trace(NULL), cities_known(false)
 {
     x_dimension = x_dim;
     y_dimension = y_dim;
@@ -71,21 +95,21 @@ Civ2Map::Civ2Map(int x_dim, int y_dim, int area, bool has_civ_view_map,
     // when doing the body counter adjustments
     map_position = static_cast<unsigned char> (ma_pos);
 
-    // Allocate terrain map
-    terrain_map = new TerrainCell[x_dim * y_dim];
-    if (terrain_map.isNull()) throw runtime_error("Insufficient memory.");
+    // Allocate the terrain map, which starts out as ocean, owned by no one
+    for (int p = 0; p < NUM_PLANES; p++)
+    {
+        planes[p].allocate(map_area);
+        if (planes[p].isNull()) throw runtime_error("Insufficient memory.");
+    }
+    memset(planes[TERRAIN_PLANE].getWritable(), OCEAN, map_area);
+    memset(planes[FERT_OWNERSHIP_PLANE].getWritable(), 0xF0, map_area);
 
     // Allocate civ view map if needed
     if (has_civ_view_map)
     {
-        civ_view_map = new unsigned char[map_area * 7];
+        // allocate() initializes it to 0
+        civ_view_map.allocate(map_area * 7);
         if (civ_view_map.isNull()) throw runtime_error("Insufficient memory.");
-
-        // Initialize
-        for (int i = 0; i  < map_area * 7; i++)
-        {
-            civ_view_map[i] = 0;
-        }
     }
 
     // Setup resource map. This is generated based on grassland/resource patterns
@@ -108,7 +132,7 @@ void Civ2Map::load(istream& is) throw (runtime_error)
 }
 
 // Save terrain and civ view specific information to an output stream
-void Civ2Map::save(ostream& os) throw (runtime_error)
+void Civ2Map::save(ostream& os) const throw (runtime_error)
 {
     // The Civ specific view map comes first, if it exists
     if (has_civ_view)
@@ -133,37 +157,70 @@ int Civ2Map::getHeight() const throw(runtime_error)
 // Returns whether a given map cell contains a river
 bool Civ2Map::isRiver(int x, int y) const throw (runtime_error)
 {
-    if (terrain_map.isNull())
+    if (planes[TERRAIN_PLANE].isNull())
     {
         throw runtime_error("No map loaded");
     }
 
     int offset = XYtoOffset(x, y);
 
-    const TerrainCell& c = terrain_map[offset];
-
-    return (c.terrainType & RIVER_FLAG) != 0;
+    return (planes[TERRAIN_PLANE][offset] & RIVER_FLAG) != 0;
 }
 
 // Sets whether a given map cell contains a river
 void Civ2Map::setRiver(int x, int y, bool river) throw (runtime_error)
 {
-    if (terrain_map.isNull())
+    if (planes[TERRAIN_PLANE].isNull())
     {
         throw runtime_error("No map loaded");
     }
 
     int offset = XYtoOffset(x, y);
 
-    TerrainCell& c = terrain_map[offset];
+    unsigned char& t = planes[TERRAIN_PLANE].getWritable()[offset];
 
     if (river)
     {
-        c.terrainType |= RIVER_FLAG;
+        t |= RIVER_FLAG;
+    }
+    else
+    {
+        t &= (~RIVER_FLAG);
+    }
+}
+
+// Returns whether a given map cell has TOT_TERRAIN_FLAG set
+bool Civ2Map::hasTotTerrainFlag(int x, int y) const throw (runtime_error)
+{
+    if (planes[TERRAIN_PLANE].isNull())
+    {
+        throw runtime_error("No map loaded");
+    }
+
+    int offset = XYtoOffset(x, y);
+
+    return (planes[TERRAIN_PLANE][offset] & TOT_TERRAIN_FLAG) != 0;
+}
+
+// Sets whether a given map cell has TOT_TERRAIN_FLAG set
+void Civ2Map::setTotTerrainFlag(int x, int y, bool flag) throw (runtime_error)
+{
+    if (planes[TERRAIN_PLANE].isNull())
+    {
+        throw runtime_error("No map loaded");
+    }
+
+    int offset = XYtoOffset(x, y);
+
+    unsigned char& t = planes[TERRAIN_PLANE].getWritable()[offset];
+
+    if (flag)
+    {
+        t |= TOT_TERRAIN_FLAG;
     }
     else
     {
-        c.terrainType &= (~RIVER_FLAG);
+        t &= (~TOT_TERRAIN_FLAG);
     }
 }
 
@@ -172,16 +229,14 @@ void Civ2Map::setRiver(int x, int y, bool river) throw (runtime_error)
 // square, then that resource is hidden.
 bool Civ2Map::isResourceHidden(int x, int y) const throw (runtime_error)
 {
-    if (terrain_map.isNull())
+    if (planes[TERRAIN_PLANE].isNull())
     {
         throw runtime_error("No map loaded");
     }
 
     int offset = XYtoOffset(x, y);
 
-    const TerrainCell& c = terrain_map[offset];
-
-    return (c.terrainType & NO_RESOURCE_FLAG) != 0;
+    return (planes[TERRAIN_PLANE][offset] & NO_RESOURCE_FLAG) != 0;
 }
 
 // Set whether a resource is hidden at a given map square.
@@ -191,60 +246,59 @@ bool Civ2Map::isResourceHidden(int x, int y) const throw (runtime_error)
 
 void Civ2Map::setResourceHidden(int x, int y, bool hidden) throw (runtime_error)
 {
-    if (terrain_map.isNull())
+    if (planes[TERRAIN_PLANE].isNull())
     {
         throw runtime_error("No map loaded");
     }
 
     int offset = XYtoOffset(x, y);
 
-    TerrainCell& c = terrain_map[offset];
+    unsigned char& t = planes[TERRAIN_PLANE].getWritable()[offset];
 
     if (hidden)
     {
-        c.terrainType |= NO_RESOURCE_FLAG;
+        t |= NO_RESOURCE_FLAG;
     }
     else
     {
-        c.terrainType &= (~NO_RESOURCE_FLAG);
+        t &= (~NO_RESOURCE_FLAG);
     }
 }
 
 // Returns the terrain type (e.g. mountain, ocean, etc) index for a given map
 // square. It does not contain information about rivers or resources or
-// improvements
+// improvements, or TOT_TERRAIN_FLAG
 
 Civ2TerrainType Civ2Map::getTerrainType(int x, int y) const throw (runtime_error)
 {
-    if (terrain_map.isNull())
+    if (planes[TERRAIN_PLANE].isNull())
     {
         throw runtime_error("No map loaded");
     }
 
     int offset = XYtoOffset(x,y);
 
-    const TerrainCell& c = terrain_map[offset];
-
-    return (Civ2TerrainType)(c.terrainType & TERRAIN_TYPE_MASK);
+    return (Civ2TerrainType)(planes[TERRAIN_PLANE][offset] & TERRAIN_TYPE_MASK & ~TOT_TERRAIN_FLAG);
 }
 
 // Sets the terrain type (e.g. mountain, ocean, etc) index for a given map
-// square.
+// square. TOT_TERRAIN_FLAG is left as it is.
 void Civ2Map::setTerrainType(int x, int y, Civ2TerrainType t) throw (runtime_error)
 {
-    if (terrain_map.isNull())
+    if (planes[TERRAIN_PLANE].isNull())
     {
         throw runtime_error("No map loaded");
     }
 
     int offset = XYtoOffset(x,y);
 
-    TerrainCell& c = terrain_map[offset];
+    unsigned char& c = planes[TERRAIN_PLANE].getWritable()[offset];
 
     unsigned char index = (unsigned char)t;
 
-    c.terrainType = (c.terrainType & (~TERRAIN_TYPE_MASK))
-                    | (index & TERRAIN_TYPE_MASK);
+    unsigned char mask = TERRAIN_TYPE_MASK & ~TOT_TERRAIN_FLAG;
+
+    c = (c & (~mask)) | (index & mask);
 }
 
 // Returns the resource seed for the map
@@ -263,79 +317,81 @@ void Civ2Map::setSeed(unsigned short seed) throw (runtime_error)
 
 Improvements Civ2Map::getImprovements(int x, int y) const throw (runtime_error)
 {
-    if (terrain_map.isNull())
+    if (planes[TERRAIN_PLANE].isNull())
     {
         throw runtime_error("No map loaded");
     }
 
     int offset = XYtoOffset(x, y);
 
-    return Improvements(terrain_map[offset].improvements);
+    return Improvements(planes[IMPROVEMENT_PLANE][offset]);
 }
 
 // Sets the improvments on a given terrain square.
 void Civ2Map::setImprovements(int x, int y, Improvements i) throw (runtime_error)
 {
-    if (terrain_map.isNull())
+    if (planes[TERRAIN_PLANE].isNull())
     {
         throw runtime_error("No map loaded");
     }
 
     int offset = XYtoOffset(x, y);
 
-    terrain_map[offset].improvements = i.improvements;
+    unsigned char& b = planes[IMPROVEMENT_PLANE].getWritable()[offset];
+    if ((b ^ i.improvements) & Improvements::CITY_MASK) cities_known = false;
+    b = i.improvements;
 }
 
 // return which civs have explored a given square
 WhichCivs Civ2Map::getVisibility(int x, int y) const throw (runtime_error)
 {
-    if (terrain_map.isNull())
+    if (planes[TERRAIN_PLANE].isNull())
     {
         throw runtime_error("No map loaded");
     }
 
     int offset = XYtoOffset(x, y);
 
-    return WhichCivs(terrain_map[offset].visibility);
+    return WhichCivs(planes[VISIBILITY_PLANE][offset]);
 }
 // Set which civs have explored a given square
 void Civ2Map::setVisibility(int x, int y, WhichCivs c) throw (runtime_error)
 {
-    if (terrain_map.isNull())
+    if (planes[TERRAIN_PLANE].isNull())
     {
         throw runtime_error("No map loaded");
     }
 
     int offset = XYtoOffset(x, y);
 
-    terrain_map[offset].visibility = c.whichCivs;
+    planes[VISIBILITY_PLANE].getWritable()[offset] = c.whichCivs;
 }
 
 // Return the fertility of a given square. Fertility ranges from 0 to 16,
 // and represents the desireability of a square for building a city
 unsigned char Civ2Map::getFertility(int x, int y) const throw (runtime_error)
 {
-    if (terrain_map.isNull())
+    if (planes[TERRAIN_PLANE].isNull())
     {
         throw runtime_error("No map loaded");
     }
 
     int offset = XYtoOffset(x, y);
 
-    return (terrain_map[offset].fert_ownership & 0x0F);
+    return (planes[FERT_OWNERSHIP_PLANE][offset] & 0x0F);
 }
 
 // Sets the fertility for a given square
 void Civ2Map::setFertility(int x, int y, unsigned char f) throw (runtime_error)
 {
-    if (terrain_map.isNull())
+    if (planes[TERRAIN_PLANE].isNull())
     {
         throw runtime_error("No map loaded");
     }
 
     int offset = XYtoOffset(x, y);
-    terrain_map[offset].fert_ownership = 
-        (terrain_map[offset].fert_ownership & 0xF0) | (f & 0x0F);
+    unsigned char& fo = planes[FERT_OWNERSHIP_PLANE].getWritable()[offset];
+    fo = (fo & 0xF0) | (f & 0x0F);
 }
 
 // Calculates the fertility of a given square based on the surrounding
@@ -343,24 +399,50 @@ void Civ2Map::setFertility(int x, int y, unsigned char f) throw (runtime_error)
 // present nearby, which can be performed by the adjustFertility() method
 void Civ2Map::calcFertility(int x, int y) throw (runtime_error)
 {
-    if (terrain_map.isNull()) throw runtime_error("No map loaded.");
+    if (planes[TERRAIN_PLANE].isNull()) throw runtime_error("No map loaded.");
 
     int offset = XYtoOffset(x, y);
 
-    // Find the sum of the food, shields and trade in the square itself,
-    // the inner ring of the city radius around the square, and the outer ring
-    // of the city radius around the square
-    float selfFood = 0.0;
-    float selfShields = 0.0;
-    float selfTrade = 0.0;
+    static const FertilityWeights weights;
+
+    FertilityYields yields = calcFertilityYields(x, y);
+    float float_fertility;
+    unsigned char int_fertility = combineFertility(yields, weights,
+                                                   &float_fertility);
+
+    // Record how this square's fertility was arrived at
+#ifndef MAPCOPY_NO_FERT_TRACE
+    if (fert_trace != NULL && fert_trace->inWindow(x, y))
+    {
+        fert_trace->record(map_position, x, y, yields, float_fertility,
+                           int_fertility, isNearCity(x, y));
+    }
+#endif
+
+    unsigned char& fo = planes[FERT_OWNERSHIP_PLANE].getWritable()[offset];
+    fo = (fo & 0xF0) | int_fertility;
+}
 
-    float innerFood = 0.0;
-    float innerShields = 0.0;
-    float innerTrade = 0.0;
+// Finds the sum of the food, shields and trade in the square itself,
+// the inner ring of the city radius around the square, and the outer ring
+// of the city radius around the square
+FertilityYields Civ2Map::calcFertilityYields(int x, int y) const throw (runtime_error)
+{
+    if (planes[TERRAIN_PLANE].isNull()) throw runtime_error("No map loaded.");
 
-    float outerFood = 0.0;
-    float outerShields = 0.0;
-    float outerTrade = 0.0;
+    FertilityYields yields;
+
+    yields.selfFood = 0.0;
+    yields.selfShields = 0.0;
+    yields.selfTrade = 0.0;
+
+    yields.innerFood = 0.0;
+    yields.innerShields = 0.0;
+    yields.innerTrade = 0.0;
+
+    yields.outerFood = 0.0;
+    yields.outerShields = 0.0;
+    yields.outerTrade = 0.0;
 
     float food = 0;
     float shields = 0;
@@ -372,7 +454,7 @@ void Civ2Map::calcFertility(int x, int y) throw (runtime_error)
     static const float IRRIGATION_BONUS = (2.0 / 3.0);
     static const float MINING_BONUS = (0.5);
 
-    Civ2TerrainRules& terrain_rules = rules.getTerrainRules(map_position);
+    const Civ2TerrainRules& terrain_rules = getTerrainRules();
     RingIterator i(x, y, *this);
 
     Civ2TerrainType terrain_type;
@@ -422,23 +504,23 @@ void Civ2Map::calcFertility(int x, int y) throw (runtime_error)
         {
             case 0:
             {
-                selfFood += food;
-                selfShields += shields;
-                selfTrade += trade;
+                yields.selfFood += food;
+                yields.selfShields += shields;
+                yields.selfTrade += trade;
                 break;
             }
             case 1:
             {
-                innerFood += food;
-                innerShields += shields;
-                innerTrade += trade;
+                yields.innerFood += food;
+                yields.innerShields += shields;
+                yields.innerTrade += trade;
                 break;
             }
             case 2:
             {
-                outerFood += food;
-                outerShields += shields;
-                outerTrade += trade;
+                yields.outerFood += food;
+                yields.outerShields += shields;
+                yields.outerTrade += trade;
                 break;
             }
             default:
@@ -451,72 +533,59 @@ void Civ2Map::calcFertility(int x, int y) throw (runtime_error)
         ++i;
     }
 
-    // Now combine food based on weights of various distances from the center
-    // square. These weights were also found empirically
-    static const float SELF_WEIGHT = 4.0;
-    static const float INNER_WEIGHT = 2.0;
-    static const float OUTER_WEIGHT = 1.0;
+    // Another special feature of grassland squares. If they don't have 
+    // a shield, their fertility is decremented by 1
+    yields.grasslandNoShield = (getTerrainType(x,y) == GRASSLAND && 
+                                !hasGrasslandShield(x,y));
 
-    float combinedFood = (selfFood * SELF_WEIGHT) + 
-                         (innerFood * INNER_WEIGHT) + 
-                         (outerFood * OUTER_WEIGHT);
+    return yields;
+}
 
-    float combinedShields = (selfShields * SELF_WEIGHT) + 
-                            (innerShields * INNER_WEIGHT) + 
-                            (outerShields * OUTER_WEIGHT);
+// Combines the production around a square into a fertility value, using the
+// given weights.
+unsigned char Civ2Map::combineFertility(const FertilityYields& yields,
+                                        const FertilityWeights& weights,
+                                        float *value)
+{
+    // Now combine food based on weights of various distances from the center
+    // square.
+    float combinedFood = (yields.selfFood * weights.selfWeight) + 
+                         (yields.innerFood * weights.innerWeight) + 
+                         (yields.outerFood * weights.outerWeight);
 
-    float combinedTrade = (selfTrade * SELF_WEIGHT) + 
-                          (innerTrade * INNER_WEIGHT) + 
-                          (outerTrade * OUTER_WEIGHT);
+    float combinedShields = (yields.selfShields * weights.selfWeight) + 
+                            (yields.innerShields * weights.innerWeight) + 
+                            (yields.outerShields * weights.outerWeight);
 
-    // Combine these into a floating point fertility value
-    static const float FOOD_WEIGHT = 3.0;
-    static const float SHIELDS_WEIGHT = 2.0;
-    static const float TRADE_WEIGHT = 1.0;
-    static const float DIVISOR = 16.0;
+    float combinedTrade = (yields.selfTrade * weights.selfWeight) + 
+                          (yields.innerTrade * weights.innerWeight) + 
+                          (yields.outerTrade * weights.outerWeight);
 
+    // Combine these into a floating point fertility value
+    float float_fertility = (weights.foodWeight * combinedFood) +
+                            (weights.shieldsWeight * combinedShields) + 
+                            (weights.tradeWeight * combinedTrade);
 
-    float float_fertility = (FOOD_WEIGHT * combinedFood) +
-                            (SHIELDS_WEIGHT * combinedShields) + 
-                            (TRADE_WEIGHT * combinedTrade);
+    float_fertility /= weights.divisor;
 
-    float_fertility /= DIVISOR;
+    if (value != NULL) *value = float_fertility;
 
     // Now round off to an integer fertility
-    unsigned char int_fertility = (unsigned char) round(float_fertility);
-/* Yey! Commented out debug code!
-    if (x == 7 && y == 45)
-    {
-        cout << "self food: " << selfFood << endl;
-        cout << "self shields: " << selfShields << endl;
-        cout << "self trade: " << selfTrade << endl;
-
-        cout << "inner food: " << innerFood << endl;
-        cout << "inner shields: " << innerShields << endl;
-        cout << "inner trade: " << innerTrade << endl;
-
-        cout << "outer food: " << outerFood << endl;
-        cout << "outer shields: " << outerShields << endl;
-        cout << "outer trade: " << outerTrade << endl;
-
-        cout << "combined food: " << combinedFood << endl;
-        cout << "combined shields: " << combinedShields << endl;
-        cout << "combined trade: " << combinedTrade << endl;
+    int int_fertility = (int) round(float_fertility);
 
-        cout << "float/int fertility: " << setprecision(4) << float_fertility << "/" << (int)int_fertility << endl;
-    }
-*/
-    // Another special feature of grassland squares. If they don't have 
-    // a shield, their fertility is decremented by 1
-    if (getTerrainType(x,y) == GRASSLAND && !hasGrasslandShield(x,y)) int_fertility --;
+    if (yields.grasslandNoShield) int_fertility --;
 
     // Fertility is not allowed to be less than 8 or more than 15
     // Note that effects of being in a city radius are handled by adjustFertility
-    if (int_fertility <8) int_fertility = 8;
-    else if (int_fertility > 15) int_fertility = 15;
+    if (int_fertility < weights.minFertility) int_fertility = weights.minFertility;
+    else if (int_fertility > weights.maxFertility) int_fertility = weights.maxFertility;
 
-    terrain_map[offset].fert_ownership = 
-        (terrain_map[offset].fert_ownership & 0xF0) | int_fertility;
+    return (unsigned char) int_fertility;
+}
+
+void Civ2Map::setFertilityTrace(Civ2FertilityTrace *trace)
+{
+    fert_trace = trace;
 }
 
 // Adjusts the fertility of a given square so that it is in the range
@@ -525,76 +594,427 @@ void Civ2Map::calcFertility(int x, int y) throw (runtime_error)
 // rather than 3).
 void Civ2Map::adjustFertility(int x, int y) throw (runtime_error)
 {
-    if (terrain_map.isNull()) throw runtime_error("No map loaded.");
+    if (planes[TERRAIN_PLANE].isNull()) throw runtime_error("No map loaded.");
 
     int offset = XYtoOffset(x, y);
 
-    // It appears that this adjust ment is not the city radius, but one more ring
-    // outside of that
-    static const int MAX_ADJUST_RADIUS = 3;
-    bool inCityRadius = false;
-
-    for (RingIterator i(x, y, *this);
-         i.getDistance() <= MAX_ADJUST_RADIUS; ++i)
-    {
-        if (getImprovements(i.getX(), i.getY()).hasCity()) inCityRadius = true;
-    }
-    unsigned char f = terrain_map[offset].fert_ownership & 0x0F;
+    unsigned char f = planes[FERT_OWNERSHIP_PLANE][offset] & 0x0F;
 
-    if (inCityRadius) 
+    if (isNearCity(x, y)) 
     {
         // If another city has decremented fertility to below 8, then donot
         // decrement it again.
         if (f > 7) f-=8;
     }
  
-    terrain_map[offset].fert_ownership = 
-        (terrain_map[offset].fert_ownership & 0xF0) | f;
+    unsigned char& fo = planes[FERT_OWNERSHIP_PLANE].getWritable()[offset];
+    fo = (fo & 0xF0) | f;
+}
+
+// Returns whether there is a city within the adjustment radius of a square
+bool Civ2Map::isNearCity(int x, int y) const throw (runtime_error)
+{
+    for (RingIterator i(x, y, *this);
+         i.getDistance() <= CITY_ADJUST_RADIUS; ++i)
+    {
+        if (getImprovements(i.getX(), i.getY()).hasCity()) return true;
+    }
+    return false;
+}
+
+int Civ2Map::countCities() const
+{
+    const unsigned char *improvements = planes[IMPROVEMENT_PLANE];
+
+    int count = 0;
+    for (int i = 0; i < map_area; i++)
+    {
+        if (improvements[i] & Improvements::CITY_MASK) count++;
+    }
+    return count;
+}
+
+// Returns the cities found from the city records, if they are known
+bool Civ2Map::getRecordedCities(vector<City>& cities) const
+{
+    if (!cities_known) return false;
+
+    cities = recorded_cities;
+    return true;
+}
+
+// Returns the cities, searching the improvements for them if they are not
+// known. A city whose square is owned by no one is left out, since its
+// owner cannot be told.
+void Civ2Map::getCities(vector<City>& cities) const throw (runtime_error)
+{
+    if (planes[TERRAIN_PLANE].isNull()) throw runtime_error("No map loaded.");
+
+    if (getRecordedCities(cities)) return;
+
+    const unsigned char *improvements = planes[IMPROVEMENT_PLANE];
+    const unsigned char *fo = planes[FERT_OWNERSHIP_PLANE];
+
+    cities.clear();
+    for (int i = 0; i < map_area; i++)
+    {
+        if (!(improvements[i] & Improvements::CITY_MASK)) continue;
+
+        int owner = fo[i] >> 4;
+        if (owner > PURPLE) continue;
+
+        City c;
+        c.y = i / (x_dimension / 2);
+        c.x = (i % (x_dimension / 2)) * 2 + (c.y & 1);
+        c.owner = static_cast<Civilization>(owner);
+        cities.push_back(c);
+    }
+}
+
+// Finds the civilization of the nearest city for every square within the
+// city radius of one. This is done in one pass over the cities: each marks
+// the squares of its radius that are nearer to it than to any city before
+// it, going round the edge of a round map as the RingIterator does.
+void Civ2Map::getCityRadiusCivs(vector<signed char>& civs) const throw (runtime_error)
+{
+    vector<City> cities;
+    getCities(cities);
+
+    civs.assign(map_area, -1);
+    vector<unsigned char> distance(map_area, CITY_WORK_RADIUS + 1);
+
+    for (size_t c = 0; c < cities.size(); c++)
+    {
+        for (RingIterator i(cities[c].x, cities[c].y, *this);
+             i.getDistance() <= CITY_WORK_RADIUS; ++i)
+        {
+            int offset = XYtoOffset(i.getX(), i.getY());
+            if (i.getDistance() < distance[offset])
+            {
+                distance[offset] = i.getDistance();
+                civs[offset] = cities[c].owner;
+            }
+        }
+    }
+}
+
+// Sets the city radius of every square from the cities of the map
+void Civ2Map::calcCityRadius() throw (runtime_error)
+{
+    vector<signed char> civs;
+    getCityRadiusCivs(civs);
+
+    // The city radius is stored as the civ # shifted left by 5.
+    unsigned char *plane = planes[CITY_RADIUS_PLANE].getWritable();
+    for (int i = 0; i < map_area; i++)
+    {
+        plane[i] = civs[i] < 0 ? 0 : (civs[i] << 5);
+    }
+}
+
+// Sets the ownership of every square from the cities of the map
+void Civ2Map::calcOwnership() throw (runtime_error)
+{
+    vector<signed char> civs;
+    getCityRadiusCivs(civs);
+
+    unsigned char *fo = planes[FERT_OWNERSHIP_PLANE].getWritable();
+    for (int i = 0; i < map_area; i++)
+    {
+        unsigned char owner = civs[i] < 0 ? NO_OWNER : civs[i];
+        fo[i] = (fo[i] & 0x0F) | (owner << 4);
+    }
+}
+
+// Sets the body counter of every square. The bodies are found with a
+// union-find over the squares: each square is joined to the squares west,
+// northwest, northeast and north of it that are land if it is land, or
+// ocean if it is ocean, which covers all eight of its neighbours once the
+// whole map has been seen. The bodies are then numbered in the order of
+// their first squares.
+void Civ2Map::calcBodyCounters() throw (runtime_error)
+{
+    if (planes[TERRAIN_PLANE].isNull()) throw runtime_error("No map loaded.");
+
+    const unsigned char *terrain = planes[TERRAIN_PLANE];
+    int rowSize = x_dimension / 2;
+
+    vector<int> parent(map_area);
+    for (int i = 0; i < map_area; i++) parent[i] = i;
+
+    auto find = [&](int i)
+    {
+        while (parent[i] != i)
+        {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    };
+
+    auto isOcean = [&](int i)
+    {
+        return (terrain[i] & TERRAIN_TYPE_MASK & ~TOT_TERRAIN_FLAG) == OCEAN;
+    };
+
+    // Join square i to the square at column c of row y, if it is on the map
+    // and of the same kind. Columns past either side wrap on a round map.
+    auto join = [&](int i, int c, int y)
+    {
+        if (y < 0) return;
+        if (c < 0 || c >= rowSize)
+        {
+            if (flat_earth) return;
+            c = (c + rowSize) % rowSize;
+        }
+
+        int j = y * rowSize + c;
+        if (isOcean(i) != isOcean(j)) return;
+
+        int a = find(i);
+        int b = find(j);
+        if (a != b) parent[max(a, b)] = min(a, b);
+    };
+
+    for (int i = 0; i < map_area; i++)
+    {
+        int y = i / rowSize;
+        int c = i % rowSize;
+
+        // Squares of odd rows are a half square to the east of those of
+        // even rows, so the row above has a square at column c to the
+        // northwest of an odd row, and to the northeast of an even one
+        join(i, c - 1, y);
+        join(i, (y & 1) ? c : c - 1, y - 1);
+        join(i, (y & 1) ? c + 1 : c, y - 1);
+        join(i, c, y - 2);
+    }
+
+    // A body's root is its first square, since a join keeps the smaller
+    // root, so a root is seen before the other squares of its body
+    vector<int> size(map_area, 0);
+    for (int i = 0; i < map_area; i++) size[find(i)]++;
+
+    vector<unsigned char> body(map_area, static_cast<unsigned char>(NO_BODY));
+    int landBodies = 0;
+    int oceanBodies = 0;
+    unsigned char *plane = planes[BODY_COUNTER_PLANE].getWritable();
+
+    for (int i = 0; i < map_area; i++)
+    {
+        int root = find(i);
+        if (root == i)
+        {
+            // Small ocean bodies still take a number, as the Map Editor's do
+            int n = isOcean(i) ? ++oceanBodies : ++landBodies;
+            if (n < NO_BODY && (!isOcean(i) || size[i] >= MIN_OCEAN_BODY))
+            {
+                body[i] = n;
+            }
+        }
+
+        // The upper two bits are the map position, as in setBodyCounter()
+        plane[i] = body[root] | (map_position << 6);
+    }
+}
+
+// Copies the fertility of every square into plane, one entry per square in
+// file order.
+void Civ2Map::getFertilityPlane(vector<unsigned char>& plane) const throw (runtime_error)
+{
+    if (planes[TERRAIN_PLANE].isNull()) throw runtime_error("No map loaded.");
+
+    const unsigned char *fo = planes[FERT_OWNERSHIP_PLANE];
+
+    plane.resize(map_area);
+    for (int i = 0; i < map_area; i++)
+    {
+        plane[i] = fo[i] & 0x0F;
+    }
+}
+
+// Sets the fertility of every square from a plane made by getFertilityPlane()
+void Civ2Map::setFertilityPlane(const vector<unsigned char>& plane) throw (runtime_error)
+{
+    if (planes[TERRAIN_PLANE].isNull()) throw runtime_error("No map loaded.");
+
+    if (plane.size() != map_area)
+    {
+        throw runtime_error("Fertility data does not match the map size.");
+    }
+
+    unsigned char *fo = planes[FERT_OWNERSHIP_PLANE].getWritable();
+    for (int i = 0; i < map_area; i++)
+    {
+        fo[i] = (fo[i] & 0xF0) | (plane[i] & 0x0F);
+    }
+}
+
+// Return the number of squares in the map
+int Civ2Map::getArea() const throw (runtime_error)
+{
+    if (planes[TERRAIN_PLANE].isNull()) throw runtime_error("No map loaded.");
+    return map_area;
+}
+
+void Civ2Map::getLayer(Layer layer, unsigned char *data) const throw (runtime_error)
+{
+    if (planes[TERRAIN_PLANE].isNull()) throw runtime_error("No map loaded.");
+
+    const unsigned char *plane = planes[getPlane(layer)];
+
+    switch (layer)
+    {
+        case OWNERSHIP_LAYER:
+            for (int i = 0; i < map_area; i++) data[i] = plane[i] >> 4;
+            break;
+        case FERTILITY_LAYER:
+            for (int i = 0; i < map_area; i++) data[i] = plane[i] & 0x0F;
+            break;
+        default:
+            memcpy(data, plane, map_area);
+            break;
+    }
+}
+
+void Civ2Map::setLayer(Layer layer, const unsigned char *data) throw (runtime_error)
+{
+    if (planes[TERRAIN_PLANE].isNull()) throw runtime_error("No map loaded.");
+    unsigned char *plane = planes[getPlane(layer)].getWritable();
+
+    if (layer == IMPROVEMENT_LAYER) cities_known = false;
+
+    switch (layer)
+    {
+        case OWNERSHIP_LAYER:
+            for (int i = 0; i < map_area; i++)
+            {
+                plane[i] = (plane[i] & 0x0F) | ((data[i] & 0x0F) << 4);
+            }
+            break;
+        case FERTILITY_LAYER:
+            for (int i = 0; i < map_area; i++)
+            {
+                plane[i] = (plane[i] & 0xF0) | (data[i] & 0x0F);
+            }
+            break;
+        default:
+            memcpy(plane, data, map_area);
+            break;
+    }
+}
+
+void Civ2Map::shareLayer(const Civ2Map& source, Layer layer) throw (runtime_error)
+{
+    if (planes[TERRAIN_PLANE].isNull() || source.planes[TERRAIN_PLANE].isNull())
+    {
+        throw runtime_error("No map loaded.");
+    }
+    if (!isSameSize(source)) throw runtime_error("Maps are not the same size.");
+
+    Plane p = getPlane(layer);
+    planes[p] = source.planes[p];
+
+    // The cities are those of source now
+    if (p == IMPROVEMENT_PLANE)
+    {
+        recorded_cities = source.recorded_cities;
+        cities_known = source.cities_known;
+    }
+}
+
+void Civ2Map::shareCivView(const Civ2Map& source) throw (runtime_error)
+{
+    if (civ_view_map.isNull() || source.civ_view_map.isNull())
+    {
+        throw runtime_error("No civ view map loaded.");
+    }
+    if (!isSameSize(source)) throw runtime_error("Maps are not the same size.");
+
+    civ_view_map = source.civ_view_map;
+}
+
+bool Civ2Map::isSameSize(const Civ2Map& other) const
+{
+    return x_dimension == other.x_dimension &&
+           y_dimension == other.y_dimension &&
+           map_area == other.map_area;
+}
+
+// Adds the inputs of the fertility calculation to a digest: the map shape,
+// the terrain type and city flag of every square, the grassland shield
+// pattern, and the terrain rules for this map. Rivers, other improvements
+// and the resource seed do not affect calcFertility()/adjustFertility(),
+// so they are left out to let otherwise identical maps share a digest.
+// Leaving out the city flags as well gives a digest of the inputs to
+// calcFertility() alone.
+void Civ2Map::addFertilityInputsToHash(Hash64& h, bool includeCities) const throw (runtime_error)
+{
+    if (planes[TERRAIN_PLANE].isNull()) throw runtime_error("No map loaded.");
+
+    h.addValue(x_dimension);
+    h.addValue(y_dimension);
+    h.addValue(map_area);
+    h.addValue(flat_earth);
+
+    const unsigned char *terrain = planes[TERRAIN_PLANE];
+    const unsigned char *improvements = planes[IMPROVEMENT_PLANE];
+
+    for (int i = 0; i < map_area; i++)
+    {
+        unsigned char cell[3];
+        cell[0] = terrain[i] & TERRAIN_TYPE_MASK & ~TOT_TERRAIN_FLAG;
+        cell[1] = includeCities ? (improvements[i] & Improvements::CITY_MASK) : 0;
+        cell[2] = resource_map[i] & GRASS_SHIELD_FLAG;
+        h.add(cell, sizeof(cell));
+    }
+
+    getTerrainRules().addToHash(h);
 }
 
 // Gets the ownership of a square. This is set for the civilization that
 // has a unit/city on or close to a square.
 Civ2Map::Civilization Civ2Map::getOwnership(int x, int y) const throw (runtime_error)
 {
-    if (terrain_map.isNull())
+    if (planes[TERRAIN_PLANE].isNull())
     {
         throw runtime_error("No map loaded");
     }
 
     int offset = XYtoOffset(x, y);
 
-    return static_cast<Civilization>(terrain_map[offset].fert_ownership >> 4);
+    return static_cast<Civilization>(planes[FERT_OWNERSHIP_PLANE][offset] >> 4);
 }
 
 // Sets the ownership of a given square
 void Civ2Map::setOwnership(int x, int y, Civilization civ) throw (runtime_error)
 {
-    if (terrain_map.isNull())
+    if (planes[TERRAIN_PLANE].isNull())
     {
         throw runtime_error("No map loaded");
     }
 
     int offset = XYtoOffset(x, y);
     unsigned char c = static_cast<unsigned char>(civ);
-    terrain_map[offset].fert_ownership =  
-        (terrain_map[offset].fert_ownership & 0x0F) | (c << 4);
+    unsigned char& fo = planes[FERT_OWNERSHIP_PLANE].getWritable()[offset];
+    fo = (fo & 0x0F) | (c << 4);
 }
 
 unsigned char Civ2Map::getBodyCounter(int x, int y) const throw (runtime_error)
 {
-    if (terrain_map.isNull())
+    if (planes[TERRAIN_PLANE].isNull())
     {
         throw runtime_error("No map loaded");
     }
 
     int offset = XYtoOffset(x, y);
 
-    return terrain_map[offset].body_counter;
+    return planes[BODY_COUNTER_PLANE][offset];
 }
 
 void Civ2Map::setBodyCounter(int x, int y, unsigned char bc) throw (runtime_error)
 {
-    if (terrain_map.isNull())
+    if (planes[TERRAIN_PLANE].isNull())
     {
         throw runtime_error("No map loaded");
     }
@@ -612,12 +1032,12 @@ void Civ2Map::setBodyCounter(int x, int y, unsigned char bc) throw (runtime_erro
     bc = bc & 0x3F; // Remove the two highest bits
     bc = bc | (map_position << 6); // Set the highest two bits based on map position
 
-    terrain_map[offset].body_counter = bc;
+    planes[BODY_COUNTER_PLANE].getWritable()[offset] = bc;
 }
 
 Civ2Map::Civilization Civ2Map::getCityRadius(int x, int y) const throw (runtime_error)
 {
-    if (terrain_map.isNull())
+    if (planes[TERRAIN_PLANE].isNull())
     {
         throw runtime_error("No map loaded");
     }
@@ -625,18 +1045,18 @@ Civ2Map::Civilization Civ2Map::getCityRadius(int x, int y) const throw (runtime_
     int offset = XYtoOffset(x, y);
 
     // The city radius is stored as the civ # shifted left by 5.
-    return static_cast<Civilization>(terrain_map[offset].city_radius >> 5);
+    return static_cast<Civilization>(planes[CITY_RADIUS_PLANE][offset] >> 5);
 }
 
 void Civ2Map::setCityRadius(int x, int y, Civilization c) throw (runtime_error)
 {
-    if (terrain_map.isNull())
+    if (planes[TERRAIN_PLANE].isNull())
     {
         throw runtime_error("No map loaded");
     }
     int offset = XYtoOffset(x, y);
 
-    terrain_map[offset].city_radius = (c << 5);
+    planes[CITY_RADIUS_PLANE].getWritable()[offset] = (c << 5);
 }
 
 
@@ -671,13 +1091,13 @@ void Civ2Map::setCivView(int x, int y, Civilization c, Improvements i) throw (ru
     else
     {
         int offset = XYtoCivViewOffset(x, y, c);
-        civ_view_map[offset] = i.improvements;
+        civ_view_map.getWritable()[offset] = i.improvements;
     }
 }
 
 // Returns whether a given map square has a grassland shield.
 // This always returns false if the square is not a grassland square
-bool Civ2Map::hasGrasslandShield(int x, int y) throw (runtime_error)
+bool Civ2Map::hasGrasslandShield(int x, int y) const throw (runtime_error)
 {
     if (getTerrainType(x, y) != GRASSLAND) return false;
 
@@ -689,44 +1109,93 @@ bool Civ2Map::hasGrasslandShield(int x, int y) throw (runtime_error)
 }
 
 // Return whether the map is flat
-bool Civ2Map::isFlat() throw (runtime_error)
+bool Civ2Map::isFlat() const throw (runtime_error)
 {
     return flat_earth;
 }
 
+// Return the terrain rules for this map
+Civ2TerrainRules& Civ2Map::getTerrainRules()
+{
+    return terrain_rules;
+}
+
+const Civ2TerrainRules& Civ2Map::getTerrainRules() const
+{
+    return terrain_rules;
+}
+
+// Called by Civ2SavedGame when maps before this one are added or removed
+void Civ2Map::setPosition(int ma_pos, const Civ2TerrainRules& in_rules)
+{
+    map_position = static_cast<unsigned char> (ma_pos);
+    terrain_rules = in_rules;
+}
+
 ////////////////////////// Private Methods ///////////////////////////
 
 // This loads the terrain map from the given input stream. It assumes that the
 // read pointer for the input stream is set to the correct location.
-// The read map is placed into terran_map
+// The read map is split into the planes of the map
 // Note: What I call a "terrain map" is the second block of map data within the
 // Civ2 Saved Game file.  It is also stored in .MP files.
 
 void Civ2Map::loadTerrainMap(istream& is) throw (runtime_error)
 {
-    if (terrain_map == NULL)
+    if (planes[TERRAIN_PLANE].isNull())
     {
         throw runtime_error("Cannot Save: No map allocated.");
     }
 
-    is.read(reinterpret_cast<char *>(terrain_map.get()),
-            map_area * sizeof(TerrainCell));
-    if (is.gcount() != map_area * sizeof(TerrainCell))
+    // The file keeps the bytes of each square together, which are split
+    // into the planes here
+    PooledArray<unsigned char> cells;
+    cells.allocate(map_area * NUM_PLANES);
+
+    is.read(reinterpret_cast<char *>(cells.get()), map_area * NUM_PLANES);
+    if (is.gcount() != map_area * NUM_PLANES)
         throw runtime_error("Read Error.");
 
+    for (int p = 0; p < NUM_PLANES; p++)
+    {
+        unsigned char *plane = planes[p].getWritable();
+        const unsigned char *cell = cells.get() + p;
+
+        for (int i = 0; i < map_area; i++, cell += NUM_PLANES)
+        {
+            plane[i] = *cell;
+        }
+    }
+
+    // Until its saved game finds them from the city records
+    cities_known = false;
+
     LogOutput::log(DEBUG) << "Read terrain map" << endl;
 }
 
 // Saves a terrain map to an ostream
 void Civ2Map::saveTerrainMap(ostream& os) const throw(runtime_error)
 {
-    if (terrain_map == NULL)
+    if (planes[TERRAIN_PLANE].isNull())
     {
         throw runtime_error("Cannot Save: No map allocated.");
     }
 
-    os.write(reinterpret_cast<const char *>(terrain_map.get()),
-            map_area * sizeof(TerrainCell));
+    PooledArray<unsigned char> cells;
+    cells.allocate(map_area * NUM_PLANES);
+
+    for (int p = 0; p < NUM_PLANES; p++)
+    {
+        const unsigned char *plane = planes[p];
+        unsigned char *cell = cells.get() + p;
+
+        for (int i = 0; i < map_area; i++, cell += NUM_PLANES)
+        {
+            *cell = plane[i];
+        }
+    }
+
+    os.write(reinterpret_cast<const char *>(cells.get()), map_area * NUM_PLANES);
 
     if (!os)
         throw runtime_error("Write Error.");
@@ -746,7 +1215,7 @@ void Civ2Map::loadCivViewMap(istream& is)
 
     if (civ_view_map.isNull()) throw runtime_error("Cannot load civ view map because it is not allocated.");
 
-    is.read(reinterpret_cast<char *>(civ_view_map.get()),
+    is.read(reinterpret_cast<char *>(civ_view_map.getWritable()),
             map_area * sizeof(unsigned char) * 7);
     if (is.gcount() != map_area * sizeof(unsigned char) * 7)
         throw runtime_error("Read Error.");
@@ -763,7 +1232,7 @@ void Civ2Map::saveCivViewMap(ostream& os) const
         throw runtime_error("Cannot Save: No map loaded.");
     }
 
-    if (civ_view_map == NULL)
+    if (civ_view_map.isNull())
     {
         throw runtime_error("Cannot Save: No map allocated.");
     }
@@ -790,6 +1259,22 @@ void Civ2Map::saveCivViewMap(ostream& os) const
         ((i % width) * 2) + 1    if y is odd
 */
 
+// Returns the plane a layer is kept in
+Civ2Map::Plane Civ2Map::getPlane(Layer layer) throw (runtime_error)
+{
+    switch (layer)
+    {
+        case TERRAIN_LAYER:      return TERRAIN_PLANE;
+        case IMPROVEMENT_LAYER:  return IMPROVEMENT_PLANE;
+        case VISIBILITY_LAYER:   return VISIBILITY_PLANE;
+        case BODY_COUNTER_LAYER: return BODY_COUNTER_PLANE;
+        case CITY_RADIUS_LAYER:  return CITY_RADIUS_PLANE;
+        case OWNERSHIP_LAYER:
+        case FERTILITY_LAYER:    return FERT_OWNERSHIP_PLANE;
+        default: throw runtime_error("Unknown map layer.");
+    }
+}
+
 int Civ2Map::XYtoOffset(int x, int y) const
                               throw (runtime_error)
 {
@@ -815,7 +1300,7 @@ int Civ2Map::XYtoCivViewOffset(int x, int y, Civilization c) const
     // them
     if (c == RED) throw runtime_error("Barbarians do not have civ view info.");
 
-    // use the terrain_map offset, and adjust for civilization
+    // use the terrain map offset, and adjust for civilization
     int offset = XYtoOffset(x, y);
 
     // C++ won't let us subtract down the value of an enumeration
@@ -838,9 +1323,9 @@ void Civ2Map::initResourceMap() throw (runtime_error)
     int evenVerticalSeed = 0;
     int oddVerticalSeed = 2;
 
-    resource_map = new unsigned char[x_dimension * y_dimension];
+    resource_map.allocate(x_dimension * y_dimension);
     if (resource_map.isNull()) 
-        throw new runtime_error ("Could not allocate enough memory for resource_map.");
+        throw runtime_error ("Could not allocate enough memory for resource_map.");
 
     for (int y = 0; y < getHeight(); y++)
     {
@@ -892,7 +1377,7 @@ void Civ2Map::initResourceMap() throw (runtime_error)
 // at the center point, 1 in the first ring, 2 in the second ring and so on.
 
 // Constructor, set up a RingIterator with a given point as its center
-Civ2Map::RingIterator::RingIterator(int x, int y, Civ2Map& m)
+Civ2Map::RingIterator::RingIterator(int x, int y, const Civ2Map& m)
  : map(m)
 {
     centerX = x;
@@ -928,9 +1413,9 @@ void Civ2Map::RingIterator::reset()
 }
 
 // Accessors for current position and distance
-int Civ2Map::RingIterator::getX() { return curX; }
-int Civ2Map::RingIterator::getY() { return curY; }
-int Civ2Map::RingIterator::getDistance() { return distance; }
+int Civ2Map::RingIterator::getX() const { return curX; }
+int Civ2Map::RingIterator::getY() const { return curY; }
+int Civ2Map::RingIterator::getDistance() const { return distance; }
 
 // Move to the next point in the ring pattern
 void Civ2Map::RingIterator::moveToNextPoint() throw (runtime_error)
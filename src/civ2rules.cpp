@@ -28,9 +28,59 @@
 //
 // Revision History:
 #include <iostream>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <cstdlib>
 
 #include "civ2sav.h"
 
+namespace
+{
+    // Terrain rules that have been read from files, keyed by a digest of the
+    // file contents. Entries are never removed, so references to them stay
+    // valid for the life of the process.
+    map<unsigned long long, const Civ2TerrainRules*> loadedTerrainRules;
+    mutex loadedTerrainRulesLock;
+
+    // Removes white space (and DOS line endings) from both ends of a string
+    string trim(const string& s)
+    {
+        static const char *whiteSpace = " \t\r\n";
+
+        string::size_type start = s.find_first_not_of(whiteSpace);
+        if (start == string::npos) return "";
+
+        string::size_type end = s.find_last_not_of(whiteSpace);
+        return s.substr(start, end - start + 1);
+    }
+
+    // Splits a line of a rules.txt file into its comma separated fields
+    void splitFields(const string& line, vector<string>& fields)
+    {
+        fields.clear();
+
+        string::size_type start = 0;
+        while (true)
+        {
+            string::size_type comma = line.find(',', start);
+            fields.push_back(trim(line.substr(start, comma - start)));
+            if (comma == string::npos) break;
+            start = comma + 1;
+        }
+    }
+
+    // Converts a field to an integer, returning false if it is not one
+    bool parseInt(const string& field, int& value)
+    {
+        if (field.empty()) return false;
+
+        char *end;
+        value = strtol(field.c_str(), &end, 10);
+        return (*end == '\0');
+    }
+}
+
 
 /////////////////////// Civ2Rules Methods ////////////////////////////////
 
@@ -44,35 +94,108 @@ Civ2Rules::Civ2Rules()
 // Get the terrain rules for a given map number
 Civ2TerrainRules& Civ2Rules::getTerrainRules(int mapNum) throw (runtime_error)
 {
-    if (mapNum >= map_terrain_rules.size()) 
+    if (mapNum < 0 || mapNum >= map_terrain_rules.size()) 
     {
         stringstream message;
         message << "No terrain rules for map " << mapNum << " are defined.";
-        throw new runtime_error(message.str());
+        throw runtime_error(message.str());
     }
 
     return map_terrain_rules[mapNum];
 }
 
+const Civ2TerrainRules& Civ2Rules::getTerrainRules(int mapNum) const throw (runtime_error)
+{
+    if (mapNum < 0 || mapNum >= map_terrain_rules.size()) 
+    {
+        stringstream message;
+        message << "No terrain rules for map " << mapNum << " are defined.";
+        throw runtime_error(message.str());
+    }
+
+    return map_terrain_rules[mapNum];
+}
+
+// Replace the terrain rules for a given map number
+void Civ2Rules::setTerrainRules(int mapNum, const Civ2TerrainRules& r) throw (runtime_error)
+{
+    if (mapNum < 0 || mapNum >= map_terrain_rules.size()) 
+    {
+        stringstream message;
+        message << "No terrain rules for map " << mapNum << " are defined.";
+        throw runtime_error(message.str());
+    }
+
+    map_terrain_rules[mapNum] = r;
+}
+
+// Returns the terrain rules from a rules.txt file. The file is read every
+// time so that its digest can be checked, but it is only parsed the first
+// time a given set of contents is seen.
+const Civ2TerrainRules& Civ2Rules::loadTerrainRules(const string& filename)
+    throw (runtime_error)
+{
+    ifstream theFile(filename.c_str(), ios_base::binary);
+    if (!theFile) throw runtime_error(string("Could not open file: ") + filename);
+
+    stringstream contents;
+    contents << theFile.rdbuf();
+    string text = contents.str();
+
+    Hash64 digest;
+    digest.add(text.data(), text.size());
+
+    lock_guard<mutex> lock(loadedTerrainRulesLock);
+
+    map<unsigned long long, const Civ2TerrainRules*>::iterator found =
+        loadedTerrainRules.find(digest.getValue());
+
+    if (found != loadedTerrainRules.end()) return *(found->second);
+
+    try
+    {
+        istringstream is(text);
+        const Civ2TerrainRules *r = new Civ2TerrainRules(is);
+        loadedTerrainRules[digest.getValue()] = r;
+
+        LogOutput::log(DEBUG) << "Read terrain rules from " << filename << endl;
+        return *r;
+    }
+    catch (runtime_error& e)
+    {
+        throw runtime_error(string("Error reading ") + filename + ": " + e.what());
+    }
+}
+
 
 ///////////////////// Civ2TerrainRules constatants //////////////////////////////
 // Default values for terrain rules
 const Civ2TerrainRules::TerrainInfo Civ2TerrainRules::default_rules[NUM_TERRAIN_TYPES] =
 {
-//    Food, Shields, Trade, Allows Irrigation, Allows Mining
-    { 0,    1,       0,     true,              true  }, // Desert
-    { 1,    1,       0,     true,              false }, // Plains
-    { 2,    1,       0,     true,              false }, // Grassland
-    { 1,    2,       0,     false,             false }, // Forrest
-    { 1,    0,       0,     true,              true  }, // Hills
-    { 0,    1,       0,     false,             true  }, // Mountains
-    { 1,    0,       0,     true,              false }, // Tundra
-    { 0,    0,       0,     false,             true  }, // Glacier
-    { 1,    0,       0,     false,             false }, // Swamp
-    { 1,    0,       0,     false,             false }, // Jungle
-    { 1,    0,       2,     false,             false }  // Ocean
+//    Move, Food, Shields, Trade, Allows Irrigation, Allows Mining
+    { 1,    0,    1,       0,     true,              true  }, // Desert
+    { 1,    1,    1,       0,     true,              false }, // Plains
+    { 1,    2,    1,       0,     true,              false }, // Grassland
+    { 2,    1,    2,       0,     false,             false }, // Forrest
+    { 2,    1,    0,       0,     true,              true  }, // Hills
+    { 3,    0,    1,       0,     false,             true  }, // Mountains
+    { 1,    1,    0,       0,     true,              false }, // Tundra
+    { 2,    0,    0,       0,     false,             true  }, // Glacier
+    { 2,    1,    0,       0,     false,             false }, // Swamp
+    { 2,    1,    0,       0,     false,             false }, // Jungle
+    { 1,    1,    0,       2,     false,             false }  // Ocean
 };
 
+// Columns of a terrain line in the @TERRAIN section of rules.txt
+// (The name is column 0)
+static const int MOVE_COLUMN = 1;
+static const int FOOD_COLUMN = 3;
+static const int SHIELDS_COLUMN = 4;
+static const int TRADE_COLUMN = 5;
+static const int IRRIGATE_COLUMN = 6;
+static const int MINE_COLUMN = 10;
+static const int MIN_COLUMNS = 14;
+
 /////////////////////// Civ2TerrainRules Methods ////////////////////////////////
 
 // Construct a terrain type with the default rules
@@ -86,32 +209,127 @@ Civ2TerrainRules::Civ2TerrainRules()
 }
 // end default constructor
 
+// Construct from a rules.txt file. The first NUM_TERRAIN_TYPES lines of the
+// @TERRAIN section describe the base terrain types, in the same order as
+// Civ2TerrainType. A terrain can be irrigated or mined if its irrigation or
+// mining result is "yes", rather than "no" or the name of another terrain.
+Civ2TerrainRules::Civ2TerrainRules(istream& is) throw (runtime_error)
+{
+    bool inSection = false;
+    int t = 0;
+    int lineNum = 0;
+    string line;
+    vector<string> fields;
+
+    while (t < NUM_TERRAIN_TYPES && getline(is, line))
+    {
+        lineNum++;
+
+        // Drop comments, which start with ';'
+        string::size_type semicolon = line.find(';');
+        if (semicolon != string::npos) line.erase(semicolon);
+
+        line = trim(line);
+        if (line.empty()) continue;
+
+        if (!inSection)
+        {
+            if (copy_to_upper(line) == "@TERRAIN") inSection = true;
+            continue;
+        }
+
+        stringstream message;
+        message << "line " << lineNum << ": ";
+
+        if (line[0] == '@')
+        {
+            message << "Too few terrain types in @TERRAIN section.";
+            throw runtime_error(message.str());
+        }
+
+        splitFields(line, fields);
+
+        TerrainInfo& info = terrain_rules[t];
+        if (fields.size() < MIN_COLUMNS ||
+            !parseInt(fields[MOVE_COLUMN], info.moveCost) ||
+            !parseInt(fields[FOOD_COLUMN], info.food) ||
+            !parseInt(fields[SHIELDS_COLUMN], info.shields) ||
+            !parseInt(fields[TRADE_COLUMN], info.trade))
+        {
+            message << "Invalid terrain: " << line;
+            throw runtime_error(message.str());
+        }
+
+        info.canBeIrrigated = (copy_to_lower(fields[IRRIGATE_COLUMN]) == "yes");
+        info.canBeMined = (copy_to_lower(fields[MINE_COLUMN]) == "yes");
+        t++;
+    }
+
+    if (!inSection) throw runtime_error("No @TERRAIN section found.");
+    if (t < NUM_TERRAIN_TYPES)
+    {
+        throw runtime_error("Too few terrain types in @TERRAIN section.");
+    }
+}
+
+// Return the rules for a terrain type. Some ToT maps set TOT_TERRAIN_FLAG
+// on some squares, and the Map Editor reads these as the type without the
+// flag (0x2a is ocean). Any other type past OCEAN is wrapped around so that
+// it is never looked up outside the table.
+const Civ2TerrainRules::TerrainInfo& Civ2TerrainRules::getInfo(const Civ2TerrainType& t) const
+{
+    unsigned type = static_cast<unsigned>(t) & ~TOT_TERRAIN_FLAG;
+    return terrain_rules[type % NUM_TERRAIN_TYPES];
+}
+
+// Return movement cost for a given terrain type
+int Civ2TerrainRules::getMoveCost(const Civ2TerrainType& t) const
+{
+    return getInfo(t).moveCost;
+}
+
 // Return food production for a given terrain type
 int Civ2TerrainRules::getFood(const Civ2TerrainType& t) const
 {
-    return terrain_rules[t].food;
+    return getInfo(t).food;
 }
 
 // Return shield production for a given terrain type
 int Civ2TerrainRules::getShields(const Civ2TerrainType& t) const
 {
-    return terrain_rules[t].shields;
+    return getInfo(t).shields;
 }
 
 // Return trade production for a given terrain type
 int Civ2TerrainRules::getTrade(const Civ2TerrainType& t) const
 {
-    return terrain_rules[t].trade;
+    return getInfo(t).trade;
 }
 
 // Return whether a given terrain type can be irrigated
 bool Civ2TerrainRules::canBeIrrigated(const Civ2TerrainType& t) const
 {
-    return terrain_rules[t].canBeIrrigated;
+    return getInfo(t).canBeIrrigated;
 }
 
 // Return whether a given terrain type can be mined
 bool Civ2TerrainRules::canBeMined(const Civ2TerrainType& t) const
 {
-    return terrain_rules[t].canBeMined;
+    return getInfo(t).canBeMined;
+}
+
+// Add the terrain rules to a content digest. Fields are added one at a time
+// so that structure padding does not end up in the digest. Only the fields
+// the fertility calculation reads are added; rules that differ only in move
+// cost give the same fertility and share cached results.
+void Civ2TerrainRules::addToHash(Hash64& h) const
+{
+    for (int i = 0; i < NUM_TERRAIN_TYPES; i++)
+    {
+        h.addValue(terrain_rules[i].food);
+        h.addValue(terrain_rules[i].shields);
+        h.addValue(terrain_rules[i].trade);
+        h.addValue(terrain_rules[i].canBeIrrigated);
+        h.addValue(terrain_rules[i].canBeMined);
+    }
 }
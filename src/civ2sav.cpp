@@ -41,7 +41,14 @@
 // Feb/20/2005 JDR  1.2Beta1 release of ToT multi-map support
 // Mar/15/2005 JDR  Fix problem adding new maps by creating a temp copy before
 //                  saving.
+// Oct/18/2026      Made Civ2SavedGame movable. Maps are owned through
+//                  SmartPointers and keep their own terrain rules.
+// Oct/18/2026      Buffers come from the thread's BufferPool.
+// Oct/18/2026      Added Civ2Unit and Civ2City views of the unit and city
+//                  records.
 #include <iostream>
+#include <cstring>
+#include <algorithm>
 
 #include "civ2sav.h"
 
@@ -85,6 +92,23 @@ const long MGE_MAP_HEADER_OFFSET = 0x3586;
 const long TOT10_TRANSPORTERS_OFFSET = 0x7420;
 const long TOT11_TRANSPORTERS_OFFSET = 0x74C8;
 
+// The number of units and cities are kept in the pre-map data. Their
+// records follow the maps, after the locator map of 2 bytes per locator
+// square and a block of fixed size, units first.
+const int NUM_UNITS_OFFSET = 58;
+const int NUM_CITIES_OFFSET = 60;
+const int TOT_NUM_UNITS_OFFSET = 698;
+const int TOT_NUM_CITIES_OFFSET = 700;
+const int POST_MAP_BLOCK_SIZE = 1024;
+const int TOT_POST_MAP_BLOCK_SIZE = 10240;
+
+const int FW_UNIT_SIZE = 26;     // Also CIC
+const int MGE_UNIT_SIZE = 32;
+const int TOT_UNIT_SIZE = 40;
+const int FW_CITY_SIZE = 84;     // Also CIC
+const int MGE_CITY_SIZE = 88;
+const int TOT_CITY_SIZE = 92;
+
 /////////////////////// Civ2SavedGame Methods ////////////////////////////////
 
 Civ2SavedGame::Civ2SavedGame()
@@ -95,12 +119,54 @@ Civ2SavedGame::Civ2SavedGame()
     secondary_maps = 0;
     preMapDataSize = 0;
     postMapDataSize = 0;
-}
-
-Civ2SavedGame::~Civ2SavedGame()
-{
-    // Destroy maps contained in maps vector
-    destroyMaps();
+    units_offset = 0;
+    num_units = 0;
+    unit_size = 0;
+    cities_offset = 0;
+    num_cities = 0;
+    city_size = 0;
+}
+
+// Take the maps and buffers of another game, leaving it empty
+Civ2SavedGame::Civ2SavedGame(Civ2SavedGame&& other)
+{
+    *this = move(other);
+}
+
+Civ2SavedGame& Civ2SavedGame::operator=(Civ2SavedGame&& other)
+{
+    if (this == &other) return *this;
+
+    header = move(other.header);
+    start_positions = move(other.start_positions);
+    maps = move(other.maps);
+    isMP = other.isMP;
+    version = other.version;
+    map_header_offset = other.map_header_offset;
+    secondary_maps = other.secondary_maps;
+    preMapData = move(other.preMapData);
+    preMapDataSize = other.preMapDataSize;
+    postMapData = move(other.postMapData);
+    postMapDataSize = other.postMapDataSize;
+    units_offset = other.units_offset;
+    num_units = other.num_units;
+    unit_size = other.unit_size;
+    cities_offset = other.cities_offset;
+    num_cities = other.num_cities;
+    city_size = other.city_size;
+    rules = move(other.rules);
+
+    other.maps.clear();
+    other.isMP = false;
+    other.version = 0;
+    other.map_header_offset = 0;
+    other.secondary_maps = 0;
+    other.preMapDataSize = 0;
+    other.postMapDataSize = 0;
+    other.num_units = 0;
+    other.num_cities = 0;
+    other.rules = Civ2Rules();
+    return *this;
 }
 
 // loads a Civ2 Saved game file
@@ -116,8 +182,6 @@ void Civ2SavedGame::load(const string& filename) throw (runtime_error)
 {
     ifstream theFile;
 
-    isMP = isMPFile(filename);
-
     theFile.open(filename.c_str(), ios_base::binary);
 
     if (!theFile) throw runtime_error(string("Could not open file: ")
@@ -125,170 +189,298 @@ void Civ2SavedGame::load(const string& filename) throw (runtime_error)
 
     try
     {
+        load(theFile, isMPFile(filename));
+    }
+    catch (runtime_error& e)
+    {
+        throw runtime_error(string("File: ") + filename + " " + e.what());
+    }
+}
 
-        // Seek within a saved game file for the map header
-        if (!isMP)
+// Loads a saved game, or a map if mapOnly is true, from a stream. The
+// stream must be able to seek, like a file or a stringstream holding the
+// contents of one.
+void Civ2SavedGame::load(istream& theFile, bool mapOnly) throw (runtime_error)
+{
+    isMP = mapOnly;
+
+    // Seek within a saved game file for the map header
+    if (!isMP)
+    {
+        // MERCATOR
+        // Find out the offset for the map header
+        loadMapHeaderOffset(theFile);
+
+        // Now slurp up all the data prior to that offset
+        preMapDataSize = readDataBlock(theFile, preMapData, 0, map_header_offset);
+
+        if (preMapDataSize == -1 || !theFile)
         {
-            // MERCATOR
-            // Find out the offset for the map header
-            loadMapHeaderOffset(theFile);
+            throw runtime_error("Error reading pre-Map data from file.");
+        }
+    }
+    else
+    {
+        theFile.seekg(0);
 
-            // Now slurp up all the data prior to that offset
-            preMapDataSize = readDataBlock(theFile, preMapData, 0, map_header_offset);
+        if (!theFile) throw runtime_error("Error accessing file");
+    }
 
-            if (preMapDataSize == -1 || !theFile)
-            {
-                throw runtime_error("Error reading pre-Map data from file.");
-            }
+    loadMapHeader(theFile);
+    
+    if (isMP)
+    {
+        // load start positions
+        loadStartPositions(theFile);
+    }
+
+    // Destroy any previous maps
+    maps.clear();
+
+    // Allocate and load maps. There should always be at least 1
+    for (int i = 0; i < secondary_maps+1; i++)
+    {
+        maps.push_back(newMap(i));
+        maps[i]->load(theFile);
+
+        // Read map specific seed for TOT files
+        if (version == TOT10_VERSION || 
+            version == TOT11_VERSION )
+        {
+             maps[i]->setSeed(loadMapSpecificSeed(theFile));
+             LogOutput::log(DEBUG) << "Map " << i + 1 << " seed is " << maps[i]->getSeed() << endl;
         }
         else
         {
-            theFile.seekg(0);
-
-            if (!theFile) throw runtime_error("Error accessing file");
+            // Use the global seed
+            maps[i]->setSeed(header->map_seed);
         }
+    } // end loop over all maps
 
-        loadMapHeader(theFile);
-        
-        if (isMP)
+    // Get all the extra data from the saved game file
+    if (!isMP)
+    {
+        // Find the end of the file
+        istream::pos_type start = theFile.tellg();
+        theFile.seekg(0, ios_base::end);
+        istream::pos_type end = theFile.tellg();
+
+        postMapDataSize = readDataBlock(theFile, postMapData, start, end);
+        if (postMapDataSize == -1)
         {
-            // load start positions
-            loadStartPositions(theFile);
+            throw runtime_error("Error reading post-Map data from file.");
         }
+    }
 
-        // Destroy any previous maps
-        destroyMaps();
+    findRecords();
+}
+void Civ2SavedGame::save(const string& filename) const throw (runtime_error)
+{
+    fstream theFile;
 
-        // Allocate and load maps. There should always be at least 1
-        for (int i = 0; i < secondary_maps+1; i++)
-        {
-            maps.push_back(new Civ2Map(header->x_dimension,
-                                       header->y_dimension,
-                                       header->map_area,
-                                       !isMP, // The map has a civ view map
-                                              // if this is not an MP file
-                                       i,
-                                       header->flat_earth,
-                                       rules) );
-            maps[i]->load(theFile);
-
-            // Read map specific seed for TOT files
-            if (version == TOT10_VERSION || 
-                version == TOT11_VERSION )
-            {
-                 maps[i]->setSeed(loadMapSpecificSeed(theFile));
-                 LogOutput::log(DEBUG) << "Map " << i + 1 << " seed is " << maps[i]->getSeed() << endl;
-            }
-            else
-            {
-                // Use the global seed
-                maps[i]->setSeed(header->map_seed);
-            }
-        } // end loop over all maps
+    // Check for an inconsistent map structure before creating the file
+    checkSavable();
 
-        // Get all the extra data from the saved game file
-        if (!isMP)
-        {
-            // Find the end of the file
-            istream::pos_type start = theFile.tellg();
-            theFile.seekg(0, ios_base::end);
-            istream::pos_type end = theFile.tellg();
+    // Open the file for writing only. This will force a new file to be created
+    // if one does not exist, and will truncate an existing file. (same as wb in C)
+    theFile.open(filename.c_str(), ios_base::out | ios_base::binary);
 
-            postMapDataSize = readDataBlock(theFile, postMapData, start, end);
-            if (postMapDataSize == -1)
-            {
-                throw runtime_error("Error reading post-Map data from file.");
-            }
-        }        
+    if (!theFile) throw runtime_error(string("Could not open file: ")
+                                      +=filename);
+
+    try
+    {
+        save(theFile);
     }
     catch (runtime_error& e)
     {
         throw runtime_error(string("File: ") + filename + " " + e.what());
     }
+
 }
 
-// Saves to a Civ2 Saved game file into the original file that it was loaded
-// from.
-//
-// Exceptions:
-// runtime_error - when the save fails for some reason.  The reason is
-//                 returned in the what() member of the runtime_error.
-//
-void Civ2SavedGame::save(const string& filename) throw (runtime_error)
+// Writes the saved game, or the map of an MP file, to a stream
+void Civ2SavedGame::save(ostream& theFile) const throw (runtime_error)
 {
-    fstream theFile;
+    checkSavable();
+
+    if (!isMP)
+    {
+        // Write out the pre-Map data read in at load time
+        theFile.write(preMapData, preMapDataSize);
+        if (!theFile) throw runtime_error("Error writing pre-Map data.");
+    }
 
-    // Check for an inconsistent map structure. It is illegal to save with
-    // 0 maps, and it is illegal to save with > 1 map if this is not a ToT saved
-    // game
+    saveMapHeader(theFile);
+    if (isMP)
+    {
+        saveStartPositions(theFile);
+    }
+
+    // Save each map in turn, writing a map specific seed
+    // for TOT maps
+    for (int i = 0; i < secondary_maps + 1; i++)
+    {
+        maps[i]->save(theFile);
+
+        if (!isMP && (version == TOT10_VERSION || version == TOT11_VERSION ))
+        {
+            saveMapSpecificSeed(theFile, maps[i]->getSeed());
+        }
+    }
+
+    // Write out post-Map data
+    if (!isMP)
+    {
+        theFile.write(postMapData, postMapDataSize);
+        if (!theFile) throw runtime_error("Failure writing post-Map data.");
+    }
+}
+
+// Check for an inconsistent map structure. It is illegal to save with
+// 0 maps, and it is illegal to save with > 1 map if this is not a ToT saved
+// game
+void Civ2SavedGame::checkSavable() const throw (runtime_error)
+{
     if (maps.size()==0) throw runtime_error("Cannot save a file with no maps");
 
     if (maps.size() > 1 && supportsMultiMaps() == false)
     {
         throw runtime_error("Cannot save multiple maps into a non-ToT game");
     }
+}
 
-    // Open the file for writing only. This will force a new file to be created
-    // if one does not exist, and will truncate an existing file. (same as wb in C)
-    theFile.open(filename.c_str(), ios_base::out | ios_base::binary);
+// Snapshot layout: the magic number and format version, the values found
+// by load(), the map header, the start positions (MP files only), the
+// pre-Map data, each map with its seed, the post-Map data, and an end
+// marker. Values are stored as they are in memory.
+namespace
+{
+    const char SNAPSHOT_MAGIC[4] = { 'M', 'C', 'S', 'S' };
+    const char SNAPSHOT_END[4] = { 'M', 'C', 'S', 'E' };
+    const unsigned int SNAPSHOT_VERSION = 1;
 
-    if (!theFile) throw runtime_error(string("Could not open file: ")
-                                      +=filename);
+    template <class T>
+    void writeValue(ostream& os, const T& v)
+    {
+        os.write(reinterpret_cast<const char *>(&v), sizeof(T));
+    }
 
-    if (!isMP)
+    template <class T>
+    void readValue(istream& is, T& v) throw (runtime_error)
     {
-        // Write out the pre-Map data read in at load time
-        theFile.write(preMapData, preMapDataSize);
-        if (!theFile) throw runtime_error(string("Error writing pre-Map data to: ")
-                                          +=filename);
+        is.read(reinterpret_cast<char *>(&v), sizeof(T));
+        if (is.gcount() != sizeof(T)) throw runtime_error("Snapshot is incomplete.");
     }
+}
 
-    try
+void Civ2SavedGame::saveSnapshot(ostream& os) const throw (runtime_error)
+{
+    if (header == NULL || maps.size() != secondary_maps + 1)
     {
-        saveMapHeader(theFile);
-        if (isMP)
-        {
-            saveStartPositions(theFile);
-        }
+        throw runtime_error("Cannot Save: No map loaded.");
+    }
 
-        // Save each map in turn, writing a map specific seed
-        // for TOT maps
-        for (int i = 0; i < secondary_maps + 1; i++)
-        {
-            maps[i]->save(theFile);
+    os.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    writeValue(os, SNAPSHOT_VERSION);
+    writeValue(os, isMP);
+    writeValue(os, version);
+    writeValue(os, map_header_offset);
+    writeValue(os, secondary_maps);
+    writeValue(os, *header);
 
-            if (!isMP && (version == TOT10_VERSION || version == TOT11_VERSION ))
-            {
-                saveMapSpecificSeed(theFile, maps[i]->getSeed());
-            }
-        }
+    if (isMP) saveStartPositions(os);
 
-        // Write out post-Map data
-        if (!isMP)
-        {
-            theFile.write(postMapData, postMapDataSize);
-            if (!theFile) throw runtime_error("Failure writing post-Map data.");
-        }
+    writeValue(os, preMapDataSize);
+    if (!isMP) os.write(preMapData, preMapDataSize);
+
+    for (int i = 0; i < maps.size(); i++)
+    {
+        writeValue(os, maps[i]->getSeed());
+        maps[i]->save(os);
     }
-    catch (runtime_error& e)
+
+    writeValue(os, postMapDataSize);
+    if (!isMP) os.write(postMapData, postMapDataSize);
+
+    os.write(SNAPSHOT_END, sizeof(SNAPSHOT_END));
+
+    if (!os) throw runtime_error("Write Error.");
+}
+
+void Civ2SavedGame::loadSnapshot(istream& is) throw (runtime_error)
+{
+    char magic[4];
+    unsigned int format;
+
+    is.read(magic, sizeof(magic));
+    readValue(is, format);
+    if (memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0 || format != SNAPSHOT_VERSION)
     {
-        throw runtime_error(string("File: ") + filename + " " + e.what());
+        throw runtime_error("Not a snapshot, or from a different version of MapCopy.");
     }
 
+    readValue(is, isMP);
+    readValue(is, version);
+    readValue(is, map_header_offset);
+    readValue(is, secondary_maps);
+
+    PooledArray<MapHeader> p;
+    p.allocate(1);
+    readValue(is, *p);
+    header = move(p);
+
+    if (isMP) loadStartPositions(is);
+
+    readValue(is, preMapDataSize);
+    if (!isMP)
+    {
+        preMapDataSize = readDataBlock(is, preMapData, is.tellg(),
+                                       is.tellg() + istream::off_type(preMapDataSize));
+        if (preMapDataSize == -1) throw runtime_error("Snapshot is incomplete.");
+    }
+
+    maps.clear();
+
+    for (int i = 0; i < secondary_maps+1; i++)
+    {
+        maps.push_back(newMap(i));
+
+        unsigned short seed;
+        readValue(is, seed);
+        maps[i]->load(is);
+        maps[i]->setSeed(seed);
+    }
+
+    readValue(is, postMapDataSize);
+    if (!isMP)
+    {
+        postMapDataSize = readDataBlock(is, postMapData, is.tellg(),
+                                        is.tellg() + istream::off_type(postMapDataSize));
+        if (postMapDataSize == -1) throw runtime_error("Snapshot is incomplete.");
+    }
+
+    is.read(magic, sizeof(magic));
+    if (is.gcount() != sizeof(magic) || memcmp(magic, SNAPSHOT_END, sizeof(magic)) != 0)
+    {
+        throw runtime_error("Snapshot is incomplete.");
+    }
+
+    findRecords();
 }
 
 // Creates a MP file in memory
 void Civ2SavedGame::createMP(int width, int height) throw (runtime_error)
 {
     // First, destroy pre-existing maps (if any)
-    destroyMaps();
+    maps.clear();
 
     // Second, allocate memory
-    SmartPointer<MapHeader> newHeader = new MapHeader();
-    if (newHeader.isNull()) throw runtime_error("Insufficient memory.");
+    PooledArray<MapHeader> newHeader;
+    newHeader.allocate(1);
 
-    SmartPointer<StartPositions> newStart = new StartPositions();
-    if (newStart.isNull()) throw runtime_error("Insufficient memory.");
+    PooledArray<StartPositions> newStart;
+    newStart.allocate(1);
 
     // Third, initialize header and start positions
     newHeader->x_dimension = width;
@@ -314,16 +506,18 @@ void Civ2SavedGame::createMP(int width, int height) throw (runtime_error)
                                false, // MPs have no civ view information
                                0, // The first and only map for the .MP file
                                false,
-                               rules) ); 
+                               rules.getTerrainRules(0)) );
 
     // Now set members
     isMP = true;
 
-    header = newHeader.releaseControl();
-    start_positions = newStart.releaseControl();
+    header = move(newHeader);
+    start_positions = move(newStart);
     secondary_maps = 0;
     version = 0;
     map_header_offset = 0;
+    num_units = 0;
+    num_cities = 0;
 }
 
 // Creates a new saved game file in memory, not supported yet
@@ -369,6 +563,15 @@ Civ2SavedGame::StartPositions& Civ2SavedGame::getCivStart() throw (runtime_error
     else return *start_positions;
 }
 
+const Civ2SavedGame::StartPositions& Civ2SavedGame::getCivStart() const throw (runtime_error)
+{
+    if (!isMP || start_positions.isNull())
+    {
+        throw runtime_error("Start positions are not defined on a .SAV file.");
+    }
+    else return *start_positions;
+}
+
 // Sets the starting positions for civilizations. This is only valid
 // for .MP files
 void Civ2SavedGame::setCivStart(const StartPositions& sp) throw (runtime_error)
@@ -381,9 +584,7 @@ void Civ2SavedGame::setCivStart(const StartPositions& sp) throw (runtime_error)
     {
         if (start_positions.isNull())
         {
-            start_positions = new StartPositions();
-            if (start_positions.isNull())
-                throw runtime_error("Insufficient memory.");
+            start_positions.allocate(1);
         }
 
         *start_positions = sp;
@@ -415,6 +616,7 @@ int Civ2SavedGame::getNumMaps() const throw (runtime_error)
 
 // Add a new map to the game. n is an index into the current set of maps
 // n must be >= 0 and <= getNumMaps()
+// The maps after it move up one position, without being copied.
 void Civ2SavedGame::addMap(int n) throw (runtime_error)
 {
     if (supportsMultiMaps() == false)
@@ -429,43 +631,14 @@ void Civ2SavedGame::addMap(int n) throw (runtime_error)
         throw runtime_error(message.str());
     }
 
-    // Create the new map
-    SmartPointer<Civ2Map> m = new Civ2Map(header->x_dimension,
-                                          header->y_dimension,
-                                          header->map_area,
-                                          !isMP, 
-                                          n,
-                                          header->flat_earth,
-                                          rules); 
-    // Insertion at the end is easy for a vector
-    if (n == secondary_maps +1)
-    {
-        maps.push_back(m.releaseControl());
-    }
-    else // We must iterate through to find the right point
-    {
-        vector<Civ2Map*>::iterator i = maps.begin();
-        for (int j = 0; j <= n; j++)
-        {
-            if (j == n)
-            { 
-                // This is inefficient for a vector, but I chose to 
-                // give getMap()'s performance a higher priority than
-                // addMap()/removeMap()
-                maps.insert(i, m.releaseControl());
-            }
-            else // Must use the else, because insert will invalidate
-                 // iterator
-            {
-                i++;
-            }
-        }
-    }
+    maps.insert(maps.begin() + n, newMap(n));
     secondary_maps++;
+    renumberMaps(n + 1);
 }
 
 // Removes map at index n
 // n must be >= 0 and < getNumMaps()
+// The maps after it move down one position, without being copied.
 void Civ2SavedGame::removeMap(int n) throw (runtime_error)
 {
     if (n < 0 || n > secondary_maps)
@@ -475,30 +648,11 @@ void Civ2SavedGame::removeMap(int n) throw (runtime_error)
                  << secondary_maps;
         throw runtime_error(message.str());
     } 
-    // delete the map
-    Civ2Map *m = maps[n];
-    delete m;
+    if (secondary_maps == 0) throw runtime_error("Cannot remove the only map");
 
-    // Now remove that map entry
-    if (n == secondary_maps)
-    {
-        maps.pop_back();
-    }
-    else // Must iterate through to find the right one to remove
-    {
-        vector<Civ2Map*>::iterator i = maps.begin();
-        for (int j = 0; j <= n; j++)
-        {
-            if (j == n)
-            {
-                maps.erase(i);
-            }
-            else // Must have else because remove invalidates i
-            {
-                i++;
-            }
-        }
-    }
+    maps.erase(maps.begin() + n);
+    secondary_maps--;
+    renumberMaps(n);
 }
 
 // Return the map at index n
@@ -517,6 +671,19 @@ Civ2Map& Civ2SavedGame::getMap(int n) throw (runtime_error)
     return *(maps[n]);
 }
 
+const Civ2Map& Civ2SavedGame::getMap(int n) const throw (runtime_error)
+{
+    if (n < 0 || n > secondary_maps) 
+    {
+        stringstream message;
+        message << "Cannot get map, index " << n << " is < 0 or > " 
+                 << secondary_maps;
+        throw runtime_error(message.str());
+    } 
+
+    return *(maps[n]);
+}
+
 // Return pretty version string
 const char * Civ2SavedGame::getVersionString() const
 {
@@ -549,14 +716,205 @@ bool Civ2SavedGame::isFlatEarth() const
     return (header->flat_earth == 1);
 }
 
+// Return the rules used for this game's maps
+const Civ2Rules& Civ2SavedGame::getRules() const
+{
+    return rules;
+}
+
+// Replace the terrain rules for the map at position mapNum, and for any map
+// later added at that position
+void Civ2SavedGame::setTerrainRules(int mapNum, const Civ2TerrainRules& r)
+    throw (runtime_error)
+{
+    rules.setTerrainRules(mapNum, r);
+    if (mapNum < maps.size()) maps[mapNum]->setPosition(mapNum, r);
+}
+
 // Return this is a MP file
 bool Civ2SavedGame::isMapOnly() const
 {
     return isMP;
 }
 
+int Civ2SavedGame::getNumUnits() const
+{
+    return num_units;
+}
+
+int Civ2SavedGame::getNumCities() const
+{
+    return num_cities;
+}
+
+// Return a view of the nth unit record
+Civ2Unit Civ2SavedGame::getUnit(int n) throw (runtime_error)
+{
+    if (n < 0 || n >= num_units) throw runtime_error("No such unit.");
+
+    char *record = postMapData + units_offset + n * unit_size;
+    return Civ2Unit(record, record, supportsMultiMaps());
+}
+
+Civ2Unit Civ2SavedGame::getUnit(int n) const throw (runtime_error)
+{
+    if (n < 0 || n >= num_units) throw runtime_error("No such unit.");
+
+    return Civ2Unit(postMapData + units_offset + n * unit_size, NULL,
+                    supportsMultiMaps());
+}
+
+// Return a view of the nth city record
+Civ2City Civ2SavedGame::getCity(int n) throw (runtime_error)
+{
+    if (n < 0 || n >= num_cities) throw runtime_error("No such city.");
+
+    char *record = postMapData + cities_offset + n * city_size;
+    return Civ2City(record, record, supportsMultiMaps(), this);
+}
+
+Civ2City Civ2SavedGame::getCity(int n) const throw (runtime_error)
+{
+    if (n < 0 || n >= num_cities) throw runtime_error("No such city.");
+
+    return Civ2City(postMapData + cities_offset + n * city_size, NULL,
+                    supportsMultiMaps(), NULL);
+}
+
 ////////////////////////// Private Helper Functions ///////////////////////////
 
+// Finds where the unit and city records are in the post-map data. Only the
+// offsets are worked out here; the records themselves are only read when
+// a view of one is used. If the records would not fit in the post-map
+// data, the file is not laid out as expected, and the game is treated as
+// having none.
+void Civ2SavedGame::findRecords()
+{
+    num_units = 0;
+    num_cities = 0;
+
+    if (isMP) return;
+
+    int units_count_offset = NUM_UNITS_OFFSET;
+    int cities_count_offset = NUM_CITIES_OFFSET;
+    int block_size = POST_MAP_BLOCK_SIZE;
+
+    switch (version)
+    {
+        case CIC_VERSION:
+        case FW_VERSION:
+            unit_size = FW_UNIT_SIZE;
+            city_size = FW_CITY_SIZE;
+            break;
+        case MGE13_VERSION:
+            unit_size = MGE_UNIT_SIZE;
+            city_size = MGE_CITY_SIZE;
+            break;
+        case TOT10_VERSION:
+        case TOT11_VERSION:
+            unit_size = TOT_UNIT_SIZE;
+            city_size = TOT_CITY_SIZE;
+            units_count_offset = TOT_NUM_UNITS_OFFSET;
+            cities_count_offset = TOT_NUM_CITIES_OFFSET;
+            block_size = TOT_POST_MAP_BLOCK_SIZE;
+            break;
+        default:
+            return;
+    }
+
+    if (preMapDataSize < cities_count_offset + (int) sizeof(short)) return;
+
+    unsigned short units;
+    unsigned short cities;
+    memcpy(&units, preMapData + units_count_offset, sizeof(units));
+    memcpy(&cities, preMapData + cities_count_offset, sizeof(cities));
+
+    int start = header->locator_x_dimension * header->locator_y_dimension * 2 +
+                block_size;
+    if (start + units * unit_size + cities * city_size > postMapDataSize)
+    {
+        LogOutput::log(DEBUG) << "Unit and city records not found." << endl;
+        return;
+    }
+
+    units_offset = start;
+    num_units = units;
+    cities_offset = start + units * unit_size;
+    num_cities = cities;
+
+    LogOutput::log(DEBUG) << "Units: " << num_units << endl;
+    LogOutput::log(DEBUG) << "Cities: " << num_cities << endl;
+
+    findCitySquares();
+}
+
+// Tells each map where its cities are and who owns them, from the city
+// records. The cities are only given to a map if the city improvement is at
+// the square of each of them, and every city improvement on it belongs to
+// a record, which is checked with one pass over its improvements here so
+// that later work around cities need not search the map again.
+void Civ2SavedGame::findCitySquares()
+{
+    for (size_t m = 0; m < maps.size(); m++)
+    {
+        Civ2Map& map = *maps[m];
+        vector<Civ2Map::City> cities;
+
+        for (int i = 0; i < num_cities; i++)
+        {
+            Civ2City record = getCity(i);
+
+            Civ2Map::City c;
+            c.x = record.getX();
+            c.y = record.getY();
+            c.owner = static_cast<Civ2Map::Civilization>(record.getOwner() & 0x07);
+
+            if (record.getMap() != (int) m) continue;
+            if (c.x < 0 || c.x >= map.getWidth() || c.y < 0 || c.y >= map.getHeight() ||
+                (c.x + c.y) % 2 != 0)
+            {
+                continue;
+            }
+
+            // Only the first record of a square counts
+            bool found = false;
+            for (size_t j = 0; j < cities.size() && !found; j++)
+            {
+                found = cities[j].x == c.x && cities[j].y == c.y;
+            }
+            if (!found) cities.push_back(c);
+        }
+
+        bool found = true;
+        for (size_t i = 0; i < cities.size() && found; i++)
+        {
+            found = map.getImprovements(cities[i].x, cities[i].y).hasCity();
+        }
+
+        if (found && map.countCities() == (int) cities.size())
+        {
+            map.recorded_cities = cities;
+            map.cities_known = true;
+        }
+        else
+        {
+            LogOutput::log(DEBUG) << "Map " << m + 1
+                                  << " does not match its city records." << endl;
+        }
+    }
+}
+
+// A city record has been moved or has changed hands, so the maps go back to
+// finding their cities from their improvements
+void Civ2SavedGame::forgetCitySquares()
+{
+    for (size_t m = 0; m < maps.size(); m++)
+    {
+        maps[m]->recorded_cities.clear();
+        maps[m]->cities_known = false;
+    }
+}
+
 // MERCATOR
 // Gets the offset of the map header in a savegame.
 // Stores values into <version> and <map_header_offset> variables.
@@ -616,16 +974,15 @@ void Civ2SavedGame::loadMapHeaderOffset(istream& is) throw (runtime_error)
 
 void Civ2SavedGame::loadMapHeader(istream& is) throw(runtime_error)
 {
-    SmartPointer<MapHeader> p = new MapHeader;
-    if (p == NULL) throw runtime_error("Insufficient Memory.");
-
+    PooledArray<MapHeader> p;
+    p.allocate(1);
 
     is.read(reinterpret_cast<char *>(p.get()), sizeof(MapHeader));
 
     if (is.gcount() != sizeof(MapHeader))
         throw runtime_error("Read error.");
 
-    header = p.releaseControl();
+    header = move(p);
 
 	// MERCATOR
 	// Also read 8th header value for ToT files.
@@ -685,16 +1042,15 @@ void Civ2SavedGame::saveMapHeader(ostream& os) const throw(runtime_error)
 void Civ2SavedGame::loadStartPositions(istream& is)
                                        throw (runtime_error)
 {
-    StartPositions *ptr = new StartPositions();
-    SmartPointer<StartPositions> p = ptr;                
-    if (ptr == NULL) throw runtime_error("Insufficient Memory.");
+    PooledArray<StartPositions> p;
+    p.allocate(1);
 
-    is.read(reinterpret_cast<char *>(ptr), sizeof(StartPositions));
+    is.read(reinterpret_cast<char *>(p.get()), sizeof(StartPositions));
 
     if (is.gcount() != sizeof(StartPositions))
         throw runtime_error("Read error.");
 
-    start_positions = p.releaseControl();
+    start_positions = move(p);
     LogOutput::log(DEBUG) << "Loaded start positions." << endl;
 }
 
@@ -711,7 +1067,7 @@ unsigned short Civ2SavedGame::loadMapSpecificSeed(istream& is) throw (runtime_er
     return seed;
 }
 
-void Civ2SavedGame::saveMapSpecificSeed(ostream& os, unsigned short seed) throw (runtime_error)
+void Civ2SavedGame::saveMapSpecificSeed(ostream& os, unsigned short seed) const throw (runtime_error)
 {
     os.write(reinterpret_cast<const char *>(&seed), sizeof(unsigned short));
     if (!os)
@@ -735,14 +1091,26 @@ void Civ2SavedGame::saveStartPositions(ostream& os) const throw (runtime_error)
     LogOutput::log(DEBUG) << "Wrote starting positions." << endl;
 }
 
-// Destroy all memory associated with the maps vector
-void Civ2SavedGame::destroyMaps()
+// Create a map for position n, sized from the map header
+SmartPointer<Civ2Map> Civ2SavedGame::newMap(int n) const throw (runtime_error)
 {
-    for (int i = 0; i < maps.size(); i++)
+    return SmartPointer<Civ2Map>(new Civ2Map(header->x_dimension,
+                                             header->y_dimension,
+                                             header->map_area,
+                                             !isMP, // The map has a civ view map
+                                                    // if this is not an MP file
+                                             n,
+                                             header->flat_earth,
+                                             rules.getTerrainRules(n)));
+}
+
+// Tell the maps from position from onwards where they now are
+void Civ2SavedGame::renumberMaps(int from)
+{
+    for (int i = from; i < maps.size(); i++)
     {
-        delete maps[i];
+        maps[i]->setPosition(i, rules.getTerrainRules(i));
     }
-    maps.clear();
 }
 
 // Determine if this saved game file supports multiple maps
@@ -755,16 +1123,15 @@ bool Civ2SavedGame::supportsMultiMaps() const
 // read that data into the allocated memory. Note the byte at offset end
 // is not read, but the stream is left with end being its current position.
 int Civ2SavedGame::readDataBlock(istream& inputStream, 
-                                 SmartPointer<char, true>& memory,
+                                 PooledArray<char>& memory,
                                  istream::pos_type start, istream::pos_type end)
 {
     // Figure out how much memory is needed
     int size = end - start;
 
     // Allocate the memory
-    memory = new char[ size ];
-
-    if (memory.isNull()) return -1;
+    if (size < 0) return -1;
+    memory.allocate(size);
 
     // Seek to the starting position and read the data
     inputStream.seekg(start);
@@ -973,3 +1340,196 @@ void WhichCivs::setPurple(bool b)
     if (b) whichCivs |= PURPLE_MASK;
     else whichCivs &= (~PURPLE_MASK);
 }
+
+/////////////////////// Civ2Unit Methods ///////////////////////////////
+
+Civ2Unit::Civ2Unit(const char *r, char *w, bool m) : record(r), writable(w), hasMap(m)
+{
+}
+
+// The record, for changing it
+char *Civ2Unit::getWritable() const throw (runtime_error)
+{
+    if (writable == NULL) throw runtime_error("Cannot change a unit of a const saved game.");
+    return writable;
+}
+
+int Civ2Unit::getX() const
+{
+    short x;
+    memcpy(&x, record + X_OFFSET, sizeof(x));
+    return x;
+}
+
+int Civ2Unit::getY() const
+{
+    short y;
+    memcpy(&y, record + Y_OFFSET, sizeof(y));
+    return y;
+}
+
+int Civ2Unit::getMap() const
+{
+    if (!hasMap) return 0;
+
+    short map;
+    memcpy(&map, record + MAP_OFFSET, sizeof(map));
+    return map;
+}
+
+int Civ2Unit::getType() const
+{
+    return (unsigned char) record[TYPE_OFFSET + (hasMap ? MAP_SIZE : 0)];
+}
+
+int Civ2Unit::getOwner() const
+{
+    return (unsigned char) record[OWNER_OFFSET + (hasMap ? MAP_SIZE : 0)];
+}
+
+void Civ2Unit::setX(int x) throw (runtime_error)
+{
+    short s = x;
+    memcpy(getWritable() + X_OFFSET, &s, sizeof(s));
+}
+
+void Civ2Unit::setY(int y) throw (runtime_error)
+{
+    short s = y;
+    memcpy(getWritable() + Y_OFFSET, &s, sizeof(s));
+}
+
+void Civ2Unit::setMap(int map) throw (runtime_error)
+{
+    if (!hasMap)
+    {
+        if (map == 0) return;
+        throw runtime_error("Only ToT units can be on other maps.");
+    }
+
+    short s = map;
+    memcpy(getWritable() + MAP_OFFSET, &s, sizeof(s));
+}
+
+void Civ2Unit::setType(int type) throw (runtime_error)
+{
+    getWritable()[TYPE_OFFSET + (hasMap ? MAP_SIZE : 0)] = (char) type;
+}
+
+void Civ2Unit::setOwner(int civ) throw (runtime_error)
+{
+    getWritable()[OWNER_OFFSET + (hasMap ? MAP_SIZE : 0)] = (char) civ;
+}
+
+/////////////////////// Civ2City Methods ///////////////////////////////
+
+Civ2City::Civ2City(const char *r, char *w, bool m, Civ2SavedGame *g)
+: record(r), writable(w), hasMap(m), game(g)
+{
+}
+
+// The record, for changing it
+char *Civ2City::getWritable() const throw (runtime_error)
+{
+    if (writable == NULL) throw runtime_error("Cannot change a city of a const saved game.");
+    return writable;
+}
+
+// The maps' cities may no longer match the records. Only called after
+// getWritable(), so there is a saved game.
+void Civ2City::moved()
+{
+    game->forgetCitySquares();
+}
+
+int Civ2City::getX() const
+{
+    short x;
+    memcpy(&x, record + X_OFFSET, sizeof(x));
+    return x;
+}
+
+int Civ2City::getY() const
+{
+    short y;
+    memcpy(&y, record + Y_OFFSET, sizeof(y));
+    return y;
+}
+
+int Civ2City::getMap() const
+{
+    if (!hasMap) return 0;
+
+    short map;
+    memcpy(&map, record + MAP_OFFSET, sizeof(map));
+    return map;
+}
+
+int Civ2City::getOwner() const
+{
+    return (unsigned char) record[OWNER_OFFSET + (hasMap ? MAP_SIZE : 0)];
+}
+
+int Civ2City::getSize() const
+{
+    return (unsigned char) record[SIZE_OFFSET + (hasMap ? MAP_SIZE : 0)];
+}
+
+// The name, which is kept 0 terminated in a fixed size field
+string Civ2City::getName() const
+{
+    const char *name = record + NAME_OFFSET + (hasMap ? MAP_SIZE : 0);
+    return string(name, strnlen(name, NAME_SIZE));
+}
+
+// Moving a city's record does not move the city improvement on the map
+void Civ2City::setX(int x) throw (runtime_error)
+{
+    short s = x;
+    memcpy(getWritable() + X_OFFSET, &s, sizeof(s));
+    moved();
+}
+
+void Civ2City::setY(int y) throw (runtime_error)
+{
+    short s = y;
+    memcpy(getWritable() + Y_OFFSET, &s, sizeof(s));
+    moved();
+}
+
+void Civ2City::setMap(int map) throw (runtime_error)
+{
+    if (!hasMap)
+    {
+        if (map == 0) return;
+        throw runtime_error("Only ToT cities can be on other maps.");
+    }
+
+    short s = map;
+    memcpy(getWritable() + MAP_OFFSET, &s, sizeof(s));
+    moved();
+}
+
+void Civ2City::setOwner(int civ) throw (runtime_error)
+{
+    getWritable()[OWNER_OFFSET + (hasMap ? MAP_SIZE : 0)] = (char) civ;
+    moved();
+}
+
+void Civ2City::setSize(int size) throw (runtime_error)
+{
+    if (size < 0 || size > 255) throw runtime_error("Invalid city size.");
+    getWritable()[SIZE_OFFSET + (hasMap ? MAP_SIZE : 0)] = (char) size;
+}
+
+void Civ2City::setName(const string& name) throw (runtime_error)
+{
+    if (name.size() >= NAME_SIZE)
+    {
+        throw runtime_error("City names are at most 15 characters.");
+    }
+
+    char *field = getWritable() + NAME_OFFSET + (hasMap ? MAP_SIZE : 0);
+    memset(field, 0, NAME_SIZE);
+    memcpy(field, name.data(), name.size());
+}
@@ -44,12 +44,18 @@
 #include <string>
 #include <stdexcept>
 #include <vector>
+#include <utility>
 #include <fstream>
 #include "DustyUtil.h"
+#include "bufpool.h"
 
 using namespace std;
 using namespace DustyUtil;
 
+class Civ2Map;
+class Civ2SavedGame;
+class Civ2FertilityTrace;
+
 // Debug and verbose levels used for logging output
 static const int NORMAL = 0;
 static const int DEBUG = 1;
@@ -153,10 +159,109 @@ class WhichCivs
     static const unsigned char PURPLE_MASK;
 };
 
+// Civ2Unit
+// A view of one unit record in the data following the maps of a Civ 2
+// saved game. Like Improvements, it hides the record's format from
+// clients, but rather than holding a copy of the record it points into the
+// saved game: each field is decoded from the record when it is read, and
+// written straight back into it when it is set, so the saved game saves
+// the change without doing anything more. A view is only valid as long as
+// the saved game it came from. A view of a const saved game cannot be
+// changed.
+class Civ2Unit
+{
+    public:
+    int getX() const;
+    int getY() const;
+    int getMap() const; // Always 0 before ToT
+    int getType() const;
+    int getOwner() const;
+
+    void setX(int x) throw (runtime_error);
+    void setY(int y) throw (runtime_error);
+    void setMap(int map) throw (runtime_error);
+    void setType(int type) throw (runtime_error);
+    void setOwner(int civ) throw (runtime_error);
+
+    private:
+    // Called by friend Civ2SavedGame
+    Civ2Unit(const char *record, char *writable, bool hasMap);
+
+    friend class Civ2SavedGame;
+
+    char *getWritable() const throw (runtime_error);
+
+    const char *record;
+    char *writable; // NULL for a view of a const saved game
+
+    // ToT records keep the map number after the coordinates, which moves
+    // the fields after it along by MAP_SIZE bytes
+    bool hasMap;
+
+    // Offsets of the fields within a record before ToT
+    static const int X_OFFSET = 0;
+    static const int Y_OFFSET = 2;
+    static const int MAP_OFFSET = 4;
+    static const int MAP_SIZE = 2;
+    static const int TYPE_OFFSET = 6;
+    static const int OWNER_OFFSET = 7;
+};
+
+// Civ2City
+// A view of one city record, in the same way as Civ2Unit. Changing where a
+// city is, or who owns it, also makes the saved game's maps forget the
+// cities they were given from the records, so they find them from their
+// improvements again. The view must not outlive, or be moved with, the
+// saved game.
+class Civ2City
+{
+    public:
+    int getX() const;
+    int getY() const;
+    int getMap() const; // Always 0 before ToT
+    int getOwner() const;
+    int getSize() const;
+    string getName() const;
+
+    void setX(int x) throw (runtime_error);
+    void setY(int y) throw (runtime_error);
+    void setMap(int map) throw (runtime_error);
+    void setOwner(int civ) throw (runtime_error);
+    void setSize(int size) throw (runtime_error);
+    void setName(const string& name) throw (runtime_error);
+
+    private:
+    // Called by friend Civ2SavedGame
+    Civ2City(const char *record, char *writable, bool hasMap, Civ2SavedGame *game);
+
+    friend class Civ2SavedGame;
+
+    char *getWritable() const throw (runtime_error);
+    void moved();
+
+    const char *record;
+    char *writable;      // NULL for a view of a const saved game
+    bool hasMap;         // As for Civ2Unit
+    Civ2SavedGame *game; // The saved game, or NULL with writable
+
+    static const int X_OFFSET = 0;
+    static const int Y_OFFSET = 2;
+    static const int MAP_OFFSET = 4;
+    static const int MAP_SIZE = 2;
+    static const int OWNER_OFFSET = 8;
+    static const int SIZE_OFFSET = 9;
+    static const int NAME_OFFSET = 32;
+    static const int NAME_SIZE = 16; // Including the terminating 0
+};
+
 // Numeric values for default CIV2 terrain types
 enum Civ2TerrainType { DESSERT=0, PLAINS, GRASSLAND, FOREST, HILLS, MOUNTAINS, TUNDRA,
                        GLACIER, SWAMP,  JUNGLE, OCEAN, NUM_TERRAIN_TYPES };
 
+// Some ToT maps set this bit in the terrain type of some squares. It is not
+// part of the type: the Map Editor reads 0x2a as ocean.
+const unsigned char TOT_TERRAIN_FLAG = 0x20;
+
 // Civ2TerrainRules
 // This class encapsulates rules.txt data about terrains.
 
@@ -167,15 +272,22 @@ class Civ2TerrainRules
         // Construct a terrain type with the default rules
         Civ2TerrainRules();
 
-        // Don't need these yet: 
-        // int getMoveCost(const Type& t) const; 
+        // Construct with an input stream pointing at a rules.txt file. The
+        // terrain is read from the first @TERRAIN section in the stream.
+        Civ2TerrainRules(istream& is) throw (runtime_error);
+
+        // Don't need this yet: 
         // int getDefense(const Type& t) const;
+        int getMoveCost(const Civ2TerrainType& t) const; 
         int getFood(const Civ2TerrainType& t) const;
         int getShields(const Civ2TerrainType& t) const;
         int getTrade(const Civ2TerrainType& t) const;
         bool canBeIrrigated(const Civ2TerrainType& t) const;
         bool canBeMined(const Civ2TerrainType& t) const;
 
+        // Add the rules to a content digest
+        void addToHash(Hash64& h) const;
+
         // Additional information from rules.txt could be added but is not 
         // needed yet.
 
@@ -183,11 +295,9 @@ class Civ2TerrainRules
 
         friend class Civ2Rules;
 
-        // Construct with an input stream pointing at a rules.txt file         
-        // Civ2TerrainRules(istream& is);
-
         struct TerrainInfo
         {
+            int moveCost;
             int food;
             int shields;
             int trade;
@@ -195,10 +305,60 @@ class Civ2TerrainRules
             bool canBeMined;
         };
 
+        const TerrainInfo& getInfo(const Civ2TerrainType& t) const;
+
         TerrainInfo terrain_rules[NUM_TERRAIN_TYPES];
         static const TerrainInfo default_rules[NUM_TERRAIN_TYPES];
 };
 
+// FertilityYields
+// The production totals around a square that go into its fertility: the
+// square itself, the 8 squares adjacent to it, and the 12 squares in the outer
+// ring of its city radius.  Irrigation and mining bonuses are already included.
+struct FertilityYields
+{
+    float selfFood;
+    float selfShields;
+    float selfTrade;
+
+    float innerFood;
+    float innerShields;
+    float innerTrade;
+
+    float outerFood;
+    float outerShields;
+    float outerTrade;
+
+    // True if the square is grassland without a shield, which lowers
+    // its fertility by one.
+    bool grasslandNoShield;
+};
+
+// FertilityWeights
+// The constants used to combine FertilityYields into a fertility value. These
+// were found empirically, the defaults are the best match found so far for
+// how Civ2 calculates fertility.
+struct FertilityWeights
+{
+    FertilityWeights();
+
+    // Weights for the square, the inner ring, and the outer ring
+    float selfWeight;
+    float innerWeight;
+    float outerWeight;
+
+    // Weights for food, shields, and trade
+    float foodWeight;
+    float shieldsWeight;
+    float tradeWeight;
+
+    float divisor;
+
+    // The range the result is clamped to
+    int minFertility;
+    int maxFertility;
+};
+
 // Class to encapsulate the data in a Civ2 Rules.txt file
 class Civ2Rules
 {
@@ -208,6 +368,17 @@ class Civ2Rules
 
         // Return terrain rules for a given map.
         Civ2TerrainRules& getTerrainRules(int mapNum) throw (runtime_error);
+        const Civ2TerrainRules& getTerrainRules(int mapNum) const throw (runtime_error);
+
+        // Replace the terrain rules for a given map.
+        void setTerrainRules(int mapNum, const Civ2TerrainRules& r) throw (runtime_error);
+
+        // Return the terrain rules read from a rules.txt file. Each distinct
+        // file is only parsed once per process: parsed rules are kept,
+        // keyed by a digest of the file's contents, and shared by every
+        // later caller. This may be called from multiple threads.
+        static const Civ2TerrainRules& loadTerrainRules(const string& filename)
+            throw (runtime_error);
 
     private:
 
@@ -219,15 +390,29 @@ class Civ2Rules
 // This class is responsible for reading a Civ 2 saved game into memory,
 // allowing the game to be modified, and writing it to back to a file.
 //
+// The const methods only read, and may be called from several threads at
+// once, as long as no thread is changing the game.
+//
+// A game owns its maps and buffers. It cannot be copied, but it can be
+// moved, which leaves the game moved from empty.
 class Civ2SavedGame
 {
     public:
 
         Civ2SavedGame();
-        ~Civ2SavedGame();
+        Civ2SavedGame(Civ2SavedGame&& other);
+        Civ2SavedGame& operator=(Civ2SavedGame&& other);
 
         void load(const string& filename) throw (runtime_error);
-        void save(const string& filename) throw (runtime_error);
+        void load(istream& is, bool mapOnly) throw (runtime_error);
+        void save(const string& filename) const throw (runtime_error);
+        void save(ostream& os) const throw (runtime_error);
+
+        // A snapshot holds everything load() found in a file in a form that
+        // can be read back without searching the file for its parts again.
+        // See Civ2SnapshotCache.
+        void saveSnapshot(ostream& os) const throw (runtime_error);
+        void loadSnapshot(istream& is) throw (runtime_error);
 
         void createMP(int width, int height) throw (runtime_error);
         void createSAV(int width, int height, int num_maps = 0) throw (runtime_error);
@@ -243,6 +428,7 @@ class Civ2SavedGame
         void removeMap(int n) throw (runtime_error);
 
         Civ2Map& getMap(int n) throw (runtime_error);
+        const Civ2Map& getMap(int n) const throw (runtime_error);
 
         struct StartPositions
         {
@@ -251,6 +437,7 @@ class Civ2SavedGame
         };
 
         StartPositions& getCivStart() throw (runtime_error);
+        const StartPositions& getCivStart() const throw (runtime_error);
         void setCivStart(const StartPositions& sp) throw (runtime_error);
 
         static bool isMPFile(string filename);
@@ -259,7 +446,24 @@ class Civ2SavedGame
 
         const char * getVersionString() const;
         bool isFlatEarth() const;
-        
+
+        // The rules used for calculations on this game's maps. Each map
+        // keeps its own copy of the terrain rules for its position, so they
+        // can only be replaced through setTerrainRules().
+        const Civ2Rules& getRules() const;
+        void setTerrainRules(int mapNum, const Civ2TerrainRules& r) throw (runtime_error);
+
+        // The unit and city records that follow the maps in a saved game.
+        // Each view is made when it is asked for and reads and writes the
+        // record where it lies in the post-map data; see Civ2Unit. An MP
+        // file, or a saved game whose records cannot be found, has none.
+        int getNumUnits() const;
+        int getNumCities() const;
+        Civ2Unit getUnit(int n) throw (runtime_error);
+        Civ2Unit getUnit(int n) const throw (runtime_error);
+        Civ2City getCity(int n) throw (runtime_error);
+        Civ2City getCity(int n) const throw (runtime_error);
+
     private:
         struct MapHeader
         {
@@ -283,21 +487,34 @@ class Civ2SavedGame
             throw(runtime_error);
 
         unsigned short loadMapSpecificSeed(istream& is) throw (runtime_error);
-        void saveMapSpecificSeed(ostream& os, unsigned short seed) throw (runtime_error);
+        void saveMapSpecificSeed(ostream& os, unsigned short seed) const throw (runtime_error);
 
         void loadStartPositions(istream& is) throw (runtime_error);
         void saveStartPositions(ostream& os) const throw (runtime_error);
 
-        void destroyMaps();
+        void checkSavable() const throw (runtime_error);
+        SmartPointer<Civ2Map> newMap(int position) const throw (runtime_error);
+        void renumberMaps(int from);
 
         int readDataBlock(istream& inputStream, 
-                          SmartPointer<char, true>& memory,
+                          PooledArray<char>& memory,
                           istream::pos_type start, istream::pos_type end);
 
+        // Find the unit and city records in the post-map data, and tell each
+        // map where its cities are. Called once the file is loaded.
+        void findRecords();
+        void findCitySquares();
+
+        // Called by friend Civ2City when a record's square or owner changes
+        void forgetCitySquares();
+        friend class Civ2City;
+
 
-        SmartPointer<MapHeader> header;
-        SmartPointer<StartPositions> start_positions;
-        vector<Civ2Map*> maps;
+        // These and the buffers of the maps come from the thread's
+        // BufferPool, if it has one
+        PooledArray<MapHeader> header;
+        PooledArray<StartPositions> start_positions;
+        vector< SmartPointer<Civ2Map> > maps;
 
         bool isMP;
 
@@ -312,13 +529,26 @@ class Civ2SavedGame
 		unsigned short secondary_maps;
 
         // The non-Map related data from Civ 2 .SAV file.
-        SmartPointer<char, true> preMapData;
+        PooledArray<char> preMapData;
         int preMapDataSize;
 
-        SmartPointer<char, true> postMapData;
+        PooledArray<char> postMapData;
         int postMapDataSize;
 
+        // Where the unit and city records are in postMapData, how many
+        // there are and the size of each, from findRecords()
+        int units_offset;
+        int num_units;
+        int unit_size;
+        int cities_offset;
+        int num_cities;
+        int city_size;
+
         Civ2Rules rules;
+
+        // Not copyable
+        Civ2SavedGame(const Civ2SavedGame&);
+        Civ2SavedGame& operator=(const Civ2SavedGame&);
 };
 
 // Civ2Map
@@ -326,16 +556,24 @@ class Civ2SavedGame
 // For TOT saved games, there could be multiple maps per saved game.
 // Civ2SavedGame is a friend of Civ2Map, and only Civ2SavedGame is allowed
 // to construct a Civ2Map object.
+// As with Civ2SavedGame, the const methods may be called from several
+// threads at once. A map owns its squares and a copy of its terrain rules,
+// and does not refer back to its game, so it can be moved but not copied.
+// Its squares may share memory with other maps through shareLayer(), which
+// is safe across threads too, since shared memory is only ever read.
 class Civ2Map
 {
     public:
 
+        Civ2Map(Civ2Map&& other) = default;
+        Civ2Map& operator=(Civ2Map&& other) = default;
+
 
         enum Civilization { RED=0, WHITE, GREEN, BLUE, YELLOW, CYAN, ORANGE, PURPLE,
                             ALL };
 
         void load(istream& is) throw (runtime_error);
-        void save(ostream& os) throw (runtime_error);
+        void save(ostream& os) const throw (runtime_error);
 
         int getWidth() const throw (runtime_error);
         int getHeight() const throw (runtime_error);
@@ -363,6 +601,8 @@ class Civ2Map
 
         bool isRiver(int x, int y) const throw (runtime_error);
         void setRiver(int x, int y, bool river) throw(runtime_error);
+        bool hasTotTerrainFlag(int x, int y) const throw (runtime_error);
+        void setTotTerrainFlag(int x, int y, bool flag) throw(runtime_error);
         bool isResourceHidden(int x, int y) const throw(runtime_error);
         void setResourceHidden(int x, int y, bool hidden) throw(runtime_error);
 
@@ -370,16 +610,115 @@ class Civ2Map
         void setFertility(int x, int y, unsigned char) throw (runtime_error);
         void calcFertility(int x, int y) throw (runtime_error);
 
+        // The two halves of calcFertility(): gathering the production around
+        // a square, and combining it into a fertility value. value, if given,
+        // receives the combined value before rounding.
+        FertilityYields calcFertilityYields(int x, int y) const throw (runtime_error);
+        static unsigned char combineFertility(const FertilityYields& yields,
+                                              const FertilityWeights& weights,
+                                              float *value = NULL);
+
         void adjustFertility(int x, int y) throw (runtime_error);
 
+        // Have calcFertility() record each square it calculates in trace.
+        // The trace is not owned by the map. Passing NULL stops recording.
+        void setFertilityTrace(Civ2FertilityTrace *trace);
+
+        // Whether a city is close enough to a square for adjustFertility()
+        // to lower its fertility
+        bool isNearCity(int x, int y) const throw (runtime_error);
+
+        // How close that is. It appears that this is not the city radius,
+        // but one more ring outside of that.
+        static const int CITY_ADJUST_RADIUS = 3;
+
+        // A city on the map, and the civilization owning it
+        struct City
+        {
+            int x;
+            int y;
+            Civilization owner;
+        };
+
+        // The cities of the map, as found from the city records of its
+        // saved game, so that work done around cities need not search the
+        // map for them. Returns false if they are not known: on an MP file,
+        // once a city has been added to or removed from the map's
+        // improvements, or once a city record has been moved or has changed
+        // hands through Civ2City.
+        bool getRecordedCities(vector<City>& cities) const;
+
+        // The cities of the map, from the city records if they are known,
+        // and otherwise from the squares with the city improvement, each
+        // owned by the owner of its square
+        void getCities(vector<City>& cities) const throw (runtime_error);
+
+        // The squares a city can work are those this close to it
+        static const int CITY_WORK_RADIUS = 2;
+
+        // Rebuild the city radius or the ownership of every square from the
+        // cities of the map. A square within CITY_WORK_RADIUS of a city gets
+        // the civilization of the nearest one, or if several are as near,
+        // the first of them. Any other square gets a city radius of 0, and
+        // is owned by no one.
+        void calcCityRadius() throw (runtime_error);
+        void calcOwnership() throw (runtime_error);
+
+        // Rebuild the body counter of every square, as the Map Editor's
+        // "analyze map" does. Squares of land, or of ocean, that touch, even
+        // at a corner, are one body, going round the edge of a round map.
+        // Land and ocean bodies are numbered apart from 1, in the order
+        // their first squares are stored. Bodies of ocean smaller than
+        // MIN_OCEAN_BODY squares, and any past the 62nd, get NO_BODY.
+        void calcBodyCounters() throw (runtime_error);
+        static const int MIN_OCEAN_BODY = 9;
+        static const unsigned char NO_BODY = 63;
+
+        // Bulk access to the fertility of every square, one value per square
+        // in the order squares are stored in the file.
+        void getFertilityPlane(vector<unsigned char>& plane) const throw (runtime_error);
+        void setFertilityPlane(const vector<unsigned char>& plane) throw (runtime_error);
+
+        // The parts of each square that can be read or written in bulk.
+        // Terrain, improvements, visibility, body counter and city radius
+        // are the bytes stored in the file; ownership and fertility are
+        // 0-15.
+        enum Layer { TERRAIN_LAYER = 0, IMPROVEMENT_LAYER, VISIBILITY_LAYER,
+                     BODY_COUNTER_LAYER, CITY_RADIUS_LAYER, OWNERSHIP_LAYER,
+                     FERTILITY_LAYER, NUM_LAYERS };
+
+        // The number of squares, which is the size of a layer
+        int getArea() const throw (runtime_error);
+
+        // Copy a layer to or from data, which holds getArea() values in the
+        // order squares are stored in the file
+        void getLayer(Layer layer, unsigned char *data) const throw (runtime_error);
+        void setLayer(Layer layer, const unsigned char *data) throw (runtime_error);
+
+        // Make a layer the same as that of source, a map of the same size,
+        // by sharing source's copy of it. Neither map really copies the layer
+        // until it is changed in that map. Ownership and fertility are kept
+        // in the same bytes, so sharing either of them shares both.
+        void shareLayer(const Civ2Map& source, Layer layer) throw (runtime_error);
+        void shareCivView(const Civ2Map& source) throw (runtime_error);
+
+        // Whether the map has the same size as another
+        bool isSameSize(const Civ2Map& other) const;
+
+        // Add everything calcFertility() and adjustFertility() depend on to a
+        // content digest. Without the cities, only what calcFertility()
+        // depends on is added.
+        void addFertilityInputsToHash(Hash64& h, bool includeCities = true) const throw (runtime_error);
+
         Civilization getOwnership(int x, int y) const throw (runtime_error);
         void setOwnership(int x, int y, Civilization civ) throw (runtime_error);
 
-        bool hasGrasslandShield(int x, int y) throw (runtime_error);
+        bool hasGrasslandShield(int x, int y) const throw (runtime_error);
 
         Civ2TerrainRules& getTerrainRules();
+        const Civ2TerrainRules& getTerrainRules() const;
 
-        bool isFlat() throw (runtime_error);
+        bool isFlat() const throw (runtime_error);
 
         // Class to iterate through squares in a ring pattern
         // around a center point, like in the city radius/adjust radius
@@ -387,9 +726,9 @@ class Civ2Map
         {
             public:
                 
-                int getX();
-                int getY();
-                int getDistance();
+                int getX() const;
+                int getY() const;
+                int getDistance() const;
                 void reset();
 
                 RingIterator& operator++() throw (runtime_error) // Prefix operator
@@ -408,7 +747,7 @@ class Civ2Map
                 // Copy constructor
                 RingIterator(const RingIterator& ri);
 
-                RingIterator(int x, int y, Civ2Map& map);
+                RingIterator(int x, int y, const Civ2Map& map);
             private:
                
                 int centerX;
@@ -419,40 +758,32 @@ class Civ2Map
                 int endRingY;
                 int curX;
                 int curY;
-                Civ2Map& map;
+                const Civ2Map& map;
                 bool atCorner;
                 void moveToNextPoint() throw (runtime_error);
                 bool movePoint(int &x, int&y, const int& direction, const int &distance);
         };
 
     private:
-        struct TerrainCell
-        {
-            unsigned char terrainType;
-            unsigned char improvements;
-            unsigned char city_radius;
-            unsigned char body_counter;
-            unsigned char visibility;
-            unsigned char fert_ownership; // upper nibble ownership
-                                          // lower nibble fertility
-
-            TerrainCell() 
-            {
-                terrainType = OCEAN; 
-                improvements = 0;
-                city_radius = 0;
-                body_counter = 0;
-                visibility = 0;
-                fert_ownership = 0xF0;
-            } 
-                        
+        // The six bytes of each square in the file. Each is kept in a plane
+        // of its own, so that a map copied from another can share the
+        // planes it copies whole.
+        enum Plane { TERRAIN_PLANE = 0, IMPROVEMENT_PLANE, CITY_RADIUS_PLANE,
+                     BODY_COUNTER_PLANE, VISIBILITY_PLANE,
+                     FERT_OWNERSHIP_PLANE, // upper nibble ownership
+                                           // lower nibble fertility
+                     NUM_PLANES };
 
-        };
         friend class Civ2SavedGame;    // Civ2Saved game is responsible for creating/
                                        // destroying Civ2Maps.
 
         Civ2Map(int x_dim, int y_dim, int area, bool has_civ_view_map,
-                int mapPos, bool flat_earth, Civ2Rules& rules) throw (runtime_error); 
+                int mapPos, bool flat_earth, const Civ2TerrainRules& rules)
+            throw (runtime_error);
+
+        // Move the map to another position in its game, which uses the
+        // terrain rules for that position
+        void setPosition(int mapPos, const Civ2TerrainRules& rules);
 
         void loadCivViewMap(istream& is) throw (runtime_error);
         void saveCivViewMap(ostream& os) const throw (runtime_error);
@@ -460,15 +791,29 @@ class Civ2Map
         void loadTerrainMap(istream& is) throw(runtime_error);
         void saveTerrainMap(ostream& os) const throw(runtime_error);
 
+        static Plane getPlane(Layer layer) throw (runtime_error);
+
         int XYtoOffset(int x, int y) const throw (runtime_error);
 
+        // The number of squares with the city improvement
+        int countCities() const;
+
+        // The civilization that calcCityRadius() gives each square, in file
+        // order, or -1 for none
+        void getCityRadiusCivs(vector<signed char>& civs) const throw (runtime_error);
+
+        // The ownership of a square owned by no one
+        static const unsigned char NO_OWNER = 0x0F;
+
         int XYtoCivViewOffset(int x, int y, Civilization c) const throw (runtime_error);
 
         void initResourceMap() throw (runtime_error);
 
-        SmartPointer<TerrainCell,true> terrain_map;
-        SmartPointer<unsigned char,true> civ_view_map;
-        SmartPointer<unsigned char, true> resource_map;
+        // The squares, and what each civilization last saw of them. These
+        // may be shared with other maps; see shareLayer().
+        SharedArray<unsigned char> planes[NUM_PLANES];
+        SharedArray<unsigned char> civ_view_map;
+        PooledArray<unsigned char> resource_map;
 
         // Bit fields in resource_map;
         static const unsigned char GRASS_SHIELD_FLAG = 0x01;
@@ -489,7 +834,14 @@ class Civ2Map
         unsigned char map_position;
 
         // Terrain rules specific to this map
-        Civ2Rules& rules;
+        Civ2TerrainRules terrain_rules;
+
+        // Where calcFertility() records its work, if anywhere
+        Civ2FertilityTrace *fert_trace;
+
+        // The cities, if known; see getRecordedCities()
+        vector<City> recorded_cities;
+        bool cities_known;
 };
 #endif
 
@@ -0,0 +1,2462 @@
+/*
+ * The contents of this file are subject to the Mozilla Public
+ * License Version 1.1 (the "License"); you may not use this file
+ * except in compliance with the License. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS
+ * IS" basis, WITHOUT WARRANTY OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * rights and limitations under the License.
+ *
+ * The Original Code is MapCopy, a copy utility for Civ2 maps and saved games.
+ *
+ * The Initial Developer of the Original Code is James Dustin Reichwein.
+ * Portions created by James Dustin Reichwein are
+ * Copyright (C) 2000,2005, James Dustin Reichwein.  All
+ * Rights Reserved.
+ *
+ * Contributor(s):
+ */
+
+
+// copyjob.cpp
+// Description:  A single MapCopy copy operation: its options, and the code
+//               that carries it out.
+//
+// Creation Date: Oct/18/2026
+//
+// Revision History:
+// Oct/18/2026       Moved from mapcopy.cpp, so that one process can run
+//                   more than one copy.
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include <exception>
+#include "copyjob.h"
+#include "bufpool.h"
+#include "snapcache.h"
+
+namespace
+{
+    // The size used for the buffer used when backing up
+    unsigned int BACKUP_BUFFER_SIZE = 1024;
+
+    // Load a file into game. With a snapshot cache, an unchanged file is
+    // loaded from its snapshot.
+    void loadGameFile(Civ2SavedGame& game, const string& filename,
+                      const FileStamp& stamp, Civ2SnapshotCache *snapshots)
+        throw (runtime_error)
+    {
+        if (snapshots == NULL)
+        {
+            game.load(filename);
+            return;
+        }
+
+        if (snapshots->lookup(filename, stamp, game)) return;
+
+        string data;
+        {
+            ifstream file(filename.c_str(), ios_base::binary);
+            if (!file) throw runtime_error(string("Could not open file: ") + filename);
+
+            ostringstream contents;
+            contents << file.rdbuf();
+            data = contents.str();
+        }
+
+        Hash64 digest;
+        digest.add(data.data(), data.size());
+        if (snapshots->lookup(filename, stamp, digest, game)) return;
+
+        memoryBuf buf(data.data(), data.size());
+        istream is(&buf);
+        try
+        {
+            game.load(is, Civ2SavedGame::isMPFile(filename));
+        }
+        catch (runtime_error& e)
+        {
+            throw runtime_error(string("File: ") + filename + " " + e.what());
+        }
+
+        // A cache that can't be written to only costs time
+        try
+        {
+            snapshots->store(filename, stamp, digest, game);
+        }
+        catch (runtime_error& e)
+        {
+            LogOutput::log(NORMAL) << "Warning: " << e.what() << endl;
+        }
+    }
+
+    // Wraps x around a round map. Returns false if x,y is off the map.
+    bool wrapSquare(const Civ2Map& map, int& x, int y) throw (runtime_error)
+    {
+        if (y < 0 || y >= map.getHeight()) return false;
+        if (x >= 0 && x < map.getWidth()) return true;
+        if (map.isFlat()) return false;
+
+        x %= map.getWidth();
+        if (x < 0) x += map.getWidth();
+        return true;
+    }
+
+    // The first x in a row of a window that is a square of the map, since
+    // x + y must be even
+    int getFirstX(int x1, int y)
+    {
+        return x1 + ((x1 + y) & 1);
+    }
+
+    // Add everything that would be saved from a game to a digest
+    void addGameToHash(const Civ2SavedGame& game, Hash64& h) throw (runtime_error)
+    {
+        hashBuf buf(h);
+        ostream os(&buf);
+        game.saveSnapshot(os);
+    }
+}
+
+/////////////////////// CopyContext Methods ////////////////////////////////
+
+CopyContext::CopyContext()
+: source_loads(0), source_hits(0), calculated_count(0), calculated_hits(0),
+  quiet(false), log_stream(NULL)
+{
+}
+
+CopyContext::~CopyContext()
+{
+    // Deleting a cache writes its index
+    for (map<string, Civ2FertilityCache*>::iterator i = fert_caches.begin();
+         i != fert_caches.end(); ++i)
+    {
+        delete i->second;
+    }
+    for (map<string, Civ2SnapshotCache*>::iterator i = snapshot_caches.begin();
+         i != snapshot_caches.end(); ++i)
+    {
+        delete i->second;
+    }
+}
+
+shared_ptr<Civ2SavedGame> CopyContext::getSource(const string& filename,
+                                                 Civ2SnapshotCache *snapshots)
+    throw (runtime_error)
+{
+    {
+        lock_guard<mutex> guard(context_lock);
+
+        for (list<LoadedSource>::iterator i = sources.begin(); i != sources.end(); ++i)
+        {
+            if (i->name == filename)
+            {
+                // Something else may have changed the file since it was
+                // loaded
+                if (!isSameVersion(filename, i->version))
+                {
+                    sources.erase(i);
+                    break;
+                }
+
+                // Move it to the front of the list, since it's now the most
+                // recently used
+                sources.splice(sources.begin(), sources, i);
+                source_hits++;
+
+                LogOutput::log(NORMAL) << "Using loaded file: " << filename << endl;
+                return sources.front().game;
+            }
+        }
+    }
+
+    // The file is loaded without holding the lock, so that other threads
+    // can use the context in the meantime.
+    LogOutput::log(NORMAL) << "Loading File: " << filename << endl;
+
+    FileVersion version = getFileVersion(filename);
+    shared_ptr<Civ2SavedGame> game(new Civ2SavedGame());
+    loadGameFile(*game, filename, version.stamp, snapshots);
+    logFileDetails(*game);
+
+    lock_guard<mutex> guard(context_lock);
+    source_loads++;
+
+    // Another thread may have loaded the same file in the meantime. Keep
+    // whichever is already in the list.
+    for (list<LoadedSource>::iterator i = sources.begin(); i != sources.end(); ++i)
+    {
+        if (i->name == filename) return i->game;
+    }
+
+    if (sources.size() >= MAX_SOURCES) sources.pop_back();
+
+    LoadedSource s;
+    s.name = filename;
+    s.version = version;
+    s.game = game;
+    sources.push_front(s);
+
+    return game;
+}
+
+void CopyContext::fileWritten(const string& filename)
+{
+    lock_guard<mutex> guard(context_lock);
+
+    for (list<LoadedSource>::iterator i = sources.begin(); i != sources.end(); ++i)
+    {
+        if (i->name == filename)
+        {
+            sources.erase(i);
+            return;
+        }
+    }
+}
+
+Civ2FertilityCache& CopyContext::getFertilityCache(const string& directory,
+                                                   unsigned long maxBytes)
+    throw (runtime_error)
+{
+    lock_guard<mutex> guard(context_lock);
+
+    map<string, Civ2FertilityCache*>::iterator found = fert_caches.find(directory);
+    if (found != fert_caches.end()) return *(found->second);
+
+    Civ2FertilityCache *cache = new Civ2FertilityCache(directory, maxBytes);
+    fert_caches[directory] = cache;
+    return *cache;
+}
+
+Civ2SnapshotCache& CopyContext::getSnapshotCache(const string& directory,
+                                                 unsigned long maxBytes)
+    throw (runtime_error)
+{
+    lock_guard<mutex> guard(context_lock);
+
+    map<string, Civ2SnapshotCache*>::iterator found = snapshot_caches.find(directory);
+    if (found != snapshot_caches.end()) return *(found->second);
+
+    Civ2SnapshotCache *cache = new Civ2SnapshotCache(directory, maxBytes);
+    snapshot_caches[directory] = cache;
+    return *cache;
+}
+
+void CopyContext::flushCaches() throw (runtime_error)
+{
+    lock_guard<mutex> guard(context_lock);
+
+    for (map<string, Civ2FertilityCache*>::iterator i = fert_caches.begin();
+         i != fert_caches.end(); ++i)
+    {
+        i->second->flush();
+    }
+    for (map<string, Civ2SnapshotCache*>::iterator i = snapshot_caches.begin();
+         i != snapshot_caches.end(); ++i)
+    {
+        i->second->flush();
+    }
+}
+
+bool CopyContext::findCalculatedFertility(const Hash64& digest,
+                                          vector<unsigned char>& plane)
+{
+    unique_lock<mutex> guard(context_lock);
+
+    while (true)
+    {
+        map<unsigned long long, vector<unsigned char> >::iterator found =
+            calculated.find(digest.getValue());
+        if (found != calculated.end())
+        {
+            plane = found->second;
+            calculated_hits++;
+            return true;
+        }
+
+        if (calculating.count(digest.getValue()) == 0)
+        {
+            calculating.insert(digest.getValue());
+            return false;
+        }
+
+        calculationDone.wait(guard);
+    }
+}
+
+void CopyContext::storeCalculatedFertility(const Hash64& digest,
+                                           const vector<unsigned char>& plane)
+{
+    lock_guard<mutex> guard(context_lock);
+
+    if (calculated.size() >= MAX_CALCULATED) calculated.erase(calculated.begin());
+    calculated[digest.getValue()] = plane;
+    calculated_count++;
+
+    calculating.erase(digest.getValue());
+    calculationDone.notify_all();
+}
+
+void CopyContext::abandonCalculatedFertility(const Hash64& digest)
+{
+    lock_guard<mutex> guard(context_lock);
+
+    calculating.erase(digest.getValue());
+    calculationDone.notify_all();
+}
+
+bool CopyContext::findMemo(const string& memoFile, const Hash64& key)
+    throw (runtime_error)
+{
+    lock_guard<mutex> guard(context_lock);
+
+    map<string, set<unsigned long long> >::iterator found = memos.find(memoFile);
+    if (found == memos.end())
+    {
+        // A missing memo file is just an empty memo
+        set<unsigned long long>& entries = memos[memoFile];
+
+        ifstream theFile(memoFile.c_str());
+        string entry;
+        while (theFile >> entry) entries.insert(strtoull(entry.c_str(), NULL, 16));
+
+        found = memos.find(memoFile);
+    }
+
+    return found->second.count(key.getValue()) > 0;
+}
+
+void CopyContext::storeMemo(const string& memoFile, const Hash64& key)
+    throw (runtime_error)
+{
+    lock_guard<mutex> guard(context_lock);
+
+    if (!memos[memoFile].insert(key.getValue()).second) return;
+
+    ofstream theFile(memoFile.c_str(), ios_base::out | ios_base::app);
+    theFile << key.toString() << "\n";
+    if (!theFile) throw runtime_error("Could not write memo file: " + memoFile);
+}
+
+int CopyContext::getSourceLoads() const
+{
+    lock_guard<mutex> guard(context_lock);
+    return source_loads;
+}
+
+int CopyContext::getSourceHits() const
+{
+    lock_guard<mutex> guard(context_lock);
+    return source_hits;
+}
+
+int CopyContext::getCalculatedFertilityCount() const
+{
+    lock_guard<mutex> guard(context_lock);
+    return calculated_count;
+}
+
+int CopyContext::getCalculatedFertilityHits() const
+{
+    lock_guard<mutex> guard(context_lock);
+    return calculated_hits;
+}
+
+/////////////////////// CopyJob Methods ////////////////////////////////
+
+// Default option values
+const CopyJob::OP_VALUE CopyJob::defaults[CopyJob::NUM_OPTIONS][CopyJob::NUM_TYPES] =
+{
+    //                  MP->MP   SAV->SAV   MP->SAV   SAV->MP, MP,  SAV
+    /* seed */        { COPY,    COPY,      COPY,     COPY,    OFF, OFF},
+    /* terrain */     { COPY,    COPY,      COPY,     COPY,    OFF, OFF},
+    /* improvement */ { COPY,    OFF,       OFF,      OFF,     OFF, OFF},
+    /* visibility */  { COPY,    OFF,       OFF,      OFF,     OFF, OFF},
+    /* owenership */  { COPY,    OFF,       OFF,      OFF,     OFF, OFF},
+    /* civ_start  */  { COPY,    OFF,       OFF,      OFF,     OFF, OFF},
+    /* body_counter */{ COPY,    COPY,      COPY,     COPY,    OFF, OFF},
+    /* city_radius */ { COPY,    OFF,       OFF,      OFF,     OFF, OFF},
+    /* verbose */     { ON,      ON,        ON,       ON,      ON,  ON}, 
+    /* backup */      { ON,      ON,        ON,       ON,      ON,  ON}, 
+    /* fertility */   { COPY,    ADJUST,    CALC,     OFF,     OFF, OFF},
+    /* civ_view */    { OFF,     OFF,       OFF,      OFF,     OFF, OFF},
+    /* resource 
+       supression */  { COPY,    COPY,      COPY,     COPY,    OFF, OFF},
+    /* skip_unchanged*/{OFF,     OFF,       OFF,      OFF,     OFF, OFF}
+};
+
+CopyJob::CopyJob()
+: sourceFile(""), destFile(""), sourceMap(-1), destMap(-1), copy_type(MP2MP),
+  unchanged(false), memoFile(""), memoKeySet(false),
+  fertCacheDir(""), fertCacheMaxKB(16384), fertCache(NULL),
+  snapshotDir(""), snapshotMaxKB(65536), copyContext(NULL),
+  fertTraceFile(""), fertTraceWindowSet(false), fertTrace(NULL),
+  regionSet(false), stampSet(false)
+{
+    for (int i = 0; i < NUM_OPTIONS; i++) options[i] = OFF;
+}
+
+// Carry out the copy.  Source files are loaded through the context, so
+// that a file used by several jobs is only loaded once.
+void CopyJob::run(CopyContext& context) throw (runtime_error)
+{
+    load(context);
+    copy(context);
+    save(context);
+}
+
+// Back up the destination file (with +skip, save() does that instead), then
+// load the source file, and load or create the destination file
+void CopyJob::load(CopyContext& context) throw (runtime_error)
+{
+    // This tells the Civ2SavedGame objects whether to print detailed messages
+    LogOutput::Scope logScope(getLogSettings(context));
+
+    unchanged = false;
+    memoKeySet = false;
+
+    // With +skip, the backup waits until save() knows that the copy changed
+    // the destination
+    if (options[BACKUP] == ON && options[SKIP_UNCHANGED] != ON)
+    {
+        context.fileWritten(destFile + ".bak");
+        backupFile(destFile);
+    }
+
+    // Note what the destination looked like before loading it, so save()
+    // can tell if anything else changes it in the meantime
+    destVersion = getFileVersion(destFile);
+
+    // Skip a copy that the memo says changes nothing, without loading
+    // anything
+    if (!memoFile.empty() && destVersion.stamp.exists)
+    {
+        memoKeySet = getMemoKey(memoKey);
+        if (memoKeySet && context.findMemo(memoFile, memoKey))
+        {
+            LogOutput::log(NORMAL) << "Copy is known not to change " << destFile
+                                   << ", skipping it." << endl;
+            unchanged = true;
+            return;
+        }
+    }
+
+    loadSource(context);
+
+    destGame = new Civ2SavedGame();
+
+    // I'm using pointers for one and two so that for an inplace modification
+    // I can set the source (one) equal to the destination
+    Civ2SavedGame *two = destGame;
+    Civ2SavedGame *one = sourceGame ? sourceGame.get() : two;
+
+    // A destination built by steps is created the size of the first file
+    // they copy from
+    for (int i = 0; i < stepJobs.size() && one == two; i++)
+    {
+        if (stepJobs[i]->sourceGame) one = stepJobs[i]->sourceGame.get();
+    }
+
+    if (destVersion.stamp.exists)
+    {
+        LogOutput::log(NORMAL) << "Loading File: " << destFile << endl;
+        two->load(destFile);
+        logFileDetails(*two);
+
+        // Remember what it looked like, to tell whether the copy changes it
+        if (options[SKIP_UNCHANGED] == ON)
+        {
+            destDigest = Hash64();
+            addGameToHash(*two, destDigest);
+        }
+    }
+    else if (one == two)
+    {
+        throw runtime_error(string("File ") + destFile + " must exist for in place modification.");
+    }
+    else if (Civ2SavedGame::isMPFile(destFile))
+    {
+        LogOutput::log(NORMAL) << "Creating MP File: " << destFile << endl;
+        two->createMP(one->getWidth(), one->getHeight());
+    }
+    else
+    {
+        LogOutput::log(NORMAL) << "Creating SAV File: " << destFile << endl;
+        two->createSAV(one->getWidth(), one->getHeight());
+    }
+}
+
+// Load only the source file, for a job that will take its destination from
+// the job before it
+void CopyJob::loadSource(CopyContext& context) throw (runtime_error)
+{
+    // This tells the Civ2SavedGame objects whether to print detailed messages
+    LogOutput::Scope logScope(getLogSettings(context));
+
+    // Load a source file if one is provided
+    if (copy_type != MP && copy_type != SAV) 
+    {
+        sourceGame = context.getSource(sourceFile, getSnapshotCache(context));
+    }
+
+    for (int i = 0; i < stepJobs.size(); i++) stepJobs[i]->loadSource(context);
+}
+
+// Returns the snapshot cache the job loads files through, or NULL if it does
+// not use one
+Civ2SnapshotCache *CopyJob::getSnapshotCache(CopyContext& context) const
+    throw (runtime_error)
+{
+    if (snapshotDir.empty()) return NULL;
+    return &context.getSnapshotCache(snapshotDir, snapshotMaxKB * 1024);
+}
+
+// The job's key in the memo: a digest of its options and of the contents of
+// its source, destination and rules files. Returns false if a file could not
+// be read. A job that records a fertility trace is never remembered, since
+// skipping it would leave the trace unwritten.
+bool CopyJob::getMemoKey(Hash64& key) const
+{
+    if (!fertTraceFile.empty()) return false;
+
+    // The key would have to hold every step's file as well
+    if (!stepJobs.empty()) return false;
+
+    key = Hash64();
+    key.addValue(copy_type);
+    key.addValue(sourceMap);
+    key.addValue(destMap);
+    key.addValue(regionSet);
+    key.addValue(stampSet);
+    for (int i = 0; i < 4; i++) key.addValue(regionSet ? region[i] : 0);
+    for (int i = 0; i < 2; i++) key.addValue(stampSet ? stamp[i] : 0);
+
+    // Verbosity and backups don't change the results
+    for (int i = 0; i < NUM_OPTIONS; i++)
+    {
+        if (i != VERBOSE && i != BACKUP) key.addValue(options[i]);
+    }
+
+    if (!isInPlace() && !key.addFile(sourceFile)) return false;
+    if (!key.addFile(destFile)) return false;
+
+    for (int i = 0; i < NUM_RULES_FILES; i++)
+    {
+        key.addString(rulesFiles[i]);
+        if (!rulesFiles[i].empty() && !key.addFile(rulesFiles[i])) return false;
+    }
+
+    return true;
+}
+
+// Take over the loaded destination of a job that has been copied but not
+// saved.
+void CopyJob::takeDestination(CopyJob& previous) throw (runtime_error)
+{
+    if (previous.destGame.isNull()) throw runtime_error("Copy job has not been loaded.");
+
+    destGame = move(previous.destGame);
+    destVersion = previous.destVersion;
+    destDigest = previous.destDigest;
+    unchanged = false;
+}
+
+// Copy from the loaded source to the loaded destination
+void CopyJob::copy(CopyContext& context) throw (runtime_error)
+{
+    if (unchanged) return;
+    if (destGame.isNull()) throw runtime_error("Copy job has not been loaded.");
+
+    Civ2SavedGame *two = destGame;
+    Civ2SavedGame *one = sourceGame ? sourceGame.get() : two;
+
+    // The steps go first, so that the job's own options, such as a
+    // fertility calculation, are applied once all of them are done
+    for (int i = 0; i < stepJobs.size(); i++)
+    {
+        CopyJob& step = *stepJobs[i];
+        {
+            LogOutput::Scope logScope(getLogSettings(context));
+            if (step.sourceGame)
+            {
+                LogOutput::log(NORMAL) << "Copying layers from " << step.sourceFile << endl;
+            }
+            else LogOutput::log(NORMAL) << "Modifying " << destFile << " in place" << endl;
+        }
+
+        step.copyGames(context, step.sourceGame ? *step.sourceGame : *two, *two);
+        step.sourceGame.reset();
+    }
+
+    // Once the steps are done, there is only more to do if the job was
+    // given copy options of its own
+    if (stepJobs.empty() || setsMapOptions()) copyGames(context, *one, *two);
+
+    // The source is no longer needed
+    sourceGame.reset();
+}
+
+// Copy between two games in memory. source and dest are the same game for
+// an in place modification.
+void CopyJob::copyGames(CopyContext& context, const Civ2SavedGame& source,
+                        Civ2SavedGame& dest) throw (runtime_error)
+{
+    LogOutput::Scope logScope(getLogSettings(context));
+
+    const Civ2SavedGame *one = &source;
+    Civ2SavedGame *two = &dest;
+
+    copyContext = &context;
+    fertCache = NULL;
+    if (!fertCacheDir.empty())
+    {
+        fertCache = &context.getFertilityCache(fertCacheDir, fertCacheMaxKB * 1024);
+    }
+
+    SmartPointer<Civ2FertilityTrace> trace;
+    if (!fertTraceFile.empty())
+    {
+        trace = new Civ2FertilityTrace(fertTraceFile);
+        if (fertTraceWindowSet)
+        {
+            trace->setWindow(fertTraceWindow[0], fertTraceWindow[1],
+                             fertTraceWindow[2], fertTraceWindow[3]);
+        }
+    }
+    fertTrace = trace;
+
+    // Confirm maps are the same size. A stamp goes anywhere in a larger
+    // map.
+    if (!stampSet && (one->getWidth() != two->getWidth() ||
+                      one->getHeight() != two->getHeight()))
+    {
+        throw runtime_error("Both maps must be the same size!");
+    }
+
+    loadRulesFiles(*two);
+
+    // Setup default for ToT to ToT copies to be "all"
+  
+    setMapDefaults(one->supportsMultiMaps(), two->supportsMultiMaps());
+
+    // Check for an ALL copy that would require a non-ToT saved game
+    // to support multiple maps
+    if (sourceMap == 0 && sourceMap > two->getNumMaps()&& two->supportsMultiMaps() == false)
+    {
+        throw runtime_error("Cannot create multiple maps in a non-ToT saved game.");
+    }
+
+    // Check for a map to map copy that would require a non-ToT saved game
+    // to support multiple maps
+    if(destMap > 1 && two->supportsMultiMaps() == false)
+    {
+        throw runtime_error("Cannot create multiple maps in a non-ToT saved game.");
+    }
+
+    // Check for a non-existant source map
+    if (sourceMap > one->getNumMaps()) 
+    {
+        throw runtime_error("Map specified with +sm does not exist within source file.");
+    }
+
+    // Check for a copy that creates a "gap" in the destination
+    if (destMap > two->getNumMaps() + 1) 
+    {
+        throw runtime_error("Cannot create a gap between maps in a ToT saved game.");
+    }
+
+    // Copy main resource seed. It, and the civ start positions, belong to
+    // the whole map, so a region is copied without them.
+    if (options[SEED]==COPY && isWholeMapCopy()) two->setSeed(one->getSeed());
+
+    // Copy civilization start positions
+    if (options[CIV_START] == COPY && isWholeMapCopy())
+    {
+        two->setCivStart(one->getCivStart());
+    }
+
+
+    // There are three types of copies.
+
+    // First type: Copying one source map into one destination map
+    if (sourceMap > 0 && destMap > 0)
+    {
+        // Note sourceMap and destMap are one based, while the indices
+        // used by addMap() and getMap() are zero based.
+
+        if (destMap > two->getNumMaps())
+        {
+            LogOutput::log(NORMAL) << "Adding map " << destMap << " to " << destFile << endl;
+
+            two->addMap(destMap  - 1); // Add additional map to destination
+                                      // if needed
+        }
+
+        LogOutput::log(NORMAL) << "Copying map " << sourceMap << " to " << destMap << endl;            
+
+        // Do the actual copy.
+        doMapCopy(one->getMap(sourceMap - 1), two->getMap(destMap - 1));
+
+    }
+    // Second type: Copying multiple source maps into the destination file
+    else if (sourceMap == 0 && destMap == 0)
+    {
+        vector<int> sources;
+        for (int i = 0; i < one->getNumMaps(); i++) sources.push_back(i);
+
+        copyMaps(*one, *two, sources);
+    }
+    // Copying one source map over all maps in the destination file
+    else if (sourceMap != 0 && destMap == 0)
+    {
+        vector<int> sources(two->getNumMaps(), sourceMap - 1);
+
+        copyMaps(*one, *two, sources);
+    }
+    else
+    {
+        // Really with all the error checking this should never happen.
+        // Of course, that means it will probably happen the first
+        // time I run the program.
+        stringstream message;
+        message << "Unrecognized copy type. sm = " << sourceMap << " dm = " << destMap;
+        throw runtime_error(message.str());
+    }
+
+    // if the destination does not support multiple maps, its main map
+    // seed should be set to that of its only map. This is because
+    // non-ToT saved game files (and .MPs) don't support a map specific
+    // resource seed
+    if (two->supportsMultiMaps() == false && options[SEED] == COPY)
+    {
+        two->setSeed(two->getMap(0).getSeed());
+    }
+            
+    if (!trace.isNull())
+    {
+        trace->flush();
+        LogOutput::log(NORMAL) << "Recorded " << trace->getCount()
+                               << " squares in " << fertTraceFile << endl;
+    }
+
+    fertTrace = NULL;
+    fertCache = NULL;
+    copyContext = NULL;
+}
+
+// Save the results into the destination file
+void CopyJob::save(CopyContext& context) throw (runtime_error)
+{
+    if (unchanged) return;
+    if (destGame.isNull()) throw runtime_error("Copy job has not been loaded.");
+
+    LogOutput::Scope logScope(getLogSettings(context));
+
+    // Don't overwrite changes made by another program since the destination
+    // was loaded
+    if (!isSameVersion(destFile, destVersion)) throw DestinationChanged(destFile);
+
+    // With +skip, leave the destination (and its backup) alone if the copy
+    // did not change it
+    if (options[SKIP_UNCHANGED] == ON && destVersion.stamp.exists)
+    {
+        Hash64 digest;
+        addGameToHash(*destGame, digest);
+
+        if (digest.getValue() == destDigest.getValue())
+        {
+            LogOutput::log(NORMAL) << "Copying did not change " << destFile
+                                   << ", not saving it." << endl;
+
+            // A memo that can't be written to only costs time
+            try
+            {
+                if (memoKeySet) context.storeMemo(memoFile, memoKey);
+            }
+            catch (runtime_error& e)
+            {
+                LogOutput::log(NORMAL) << "Warning: " << e.what() << endl;
+            }
+
+            unchanged = true;
+            destGame = NULL;
+            return;
+        }
+    }
+
+    // Without +skip, load() made the backup
+    if (options[BACKUP] == ON && options[SKIP_UNCHANGED] == ON)
+    {
+        context.fileWritten(destFile + ".bak");
+        backupFile(destFile);
+    }
+
+    context.fileWritten(destFile);
+    destGame->save(destFile);
+
+    destGame = NULL;
+}
+
+void CopyJob::unload()
+{
+    sourceGame.reset();
+    destGame = NULL;
+    for (int i = 0; i < stepJobs.size(); i++) stepJobs[i]->unload();
+}
+
+// The screen messages to match the verbose option
+LogOutput::Settings CopyJob::getLogSettings(const CopyContext& context) const
+{
+    LogOutput::Settings settings = LogOutput::getSettings();
+    settings.enabled.clear();
+
+    // Nothing may be logged by a quiet context
+    if (context.isQuiet()) return settings;
+
+    if (context.getLogStream() != NULL) settings.stream = context.getLogStream();
+
+    settings.enabled.resize(DEBUG + 1, false);
+    if (options[VERBOSE] == ON || options[VERBOSE] == DEV) settings.enabled[NORMAL] = true;
+    if (options[VERBOSE] == DEV) settings.enabled[DEBUG] = true;
+
+    return settings;
+}
+
+// Copies the maps of one given by sources into two: map i of two gets map
+// sources[i] of one, counting from 0. Maps two does not have yet are added.
+//
+// The maps are independent of each other, so when they need a fertility
+// pass, which is most of the work, each is done on a thread of its own.
+// Each map's messages are held back and shown in map order once all are
+// done, so the output is the same as when they are done one at a time.
+void CopyJob::copyMaps(const Civ2SavedGame& one, Civ2SavedGame& two,
+                       const vector<int>& sources) throw (runtime_error)
+{
+    int n = sources.size();
+
+    if (!isMapCopyParallel(n))
+    {
+        for (int i = 0; i < n; i++)
+        {
+            if (i >= two.getNumMaps())
+            {
+                LogOutput::log(NORMAL) << "Adding map " << i + 1 << " to " << destFile << endl;
+
+                two.addMap(i); // Add additional map to destination
+                               // if needed
+            }
+            LogOutput::log(NORMAL) << "Copying map " << sources[i] + 1 << " to " << i + 1 << endl;
+            doMapCopy(one.getMap(sources[i]), two.getMap(i));
+        }
+        return;
+    }
+
+    vector<ostringstream> logs(n);
+    LogOutput::Settings logSettings = LogOutput::getSettings();
+    shared_ptr<BufferPool> pool = BufferPool::getCurrent();
+
+    // Maps are added here, since that changes the game
+    for (int i = 0; i < n; i++)
+    {
+        logSettings.stream = &logs[i];
+        LogOutput::Scope logScope(logSettings);
+
+        if (i >= two.getNumMaps())
+        {
+            LogOutput::log(NORMAL) << "Adding map " << i + 1 << " to " << destFile << endl;
+            two.addMap(i);
+        }
+        LogOutput::log(NORMAL) << "Copying map " << sources[i] + 1 << " to " << i + 1 << endl;
+    }
+
+    vector<exception_ptr> errors(n);
+    vector<char> secondPass(n, 0);
+    vector<int> wave(n, 0);
+    int numWaves = 1;
+
+    // Runs step(i) on a thread for each map i in the given wave, or in every
+    // wave if wave is -1, that has not failed yet
+    auto runWave = [&](int w, const function<void (int)>& step)
+    {
+        vector<thread> threads;
+        for (int i = 0; i < n; i++)
+        {
+            if ((w != -1 && wave[i] != w) || errors[i]) continue;
+
+            threads.push_back(thread([&, i]()
+            {
+                LogOutput::Settings settings = logSettings;
+                settings.stream = &logs[i];
+                LogOutput::Scope logScope(settings);
+                BufferPool::Scope poolScope(pool);
+
+                try
+                {
+                    step(i);
+                }
+                catch (...)
+                {
+                    errors[i] = current_exception();
+                }
+            }));
+        }
+        for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+    };
+
+    runWave(-1, [&](int i)
+    {
+        secondPass[i] = copyMapSquares(one.getMap(sources[i]), two.getMap(i));
+    });
+
+    // Maps whose fertility would be calculated from the same inputs wait for
+    // a later wave, and use what the first of them calculated, just as they
+    // would one at a time
+    if (copyContext != NULL &&
+        (options[FERTILITY] == CALC || options[FERTILITY] == CALCALL))
+    {
+        vector<unsigned long long> digests;
+        for (int i = 0; i < n; i++)
+        {
+            if (errors[i] || !secondPass[i]) continue;
+
+            Hash64 digest;
+            digest.addValue(options[FERTILITY]);
+            two.getMap(i).addFertilityInputsToHash(digest, false);
+
+            wave[i] = count(digests.begin(), digests.end(), digest.getValue());
+            numWaves = max(numWaves, wave[i] + 1);
+            digests.push_back(digest.getValue());
+        }
+    }
+
+    for (int w = 0; w < numWaves; w++)
+    {
+        runWave(w, [&](int i)
+        {
+            if (secondPass[i]) doMapFertility(one.getMap(sources[i]), two.getMap(i));
+        });
+    }
+
+    // Show the messages up to the first map that failed, as if the maps
+    // had been copied in order
+    for (int i = 0; i < n; i++)
+    {
+        LogOutput::log(NORMAL) << logs[i].str();
+        if (errors[i]) rethrow_exception(errors[i]);
+    }
+}
+
+// Whether copyMaps() copies n maps on threads of their own. That is only
+// worth it when there is a fertility pass to do. A trace records squares
+// in the order they are calculated, so it needs the maps done in order.
+bool CopyJob::isMapCopyParallel(int n) const
+{
+    if (n < 2 || fertTrace != NULL || thread::hardware_concurrency() == 1)
+    {
+        return false;
+    }
+
+    return options[FERTILITY] == CALC || options[FERTILITY] == CALCALL ||
+           options[FERTILITY] == ADJUST;
+}
+
+// Performs a copy between two Civ2Map objects
+void CopyJob::doMapCopy(const Civ2Map& source, Civ2Map& dest) throw(runtime_error)
+{
+    if (copyMapSquares(source, dest)) doMapFertility(source, dest);
+}
+
+// The first pass of a copy between two maps, which copies each square.
+// Returns whether a second pass is needed for the fertility.
+bool CopyJob::copyMapSquares(const Civ2Map& source, Civ2Map& dest) throw(runtime_error)
+{
+    // Set to true if a second pass through the map is needed
+    bool secondPassNeeded = false;
+
+    // Copy map specific resource seed
+    if (options[SEED] == COPY && isWholeMapCopy()) dest.setSeed(source.getSeed());
+
+    // Layers copied whole are shared with the source rather than copied
+    // square by square. A map only gets its own copy of such a layer if it
+    // is changed later, so copying one source over many maps costs little
+    // memory for the maps nothing else changes. The terrain byte holds the
+    // resource flag too. The body counter and city radius are not shared,
+    // since copying them rewrites some of their bits.
+    bool sameSize = dest.isSameSize(source) && isWholeMapCopy();
+    bool shareTerrain = sameSize && options[TERRAIN] == COPY &&
+                        options[RESOURCE_SUP] == COPY;
+    bool shareImprovements = sameSize && options[IMPROVEMENT] == COPY;
+    bool shareVisibility = sameSize && options[VISIBILITY] == COPY;
+    bool shareFertility = sameSize && options[OWNERSHIP] == COPY &&
+                          options[FERTILITY] == COPY;
+    bool shareCivView = sameSize && options[CIV_VIEW] == COPY;
+
+    if (shareTerrain) dest.shareLayer(source, Civ2Map::TERRAIN_LAYER);
+    if (shareImprovements) dest.shareLayer(source, Civ2Map::IMPROVEMENT_LAYER);
+    if (shareVisibility) dest.shareLayer(source, Civ2Map::VISIBILITY_LAYER);
+    if (shareFertility) dest.shareLayer(source, Civ2Map::FERTILITY_LAYER);
+    if (shareCivView) dest.shareCivView(source);
+
+    // Iterate through the source squares to copy, copying info into the
+    // destination squares they go to.
+    // Note that due to the nature of Civ2 maps, not every combination
+    // of X and Y is valid.  Specifically, x+y must be even.
+    // Also note that this is going through the coordinate system as
+    // seen in Civ2, not in the MapEditor
+    Window w = getSourceWindow(source);
+    int dx = stampSet ? stamp[0] : 0;
+    int dy = stampSet ? stamp[1] : 0;
+
+    for (int sy = w.y1; sy <= w.y2; sy++)
+    {
+        for (int sx = getFirstX(w.x1, sy); sx <= w.x2; sx+=2)
+        {
+            int x = sx + dx;
+            int y = sy + dy;
+            if (!wrapSquare(dest, x, y)) continue;
+
+            // Terrain includes terrain type, and the river flag
+            if (options[TERRAIN]==COPY && !shareTerrain)
+            {
+                dest.setRiver(x, y, source.isRiver(sx, sy));
+                dest.setTerrainType(x, y, source.getTerrainType(sx, sy));
+                dest.setTotTerrainFlag(x, y, source.hasTotTerrainFlag(sx, sy));
+            }
+            if (options[IMPROVEMENT] == COPY && !shareImprovements)
+            {
+                dest.setImprovements(x, y, source.getImprovements(sx, sy));
+            }
+            // This governs what civs see what squares
+            if (options[VISIBILITY] == COPY && !shareVisibility)
+            {
+                dest.setVisibility(x, y, source.getVisibility(sx, sy));
+            }
+            if (options[OWNERSHIP] == COPY && !shareFertility)
+            {
+                dest.setOwnership(x, y, source.getOwnership(sx, sy));
+            }
+
+            // The body_counter is a # assigned to a continent. It
+            // can be calculated by the map editor by doing an analyze map
+            if (options[BODY_COUNTER] == COPY)
+            {
+                dest.setBodyCounter(x, y, source.getBodyCounter(sx, sy));
+            }
+
+            if (options[CITY_RADIUS] == COPY)
+            {
+                dest.setCityRadius(x, y, source.getCityRadius(sx, sy));
+            }
+
+            // Fertility is tricky.
+            switch (options[FERTILITY])
+            {
+                case COPY:
+                    if (!shareFertility)
+                    {
+                        dest.setFertility(x, y, source.getFertility(sx, sy));
+                    }
+                    break;
+
+                case CALC:
+                    secondPassNeeded = true;
+                    break;
+
+                case CALCALL:
+                    secondPassNeeded = true;
+                    break;
+
+                case ADJUST:                      
+                    secondPassNeeded = true;
+                    break;
+
+                case ZERO:
+                    dest.setFertility(x, y, 0);
+                    break;
+
+                default:
+                    // Assume off, don't copy
+                    break;
+            }
+
+            // "civ_view" is the improvement information that each civilization
+            // sees.  Each civilization only sees the terrain improvement info
+            // that was current when a unit was near that square.  Hence you
+            // need to reexplore to see what other civs have been up to.
+
+            // If the civ_view option is CURRENT, each civilization will see
+            // the most current improvement information
+            switch(options[CIV_VIEW])
+            {
+                case CURRENT:
+                    dest.setCivView(x, y, Civ2Map::ALL,
+                                   dest.getImprovements(x, y));
+                    break;
+
+                case COPY:
+                    if (shareCivView) break;
+
+                    dest.setCivView(x, y, Civ2Map::WHITE,
+                                   source.getCivView(sx, sy, Civ2Map::WHITE));
+                    dest.setCivView(x, y, Civ2Map::GREEN,
+                                   source.getCivView(sx, sy, Civ2Map::GREEN));
+                    dest.setCivView(x, y, Civ2Map::BLUE,
+                                   source.getCivView(sx, sy, Civ2Map::BLUE));
+                    dest.setCivView(x, y, Civ2Map::YELLOW,
+                                   source.getCivView(sx, sy, Civ2Map::YELLOW));
+                    dest.setCivView(x, y, Civ2Map::CYAN,
+                                   source.getCivView(sx, sy, Civ2Map::CYAN));
+                    dest.setCivView(x, y, Civ2Map::ORANGE,
+                                   source.getCivView(sx, sy, Civ2Map::ORANGE));
+                    dest.setCivView(x, y, Civ2Map::PURPLE,
+                                   source.getCivView(sx, sy, Civ2Map::PURPLE));
+                    break;
+
+                default: // Assume off
+                    break;
+            } // end switch on civ view
+
+            // The resource supression flag allows a resource
+            // that would be there based on the resource seed to be removed
+            // Command line arguments allow it to be copied, cleared (making
+            // all resources visible), or set (making all resources disappear)
+            switch (options[RESOURCE_SUP])
+            {
+                case COPY:
+                    if (!shareTerrain)
+                    {
+                        dest.setResourceHidden(x, y, source.isResourceHidden(sx, sy));
+                    }
+                    break;
+                case CLEAR:
+                    dest.setResourceHidden(x, y, false);
+                    break;
+                case SET:
+                    dest.setResourceHidden(x, y, true);
+                    break;
+                default: // assume off
+                    break;
+            } // end switch on resource supression
+        } // end inner for
+    } // end outer for
+
+    // The city radius and ownership are calculated from the cities once
+    // every square has been copied, since the cities may have been copied
+    // too, and the body counters from the terrain
+    if (options[CITY_RADIUS] == CALC) dest.calcCityRadius();
+    if (options[OWNERSHIP] == CALC) dest.calcOwnership();
+    if (options[BODY_COUNTER] == CALC) dest.calcBodyCounters();
+
+    return secondPassNeeded;
+}
+
+// Do a second pass for fertility calculations. Since the calculations
+// for a square depend on adjacent suqares, all squares be in their 
+// final state before calculations can be made. Hence a second pass is used.
+void CopyJob::doMapFertility(const Civ2Map& source, Civ2Map& dest) throw(runtime_error)
+{
+    // CALC and CALCALL results depend only on the destination map, so
+    // they can come from the fertility cache. A trace needs the
+    // calculations to actually be done, so it bypasses the cache. The
+    // cache only holds whole maps.
+    bool cacheable = fertCache != NULL && fertTrace == NULL && isWholeMapCopy() &&
+                     (options[FERTILITY] == CALC || options[FERTILITY] == CALCALL);
+    Hash64 digest;
+
+    if (cacheable && loadCachedFertility(dest, digest)) return;
+
+    // Only the squares near those copied can have changed
+    Window f = getFertilityWindow(source, dest);
+
+    if (options[FERTILITY] == ADJUST)
+    {
+        // Each square copied takes the fertility of its source square...
+        Window w = getSourceWindow(source);
+        int dx = stampSet ? stamp[0] : 0;
+        int dy = stampSet ? stamp[1] : 0;
+
+        for (int sy = w.y1; sy <= w.y2; sy++)
+        {
+            for (int sx = getFirstX(w.x1, sy); sx <= w.x2; sx+=2)
+            {
+                int x = sx + dx;
+                int y = sy + dy;
+                if (!wrapSquare(dest, x, y)) continue;
+
+                if (dest.getTerrainType(x, y) != OCEAN)
+                {
+                    dest.setFertility(x, y, source.getFertility(sx, sy));
+                }
+                else dest.setFertility(x, y, 0);
+            }
+        }
+
+        // ...and then it, and any square near a city copied with it, is
+        // adjusted. adjustFertility() only looks at nearby cities, so the
+        // order does not matter.
+        adjustMapFertility(dest, f, true);
+    }
+    else calcMapFertility(dest, f);
+
+    if (cacheable) storeCachedFertility(dest, digest);
+}
+
+// Does the CALC or CALCALL fertility calculation for a map. The calculation
+// is done for every square before any are adjusted for nearby cities, which
+// gives the same result as adjusting each square as it is calculated, since
+// calcFertility() does not look at the fertility of other squares. This
+// lets the unadjusted results be shared through the context with other
+// jobs whose maps have the same terrain, such as a fan-out copy of one
+// source into many destinations.
+//
+// Only the squares in w are calculated. The results are only shared when
+// that is the whole map.
+void CopyJob::calcMapFertility(Civ2Map& dest, const Window& w) throw (runtime_error)
+{
+    // A trace needs the calculations to actually be done
+    bool shared = copyContext != NULL && fertTrace == NULL && isWholeMapCopy();
+
+    Hash64 digest;
+    vector<unsigned char> plane;
+
+    if (shared)
+    {
+        digest.addValue(options[FERTILITY]);
+        dest.addFertilityInputsToHash(digest, false);
+    }
+
+    if (shared && copyContext->findCalculatedFertility(digest, plane))
+    {
+        dest.setFertilityPlane(plane);
+        LogOutput::log(NORMAL) << "Using previously calculated fertility." << endl;
+    }
+    else
+    {
+        try
+        {
+            dest.setFertilityTrace(fertTrace);
+
+            for (int y = w.y1; y <= w.y2; y++)
+            {
+                for (int i = getFirstX(w.x1, y); i <= w.x2; i+=2)
+                {
+                    int x = i;
+                    if (!wrapSquare(dest, x, y)) continue;
+
+                    Civ2TerrainType t = dest.getTerrainType(x, y);
+
+                    if (options[FERTILITY] == CALCALL ? (t != OCEAN) :
+                        (t == GRASSLAND || t == PLAINS))
+                    {
+                        dest.calcFertility(x, y);
+                    }
+                    else dest.setFertility(x, y, 0);
+                }
+            }
+
+            dest.setFertilityTrace(NULL);
+        }
+        catch (...)
+        {
+            dest.setFertilityTrace(NULL);
+            if (shared) copyContext->abandonCalculatedFertility(digest);
+            throw;
+        }
+
+        if (shared)
+        {
+            dest.getFertilityPlane(plane);
+            copyContext->storeCalculatedFertility(digest, plane);
+        }
+    }
+
+    adjustMapFertility(dest, w, false);
+}
+
+// Adjusts the squares in w for nearby cities, either every land square, or
+// every square whose fertility is above 7, which are the only ones
+// adjustFertility() changes. It also leaves squares with no city nearby
+// alone, so when the whole map is being done and the map knows where its
+// cities are from the city records, only the squares around its cities
+// are visited. A square near two cities is visited twice, which does no
+// harm, since a fertility is only lowered while it is above 7.
+void CopyJob::adjustMapFertility(Civ2Map& dest, const Window& w, bool landOnly)
+    throw (runtime_error)
+{
+    vector<Civ2Map::City> cities;
+
+    if (isWholeMapCopy() && dest.getRecordedCities(cities))
+    {
+        for (size_t c = 0; c < cities.size(); c++)
+        {
+            for (Civ2Map::RingIterator i(cities[c].x, cities[c].y, dest);
+                 i.getDistance() <= Civ2Map::CITY_ADJUST_RADIUS; ++i)
+            {
+                int x = i.getX();
+                int y = i.getY();
+
+                if (landOnly ? dest.getTerrainType(x, y) != OCEAN :
+                    dest.getFertility(x, y) > 7)
+                {
+                    dest.adjustFertility(x, y);
+                }
+            }
+        }
+        return;
+    }
+
+    for (int y = w.y1; y <= w.y2; y++)
+    {
+        for (int i = getFirstX(w.x1, y); i <= w.x2; i+=2)
+        {
+            int x = i;
+            if (!wrapSquare(dest, x, y)) continue;
+
+            if (landOnly ? dest.getTerrainType(x, y) != OCEAN :
+                dest.getFertility(x, y) > 7)
+            {
+                dest.adjustFertility(x, y);
+            }
+        }
+    }
+}
+
+// The squares of the source that are copied: the +region, or the whole
+// map, clipped to the edges of the source
+CopyJob::Window CopyJob::getSourceWindow(const Civ2Map& source) const
+{
+    Window w = { 0, 0, source.getWidth() - 1, source.getHeight() - 1 };
+    if (regionSet)
+    {
+        w.x1 = max(w.x1, region[0]);
+        w.y1 = max(w.y1, region[1]);
+        w.x2 = min(w.x2, region[2]);
+        w.y2 = min(w.y2, region[3]);
+    }
+    return w;
+}
+
+// The squares of the destination whose fertility a copy can change: those
+// copied, and those near enough to them to have a copied square within
+// their city radius, or a copied city within the distance that reduces
+// their fertility. A distance of 3 squares is at most 6 in Civ2
+// coordinates. The window is clipped to the top and bottom of the map, and
+// to its sides unless it wraps around them.
+CopyJob::Window CopyJob::getFertilityWindow(const Civ2Map& source,
+                                            const Civ2Map& dest) const
+{
+    static const int MARGIN = 6;
+
+    Window w = { 0, 0, dest.getWidth() - 1, dest.getHeight() - 1 };
+    if (isWholeMapCopy()) return w;
+
+    Window s = getSourceWindow(source);
+    int dx = stampSet ? stamp[0] : 0;
+    int dy = stampSet ? stamp[1] : 0;
+
+    w.y1 = max(w.y1, s.y1 + dy - MARGIN);
+    w.y2 = min(w.y2, s.y2 + dy + MARGIN);
+
+    int x1 = s.x1 + dx - MARGIN;
+    int x2 = s.x2 + dx + MARGIN;
+    if (dest.isFlat())
+    {
+        w.x1 = max(w.x1, x1);
+        w.x2 = min(w.x2, x2);
+    }
+    else if (x2 - x1 < w.x2)
+    {
+        // Each square is only calculated once, even if the window is wider
+        // than the map
+        w.x1 = x1;
+        w.x2 = x2;
+    }
+    return w;
+}
+
+// Looks up the fertility of a map in the fertility cache, and applies it if
+// found. digest is set to the map's cache key either way.  Problems with the
+// cache are reported, but are not fatal: the fertility is just recalculated.
+bool CopyJob::loadCachedFertility(Civ2Map& dest, Hash64& digest)
+{
+    digest = Hash64();
+    digest.addValue(options[FERTILITY]);
+    dest.addFertilityInputsToHash(digest);
+
+    try
+    {
+        vector<unsigned char> plane;
+        if (fertCache->lookup(digest, plane))
+        {
+            dest.setFertilityPlane(plane);
+            LogOutput::log(NORMAL) << "Using cached fertility." << endl;
+            return true;
+        }
+    }
+    catch (runtime_error& e)
+    {
+        LogOutput::log(NORMAL) << "Warning: " << e.what() << endl;
+    }
+    return false;
+}
+
+// Stores the fertility of a map into the fertility cache
+void CopyJob::storeCachedFertility(Civ2Map& dest, const Hash64& digest)
+{
+    try
+    {
+        vector<unsigned char> plane;
+        dest.getFertilityPlane(plane);
+        fertCache->store(digest, plane);
+    }
+    catch (runtime_error& e)
+    {
+        LogOutput::log(NORMAL) << "Warning: " << e.what() << endl;
+    }
+}
+
+// Parse the command line arguments, and verify them.
+void CopyJob::parseCommandLine(int argc, char *argv[])
+{
+    // Batch files and the like track a single source file for each job
+    if (argc > 1 && argv[1] != NULL)
+    {
+        string first = argv[1];
+        if (first == "--layer" || first == "--ops" || first == "--ops-file")
+        {
+            throw runtime_error(first + " can only be used on the mapcopy command line.");
+        }
+    }
+
+    // First parse the file names on the command line
+    // Note that there may be one or two files.
+    int i = parseFileNames(argc, argv);
+
+    // The filenames determine what default values to use
+    setDefaults();
+
+    // Now parse the command line options and verify them
+    parseOptions(i, argc, argv);
+    checkArgumentValidity(true);
+}
+
+// Same as above, with the arguments already split up. args[0] is not used.
+void CopyJob::parseCommandLine(const vector<string>& args)
+{
+    vector<char *> argv;
+    for (int i = 0; i < args.size(); i++)
+    {
+        argv.push_back(const_cast<char *>(args[i].c_str()));
+    }
+    argv.push_back(NULL);
+
+    parseCommandLine(args.size(), &argv[0]);
+}
+
+
+
+namespace
+{
+    // The options that pick what a copy copies, all turned off
+    const char *const copyOptionsOff[] =
+    {
+        "-s", "-t", "-i", "-v", "-o", "-cs", "-bc", "-cr", "-f", "-cv", "-rs", NULL
+    };
+
+    // The same options, which are the ones a step of --layer or --ops sets
+    const CopyJob::OPTIONS mapOptions[] =
+    {
+        CopyJob::SEED, CopyJob::TERRAIN, CopyJob::IMPROVEMENT, CopyJob::VISIBILITY,
+        CopyJob::OWNERSHIP, CopyJob::CIV_START, CopyJob::BODY_COUNTER,
+        CopyJob::CITY_RADIUS, CopyJob::FERTILITY, CopyJob::CIV_VIEW,
+        CopyJob::RESOURCE_SUP
+    };
+    const int NUM_MAP_OPTIONS = sizeof(mapOptions) / sizeof(mapOptions[0]);
+
+    // One option set by a step: when doMapCopy() gets to it, and which
+    // options' parts of the destination it reads and writes. doMapCopy()
+    // copies first, then sets the civ view, then the resource suppression,
+    // all in one loop over the squares, then calculates the city radius,
+    // ownership and body counters, and then does the fertility pass.
+    struct StepOperation
+    {
+        int phase;
+        unsigned int reads;
+        unsigned int writes;
+    };
+    const int NUM_PHASES = 5;
+
+    unsigned int optionBit(CopyJob::OPTIONS o)
+    {
+        return 1u << o;
+    }
+
+    StepOperation getStepOperation(CopyJob::OPTIONS o, CopyJob::OP_VALUE v)
+    {
+        StepOperation op = { 0, 0, optionBit(o) };
+
+        if (o == CopyJob::CIV_VIEW && v == CopyJob::CURRENT)
+        {
+            op.phase = 1;
+            op.reads = optionBit(CopyJob::IMPROVEMENT);
+        }
+        else if (o == CopyJob::RESOURCE_SUP && (v == CopyJob::SET || v == CopyJob::CLEAR))
+        {
+            // The flag is kept in the terrain byte
+            op.phase = 2;
+            op.writes |= optionBit(CopyJob::TERRAIN);
+        }
+        else if ((o == CopyJob::CITY_RADIUS || o == CopyJob::OWNERSHIP) &&
+                 v == CopyJob::CALC)
+        {
+            // Cities are found from the improvements, and owned by the
+            // owner of their square
+            op.phase = 3;
+            op.reads = optionBit(CopyJob::IMPROVEMENT) | optionBit(CopyJob::OWNERSHIP);
+        }
+        else if (o == CopyJob::BODY_COUNTER && v == CopyJob::CALC)
+        {
+            op.phase = 3;
+            op.reads = optionBit(CopyJob::TERRAIN);
+        }
+        else if (o == CopyJob::FERTILITY && (v == CopyJob::CALC || v == CopyJob::CALCALL))
+        {
+            // The seed picks the squares with resources, and cities are
+            // found from the improvements
+            op.phase = 4;
+            op.reads = optionBit(CopyJob::TERRAIN) | optionBit(CopyJob::IMPROVEMENT) |
+                       optionBit(CopyJob::SEED);
+        }
+        else if (o == CopyJob::FERTILITY && v == CopyJob::ADJUST)
+        {
+            op.phase = 4;
+            op.reads = optionBit(CopyJob::TERRAIN) | optionBit(CopyJob::IMPROVEMENT) |
+                       optionBit(CopyJob::FERTILITY);
+        }
+
+        return op;
+    }
+
+    // Steps of --layer or --ops fused into one job: their options, and what
+    // they read and write in each phase
+    struct StepPass
+    {
+        // The file copied from, or empty for an in place modification
+        string file;
+        vector<string> tokens;
+        CopyJob::OP_VALUE values[CopyJob::NUM_OPTIONS];
+        unsigned int reads[NUM_PHASES];
+        unsigned int writes[NUM_PHASES];
+
+        StepPass()
+        {
+            for (int o = 0; o < CopyJob::NUM_OPTIONS; o++) values[o] = CopyJob::OFF;
+            for (int p = 0; p < NUM_PHASES; p++) reads[p] = writes[p] = 0;
+        }
+
+        bool calculatesFertility() const
+        {
+            return values[CopyJob::FERTILITY] == CopyJob::CALC ||
+                   values[CopyJob::FERTILITY] == CopyJob::CALCALL ||
+                   values[CopyJob::FERTILITY] == CopyJob::ADJUST;
+        }
+
+        // Whether the pass calculates fertility that a trace records
+        bool tracesFertility() const
+        {
+            return values[CopyJob::FERTILITY] == CopyJob::CALC ||
+                   values[CopyJob::FERTILITY] == CopyJob::CALCALL;
+        }
+
+        // Whether a step, copying from f, can be done in this pass with the
+        // same result as after it. That is when the step sets no option the
+        // pass already sets, and it neither writes what the pass reads or
+        // writes in a later phase, nor reads what it writes in one.
+        // mixable says whether steps copying from a file work on the same
+        // maps and squares as those modifying the destination in place.
+        bool canJoin(const string& f, const CopyJob& step, bool mixable) const
+        {
+            if (!f.empty() && !file.empty() && f != file) return false;
+            if (!mixable && f.empty() != file.empty()) return false;
+
+            // ADJUST starts from the fertility of the source
+            bool fromFile = !f.empty() || !file.empty();
+            if (fromFile && (values[CopyJob::FERTILITY] == CopyJob::ADJUST ||
+                             step.getOption(CopyJob::FERTILITY) == CopyJob::ADJUST))
+            {
+                return false;
+            }
+
+            for (int i = 0; i < NUM_MAP_OPTIONS; i++)
+            {
+                CopyJob::OPTIONS o = mapOptions[i];
+                CopyJob::OP_VALUE v = step.getOption(o);
+                if (v == CopyJob::OFF) continue;
+                if (values[o] != CopyJob::OFF) return false;
+
+                StepOperation op = getStepOperation(o, v);
+                for (int p = op.phase + 1; p < NUM_PHASES; p++)
+                {
+                    if ((op.writes & (reads[p] | writes[p])) != 0 ||
+                        (op.reads & writes[p]) != 0)
+                    {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+
+        void join(const string& f, const CopyJob& step, const vector<string>& t)
+        {
+            if (!f.empty()) file = f;
+            tokens.insert(tokens.end(), t.begin(), t.end());
+
+            for (int i = 0; i < NUM_MAP_OPTIONS; i++)
+            {
+                CopyJob::OPTIONS o = mapOptions[i];
+                CopyJob::OP_VALUE v = step.getOption(o);
+                if (v == CopyJob::OFF) continue;
+
+                StepOperation op = getStepOperation(o, v);
+                values[o] = v;
+                reads[op.phase] |= op.reads;
+                writes[op.phase] |= op.writes;
+            }
+        }
+    };
+
+    // s without the spaces and tabs at either end
+    string trimSpaces(const string& s)
+    {
+        string::size_type start = s.find_first_not_of(" \t\r\n");
+        if (start == string::npos) return "";
+        string::size_type end = s.find_last_not_of(" \t\r\n");
+        return s.substr(start, end - start + 1);
+    }
+}
+
+void CopyJob::parseLayerCommandLine(int argc, char *argv[])
+{
+    vector<string> layers;
+
+    int i = 1;
+    while (i < argc && string(argv[i]) == "--layer")
+    {
+        if (i + 1 >= argc) throw runtime_error("Missing what=file after --layer.");
+
+        string spec = argv[i + 1];
+        string::size_type equals = spec.find('=');
+        if (equals == string::npos || equals == 0 || equals + 1 == spec.size())
+        {
+            throw runtime_error("Invalid --layer, expected what=file: " + spec);
+        }
+        layers.push_back(spec);
+        i += 2;
+    }
+
+    if (layers.empty()) throw int(0);
+    if (i >= argc || argv[i][0] == '-' || argv[i][0] == '+')
+    {
+        throw runtime_error("No destination file given after --layer.");
+    }
+
+    string dest = argv[i++];
+    parseSteps(argv[0], layers, dest, vector<string>(argv + i, argv + argc));
+}
+
+void CopyJob::parseOpsCommandLine(int argc, char *argv[])
+{
+    if (argc < 4) throw int(0);
+
+    string option = argv[1];
+    vector<string> steps;
+
+    if (option == "--ops-file")
+    {
+        ifstream is(argv[2]);
+        if (!is) throw runtime_error(string("Could not open steps file: ") + argv[2]);
+
+        // One step per line, skipping blank lines and those starting with ';'
+        string line;
+        while (getline(is, line))
+        {
+            line = trimSpaces(line);
+            if (!line.empty() && line[0] != ';') steps.push_back(line);
+        }
+    }
+    else
+    {
+        string script = argv[2];
+        string::size_type start = 0;
+        while (start <= script.size())
+        {
+            string::size_type semicolon = script.find(';', start);
+            if (semicolon == string::npos) semicolon = script.size();
+
+            string step = trimSpaces(script.substr(start, semicolon - start));
+            if (!step.empty()) steps.push_back(step);
+            start = semicolon + 1;
+        }
+    }
+
+    if (steps.empty()) throw runtime_error("No steps given after " + option + ".");
+    if (argv[3][0] == '-' || argv[3][0] == '+')
+    {
+        throw runtime_error("No destination file given after " + option + ".");
+    }
+
+    parseSteps(argv[0], steps, argv[3], vector<string>(argv + 4, argv + argc));
+}
+
+// Sets the job up to run steps on dest and then to modify it in place with
+// options. Steps are fused into passes, each a job of its own in stepJobs:
+// a step joins the pass before it when doing them together gives the same
+// result, which leaves one pass for most scripts.
+void CopyJob::parseSteps(const string& program, const vector<string>& steps,
+                         const string& dest, const vector<string>& options)
+{
+    // A stamp places the files the steps copy from. Steps that modify the
+    // destination in place, and the job itself, work on the whole of it,
+    // since a region would be in the files' coordinates.
+    bool stamping = false;
+    bool sourceMapSet = false;
+    bool destMapSet = false;
+    for (int o = 0; o < options.size(); o++)
+    {
+        string lower = options[o];
+        convert_to_lower(lower);
+        if (lower.compare(1, 6, "stamp:") == 0) stamping = true;
+        if (lower.compare(1, 3, "sm:") == 0) sourceMapSet = true;
+        if (lower.compare(1, 3, "dm:") == 0) destMapSet = true;
+    }
+
+    // Steps modifying a ToT destination in place work on all of its maps,
+    // but a copy from an MP file or another game may only fill map 1. The
+    // files are not loaded yet, so the two kinds of step are only done
+    // in one pass when the maps cannot differ, and neither is stamped.
+    bool mixable = !stamping &&
+                   (Civ2SavedGame::isMPFile(dest) || (sourceMapSet && destMapSet));
+
+    // Each pass takes the other options too, such as +verbose and +sm, but
+    // only its own steps' copy options. Rules files are only used by the
+    // passes calculating fertility, and a trace is recorded by whichever
+    // pass or job calculates it.
+    vector<string> jobOptions;
+    vector<string> passOptions;
+    vector<string> inPlaceOptions;
+    vector<string> rules;
+    vector<string> traces;
+    for (int o = 0; o < options.size(); o++)
+    {
+        string lower = options[o];
+        convert_to_lower(lower);
+
+        bool placing = lower.compare(1, 6, "stamp:") == 0 ||
+                       (stamping && lower.compare(1, 7, "region:") == 0);
+        if (!placing) jobOptions.push_back(options[o]);
+
+        if (lower.compare(1, 5, "rules") == 0) rules.push_back(options[o]);
+        else if (lower.compare(1, 10, "fert-trace") == 0) traces.push_back(options[o]);
+        else
+        {
+            passOptions.push_back(options[o]);
+            if (!placing) inPlaceOptions.push_back(options[o]);
+        }
+    }
+
+    // The job itself modifies the destination in place once the steps are
+    // done, so the destination need not exist yet
+    vector<string> args;
+    args.push_back(program);
+    args.push_back(dest);
+    args.insert(args.end(), jobOptions.begin(), jobOptions.end());
+    parseInPlace(args, false);
+
+    vector<StepPass> passes;
+    for (int s = 0; s < steps.size(); s++)
+    {
+        const string& text = steps[s];
+        string file;
+        vector<string> tokens;
+
+        string::size_type equals = text.find('=');
+        if (equals != string::npos)
+        {
+            if (equals == 0 || equals + 1 == text.size())
+            {
+                throw runtime_error("Invalid step, expected what=file: " + text);
+            }
+
+            file = text.substr(equals + 1);
+            if (file == dest) throw runtime_error("Cannot copy layers from the destination: " + file);
+
+            string what = text.substr(0, equals);
+            string::size_type start = 0;
+            while (start <= what.size())
+            {
+                string::size_type comma = what.find(',', start);
+                if (comma == string::npos) comma = what.size();
+                if (comma == start) throw runtime_error("Invalid step: " + text);
+
+                tokens.push_back("+" + what.substr(start, comma - start));
+                start = comma + 1;
+            }
+        }
+        else tokens.push_back(text[0] == '+' ? text : "+" + text);
+
+        // Check the step on its own, with the types of its files
+        CopyJob step;
+        vector<string> stepArgs(copyOptionsOff, copyOptionsOff + NUM_MAP_OPTIONS);
+        stepArgs.insert(stepArgs.end(), tokens.begin(), tokens.end());
+        step.parseGameOptions(stepArgs,
+                              Civ2SavedGame::isMPFile(file.empty() ? dest : file),
+                              Civ2SavedGame::isMPFile(dest), file.empty());
+
+        // A rules file is used by every fertility calculation of the
+        // script, wherever it is, like one given after the destination
+        string lower = tokens[0];
+        convert_to_lower(lower);
+        if (file.empty() && lower.compare(1, 5, "rules") == 0)
+        {
+            rules.push_back(tokens[0]);
+            continue;
+        }
+
+        bool setsAny = false;
+        for (int i = 0; i < NUM_MAP_OPTIONS; i++)
+        {
+            OP_VALUE v = step.getOption(mapOptions[i]);
+            if (v == OFF) continue;
+
+            setsAny = true;
+            if (file.empty() && v == COPY)
+            {
+                throw runtime_error("Step needs a file to copy from: " + text);
+            }
+        }
+        if (!setsAny) throw runtime_error("Step does not change anything: " + text);
+
+        if (passes.empty() || !passes.back().canJoin(file, step, mixable))
+        {
+            passes.push_back(StepPass());
+        }
+        passes.back().join(file, step, tokens);
+    }
+
+    // A trace file would only keep the last of several calculations, so a
+    // trace needs the script to calculate fertility once. If a step does
+    // it, that pass records the trace instead of the job.
+    int tracedPass = -1;
+    if (!traces.empty())
+    {
+        OP_VALUE f = getOption(FERTILITY);
+        int calculations = (f == CALC || f == CALCALL) ? 1 : 0;
+        for (int p = 0; p < passes.size(); p++)
+        {
+            if (passes[p].tracesFertility())
+            {
+                tracedPass = p;
+                calculations++;
+            }
+        }
+        if (calculations > 1)
+        {
+            throw runtime_error("A fertility trace can only record one fertility calculation.");
+        }
+        if (tracedPass >= 0)
+        {
+            fertTraceFile = "";
+            fertTraceWindowSet = false;
+        }
+    }
+
+    stepJobs.clear();
+    for (int p = 0; p < passes.size(); p++)
+    {
+        const StepPass& pass = passes[p];
+
+        args.resize(1);
+        if (!pass.file.empty()) args.push_back(pass.file);
+        args.push_back(dest);
+        if (pass.file.empty())
+        {
+            args.insert(args.end(), inPlaceOptions.begin(), inPlaceOptions.end());
+        }
+        else args.insert(args.end(), passOptions.begin(), passOptions.end());
+        args.insert(args.end(), copyOptionsOff, copyOptionsOff + NUM_MAP_OPTIONS);
+        args.insert(args.end(), pass.tokens.begin(), pass.tokens.end());
+        if (pass.calculatesFertility())
+        {
+            args.insert(args.end(), rules.begin(), rules.end());
+        }
+        if (p == tracedPass) args.insert(args.end(), traces.begin(), traces.end());
+
+        stepJobs.push_back(new CopyJob());
+        if (pass.file.empty()) stepJobs.back()->parseInPlace(args, false);
+        else stepJobs.back()->parseCommandLine(args);
+    }
+}
+
+// Whether the job was given any option that copies or changes the maps
+bool CopyJob::setsMapOptions() const
+{
+    for (int i = 0; i < NUM_MAP_OPTIONS; i++)
+    {
+        if (options[mapOptions[i]] != OFF) return true;
+    }
+    return false;
+}
+
+// Parses args as the command line of an in place modification, whether or
+// not the file is there. args[0] is not used.
+void CopyJob::parseInPlace(const vector<string>& args, bool checkFiles)
+{
+    vector<char *> argv;
+    for (int i = 0; i < args.size(); i++)
+    {
+        argv.push_back(const_cast<char *>(args[i].c_str()));
+    }
+    argv.push_back(NULL);
+
+    // A second file name would make it a copy between files
+    int argc = args.size();
+    int i = parseFileNames(argc, &argv[0]);
+    if (i != 2) throw runtime_error(string("Unexpected file name: ") + argv[2]);
+
+    setDefaults();
+    parseOptions(i, argc, &argv[0]);
+    checkArgumentValidity(checkFiles);
+}
+
+// Sets up a job for copyGames() from its options alone. The names given
+// only appear in messages.
+void CopyJob::parseGameOptions(const vector<string>& args, bool sourceIsMP,
+                               bool destIsMP, bool inPlace)
+{
+    if (inPlace)
+    {
+        sourceFile = destFile = "game";
+        copy_type = destIsMP ? MP : SAV;
+    }
+    else
+    {
+        sourceFile = "source";
+        destFile = "destination";
+        if (sourceIsMP) copy_type = destIsMP ? MP2MP : MP2SAV;
+        else copy_type = destIsMP ? SAV2MP : SAV2SAV;
+    }
+
+    setDefaults();
+
+    // parseOptions() skips argv[0], as for the command line
+    vector<char *> argv(1, (char *) NULL);
+    for (int i = 0; i < args.size(); i++)
+    {
+        argv.push_back(const_cast<char *>(args[i].c_str()));
+    }
+    argv.push_back(NULL);
+
+    parseOptions(1, args.size() + 1, &argv[0]);
+    checkArgumentValidity(false);
+}
+
+// Parses the first two command line arguments, the source and
+// destination file names. The return value is the index of the next
+// unparsed parameter.  (2 or 3, depending on whether there are one
+// or two file names)
+int CopyJob::parseFileNames(int argc, char *argv[])
+{
+    // If too few parameters, singal main to print help text
+    if (argc < 2)
+    {
+        throw int(0);
+    }
+
+    // The first argument should be the source file name
+    if (argv[1] != NULL)
+    {
+        sourceFile = argv[1];
+    }
+    else
+    {
+        // We must have at least one file name
+        throw runtime_error("Invalid source file name.");
+    }
+
+    // The second argument should be the destination file name
+    if (argv[2] != NULL && *(argv[2]) != '-' && *(argv[2]) != '+')
+    {
+        destFile = argv[2];
+    }
+    else
+    {
+        // If there isn't a second filename, that means we're doing an inplace
+        // modification
+        destFile = sourceFile;
+        if (Civ2SavedGame::isMPFile(destFile)) copy_type = MP;
+        else copy_type = SAV;
+        return 2;
+    }
+
+    // Otherwise we are doing a file to file copy
+
+    // Figure out the type of copy
+    if (Civ2SavedGame::isMPFile(sourceFile))
+    {
+        if (Civ2SavedGame::isMPFile(destFile)) copy_type = MP2MP;
+        else copy_type = MP2SAV;
+    }
+    else
+    {
+        if (Civ2SavedGame::isMPFile(destFile)) copy_type = SAV2MP;
+        else copy_type = SAV2SAV;
+    }
+
+    return 3;
+}
+
+// Sets the default option values based on the type of copy being performed
+void CopyJob::setDefaults()
+{
+    for (int i = 0; i<NUM_OPTIONS; i++)
+    {
+        options[i] = defaults[i][copy_type];
+    }
+}
+
+// Set default values for sourceMap (+sm) and destMap (+dm) based on whether
+// the source and destination accept multiple maps
+void CopyJob::setMapDefaults(bool oneSupportsMultiMaps, bool twoSupportsMultiMaps)
+{
+    // An ALL to ALL copy is default if both maps support multiple maps,
+    // and the source and destination have not been set to a specific map
+    if (oneSupportsMultiMaps && twoSupportsMultiMaps)
+    {
+        if ( (sourceMap == -1 || sourceMap == 0) &&
+             (destMap == -1 || destMap == 0) )
+        {
+            sourceMap = 0;
+            destMap = 0;
+            return;
+        }
+    }
+    // In all other cases, these values default to 1
+    if (sourceMap == -1) sourceMap = 1;
+    if (destMap == -1) destMap = 1;
+}
+
+// Parse the command line options, starting from index
+void CopyJob::parseOptions(int index, int argc, char *argv[]) 
+{
+
+    // Now we loop through options
+    for (int i = index; i < argc; i++)
+    {
+        // Grab whether + is being used to turn an option on, or if - is
+        // being used to turn an option off. The on/off information is stored
+        // in value
+        OP_VALUE value;
+
+        if (argv[i] != NULL && strlen(argv[i]) >= 2)
+        {
+            if (*(argv[i]) == '-') value = OFF;
+            else if (*(argv[i]) == '+') value = ON;
+            else
+            {
+                throw runtime_error(string("Invalid command line option:") + argv[i]);
+            }
+        }
+        else
+        {
+            throw runtime_error("Invalid command line option.");
+        }
+
+        string o = argv[i] + 1;
+        convert_to_lower(o);
+
+        if ( o == "s" || o == "seed")
+        {
+            options[SEED] = value;
+        }
+        else if ( o == "t" || o == "terrain")
+        {
+            options[TERRAIN] = value;
+        }
+        else if ( o == "i" || o == "improvement")
+        {
+            options[IMPROVEMENT] = value;
+        }
+        else if ( o == "v" || o == "visibility")
+        {
+            options[VISIBILITY] = value;
+        }
+        else if ( o == "o" || o == "ownership")
+        {
+            options[OWNERSHIP] = value;
+        }
+        else if ( o == "o:calc" || o == "ownership:calc")
+        {
+            options[OWNERSHIP] = CALC;
+        }
+        else if ( o == "cs")
+        {
+            options[CIV_START] = value;
+        }
+        else if ( o == "bc") 
+        {
+            options[BODY_COUNTER] = value;
+        }
+        else if ( o == "bc:calc")
+        {
+            options[BODY_COUNTER] = CALC;
+        }
+        else if ( o == "cr") 
+        {
+            options[CITY_RADIUS] = value;
+        }
+        else if ( o == "cr:calc")
+        {
+            options[CITY_RADIUS] = CALC;
+        }
+        else if ( o.compare(0,4, "verb")==0 )
+        {
+            int colon = o.find_first_of(':');
+            if (colon != string::npos && o.compare(colon, string::npos, ":dev") == 0) options[VERBOSE]=DEV;
+            else options[VERBOSE] = value;
+        }
+        else if ( o == "skip")
+        {
+            options[SKIP_UNCHANGED] = value;
+        }
+        else if ( o.compare(0, 5, "memo:") == 0 && o.size() > 5)
+        {
+            // The memo only holds copies that were found to change nothing
+            memoFile = argv[i] + 6;
+            options[SKIP_UNCHANGED] = ON;
+        }
+        else if ( o == "b" || o == "backup")
+        {
+            options[BACKUP] = value;
+        }
+        else if (o == "cv")
+        {
+            options[CIV_VIEW] = value;
+        }
+        else if (o == "cv:current")
+        {
+            options[CIV_VIEW] = CURRENT;
+        }
+        else if ( o == "f" || o == "fertility")
+        {
+            options[FERTILITY] = value;
+        }
+        else if ( o.compare(0, 2, "f:") == 0 ||
+                  o.compare(0, 10, "fertility:") == 0 )
+        {
+            int colon = o.find_first_of(':');
+            if (o.compare(colon, string::npos, ":calc") == 0)    options[FERTILITY] = CALC;
+            else if (o.compare(colon, string::npos, ":calcall") == 0) options[FERTILITY] = CALCALL;
+            else if (o.compare(colon, string::npos, ":adjust") == 0)  options[FERTILITY] = ADJUST;
+            else if (o.compare(colon, string::npos, ":zero") == 0)    options[FERTILITY] = ZERO;
+            else
+            {
+                throw runtime_error("Unknown Option: " + o);
+            }
+        }
+        else if ( o.compare(0, 7, "fcache:") == 0 && o.size() > 7)
+        {
+            // Use the original argument, since the case of a directory
+            // name matters on some systems
+            fertCacheDir = argv[i] + 8;
+        }
+        else if ( o.compare(0, 10, "fcachemax:") == 0 && o.size() > 10)
+        {
+            long kb = atol(o.substr(10).c_str());
+            if (kb <= 0)
+            {
+                throw runtime_error("Invalid size for option " + o);
+            }
+            fertCacheMaxKB = kb;
+        }
+        else if ( o.compare(0, 7, "scache:") == 0 && o.size() > 7)
+        {
+            snapshotDir = argv[i] + 8;
+        }
+        else if ( o.compare(0, 10, "scachemax:") == 0 && o.size() > 10)
+        {
+            long kb = atol(o.substr(10).c_str());
+            if (kb <= 0)
+            {
+                throw runtime_error("Invalid size for option " + o);
+            }
+            snapshotMaxKB = kb;
+        }
+        else if ( o.compare(0, 11, "fert-trace:") == 0 && o.size() > 11)
+        {
+            fertTraceFile = argv[i] + 12;
+        }
+        else if ( o.compare(0, 18, "fert-trace-window:") == 0)
+        {
+            int *w = fertTraceWindow;
+            char extra;
+            if (sscanf(o.c_str() + 18, "%d,%d,%d,%d%c", &w[0], &w[1], &w[2], &w[3], &extra) != 4 ||
+                w[0] > w[2] || w[1] > w[3])
+            {
+                throw runtime_error("Invalid window for option " + o);
+            }
+            fertTraceWindowSet = true;
+        }
+        else if ( o.compare(0, 7, "region:") == 0)
+        {
+            int *w = region;
+            char extra;
+            if (sscanf(o.c_str() + 7, "%d,%d,%d,%d%c", &w[0], &w[1], &w[2], &w[3], &extra) != 4 ||
+                w[0] > w[2] || w[1] > w[3])
+            {
+                throw runtime_error("Invalid region for option " + o);
+            }
+            regionSet = true;
+        }
+        else if ( o.compare(0, 6, "stamp:") == 0)
+        {
+            char extra;
+            if (sscanf(o.c_str() + 6, "%d,%d%c", &stamp[0], &stamp[1], &extra) != 2)
+            {
+                throw runtime_error("Invalid position for option " + o);
+            }
+
+            // x + y of every square is even
+            if ((stamp[0] + stamp[1]) % 2 != 0)
+            {
+                throw runtime_error("Invalid position for option " + o + ": x + y must be even.");
+            }
+            stampSet = true;
+        }
+        else if ( o.compare(0, 6, "rules:") == 0 && o.size() > 6)
+        {
+            for (int n = 0; n < NUM_RULES_FILES; n++)
+            {
+                rulesFiles[n] = argv[i] + 7;
+            }
+        }
+        else if ( o.compare(0, 5, "rules") == 0 && o.size() > 7 &&
+                  o[5] >= '1' && o[5] < '1' + NUM_RULES_FILES && o[6] == ':')
+        {
+            rulesFiles[o[5] - '1'] = argv[i] + 8;
+        }
+        else if ( o == "rs")
+        {
+            options[RESOURCE_SUP] = value;
+        }
+        else if ( o == "rs:set" )
+        {
+            options[RESOURCE_SUP] = SET;
+        }
+        else if ( o == "rs:clear" )
+        {
+            options[RESOURCE_SUP] = CLEAR;
+        }
+        else if (o.compare(0, 3, "sm:") == 0 || 
+                 o.compare(0, 3, "dm:") == 0 )
+        {
+            int map_num = 0; // 0 is used for "all"
+            if (o.compare(2, string::npos, ":all") != 0)
+            {
+                // The value is not "all", convert to integer
+                if (o.size() <4)
+                {
+                    throw runtime_error("Missing map # for option " + o);
+                }
+                map_num = atoi(o.substr(3, string::npos).c_str());
+
+                if (map_num <1 || map_num > 4) 
+                {
+                    throw runtime_error("Invalid map # for option " + o);
+                }
+            }
+            if (o.compare(0, 3, "sm:") == 0) sourceMap = map_num;
+            else destMap = map_num;        
+        }
+        else
+        {
+            throw runtime_error("Unknown Option: " +  o);
+        }
+    } // end for
+
+}
+// end parseOptions
+
+// Determines if the argument settings are valid for the current copy type
+void CopyJob::checkArgumentValidity(bool checkFiles) 
+{
+
+    // Check to see that files are specified
+    if (copy_type == MP || copy_type == SAV)
+    {
+        if (destFile.length()==0) throw int(0);
+    }
+    else if (sourceFile.length() == 0 || destFile.length() == 0)
+    {
+        throw int(0);
+    }
+
+    // Validate multimap copies
+    if (sourceMap > 1) 
+    {
+        if (copy_type == MP || copy_type == MP2MP || copy_type == MP2SAV)
+        {
+            throw runtime_error("Invalid source map option: MP files only have one map.");
+        }
+    }
+    if (destMap != 1 && destMap != -1)
+    {
+        if (copy_type == MP || copy_type == MP2MP || copy_type == SAV2MP)
+        {
+            throw runtime_error("Invalid dest map option: MP files only have one map.");
+        }
+    }
+    if (sourceMap == 0 && destMap != 0 && destMap != -1)
+    {
+        throw runtime_error("Invalid source map option: Cannot copy 'ALL' maps to a single map.");
+    }
+     
+
+    // Copying start positions is only valid for MP2MP copies
+    if (options[CIV_START] != OFF && copy_type != MP2MP)
+    {
+        throw runtime_error("Invalid cs option: Can only copy starting positions between .MP files!");
+    }
+
+    // Copying Civ View information is only acceptable for SAV2SAV copies,
+    // but it is possible to calculate the Civ View information if the
+    // destination is a SAV file.
+    if (options[CIV_VIEW] == COPY && copy_type != SAV2SAV)
+    {
+        throw runtime_error("Invalid cv option: Can only copy civ view data between .SAV files!");
+    }
+
+    if (options[CIV_VIEW] == CURRENT && copy_type != MP2SAV
+                                     && copy_type != SAV2SAV
+                                     && copy_type != SAV)
+    {
+        throw runtime_error("Invalid cs option: Can only calculate civ view data for .SAV destiantion files!");
+    }
+
+    // A stamp copies a file into another one, so it must have a source
+    if (stampSet && (copy_type == MP || copy_type == SAV))
+    {
+        throw runtime_error("Invalid stamp option: A stamp needs a source file to copy from.");
+    }
+
+    if (checkFiles && (copy_type == MP || copy_type == SAV))
+    {
+        // Make sure destination file exists
+        if (!DustyUtil::fileExists(destFile))
+        {
+            throw runtime_error(string("File ") + destFile + " must exist for in place modification.");
+        }
+    }
+}
+
+// Replace the terrain rules of the destination game with those read from
+// any rules.txt files given on the command line. A file used for several
+// maps is only parsed once.
+void CopyJob::loadRulesFiles(Civ2SavedGame& game)
+{
+    for (int n = 0; n < NUM_RULES_FILES; n++)
+    {
+        if (rulesFiles[n].empty()) continue;
+
+        LogOutput::log(NORMAL) << "Using terrain rules for map " << n + 1
+                               << " from: " << rulesFiles[n] << endl;
+        game.setTerrainRules(n, Civ2Rules::loadTerrainRules(rulesFiles[n]));
+    }
+}
+
+// Display information about a saved game information
+void logFileDetails(const Civ2SavedGame& file)
+{
+    describeFile(file, LogOutput::log(NORMAL));
+}
+
+// Write a one line description of a saved game or map file
+void describeFile(const Civ2SavedGame& file, ostream& os)
+{
+    int width = file.getWidth();
+    int height = file.getHeight();
+    
+    if (file.isMapOnly())
+    {
+        os << width << " by " << height << " MP file." << endl;
+    }
+    else
+    {
+        string shape = " round ";
+        if (file.isFlatEarth()) shape = " flat ";
+
+        os << width << " by " << height << " " 
+           << file.getVersionString() << shape << "earth SAV/SCN file with " 
+           << file.getNumMaps() << " maps." << endl;
+    }
+}
+
+// Copies file to file.bak
+void backupFile(string file) throw (runtime_error)
+{
+    ifstream theFile;
+    theFile.open(file.c_str(), ios::binary | ios::in);
+
+    if (!theFile)
+    {
+        // We assume the file doesn't exist, so can't be backed up
+        return;
+    }
+
+    LogOutput::log(NORMAL) << "Backing up '" << file << "'." << endl;
+
+    char *backup_buffer = new char[BACKUP_BUFFER_SIZE];
+
+    if (backup_buffer == NULL)
+    {
+        throw runtime_error("Insufficient memory for backup.");
+    }
+
+    string backupName = file + ".bak";
+
+    ofstream backupFile;
+
+    backupFile.open(backupName.c_str(), ios::binary);
+
+    if (!backupFile)
+    {
+        throw runtime_error(string("Error backing up file: ") + file +
+                            string(" to file: " + backupName));
+    }
+
+    while (theFile && backupFile)
+    {
+        theFile.read(backup_buffer, BACKUP_BUFFER_SIZE);
+        backupFile.write(backup_buffer, theFile.gcount());
+    }
+
+    delete[] backup_buffer;
+
+    if (!theFile.eof() || !backupFile)
+    {
+        throw runtime_error(string("Error backing up file: ") + file +
+                            string(" to file: " + backupName));
+    }
+}
+
+
@@ -0,0 +1,422 @@
+/*
+ * The contents of this file are subject to the Mozilla Public
+ * License Version 1.1 (the "License"); you may not use this file
+ * except in compliance with the License. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS
+ * IS" basis, WITHOUT WARRANTY OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * rights and limitations under the License.
+ *
+ * The Original Code is MapCopy, a copy utility for Civ2 maps and saved games.
+ *
+ * The Initial Developer of the Original Code is James Dustin Reichwein.
+ * Portions created by James Dustin Reichwein are
+ * Copyright (C) 2000,2005, James Dustin Reichwein.  All
+ * Rights Reserved.
+ *
+ * Contributor(s):
+ */
+
+// copyjob.h
+// Description:  A single MapCopy copy operation: its options, and the code
+//               that carries it out.
+//
+// Creation Date: Oct/18/2026
+//
+// Revision History:
+
+#ifndef COPYJOB_H_
+#define COPYJOB_H_
+
+#include <string>
+#include <stdexcept>
+#include <list>
+#include <map>
+#include <set>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include "DustyUtil.h"
+#include "civ2sav.h"
+#include "fertcache.h"
+#include "snapcache.h"
+#include "fertrace.h"
+
+using namespace std;
+using namespace DustyUtil;
+
+// CopyContext
+// Holds what is shared between the copy jobs run by one MapCopy process:
+// source files that have already been loaded, and fertility caches.
+//
+// A few of the most recently used source files are kept loaded, so a batch
+// of jobs copying from the same file only loads it once. Jobs must treat
+// these as read only. Whenever a job writes a file, it tells the context
+// with fileWritten() so that a stale copy of it is not used as a source.
+// A loaded file that something else has changed is loaded again.
+//
+// A context can be shared by jobs running on different threads. In that
+// case it should be made quiet, or given a log stream that can take
+// messages from several threads, since screen messages from several jobs at
+// once would be mixed together.
+class CopyContext
+{
+    public:
+
+        CopyContext();
+        ~CopyContext();
+
+        // Returns the loaded contents of a source file, loading it first if
+        // it is not already loaded. The file stays loaded for as long as the
+        // caller holds on to it, even if the context forgets it. If
+        // snapshots is given, the file is loaded through that snapshot
+        // cache.
+        shared_ptr<Civ2SavedGame> getSource(const string& filename,
+                                            Civ2SnapshotCache *snapshots = NULL)
+            throw (runtime_error);
+
+        // Forget any loaded copy of a file that has been written
+        void fileWritten(const string& filename);
+
+        // Returns the fertility cache for a directory, opening it first if
+        // needed. maxBytes only applies when the cache is opened.
+        Civ2FertilityCache& getFertilityCache(const string& directory,
+                                              unsigned long maxBytes)
+            throw (runtime_error);
+
+        // Returns the snapshot cache for a directory, opening it first if
+        // needed. maxBytes only applies when the cache is opened.
+        Civ2SnapshotCache& getSnapshotCache(const string& directory,
+                                            unsigned long maxBytes)
+            throw (runtime_error);
+
+        // Write the indexes of all open fertility and snapshot caches back
+        // to disk
+        void flushCaches() throw (runtime_error);
+
+        // Fertility calculated by CALC/CALCALL before the adjustment for
+        // cities, keyed by a digest of the calculation's inputs, so that jobs
+        // copying the same terrain into different files only calculate it
+        // once. If the plane is not found, the caller must calculate it and
+        // then call storeCalculatedFertility(), or abandonCalculatedFertility()
+        // if the calculation fails. Until then, other threads looking for the
+        // same plane wait for it rather than calculating it as well.
+        bool findCalculatedFertility(const Hash64& digest, vector<unsigned char>& plane);
+        void storeCalculatedFertility(const Hash64& digest, const vector<unsigned char>& plane);
+        void abandonCalculatedFertility(const Hash64& digest);
+
+        // Memo files list copies that were found to change nothing, by a
+        // digest of their files and options (see CopyJob::getMemoKey()), so
+        // they can be skipped without loading anything. A memo file is read
+        // the first time it is used, and each new entry is added to it as
+        // it is stored.
+        bool findMemo(const string& memoFile, const Hash64& key) throw (runtime_error);
+        void storeMemo(const string& memoFile, const Hash64& key) throw (runtime_error);
+
+        // How many times a source was loaded or an already loaded one used,
+        // and how many fertility planes were calculated or reused
+        int getSourceLoads() const;
+        int getSourceHits() const;
+        int getCalculatedFertilityCount() const;
+        int getCalculatedFertilityHits() const;
+
+        // A quiet context turns off the screen messages of every job
+        void setQuiet(bool q) { quiet = q; }
+        bool isQuiet() const { return quiet; }
+
+        // Where the messages of the jobs using this context go. NULL, the
+        // default, means the process wide LogOutput stream.
+        void setLogStream(ostream *os) { log_stream = os; }
+        ostream *getLogStream() const { return log_stream; }
+
+    private:
+
+        // Not copyable
+        CopyContext(const CopyContext&);
+        CopyContext& operator=(const CopyContext&);
+
+        struct LoadedSource
+        {
+            string name;
+            FileVersion version;
+            shared_ptr<Civ2SavedGame> game;
+        };
+
+        // Number of source files kept loaded
+        static const unsigned int MAX_SOURCES = 8;
+
+        // Number of calculated fertility planes kept
+        static const unsigned int MAX_CALCULATED = 16;
+
+        // Loaded sources, from most to least recently used
+        list<LoadedSource> sources;
+        map<string, Civ2FertilityCache*> fert_caches;
+        map<string, Civ2SnapshotCache*> snapshot_caches;
+
+        // The entries of each memo file used, by file name
+        map<string, set<unsigned long long> > memos;
+
+        // Calculated fertility planes by digest, and the digests of planes
+        // being calculated
+        map<unsigned long long, vector<unsigned char> > calculated;
+        set<unsigned long long> calculating;
+        condition_variable calculationDone;
+
+        int source_loads;
+        int source_hits;
+        int calculated_count;
+        int calculated_hits;
+        bool quiet;
+        ostream *log_stream;
+
+        // Held while using sources, the caches, calculated or the counts
+        mutable mutex context_lock;
+};
+
+// DestinationChanged
+// Thrown by CopyJob::save() when the destination file has been changed by
+// something else since the job loaded it. Saving would lose those changes.
+class DestinationChanged : public runtime_error
+{
+    public:
+        DestinationChanged(const string& filename)
+        : runtime_error("Destination was changed while copying: " + filename) { }
+};
+
+// CopyJob
+// One copy from a source file to a destination file (or an in place
+// modification of one file), with its own option settings. A job is set up
+// from command line style arguments by parseCommandLine() and carried out by
+// run(), or by calling load(), copy() and save() in turn. The files are only
+// held in memory between load() and save(). save() will not overwrite a
+// destination that something else changed after load().
+//
+// A job may only be used by one thread at a time, but different jobs can
+// run on different threads at once, sharing a context, as long as none of
+// them writes a file another is using. Each step logs with the job's own
+// settings (see getLogSettings()), so jobs do not change each other's
+// messages.
+class CopyJob
+{
+    public:
+
+        enum OPTIONS { SEED = 0, TERRAIN, IMPROVEMENT, VISIBILITY, OWNERSHIP,
+                       CIV_START, BODY_COUNTER, CITY_RADIUS, VERBOSE, BACKUP,
+                       FERTILITY, CIV_VIEW, RESOURCE_SUP, SKIP_UNCHANGED,
+                       NUM_OPTIONS };
+        enum OP_VALUE { OFF=0, ON=1, COPY=1, CALC, CALCALL, ADJUST, CURRENT, ZERO,
+                        SET, CLEAR, DEV };
+
+        // Possible file type configurations
+        enum COPYTYPE { MP2MP=0, SAV2SAV, MP2SAV, SAV2MP, MP, SAV, NUM_TYPES };
+
+        CopyJob();
+
+        // Parse command line arguments, and verify them. As with main(),
+        // argv[0] is not used. Throws int(0) if the help text should be
+        // displayed instead.
+        void parseCommandLine(int argc, char *argv[]);
+        void parseCommandLine(const vector<string>& args);
+
+        // Parse "--layer what=file [--layer what=file ...] dest [options]",
+        // which builds dest from layers of several files at once. what is a
+        // comma separated list of the copy options, such as "t,rs" or
+        // "ownership", to take from file. The layers are copied in the order
+        // given, each file being loaded once, and then dest is modified in
+        // place with the options, such as +f:CALC, and saved once.
+        void parseLayerCommandLine(int argc, char *argv[]);
+
+        // Parse "--ops steps dest [options]" or "--ops-file file dest
+        // [options]", which runs a script of steps on dest, loading and
+        // saving it once. steps are separated by ';', and a file has one
+        // step per line. A step is either what=file, as for --layer, or an
+        // option that modifies dest in place, such as "rs:CLEAR", "f:CALCALL",
+        // "cv:CURRENT" or "rules:FILE". Steps are fused into as few passes
+        // over the maps as gives the same result as running them in order.
+        void parseOpsCommandLine(int argc, char *argv[]);
+
+        // Set up the job to copy between games already in memory, with
+        // copyGames(), instead of files. args holds only the options. The
+        // types of the games choose the defaults, as the file names would.
+        void parseGameOptions(const vector<string>& args, bool sourceIsMP,
+                              bool destIsMP, bool inPlace);
+
+        // Carry out the copy
+        void run(CopyContext& context) throw (runtime_error);
+
+        // The three steps of run(), which may be done on different threads:
+        // backing up the destination and loading the source and destination,
+        // copying between them, and saving the destination.
+        void load(CopyContext& context) throw (runtime_error);
+        void copy(CopyContext& context) throw (runtime_error);
+        void save(CopyContext& context) throw (runtime_error);
+
+        // For applying several jobs to one destination without saving it in
+        // between: instead of load(), a job after the first only loads its
+        // source, and before copy() it takes over the destination from the
+        // job before it. Only the last job is saved.
+        void loadSource(CopyContext& context) throw (runtime_error);
+        void takeDestination(CopyJob& previous) throw (runtime_error);
+
+        // What copy() does, between games in memory. For an in place job,
+        // source and dest are the same game. The files the job names are
+        // not used, but the rules files and caches of its options are.
+        void copyGames(CopyContext& context, const Civ2SavedGame& source,
+                       Civ2SavedGame& dest) throw (runtime_error);
+
+        // Free the loaded files, for a job that failed part way through
+        void unload();
+
+        const string& getSourceFile() const { return sourceFile; }
+        const string& getDestFile() const { return destFile; }
+        const string& getFertTraceFile() const { return fertTraceFile; }
+        OP_VALUE getOption(OPTIONS o) const { return options[o]; }
+
+        // The LogOutput settings for this job's messages: the levels its
+        // verbose option turns on, sent to the context's log stream, or
+        // nothing at all for a quiet context
+        LogOutput::Settings getLogSettings(const CopyContext& context) const;
+
+        // Whether the job modifies a file in place, without a source file
+        bool isInPlace() const { return copy_type == MP || copy_type == SAV; }
+
+        // Whether the destination was left alone because the copy would not
+        // have changed it (see +skip and +memo)
+        bool isUnchanged() const { return unchanged; }
+        bool usesMemo() const { return !memoFile.empty(); }
+
+    private:
+
+        // Not copyable
+        CopyJob(const CopyJob&);
+        CopyJob& operator=(const CopyJob&);
+
+        // A rectangle of squares, from x1,y1 to x2,y2 in Civ2 coordinates.
+        // It may reach past the edges of a map.
+        struct Window
+        {
+            int x1;
+            int y1;
+            int x2;
+            int y2;
+        };
+
+        void setDefaults();
+        void setMapDefaults(bool oneSupprtsMultiMaps, bool twoSupportsMultiMaps);
+        int parseFileNames(int argc, char *argv[]);
+        void parseOptions(int i, int argc, char *argv[]);
+        void checkArgumentValidity(bool checkFiles);
+        Civ2SnapshotCache *getSnapshotCache(CopyContext& context) const
+            throw (runtime_error);
+        bool getMemoKey(Hash64& key) const;
+        void loadRulesFiles(Civ2SavedGame& game);
+        void parseInPlace(const vector<string>& args, bool checkFiles);
+        void parseSteps(const string& program, const vector<string>& steps,
+                        const string& dest, const vector<string>& options);
+        bool setsMapOptions() const;
+        void copyMaps(const Civ2SavedGame& one, Civ2SavedGame& two,
+                      const vector<int>& sources) throw (runtime_error);
+        bool isMapCopyParallel(int numMaps) const;
+        void doMapCopy(const Civ2Map& source, Civ2Map& dest) throw(runtime_error);
+        bool copyMapSquares(const Civ2Map& source, Civ2Map& dest) throw(runtime_error);
+        void doMapFertility(const Civ2Map& source, Civ2Map& dest) throw(runtime_error);
+        void calcMapFertility(Civ2Map& dest, const Window& w) throw (runtime_error);
+        void adjustMapFertility(Civ2Map& dest, const Window& w, bool landOnly) throw (runtime_error);
+        bool isWholeMapCopy() const { return !regionSet && !stampSet; }
+        Window getSourceWindow(const Civ2Map& source) const;
+        Window getFertilityWindow(const Civ2Map& source, const Civ2Map& dest) const;
+        bool loadCachedFertility(Civ2Map& dest, Hash64& digest);
+        void storeCachedFertility(Civ2Map& dest, const Hash64& digest);
+
+        // The options
+        OP_VALUE options[NUM_OPTIONS];
+
+        // Default option values
+        static const OP_VALUE defaults[NUM_OPTIONS][NUM_TYPES];
+
+        // The source and destination files
+        string sourceFile;
+        string destFile;
+
+        // The source and destination maps for ToT multimap saved games.
+        // Note 0 equals "all", -1 equals "default"
+        int sourceMap;
+        int destMap;
+
+        // The type of copy
+        COPYTYPE copy_type;
+
+        // For --layer and --ops, the jobs run on destGame, in order, before
+        // this job modifies it in place. Each either copies layers from a
+        // file of its own or modifies destGame in place.
+        vector< SmartPointer<CopyJob> > stepJobs;
+
+        // The loaded files, between load() and save(). sourceGame is not
+        // used for an in place modification.
+        shared_ptr<Civ2SavedGame> sourceGame;
+        SmartPointer<Civ2SavedGame> destGame;
+
+        // The destination file as it was when it was loaded
+        FileVersion destVersion;
+
+        // With +skip, a digest of the loaded destination, to tell whether
+        // the copy changed it. unchanged is set if it did not, or if the
+        // memo showed that it would not, in which case nothing is loaded.
+        Hash64 destDigest;
+        bool unchanged;
+
+        // Memo file for +memo, and the job's key in it. The key is only set
+        // if the job could be remembered.
+        string memoFile;
+        Hash64 memoKey;
+        bool memoKeySet;
+
+        // Directory and size limit (in kilobytes) of the fertility cache.
+        // The cache is only used if a directory is given. fertCache is only
+        // set while the job is running.
+        string fertCacheDir;
+        unsigned long fertCacheMaxKB;
+        Civ2FertilityCache *fertCache;
+
+        // Directory and size limit (in kilobytes) of the snapshot cache. The
+        // cache is only used if a directory is given.
+        string snapshotDir;
+        unsigned long snapshotMaxKB;
+
+        // The context the job is being copied in. Only set during copy().
+        CopyContext *copyContext;
+
+        // The rules.txt file to use for each map in the destination. An
+        // empty name keeps the standard Civ2 terrain rules.
+        static const int NUM_RULES_FILES = 4;
+        string rulesFiles[NUM_RULES_FILES];
+
+        // File to record fertility calculations in, and the squares to record.
+        // The trace is only used if a file name is given. fertTrace is only
+        // set while the job is running.
+        string fertTraceFile;
+        bool fertTraceWindowSet;
+        int fertTraceWindow[4];
+        Civ2FertilityTrace *fertTrace;
+
+        // With +region, only the squares of the source from x1,y1 to x2,y2
+        // are copied. With +stamp, each square x,y of the source is copied
+        // to x + stamp[0], y + stamp[1] of the destination, which may be a
+        // different size.
+        bool regionSet;
+        int region[4];
+        bool stampSet;
+        int stamp[2];
+};
+
+// Display information about a saved game information
+void logFileDetails(const Civ2SavedGame& file);
+void describeFile(const Civ2SavedGame& file, ostream& os);
+
+// Copies file to file.bak
+void backupFile(string file) throw (runtime_error);
+
+#endif
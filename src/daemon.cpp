@@ -0,0 +1,722 @@
+/*
+ * The contents of this file are subject to the Mozilla Public
+ * License Version 1.1 (the "License"); you may not use this file
+ * except in compliance with the License. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS
+ * IS" basis, WITHOUT WARRANTY OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * rights and limitations under the License.
+ *
+ * The Original Code is MapCopy, a copy utility for Civ2 maps and saved games.
+ *
+ * The Initial Developer of the Original Code is James Dustin Reichwein.
+ * Portions created by James Dustin Reichwein are
+ * Copyright (C) 2000,2005, James Dustin Reichwein.  All
+ * Rights Reserved.
+ *
+ * Contributor(s):
+ */
+
+
+// daemon.cpp
+// Description:  Runs copy jobs sent over a local socket by other programs.
+//
+// Creation Date: Oct/18/2026
+//
+// Revision History:
+
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include "daemon.h"
+#include "bufpool.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#endif
+
+namespace
+{
+    // Largest frame accepted, to keep a bad client from using up memory
+    const unsigned long MAX_FRAME = 1024 * 1024;
+
+    const char *requestNames[] = { "copy", "fert", "info", "stats", "other" };
+
+#ifndef _WIN32
+    // Read or write exactly size bytes. Returns the number of bytes read,
+    // which is only less than size if the connection was closed.
+    size_t readFully(int fd, char *data, size_t size) throw (runtime_error)
+    {
+        size_t done = 0;
+        while (done < size)
+        {
+            ssize_t n = read(fd, data + done, size - done);
+            if (n == 0) break;
+            if (n < 0)
+            {
+                if (errno == EINTR) continue;
+                throw runtime_error(string("Read Error: ") + strerror(errno));
+            }
+            done += n;
+        }
+        return done;
+    }
+
+    void writeFully(int fd, const char *data, size_t size) throw (runtime_error)
+    {
+        size_t done = 0;
+        while (done < size)
+        {
+            ssize_t n = write(fd, data + done, size - done);
+            if (n < 0)
+            {
+                if (errno == EINTR) continue;
+                throw runtime_error(string("Write Error: ") + strerror(errno));
+            }
+            done += n;
+        }
+    }
+
+    // Fill in the address of a socket, checking that the path fits
+    void makeAddress(const string& path, sockaddr_un& address) throw (runtime_error)
+    {
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path))
+        {
+            throw runtime_error("Socket path is too long: " + path);
+        }
+        strcpy(address.sun_path, path.c_str());
+    }
+
+    // Returns a socket connected to path, or -1
+    int connectTo(const string& path) throw (runtime_error)
+    {
+        sockaddr_un address;
+        makeAddress(path, address);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) throw runtime_error(string("Could not create socket: ") + strerror(errno));
+
+        if (connect(fd, (sockaddr *) &address, sizeof(address)) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+#endif
+
+    // The daemon's current directory is not the client's, so a relative
+    // file name would name the wrong file
+    void checkAbsolute(const string& filename) throw (runtime_error)
+    {
+        if (!isAbsolutePath(filename))
+        {
+            throw runtime_error("File names sent to the daemon must be absolute: " + filename);
+        }
+    }
+
+    // Options of a copy that name a file or directory
+    const char *fileOptions[] = { "memo:", "fcache:", "scache:", "fert-trace:",
+                                  "rules:", "rules1:", "rules2:", "rules3:",
+                                  "rules4:", NULL };
+
+    // Makes the file names in a request absolute: the files of a copy and
+    // the file of fert or info, and the files and directories named by
+    // options
+    void makeFilesAbsolute(vector<string>& args)
+    {
+        if (args.empty()) return;
+
+        string request = copy_to_lower(args[0]);
+        if (request != "copy" && request != "fert" && request != "info") return;
+
+        for (size_t i = 1; i < args.size(); i++)
+        {
+            string& arg = args[i];
+            if (arg.empty()) continue;
+
+            if (arg[0] == '+' || arg[0] == '-')
+            {
+                for (int o = 0; fileOptions[o] != NULL; o++)
+                {
+                    size_t length = strlen(fileOptions[o]);
+                    if (arg.size() > length + 1 &&
+                        copy_to_lower(arg.substr(1, length)) == fileOptions[o])
+                    {
+                        arg = arg.substr(0, length + 1) +
+                              getAbsolutePath(arg.substr(length + 1));
+                        break;
+                    }
+                }
+            }
+            // fert's optional mode follows its file
+            else if (request == "copy" || i == 1)
+            {
+                arg = getAbsolutePath(arg);
+            }
+        }
+    }
+
+    // Splits a request frame into its arguments
+    void splitRequest(const string& frame, vector<string>& args)
+    {
+        string::size_type start = 0;
+        while (start < frame.size())
+        {
+            string::size_type end = frame.find('\0', start);
+            if (end == string::npos) end = frame.size();
+            args.push_back(frame.substr(start, end - start));
+            start = end + 1;
+        }
+    }
+}
+
+#ifndef _WIN32
+
+bool readFrame(int fd, string& frame) throw (runtime_error)
+{
+    unsigned char header[4];
+    size_t n = readFully(fd, reinterpret_cast<char *>(header), sizeof(header));
+    if (n == 0) return false;
+    if (n != sizeof(header)) throw runtime_error("Connection closed in the middle of a frame.");
+
+    unsigned long length = ((unsigned long) header[0] << 24) | (header[1] << 16) |
+                           (header[2] << 8) | header[3];
+    if (length > MAX_FRAME) throw runtime_error("Frame is too large.");
+
+    frame.resize(length);
+    if (length > 0 && readFully(fd, &frame[0], length) != length)
+    {
+        throw runtime_error("Connection closed in the middle of a frame.");
+    }
+    return true;
+}
+
+void writeFrame(int fd, const string& frame) throw (runtime_error)
+{
+    unsigned long length = frame.size();
+    unsigned char header[4];
+    header[0] = (unsigned char) (length >> 24);
+    header[1] = (unsigned char) (length >> 16);
+    header[2] = (unsigned char) (length >> 8);
+    header[3] = (unsigned char) length;
+
+    writeFully(fd, reinterpret_cast<const char *>(header), sizeof(header));
+    writeFully(fd, frame.data(), frame.size());
+}
+
+#else
+
+bool readFrame(int fd, string& frame) throw (runtime_error)
+{
+    throw runtime_error("Daemon mode needs Unix domain sockets.");
+}
+
+void writeFrame(int fd, const string& frame) throw (runtime_error)
+{
+    throw runtime_error("Daemon mode needs Unix domain sockets.");
+}
+
+#endif
+
+/////////////////////// CopyDaemon Methods ////////////////////////////////
+
+const int CopyDaemon::bucketLimits[CopyDaemon::NUM_BUCKETS] =
+    { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000 };
+
+CopyDaemon::CopyDaemon(const string& socketPath, int workers)
+: socket_path(socketPath), num_workers(workers), listen_fd(-1),
+  connections(workers), connection_count(0), stopping(false)
+{
+    for (int i = 0; i < NUM_REQUESTS; i++) requests[i] = failures[i] = 0;
+    for (int i = 0; i <= NUM_BUCKETS; i++) latency[i] = 0;
+    wake_fds[0] = wake_fds[1] = -1;
+}
+
+CopyDaemon::~CopyDaemon()
+{
+#ifndef _WIN32
+    if (listen_fd >= 0)
+    {
+        close(listen_fd);
+        unlink(socket_path.c_str());
+    }
+    if (wake_fds[0] >= 0) close(wake_fds[0]);
+    if (wake_fds[1] >= 0) close(wake_fds[1]);
+#endif
+}
+
+#ifndef _WIN32
+
+void CopyDaemon::run() throw (runtime_error)
+{
+    // A client that goes away should not take the daemon with it
+    signal(SIGPIPE, SIG_IGN);
+
+    // Don't take over the socket of a daemon that is still running. A
+    // socket file left behind by one that is not is removed.
+    int existing = connectTo(socket_path);
+    if (existing >= 0)
+    {
+        close(existing);
+        throw runtime_error("A daemon is already listening on " + socket_path);
+    }
+    unlink(socket_path.c_str());
+
+    if (pipe(wake_fds) != 0)
+    {
+        throw runtime_error(string("Could not create pipe: ") + strerror(errno));
+    }
+    fcntl(wake_fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(wake_fds[1], F_SETFL, O_NONBLOCK);
+
+    sockaddr_un address;
+    makeAddress(socket_path, address);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) throw runtime_error(string("Could not create socket: ") + strerror(errno));
+
+    if (bind(listen_fd, (sockaddr *) &address, sizeof(address)) != 0 ||
+        listen(listen_fd, 16) != 0)
+    {
+        string error = strerror(errno);
+        close(listen_fd);
+        listen_fd = -1;
+        throw runtime_error("Could not listen on " + socket_path + ": " + error);
+    }
+
+    cout << "Listening on " << socket_path << " with " << num_workers
+         << " worker threads." << endl;
+
+    // Messages from requests running at the same time would be jumbled
+    // together, so turn them off
+    context.setQuiet(true);
+    LogOutput::disableLevel(NORMAL);
+    LogOutput::disableLevel(DEBUG);
+
+    vector<thread> threads;
+    for (int i = 0; i < num_workers; i++) threads.push_back(thread(&CopyDaemon::worker, this));
+
+    // Wait for new connections, connections sending a request, and
+    // connections coming back from the workers
+    while (!stopping)
+    {
+        vector<pollfd> fds(2 + idle.size());
+        fds[0].fd = listen_fd;
+        fds[1].fd = wake_fds[0];
+        for (size_t i = 0; i < idle.size(); i++) fds[2 + i].fd = idle[i];
+        for (size_t i = 0; i < fds.size(); i++)
+        {
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+
+        if (poll(&fds[0], fds.size(), -1) < 0)
+        {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        // A closed connection is readable too. The worker finds it closed
+        // and drops it.
+        vector<int> stillIdle;
+        for (size_t i = 0; i < idle.size(); i++)
+        {
+            if (fds[2 + i].revents == 0)
+            {
+                stillIdle.push_back(idle[i]);
+                continue;
+            }
+
+            {
+                lock_guard<mutex> guard(connection_lock);
+                active.insert(idle[i]);
+            }
+            connections.push(idle[i]);
+        }
+        idle.swap(stillIdle);
+
+        if (fds[1].revents != 0)
+        {
+            char buffer[64];
+            while (read(wake_fds[0], buffer, sizeof(buffer)) > 0) { }
+
+            lock_guard<mutex> guard(connection_lock);
+            idle.insert(idle.end(), returned.begin(), returned.end());
+            returned.clear();
+        }
+
+        if (fds[0].revents != 0) acceptConnection();
+    }
+
+    // Nothing more is read from any connection. Requests already read are
+    // finished and answered, and then their connections are closed.
+    for (size_t i = 0; i < idle.size(); i++)
+    {
+        shutdown(idle[i], SHUT_RDWR);
+        close(idle[i]);
+    }
+    idle.clear();
+    {
+        lock_guard<mutex> guard(connection_lock);
+        for (set<int>::iterator i = active.begin(); i != active.end(); ++i)
+        {
+            shutdown(*i, SHUT_RD);
+        }
+    }
+
+    connections.close();
+    for (int i = 0; i < threads.size(); i++) threads[i].join();
+
+    for (size_t i = 0; i < returned.size(); i++) close(returned[i]);
+    returned.clear();
+
+    close(listen_fd);
+    listen_fd = -1;
+    unlink(socket_path.c_str());
+
+    context.flushCaches();
+    cout << "Stopped." << endl;
+}
+
+// Accept a new connection, and watch it for requests
+void CopyDaemon::acceptConnection()
+{
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) return;
+
+    // A client that stops part way through a request or doesn't read its
+    // response only ties up a worker for so long
+    timeval timeout;
+    timeout.tv_sec = IO_TIMEOUT_SECONDS;
+    timeout.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    idle.push_back(fd);
+
+    lock_guard<mutex> guard(stats_lock);
+    connection_count++;
+}
+
+// Wake up run() to look at the returned connections or see that the daemon
+// is stopping. If the pipe is full, run() has a wake up waiting already.
+void CopyDaemon::wake()
+{
+    char c = 0;
+    ssize_t result = write(wake_fds[1], &c, 1);
+    (void) result;
+}
+
+#else
+
+void CopyDaemon::run() throw (runtime_error)
+{
+    throw runtime_error("Daemon mode needs Unix domain sockets, which this system does not have.");
+}
+
+void CopyDaemon::acceptConnection()
+{
+}
+
+void CopyDaemon::wake()
+{
+}
+
+#endif
+
+// Serve one request at a time from the connections that have one, and hand
+// each connection back to run() to wait for the next
+void CopyDaemon::worker()
+{
+    BufferPool::Scope pool(make_shared<BufferPool>());
+
+    int fd;
+    while (connections.pop(fd))
+    {
+        bool keep = serve(fd);
+
+        lock_guard<mutex> guard(connection_lock);
+        active.erase(fd);
+        if (keep && !stopping)
+        {
+            returned.push_back(fd);
+            wake();
+        }
+        else
+        {
+#ifndef _WIN32
+            close(fd);
+#endif
+        }
+    }
+}
+
+// Answer the request waiting on a connection. Returns false if the
+// connection should be closed, because the client closed it, sent garbage
+// or asked the daemon to stop.
+bool CopyDaemon::serve(int fd)
+{
+#ifndef _WIN32
+    try
+    {
+        string frame;
+        if (!readFrame(fd, frame)) return false;
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        vector<string> args;
+        splitRequest(frame, args);
+
+        REQUEST type = OTHER;
+        bool stop = false;
+        string response = handle(args, type, stop);
+
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        record(type, response.compare(0, 5, "ERROR") == 0, elapsed.count());
+
+        writeFrame(fd, response);
+
+        if (stop)
+        {
+            stopping = true;
+            wake();
+            return false;
+        }
+        return true;
+    }
+    catch (exception& e)
+    {
+        // The client went away, sent garbage or timed out. Just drop the
+        // connection.
+    }
+#endif
+    return false;
+}
+
+// Carry out one request, returning the response
+string CopyDaemon::handle(const vector<string>& args, REQUEST& type, bool& stop)
+{
+    try
+    {
+        if (args.empty()) throw runtime_error("Empty request.");
+
+        string request = copy_to_lower(args[0]);
+
+        if (request == "copy")
+        {
+            type = COPY;
+            return "OK\n" + runCopy(vector<string>(args.begin() + 1, args.end()));
+        }
+        else if (request == "fert")
+        {
+            type = FERT;
+            if (args.size() < 2) throw runtime_error("fert needs a file name.");
+
+            // Same as "mapcopy FILE +f:MODE ..."
+            vector<string> copyArgs;
+            copyArgs.push_back(args[1]);
+
+            int next = 2;
+            string mode = "CALC";
+            if (args.size() > 2 && args[2][0] != '+' && args[2][0] != '-')
+            {
+                mode = copy_to_upper(args[2]);
+                if (mode != "CALC" && mode != "CALCALL")
+                {
+                    throw runtime_error("Unknown fertility mode: " + args[2]);
+                }
+                next = 3;
+            }
+            copyArgs.push_back("+f:" + mode);
+            copyArgs.insert(copyArgs.end(), args.begin() + next, args.end());
+
+            return "OK\n" + runCopy(copyArgs);
+        }
+        else if (request == "info")
+        {
+            type = INFO;
+            if (args.size() != 2) throw runtime_error("info needs one file name.");
+            checkAbsolute(args[1]);
+
+            shared_ptr<Civ2SavedGame> game = context.getSource(args[1]);
+
+            ostringstream os;
+            describeFile(*game, os);
+            return "OK\n" + os.str();
+        }
+        else if (request == "stats")
+        {
+            type = STATS;
+            return "OK\n" + getStats();
+        }
+        else if (request == "shutdown")
+        {
+            stop = true;
+            return "OK\n";
+        }
+        else throw runtime_error("Unknown request: " + args[0]);
+    }
+    catch (exception& e)
+    {
+        return string("ERROR\n") + e.what() + "\n";
+    }
+}
+
+// Run a copy job, waiting first for any other job using its files
+string CopyDaemon::runCopy(const vector<string>& args) throw (runtime_error)
+{
+    // args[0] stands in for the program name, like argv[0]
+    vector<string> jobArgs(1, "mapcopy");
+    jobArgs.insert(jobArgs.end(), args.begin(), args.end());
+
+    CopyJob job;
+    try
+    {
+        job.parseCommandLine(jobArgs);
+    }
+    catch (int& e)
+    {
+        throw runtime_error("No files given.");
+    }
+
+    if (!job.isInPlace()) checkAbsolute(job.getSourceFile());
+    checkAbsolute(job.getDestFile());
+
+    vector<string> reads;
+    vector<string> writes;
+    if (!job.isInPlace()) reads.push_back(job.getSourceFile());
+    writes.push_back(job.getDestFile());
+    if (job.getOption(CopyJob::BACKUP) == CopyJob::ON)
+    {
+        writes.push_back(job.getDestFile() + ".bak");
+    }
+
+    {
+        unique_lock<mutex> guard(files_lock);
+        while (!files.canLock(reads, writes)) filesReleased.wait(guard);
+        files.lock(reads, writes);
+    }
+
+    string error;
+    try
+    {
+        job.run(context);
+    }
+    catch (exception& e)
+    {
+        error = e.what();
+        job.unload();
+    }
+
+    {
+        lock_guard<mutex> guard(files_lock);
+        files.unlock(reads, writes);
+        filesReleased.notify_all();
+    }
+
+    if (!error.empty()) throw runtime_error(error);
+
+    if (job.isUnchanged()) return job.getDestFile() + " unchanged\n";
+    return job.getDestFile() + "\n";
+}
+
+// The counters, one per line as a name followed by values
+string CopyDaemon::getStats()
+{
+    ostringstream os;
+
+    lock_guard<mutex> guard(stats_lock);
+
+    os << "connections " << connection_count << endl;
+
+    // Requests and failed requests of each kind
+    for (int i = 0; i < NUM_REQUESTS; i++)
+    {
+        os << "requests_" << requestNames[i] << " " << requests[i] << " "
+           << failures[i] << endl;
+    }
+
+    // Number of requests by how long they took
+    for (int i = 0; i < NUM_BUCKETS; i++)
+    {
+        os << "latency_ms_le_" << bucketLimits[i] << " " << latency[i] << endl;
+    }
+    os << "latency_ms_gt_" << bucketLimits[NUM_BUCKETS - 1] << " "
+       << latency[NUM_BUCKETS] << endl;
+
+    os << "sources_loaded " << context.getSourceLoads() << endl;
+    os << "sources_reused " << context.getSourceHits() << endl;
+    os << "fertility_calculated " << context.getCalculatedFertilityCount() << endl;
+    os << "fertility_reused " << context.getCalculatedFertilityHits() << endl;
+
+    return os.str();
+}
+
+void CopyDaemon::record(REQUEST type, bool failed, double milliseconds)
+{
+    lock_guard<mutex> guard(stats_lock);
+
+    requests[type]++;
+    if (failed) failures[type]++;
+
+    int bucket = 0;
+    while (bucket < NUM_BUCKETS && milliseconds > bucketLimits[bucket]) bucket++;
+    latency[bucket]++;
+}
+
+/////////////////////// Client ////////////////////////////////////////////
+
+int runClient(const string& socketPath, const vector<string>& args) throw (runtime_error)
+{
+#ifndef _WIN32
+    int fd = connectTo(socketPath);
+    if (fd < 0) throw runtime_error("No daemon is listening on " + socketPath);
+
+    vector<string> sent = args;
+    makeFilesAbsolute(sent);
+
+    string request;
+    for (int i = 0; i < sent.size(); i++)
+    {
+        if (i > 0) request += '\0';
+        request += sent[i];
+    }
+
+    string response;
+    try
+    {
+        writeFrame(fd, request);
+        if (!readFrame(fd, response)) throw runtime_error("The daemon closed the connection.");
+    }
+    catch (...)
+    {
+        close(fd);
+        throw;
+    }
+    close(fd);
+
+    string::size_type newline = response.find('\n');
+    string status = response.substr(0, newline);
+    string body = (newline == string::npos) ? "" : response.substr(newline + 1);
+
+    cout << body;
+    return (status == "OK") ? 0 : 1;
+#else
+    throw runtime_error("Daemon mode needs Unix domain sockets, which this system does not have.");
+#endif
+}
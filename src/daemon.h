@@ -0,0 +1,155 @@
+/*
+ * The contents of this file are subject to the Mozilla Public
+ * License Version 1.1 (the "License"); you may not use this file
+ * except in compliance with the License. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS
+ * IS" basis, WITHOUT WARRANTY OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * rights and limitations under the License.
+ *
+ * The Original Code is MapCopy, a copy utility for Civ2 maps and saved games.
+ *
+ * The Initial Developer of the Original Code is James Dustin Reichwein.
+ * Portions created by James Dustin Reichwein are
+ * Copyright (C) 2000,2005, James Dustin Reichwein.  All
+ * Rights Reserved.
+ *
+ * Contributor(s):
+ */
+
+// daemon.h
+// Description:  Runs copy jobs sent over a local socket by other programs.
+//
+// Creation Date: Oct/18/2026
+//
+// Revision History:
+
+#ifndef DAEMON_H_
+#define DAEMON_H_
+
+#include <string>
+#include <vector>
+#include <set>
+#include <stdexcept>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "copyjob.h"
+#include "pipeline.h"
+
+using namespace std;
+
+// The protocol
+// A client connects to the daemon's Unix domain socket and sends requests,
+// each getting one response before the next is read. Requests and
+// responses are frames: a 4 byte length in network byte order, followed by
+// that many bytes. A request frame holds its arguments separated by '\0'.
+// The first argument picks the request:
+//
+//     copy ARGS...           Runs a copy, with the same arguments as mapcopy
+//     fert FILE [MODE] ...   Recalculates the fertility of FILE in place
+//                            (MODE is CALC, the default, or CALCALL)
+//     info FILE              Describes a map or saved game
+//     stats                  Returns the daemon's counters
+//     shutdown               Stops the daemon
+//
+// A response frame starts with "OK" or "ERROR", followed by a newline and
+// any text the request returns (or the error message).
+//
+// File names are used as they are by the daemon, whose current directory
+// is not the client's, so they must be absolute. The daemon refuses
+// relative source and destination names; runClient() makes every file name
+// it sends absolute.
+
+// Reads a frame, returning false if the connection was closed before one
+// started
+bool readFrame(int fd, string& frame) throw (runtime_error);
+void writeFrame(int fd, const string& frame) throw (runtime_error);
+
+// CopyDaemon
+// Listens on a Unix domain socket and runs the requests of any number of
+// clients on a pool of worker threads. run() watches the connections that
+// are waiting for their next request, and hands a connection to a worker
+// for one request at a time, so idle clients do not hold on to workers.
+// All requests share one quiet CopyContext, so source files and calculated
+// fertility stay loaded between requests. Jobs that use the same files are
+// kept apart with FileLocks, the same way as in a batch.
+class CopyDaemon
+{
+    public:
+
+        CopyDaemon(const string& socketPath, int workers);
+        ~CopyDaemon();
+
+        // Serve requests until a shutdown request is received. Requests in
+        // progress are finished, and then every connection is closed.
+        void run() throw (runtime_error);
+
+    private:
+
+        enum REQUEST { COPY = 0, FERT, INFO, STATS, OTHER, NUM_REQUESTS };
+
+        // Upper limits of the latency histogram buckets in milliseconds.
+        // There is one more bucket for everything slower.
+        static const int NUM_BUCKETS = 10;
+        static const int bucketLimits[NUM_BUCKETS];
+
+        // How long a worker waits for the rest of a request, or for a
+        // client to take a response, before dropping the connection
+        static const int IO_TIMEOUT_SECONDS = 30;
+
+        // Not copyable
+        CopyDaemon(const CopyDaemon&);
+        CopyDaemon& operator=(const CopyDaemon&);
+
+        void worker();
+        bool serve(int fd);
+        void acceptConnection();
+        void wake();
+        string handle(const vector<string>& args, REQUEST& type, bool& stop);
+        string runCopy(const vector<string>& args) throw (runtime_error);
+        string getStats();
+        void record(REQUEST type, bool failed, double milliseconds);
+
+        string socket_path;
+        int num_workers;
+        int listen_fd;
+
+        CopyContext context;
+
+        // Connections with a request waiting for a worker
+        BoundedQueue<int> connections;
+
+        // Connections waiting for their next request, which only run()
+        // uses. Workers put the connections they have finished with in
+        // returned, and write a byte to wake_fds[1] to have run() add them
+        // back. active holds those given to workers. Both are guarded by
+        // connection_lock.
+        vector<int> idle;
+        vector<int> returned;
+        set<int> active;
+        mutex connection_lock;
+        int wake_fds[2];
+
+        // Files used by the copies in progress
+        FileLocks files;
+        mutex files_lock;
+        condition_variable filesReleased;
+
+        // Counters for the stats request, guarded by stats_lock
+        unsigned long requests[NUM_REQUESTS];
+        unsigned long failures[NUM_REQUESTS];
+        unsigned long latency[NUM_BUCKETS + 1];
+        unsigned long connection_count;
+        mutex stats_lock;
+
+        atomic<bool> stopping;
+};
+
+// Sends one request to a daemon and prints the response. Returns 0 if the
+// request succeeded, and 1 otherwise.
+int runClient(const string& socketPath, const vector<string>& args) throw (runtime_error);
+
+#endif
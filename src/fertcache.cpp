@@ -0,0 +1,294 @@
+/*
+ * The contents of this file are subject to the Mozilla Public
+ * License Version 1.1 (the "License"); you may not use this file
+ * except in compliance with the License. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS
+ * IS" basis, WITHOUT WARRANTY OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * rights and limitations under the License.
+ * 
+ * The Original Code is MapCopy, a copy utility for Civ2 maps and saved games.
+ * 
+ * The Initial Developer of the Original Code is James Dustin Reichwein.
+ * Portions created by James Dustin Reichwein are
+ * Copyright (C) 2000,2005, James Dustin Reichwein.  All
+ * Rights Reserved.
+ * 
+ * Contributor(s): 
+ */
+
+
+// fertcache.cpp
+// Description:  Contains a disk cache of calculated fertility values.
+//
+// Creation Date: Oct/18/2026
+//
+// Revision History:
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+
+#include "civ2sav.h"
+#include "fertcache.h"
+
+/////////////////////// Civ2FertilityCache Constants ///////////////////////////
+
+namespace
+{
+    // Name of the file listing the entries in least recently used order
+    const char *INDEX_FILE = "index.txt";
+
+    // Every entry file starts with this header
+    struct EntryHeader
+    {
+        char magic[4];
+        unsigned short version;
+        unsigned short reserved;
+        unsigned int squares;
+        unsigned long long digest;
+    };
+
+    const char ENTRY_MAGIC[4] = { 'M', 'C', 'F', 'C' };
+    const unsigned short ENTRY_VERSION = 1;
+}
+
+/////////////////////// Civ2FertilityCache Methods ////////////////////////////
+
+// Opens a cache in the given directory, creating the directory if needed.
+// maxBytes is the limit on the total size of all entries.
+Civ2FertilityCache::Civ2FertilityCache(const string& directory,
+                                       unsigned long maxBytes)
+    throw (runtime_error)
+{
+    dir = directory;
+    max_bytes = maxBytes;
+    total_bytes = 0;
+    index_dirty = false;
+    hits = 0;
+    misses = 0;
+
+    if (!makeDirectory(dir))
+    {
+        throw runtime_error("Could not create fertility cache directory: " + dir);
+    }
+
+    loadIndex();
+}
+
+// Write back any changes to the index. Errors are ignored, since a stale
+// index only costs a few cache misses.
+Civ2FertilityCache::~Civ2FertilityCache()
+{
+    try
+    {
+        flush();
+    }
+    catch (runtime_error& e)
+    {
+    }
+}
+
+// Look up the fertility for a digest. Returns true if an entry was found, and
+// places the fertility of each square into plane.
+bool Civ2FertilityCache::lookup(const Hash64& digest,
+                                vector<unsigned char>& plane)
+    throw (runtime_error)
+{
+    lock_guard<mutex> guard(cache_lock);
+
+    string name = digest.toString();
+
+    map<string, list<Entry>::iterator>::iterator found = by_name.find(name);
+    if (found == by_name.end())
+    {
+        misses++;
+        return false;
+    }
+
+    ifstream theFile(entryPath(name).c_str(), ios_base::binary);
+
+    EntryHeader header;
+    theFile.read(reinterpret_cast<char *>(&header), sizeof(EntryHeader));
+
+    if (theFile.gcount() != sizeof(EntryHeader) ||
+        memcmp(header.magic, ENTRY_MAGIC, sizeof(ENTRY_MAGIC)) != 0 ||
+        header.version != ENTRY_VERSION ||
+        header.digest != digest.getValue())
+    {
+        // The entry is missing or damaged, forget about it
+        LogOutput::log(DEBUG) << "Discarding bad fertility cache entry " << name << endl;
+        total_bytes -= found->second->size;
+        entries.erase(found->second);
+        by_name.erase(found);
+        index_dirty = true;
+        misses++;
+        return false;
+    }
+
+    // Fertility values are 4 bits, so they are stored two to a byte
+    vector<unsigned char> packed((header.squares + 1) / 2);
+    theFile.read(reinterpret_cast<char *>(&packed[0]), packed.size());
+    if (theFile.gcount() != packed.size())
+    {
+        throw runtime_error("Read error in fertility cache entry " + name);
+    }
+
+    plane.resize(header.squares);
+    for (unsigned int i = 0; i < header.squares; i++)
+    {
+        if (i % 2 == 0) plane[i] = packed[i / 2] & 0x0F;
+        else plane[i] = packed[i / 2] >> 4;
+    }
+
+    touch(found->second);
+    hits++;
+    LogOutput::log(DEBUG) << "Fertility cache hit: " << name << endl;
+
+    return true;
+}
+
+// Stores the fertility for a digest. The entry is written to a temporary file
+// first, so that a partially written entry is never seen by lookup().
+void Civ2FertilityCache::store(const Hash64& digest,
+                               const vector<unsigned char>& plane)
+    throw (runtime_error)
+{
+    lock_guard<mutex> guard(cache_lock);
+
+    string name = digest.toString();
+    string path = entryPath(name);
+    string tempPath = path + ".tmp";
+
+    EntryHeader header;
+    memcpy(header.magic, ENTRY_MAGIC, sizeof(ENTRY_MAGIC));
+    header.version = ENTRY_VERSION;
+    header.reserved = 0;
+    header.squares = plane.size();
+    header.digest = digest.getValue();
+
+    vector<unsigned char> packed((plane.size() + 1) / 2, 0);
+    for (unsigned int i = 0; i < plane.size(); i++)
+    {
+        if (i % 2 == 0) packed[i / 2] |= (plane[i] & 0x0F);
+        else packed[i / 2] |= (plane[i] & 0x0F) << 4;
+    }
+
+    {
+        ofstream theFile(tempPath.c_str(), ios_base::out | ios_base::binary);
+        theFile.write(reinterpret_cast<const char *>(&header), sizeof(EntryHeader));
+        theFile.write(reinterpret_cast<const char *>(&packed[0]), packed.size());
+        if (!theFile)
+        {
+            throw runtime_error("Could not write fertility cache entry: " + tempPath);
+        }
+    }
+
+    // rename() will not replace an existing file on all systems
+    remove(path.c_str());
+    if (rename(tempPath.c_str(), path.c_str()) != 0)
+    {
+        remove(tempPath.c_str());
+        throw runtime_error("Could not write fertility cache entry: " + path);
+    }
+
+    map<string, list<Entry>::iterator>::iterator found = by_name.find(name);
+    if (found != by_name.end())
+    {
+        total_bytes -= found->second->size;
+        entries.erase(found->second);
+        by_name.erase(found);
+    }
+
+    Entry e;
+    e.name = name;
+    e.size = sizeof(EntryHeader) + packed.size();
+    entries.push_back(e);
+    by_name[name] = --entries.end();
+    total_bytes += e.size;
+    index_dirty = true;
+
+    LogOutput::log(DEBUG) << "Fertility cache store: " << name << endl;
+
+    evict();
+}
+
+// Writes the index file, if it has changed since it was read
+void Civ2FertilityCache::flush() throw (runtime_error)
+{
+    lock_guard<mutex> guard(cache_lock);
+
+    if (!index_dirty) return;
+
+    string path = entryPath(INDEX_FILE);
+    string tempPath = path + ".tmp";
+    {
+        ofstream theFile(tempPath.c_str());
+        for (list<Entry>::iterator i = entries.begin(); i != entries.end(); i++)
+        {
+            theFile << i->name << " " << i->size << "\n";
+        }
+        if (!theFile)
+        {
+            throw runtime_error("Could not write fertility cache index: " + tempPath);
+        }
+    }
+
+    remove(path.c_str());
+    if (rename(tempPath.c_str(), path.c_str()) != 0)
+    {
+        throw runtime_error("Could not write fertility cache index: " + path);
+    }
+    index_dirty = false;
+}
+
+////////////////////////// Private Helper Functions ///////////////////////////
+
+// Return the path of a file within the cache directory
+string Civ2FertilityCache::entryPath(const string& name) const
+{
+    return dir + "/" + name;
+}
+
+// Read the index file. A missing index just means an empty cache.
+void Civ2FertilityCache::loadIndex()
+{
+    ifstream theFile(entryPath(INDEX_FILE).c_str());
+
+    Entry e;
+    while (theFile >> e.name >> e.size)
+    {
+        if (by_name.find(e.name) != by_name.end()) continue;
+
+        entries.push_back(e);
+        by_name[e.name] = --entries.end();
+        total_bytes += e.size;
+    }
+}
+
+// Mark an entry as the most recently used
+void Civ2FertilityCache::touch(list<Entry>::iterator i)
+{
+    entries.splice(entries.end(), entries, i);
+    index_dirty = true;
+}
+
+// Delete least recently used entries until the cache fits within max_bytes
+void Civ2FertilityCache::evict()
+{
+    while (total_bytes > max_bytes && !entries.empty())
+    {
+        Entry& e = entries.front();
+
+        LogOutput::log(DEBUG) << "Fertility cache evict: " << e.name << endl;
+
+        remove(entryPath(e.name).c_str());
+        total_bytes -= e.size;
+        by_name.erase(e.name);
+        entries.pop_front();
+        index_dirty = true;
+    }
+}
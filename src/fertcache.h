@@ -0,0 +1,108 @@
+/*
+ * The contents of this file are subject to the Mozilla Public
+ * License Version 1.1 (the "License"); you may not use this file
+ * except in compliance with the License. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS
+ * IS" basis, WITHOUT WARRANTY OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * rights and limitations under the License.
+ * 
+ * The Original Code is MapCopy, a copy utility for Civ2 maps and saved games.
+ * 
+ * The Initial Developer of the Original Code is James Dustin Reichwein.
+ * Portions created by James Dustin Reichwein are
+ * Copyright (C) 2000,2005, James Dustin Reichwein.  All
+ * Rights Reserved.
+ * 
+ * Contributor(s): 
+ */
+
+// fertcache.h
+// Description:  Contains a disk cache of calculated fertility values.
+//
+// Creation Date: Oct/18/2026
+//
+// Revision History:
+
+#ifndef FERTCACHE_H_
+#define FERTCACHE_H_
+
+#include <string>
+#include <stdexcept>
+#include <list>
+#include <map>
+#include <vector>
+#include <mutex>
+#include "DustyUtil.h"
+
+using namespace std;
+using namespace DustyUtil;
+
+// Civ2FertilityCache
+// This class keeps the results of fertility calculations in a directory,
+// so that copying the same template map again does not need to recalculate
+// them. Each entry holds the fertility of every square of one map, and is
+// keyed by a digest of everything the calculation depends on (see
+// Civ2Map::addFertilityInputsToHash()).
+//
+// The directory holds one file per entry, named after its digest, and an
+// index file listing the entries from least to most recently used. When the
+// total size of the entries goes over the size limit, the least recently used
+// entries are deleted. The index is written back by flush() or when the
+// cache is destroyed.
+//
+// One cache can be used by several threads at once.
+class Civ2FertilityCache
+{
+    public:
+
+        Civ2FertilityCache(const string& directory, unsigned long maxBytes)
+            throw (runtime_error);
+        ~Civ2FertilityCache();
+
+        // Look up a digest. Returns true and fills in plane if it is found.
+        bool lookup(const Hash64& digest, vector<unsigned char>& plane)
+            throw (runtime_error);
+
+        // Add an entry to the cache, evicting old entries if needed.
+        void store(const Hash64& digest, const vector<unsigned char>& plane)
+            throw (runtime_error);
+
+        // Write the index back to the cache directory
+        void flush() throw (runtime_error);
+
+        int getHits() const { return hits; }
+        int getMisses() const { return misses; }
+
+    private:
+
+        struct Entry
+        {
+            string name;
+            unsigned long size;
+        };
+
+        string entryPath(const string& name) const;
+        void loadIndex();
+        void touch(list<Entry>::iterator i);
+        void evict();
+
+        string dir;
+        unsigned long max_bytes;
+        unsigned long total_bytes;
+
+        // Entries from least to most recently used, and an index into them
+        list<Entry> entries;
+        map<string, list<Entry>::iterator> by_name;
+        bool index_dirty;
+
+        int hits;
+        int misses;
+
+        // Held by lookup(), store() and flush()
+        mutex cache_lock;
+};
+
+#endif
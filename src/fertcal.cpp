@@ -0,0 +1,459 @@
+/*
+ * The contents of this file are subject to the Mozilla Public
+ * License Version 1.1 (the "License"); you may not use this file
+ * except in compliance with the License. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS
+ * IS" basis, WITHOUT WARRANTY OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * rights and limitations under the License.
+ * 
+ * The Original Code is FertCal, a fertility calibration utility for Civ2 maps
+ * and saved games.
+ * 
+ * The Initial Developer of the Original Code is James Dustin Reichwein.
+ * Portions created by James Dustin Reichwein are
+ * Copyright (C) 2005, James Dustin Reichwein.  All
+ * Rights Reserved.
+ * 
+ * Contributor(s): 
+ */
+ 
+// fertcal.cpp
+// Description:  Searches for the fertility weights that best reproduce the
+//               fertility found in a set of saved games.
+//
+// Creation Date: Oct/18/2026
+//
+// Revision History:
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <thread>
+#include <atomic>
+#include "DustyUtil.h"
+#include "civ2sav.h"
+
+
+const char *versionText[] =
+{
+    "FertCal Version 1.0",
+    "Written By James Dustin Reichwein, Copyright (C) 2005. All Rights Reserved.",
+    NULL
+};
+const char *helpText[] =
+{
+//  "12345678901234567890123456789012345678901234567890123456789012345678901234567890
+    "fertcal [options] file1 [file2 ...]",
+    "  Recalculates the fertility of grassland and plains squares in a set of",
+    "  saved games using different weights, and reports which weights match the",
+    "  fertility in the files best.  \"@list\" reads file names from file list.",
+    "  Options:",
+    "    -p name=a:b:s   Tries values a to b in steps of s for weight \"name\".",
+    "                    Names: self, inner, outer, food, shields, trade,",
+    "                    divisor, min, max. Other weights keep their defaults.",
+    "    -threads n      Number of threads to search with. (all cores by default)",
+    "    -top n          Number of best weight sets to report. (10 by default)",
+    NULL
+};
+
+namespace
+{
+    // The weights that can be searched, in the order they are reported
+    enum WEIGHT { SELF = 0, INNER, OUTER, FOOD, SHIELDS, TRADE, DIVISOR,
+                  MIN, MAX, NUM_WEIGHTS };
+
+    const char *weightNames[NUM_WEIGHTS] =
+    { "self", "inner", "outer", "food", "shields", "trade", "divisor", "min",
+      "max" };
+
+    // Fertility values range from 0 to 15, so errors range from -15 to 15
+    const int MAX_ERROR = 15;
+    const int NUM_ERRORS = MAX_ERROR * 2 + 1;
+
+    // Each candidate holds its own histogram, so this keeps the search
+    // within a few hundred megabytes
+    const double MAX_CANDIDATES = 1000000;
+
+    // A grassland or plains square from one of the files. The production
+    // around it is gathered once, so each candidate only has to re-weight it.
+    struct Sample
+    {
+        FertilityYields yields;
+        bool nearCity;
+        unsigned char fertility;
+    };
+
+    // The results of trying one set of weights
+    struct Candidate
+    {
+        float values[NUM_WEIGHTS];
+        int histogram[NUM_ERRORS];
+        int mismatches;
+        long totalError;
+    };
+
+    // The files to read, and the values to try for each weight
+    vector<string> files;
+    vector<float> weightValues[NUM_WEIGHTS];
+
+    unsigned int numThreads = 0;
+    unsigned int numTop = 10;
+}
+
+void parseCommandLine(int argc, char *argv[]);
+void parseWeightRange(const string& spec);
+void addFiles(const string& name);
+void loadSamples(const string& file, vector<Sample>& samples);
+void makeCandidates(vector<Candidate>& candidates);
+void evaluate(Candidate& c, const vector<Sample>& samples);
+FertilityWeights toWeights(const Candidate& c);
+bool betterCandidate(const Candidate& a, const Candidate& b);
+void printCandidate(const Candidate& c, int numSamples, bool histogram);
+void printText(const char *text[]);
+void printErrorMessage(const string message);
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        parseCommandLine(argc, argv);
+
+        LogOutput::setOutputStream(cout);
+        LogOutput::enableLevel(NORMAL);
+
+        vector<Sample> samples;
+        for (unsigned int i = 0; i < files.size(); i++)
+        {
+            loadSamples(files[i], samples);
+        }
+        if (samples.empty()) throw runtime_error("No grassland or plains squares found.");
+
+        cout << samples.size() << " squares read from " << files.size() << " files." << endl;
+
+        vector<Candidate> candidates;
+        makeCandidates(candidates);
+
+        if (numThreads == 0) numThreads = thread::hardware_concurrency();
+        if (numThreads == 0) numThreads = 1;
+        if (numThreads > candidates.size()) numThreads = candidates.size();
+
+        cout << "Trying " << candidates.size() << " weight sets with " 
+             << numThreads << " threads." << endl;
+
+        // Each thread takes the next untried candidate until none are left
+        atomic<unsigned int> next(0);
+        vector<thread> workers;
+        for (unsigned int t = 0; t < numThreads; t++)
+        {
+            workers.push_back(thread([&]()
+            {
+                for (unsigned int i = next++; i < candidates.size(); i = next++)
+                {
+                    evaluate(candidates[i], samples);
+                }
+            }));
+        }
+        for (unsigned int t = 0; t < workers.size(); t++) workers[t].join();
+
+        // The first candidate is always the default weights
+        Candidate defaults = candidates[0];
+
+        unsigned int numReported = min(numTop, (unsigned int)candidates.size());
+        partial_sort(candidates.begin(), candidates.begin() + numReported,
+                     candidates.end(), betterCandidate);
+
+        cout << endl << "Default weights:" << endl;
+        printCandidate(defaults, samples.size(), true);
+
+        cout << endl << "Best weights:" << endl;
+        for (unsigned int i = 0; i < numReported; i++)
+        {
+            printCandidate(candidates[i], samples.size(), i == 0);
+        }
+    }
+    catch(exception& e)
+    {
+        printErrorMessage(e.what());
+        return 1;
+    }
+    catch(int& e)
+    {
+        // int is throw to indicate to print help text
+        // 0 == help text, 1 == version text only
+        printText(versionText);
+        if (e==0) printText(helpText);
+        return 0;
+    }
+    catch(...)
+    {
+        cout << "Unknown error!\n";
+        return 1;
+    }
+    return 0;
+}
+
+// Parses the options and file names
+void parseCommandLine(int argc, char *argv[])
+{
+    if (argc < 2) throw int(0);
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+
+        if (arg == "/?" || arg == "-h") throw int(0);
+        else if (arg == "-p" && i + 1 < argc) parseWeightRange(argv[++i]);
+        else if (arg == "-threads" && i + 1 < argc) numThreads = atoi(argv[++i]);
+        else if (arg == "-top" && i + 1 < argc) numTop = atoi(argv[++i]);
+        else if (arg[0] == '-') throw runtime_error("Unknown option: " + arg);
+        else addFiles(arg);
+    }
+
+    if (files.empty()) throw runtime_error("No files given.");
+    if (numTop < 1) numTop = 1;
+}
+
+// Parses a weight range of the form name=start:end:step
+void parseWeightRange(const string& spec)
+{
+    string::size_type equals = spec.find('=');
+    if (equals == string::npos) throw runtime_error("Invalid weight range: " + spec);
+
+    string name = copy_to_lower(spec.substr(0, equals));
+    int w = 0;
+    while (w < NUM_WEIGHTS && name != weightNames[w]) w++;
+    if (w == NUM_WEIGHTS) throw runtime_error("Unknown weight: " + name);
+
+    float start, end, step;
+    char colon1, colon2;
+    stringstream s(spec.substr(equals + 1));
+    if (!(s >> start >> colon1 >> end >> colon2 >> step) || 
+        colon1 != ':' || colon2 != ':' || step <= 0 || end < start)
+    {
+        throw runtime_error("Invalid weight range: " + spec);
+    }
+
+    weightValues[w].clear();
+    // The small fudge keeps rounding from dropping the last value
+    for (float v = start; v <= end + step / 1000; v += step)
+    {
+        weightValues[w].push_back(v);
+    }
+}
+
+// Adds a file name, or all the file names listed in a file if the name
+// starts with '@'
+void addFiles(const string& name)
+{
+    if (name[0] != '@')
+    {
+        files.push_back(name);
+        return;
+    }
+
+    ifstream list(name.c_str() + 1);
+    if (!list) throw runtime_error("Could not open file list: " + name.substr(1));
+
+    string line;
+    while (getline(list, line))
+    {
+        // Allow blank lines, and DOS line endings
+        if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+        if (!line.empty()) files.push_back(line);
+    }
+}
+
+// Reads the grassland and plains squares of every map in a saved game
+void loadSamples(const string& file, vector<Sample>& samples)
+{
+    Civ2SavedGame game;
+    game.load(file);
+
+    if (game.isMapOnly())
+    {
+        cout << "Skipping " << file << ": .MP files have no fertility." << endl;
+        return;
+    }
+
+    for (int m = 0; m < game.getNumMaps(); m++)
+    {
+        Civ2Map& map = game.getMap(m);
+
+        // Note that due to the nature of Civ2 maps, not every combination
+        // of X and Y is valid.  Specifically, x+y must be even.
+        for (int y = 0; y < map.getHeight(); y++)
+        {
+            for (int x = y % 2; x < map.getWidth(); x+=2)
+            {
+                Civ2TerrainType t = map.getTerrainType(x, y);
+                if (t != GRASSLAND && t != PLAINS) continue;
+
+                Sample s;
+                s.yields = map.calcFertilityYields(x, y);
+                s.nearCity = map.isNearCity(x, y);
+                s.fertility = map.getFertility(x, y);
+                samples.push_back(s);
+            }
+        }
+    }
+}
+
+// Creates every combination of the weight values to try. The first candidate
+// is always the default weights, so the combinations skip them. Throws if
+// there are more than MAX_CANDIDATES combinations.
+void makeCandidates(vector<Candidate>& candidates)
+{
+    FertilityWeights defaults;
+    float defaultValues[NUM_WEIGHTS] =
+    { defaults.selfWeight, defaults.innerWeight, defaults.outerWeight,
+      defaults.foodWeight, defaults.shieldsWeight, defaults.tradeWeight,
+      defaults.divisor, (float)defaults.minFertility, 
+      (float)defaults.maxFertility };
+
+    Candidate c;
+    for (int w = 0; w < NUM_WEIGHTS; w++)
+    {
+        c.values[w] = defaultValues[w];
+        if (weightValues[w].empty()) weightValues[w].push_back(defaultValues[w]);
+    }
+
+    double count = 1;
+    for (int w = 0; w < NUM_WEIGHTS; w++) count *= weightValues[w].size();
+    if (count > MAX_CANDIDATES)
+    {
+        stringstream message;
+        message << "Too many weight sets to try: " << fixed << setprecision(0) 
+                << count << ". Use fewer or larger steps.";
+        throw runtime_error(message.str());
+    }
+
+    candidates.reserve((size_t)count + 1);
+    candidates.push_back(c);
+
+    // Count through the combinations like an odometer
+    int digits[NUM_WEIGHTS] = { 0 };
+    while (true)
+    {
+        bool isDefault = true;
+        for (int w = 0; w < NUM_WEIGHTS; w++)
+        {
+            c.values[w] = weightValues[w][digits[w]];
+            if (fabs(c.values[w] - defaultValues[w]) > 0.0001f) isDefault = false;
+        }
+        if (!isDefault) candidates.push_back(c);
+
+        int w = 0;
+        while (w < NUM_WEIGHTS && ++digits[w] == (int)weightValues[w].size())
+        {
+            digits[w] = 0;
+            w++;
+        }
+        if (w == NUM_WEIGHTS) break;
+    }
+}
+
+// Recalculates the fertility of every sample with a candidate's weights,
+// and records how far off each one is.
+void evaluate(Candidate& c, const vector<Sample>& samples)
+{
+    FertilityWeights weights = toWeights(c);
+
+    for (int e = 0; e < NUM_ERRORS; e++) c.histogram[e] = 0;
+    c.mismatches = 0;
+    c.totalError = 0;
+
+    for (unsigned int i = 0; i < samples.size(); i++)
+    {
+        const Sample& s = samples[i];
+        int f = Civ2Map::combineFertility(s.yields, weights);
+
+        // Apply the same adjustment as Civ2Map::adjustFertility()
+        if (s.nearCity && f > 7) f -= 8;
+
+        int error = f - s.fertility;
+        if (error < -MAX_ERROR) error = -MAX_ERROR;
+        if (error > MAX_ERROR) error = MAX_ERROR;
+
+        c.histogram[error + MAX_ERROR]++;
+        if (error != 0)
+        {
+            c.mismatches++;
+            c.totalError += abs(error);
+        }
+    }
+}
+
+// Converts a candidate's values to FertilityWeights
+FertilityWeights toWeights(const Candidate& c)
+{
+    FertilityWeights w;
+    w.selfWeight = c.values[SELF];
+    w.innerWeight = c.values[INNER];
+    w.outerWeight = c.values[OUTER];
+    w.foodWeight = c.values[FOOD];
+    w.shieldsWeight = c.values[SHIELDS];
+    w.tradeWeight = c.values[TRADE];
+    w.divisor = c.values[DIVISOR];
+    w.minFertility = (int)c.values[MIN];
+    w.maxFertility = (int)c.values[MAX];
+    return w;
+}
+
+// Orders candidates by fewest mismatches, then by smallest total error
+bool betterCandidate(const Candidate& a, const Candidate& b)
+{
+    if (a.mismatches != b.mismatches) return a.mismatches < b.mismatches;
+    return a.totalError < b.totalError;
+}
+
+// Prints a candidate's weights and how well it matched, and optionally
+// a histogram of its errors
+void printCandidate(const Candidate& c, int numSamples, bool histogram)
+{
+    for (int w = 0; w < NUM_WEIGHTS; w++)
+    {
+        cout << weightNames[w] << "=" << c.values[w] << " ";
+    }
+    cout << endl << "  " << (numSamples - c.mismatches) << " of " << numSamples
+         << " match, average error " << setprecision(3)
+         << (double)c.totalError / numSamples << endl;
+
+    if (!histogram) return;
+
+    for (int e = 0; e < NUM_ERRORS; e++)
+    {
+        if (c.histogram[e] == 0) continue;
+        cout << "  " << setw(3) << e - MAX_ERROR << ": " << setw(8) 
+             << c.histogram[e] << endl;
+    }
+}
+
+// Displays an array of strings, one line at a time. Stops when it hits a
+// NULL string
+void printText(const char *text[])
+{
+    if (text == NULL)
+    {
+        cout << "Internal Error: printText called on NULL!";
+    }
+
+    for (int i =0; text[i] != NULL; i++)
+    {
+        cout << text[i] << endl;
+    }
+}
+
+// Displays an error message
+void printErrorMessage(string message)
+{
+    cout << message << endl;
+    cout << "Type \"fertcal /?\" or see the readme.txt file for help.\n";
+}
@@ -0,0 +1,138 @@
+/*
+ * The contents of this file are subject to the Mozilla Public
+ * License Version 1.1 (the "License"); you may not use this file
+ * except in compliance with the License. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ * 
+ * Software distributed under the License is distributed on an "AS
+ * IS" basis, WITHOUT WARRANTY OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * rights and limitations under the License.
+ * 
+ * The Original Code is FertDiff, a fertiltiy diff utility for Civ2 maps and saved games.
+ * 
+ * The Initial Developer of the Original Code is James Dustin Reichwein.
+ * Portions created by James Dustin Reichwein are
+ * Copyright (C) 2005, James Dustin Reichwein.  All
+ * Rights Reserved.
+ * 
+ * Contributor(s): 
+ */
+
+// fertdump.cpp
+// Description:  Prints a fertility trace file written by mapcopy +fert-trace
+//
+// Creation Date: Oct/18/2026
+//
+// Revision History:
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include "DustyUtil.h"
+#include "civ2sav.h"
+#include "fertrace.h"
+
+
+const char *versionText[] =
+{
+    "FertDump Version 1.0",
+    NULL
+};
+const char *helpText[] =
+{
+//  "12345678901234567890123456789012345678901234567890123456789012345678901234567890
+    "fertdump tracefile [x y]",
+    "  Prints the squares recorded in a fertility trace file, one per line.",
+    "  If x and y are given, only that square is printed.",
+    NULL
+};
+
+void printText(const char *text[]);
+void printErrorMessage(const string message);
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        if (argc != 2 && argc != 4) throw int(0);
+
+        bool onlyOne = (argc == 4);
+        int onlyX = onlyOne ? atoi(argv[2]) : 0;
+        int onlyY = onlyOne ? atoi(argv[3]) : 0;
+
+        ifstream is(argv[1], ios_base::in | ios_base::binary);
+        if (!is) throw runtime_error(string("Could not open file: ") + argv[1]);
+
+        Civ2FertilityTrace::readHeader(is);
+
+        // Yields are printed as food/shields/trade for the square itself,
+        // the inner ring and the outer ring of its city radius.
+        cout << "map x,y self inner outer value fert adjusted flags" << endl;
+
+        FertilityTraceRecord r;
+        unsigned long count = 0;
+        while (Civ2FertilityTrace::readRecord(is, r))
+        {
+            if (onlyOne && (r.x != onlyX || r.y != onlyY)) continue;
+
+            count++;
+            cout << int(r.mapPosition) + 1 << " " << r.x << "," << r.y;
+            for (int i = 0; i < FertilityTraceRecord::NUM_YIELDS; i++)
+            {
+                cout << ((i % 3 == 0) ? " " : "/")
+                     << setprecision(3) << r.getYield(FertilityTraceRecord::Yield(i));
+            }
+            cout << " " << setprecision(4) << r.value
+                 << " " << int(r.fertility) << " " << int(r.adjusted);
+
+            if (r.flags & FertilityTraceRecord::GRASSLAND_NO_SHIELD) cout << " noshield";
+            if (r.flags & FertilityTraceRecord::NEAR_CITY) cout << " nearcity";
+            cout << endl;
+        }
+        cout << count << " squares." << endl;
+    }
+    catch(exception& e)
+    {
+        printErrorMessage(e.what());
+        return 1;
+    }
+    catch(int& e)
+    {
+        // int is throw to indicate to print help text
+        // 0 == help text, 1 == version text only
+        printText(versionText);
+        if (e==0) printText(helpText);
+        return 0;
+    }
+    catch(...)
+    {
+        cout << "Unknown error!\n";
+        return 1;
+    }
+    return 0;
+}
+
+
+// Displays an array of strings, one line at a time. Stops when it hits a
+// NULL string
+void printText(const char *text[])
+{
+    if (text == NULL)
+    {
+        cout << "Internal Error: printText called on NULL!";
+    }
+
+    for (int i =0; text[i] != NULL; i++)
+    {
+        cout << text[i] << endl;
+    }
+}
+
+// Displays an error message
+void printErrorMessage(string message)
+{
+    cout << message << endl;
+    cout << "Type \"fertdump\" or see the readme.txt file for help.\n";
+}
@@ -0,0 +1,180 @@
+/*
+ * The contents of this file are subject to the Mozilla Public
+ * License Version 1.1 (the "License"); you may not use this file
+ * except in compliance with the License. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS
+ * IS" basis, WITHOUT WARRANTY OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * rights and limitations under the License.
+ *
+ * The Original Code is MapCopy, a copy utility for Civ2 maps and saved games.
+ *
+ * The Initial Developer of the Original Code is James Dustin Reichwein.
+ * Portions created by James Dustin Reichwein are
+ * Copyright (C) 2000,2005, James Dustin Reichwein.  All
+ * Rights Reserved.
+ *
+ * Contributor(s):
+ */
+
+
+// fertrace.cpp
+// Description:  Records the inputs and results of fertility calculations.
+//
+// Creation Date: Oct/18/2026
+//
+// Revision History:
+
+#include <iostream>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+#include "civ2sav.h"
+#include "fertrace.h"
+
+/////////////////////// Civ2FertilityTrace Constants ///////////////////////////
+
+namespace
+{
+    struct TraceHeader
+    {
+        char magic[4];
+        unsigned short version;
+        unsigned short recordSize;
+    };
+
+    const char TRACE_MAGIC[4] = { 'M', 'C', 'F', 'T' };
+    const unsigned short TRACE_VERSION = 1;
+
+    // Number of records held before writing them out
+    const int BUFFER_RECORDS = 4096;
+
+    // Converts a yield to a count of sixths
+    unsigned short toSixths(float yield)
+    {
+        return (unsigned short) round(yield * 6.0f);
+    }
+}
+
+/////////////////////// Civ2FertilityTrace Methods ////////////////////////////
+
+// Creates the trace file. The window starts out covering every square.
+Civ2FertilityTrace::Civ2FertilityTrace(const string& filename)
+    throw (runtime_error)
+: name(filename), count(0)
+{
+    win_x1 = win_y1 = 0;
+    win_x2 = win_y2 = INT_MAX;
+
+    file.open(name.c_str(), ios_base::out | ios_base::binary | ios_base::trunc);
+    if (!file) throw runtime_error("Could not create fertility trace file: " + name);
+
+    TraceHeader header;
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.recordSize = sizeof(FertilityTraceRecord);
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    buffer.reserve(BUFFER_RECORDS);
+}
+
+Civ2FertilityTrace::~Civ2FertilityTrace()
+{
+    try
+    {
+        flush();
+    }
+    catch (runtime_error& e)
+    {
+        LogOutput::log(NORMAL) << "Warning: " << e.what() << endl;
+    }
+}
+
+void Civ2FertilityTrace::setWindow(int x1, int y1, int x2, int y2)
+{
+    win_x1 = x1;
+    win_y1 = y1;
+    win_x2 = x2;
+    win_y2 = y2;
+}
+
+// Add a record for one square
+void Civ2FertilityTrace::record(int mapPosition, int x, int y,
+                                const FertilityYields& yields, float value,
+                                unsigned char fertility, bool nearCity)
+{
+    FertilityTraceRecord r;
+
+    r.mapPosition = (unsigned char) mapPosition;
+    r.flags = 0;
+    if (yields.grasslandNoShield) r.flags |= FertilityTraceRecord::GRASSLAND_NO_SHIELD;
+    if (nearCity) r.flags |= FertilityTraceRecord::NEAR_CITY;
+    r.x = (unsigned short) x;
+    r.y = (unsigned short) y;
+
+    r.yieldSixths[FertilityTraceRecord::SELF_FOOD] = toSixths(yields.selfFood);
+    r.yieldSixths[FertilityTraceRecord::SELF_SHIELDS] = toSixths(yields.selfShields);
+    r.yieldSixths[FertilityTraceRecord::SELF_TRADE] = toSixths(yields.selfTrade);
+    r.yieldSixths[FertilityTraceRecord::INNER_FOOD] = toSixths(yields.innerFood);
+    r.yieldSixths[FertilityTraceRecord::INNER_SHIELDS] = toSixths(yields.innerShields);
+    r.yieldSixths[FertilityTraceRecord::INNER_TRADE] = toSixths(yields.innerTrade);
+    r.yieldSixths[FertilityTraceRecord::OUTER_FOOD] = toSixths(yields.outerFood);
+    r.yieldSixths[FertilityTraceRecord::OUTER_SHIELDS] = toSixths(yields.outerShields);
+    r.yieldSixths[FertilityTraceRecord::OUTER_TRADE] = toSixths(yields.outerTrade);
+
+    r.value = value;
+    r.fertility = fertility;
+
+    // Same as Civ2Map::adjustFertility()
+    r.adjusted = (nearCity && fertility > 7) ? fertility - 8 : fertility;
+    r.reserved = 0;
+
+    buffer.push_back(r);
+    count++;
+
+    if (buffer.size() >= BUFFER_RECORDS) flush();
+}
+
+// Write out any buffered records
+void Civ2FertilityTrace::flush() throw (runtime_error)
+{
+    if (buffer.empty()) return;
+
+    file.write(reinterpret_cast<const char *>(&buffer[0]),
+               buffer.size() * sizeof(FertilityTraceRecord));
+    file.flush();
+    buffer.clear();
+
+    if (!file) throw runtime_error("Could not write fertility trace file: " + name);
+}
+
+void Civ2FertilityTrace::readHeader(istream& is) throw (runtime_error)
+{
+    TraceHeader header;
+    is.read(reinterpret_cast<char *>(&header), sizeof(header));
+
+    if (!is || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0)
+    {
+        throw runtime_error("Not a fertility trace file.");
+    }
+    if (header.version != TRACE_VERSION ||
+        header.recordSize != sizeof(FertilityTraceRecord))
+    {
+        throw runtime_error("Unsupported fertility trace file version.");
+    }
+}
+
+bool Civ2FertilityTrace::readRecord(istream& is, FertilityTraceRecord& r)
+    throw (runtime_error)
+{
+    is.read(reinterpret_cast<char *>(&r), sizeof(r));
+
+    if (is.gcount() == 0) return false;
+    if (is.gcount() != sizeof(r)) throw runtime_error("Truncated fertility trace file.");
+
+    return true;
+}
@@ -0,0 +1,125 @@
+/*
+ * The contents of this file are subject to the Mozilla Public
+ * License Version 1.1 (the "License"); you may not use this file
+ * except in compliance with the License. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS
+ * IS" basis, WITHOUT WARRANTY OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * rights and limitations under the License.
+ *
+ * The Original Code is MapCopy, a copy utility for Civ2 maps and saved games.
+ *
+ * The Initial Developer of the Original Code is James Dustin Reichwein.
+ * Portions created by James Dustin Reichwein are
+ * Copyright (C) 2000,2005, James Dustin Reichwein.  All
+ * Rights Reserved.
+ *
+ * Contributor(s):
+ */
+
+// fertrace.h
+// Description:  Records the inputs and results of fertility calculations.
+//
+// Creation Date: Oct/18/2026
+//
+// Revision History:
+
+#ifndef FERTRACE_H_
+#define FERTRACE_H_
+
+#include <string>
+#include <stdexcept>
+#include <fstream>
+#include <vector>
+
+using namespace std;
+
+struct FertilityYields;
+
+// FertilityTraceRecord
+// One calculated square, as stored in a trace file. All yields are a
+// multiple of 1/6 (irrigation adds 2/3 food, mining adds 1/2 shield), so
+// they are stored exactly as a count of sixths.
+struct FertilityTraceRecord
+{
+    enum Yield { SELF_FOOD=0, SELF_SHIELDS, SELF_TRADE,
+                 INNER_FOOD, INNER_SHIELDS, INNER_TRADE,
+                 OUTER_FOOD, OUTER_SHIELDS, OUTER_TRADE, NUM_YIELDS };
+
+    // Bits in flags
+    static const unsigned char GRASSLAND_NO_SHIELD = 0x01;
+    static const unsigned char NEAR_CITY = 0x02;
+
+    unsigned char mapPosition;
+    unsigned char flags;
+    unsigned short x;
+    unsigned short y;
+    unsigned short yieldSixths[NUM_YIELDS];
+
+    // The combined value before rounding
+    float value;
+
+    // The fertility after rounding and clamping, and after the adjustment
+    // for being near a city
+    unsigned char fertility;
+    unsigned char adjusted;
+    unsigned short reserved;
+
+    float getYield(Yield y) const { return yieldSixths[y] / 6.0f; }
+};
+
+// Civ2FertilityTrace
+// Writes a FertilityTraceRecord for each square whose fertility is
+// calculated by a Civ2Map that has been given a trace (see
+// Civ2Map::setFertilityTrace()). Only squares within the trace's window are
+// recorded.  Records are buffered, and written when the buffer fills, on
+// flush(), or when the trace is destroyed.
+//
+// The file is a small header followed by fixed size records in the host's
+// byte order. Read it with readHeader() and readRecord(), or with FertDump.
+//
+// The calls into the trace from Civ2Map can be compiled out entirely by
+// defining MAPCOPY_NO_FERT_TRACE.
+class Civ2FertilityTrace
+{
+    public:
+
+        Civ2FertilityTrace(const string& filename) throw (runtime_error);
+        ~Civ2FertilityTrace();
+
+        // Limit recording to squares from x1,y1 to x2,y2 inclusive
+        void setWindow(int x1, int y1, int x2, int y2);
+
+        bool inWindow(int x, int y) const
+        {
+            return (x >= win_x1 && x <= win_x2 && y >= win_y1 && y <= win_y2);
+        }
+
+        void record(int mapPosition, int x, int y, const FertilityYields& yields,
+                    float value, unsigned char fertility, bool nearCity);
+
+        void flush() throw (runtime_error);
+
+        unsigned long getCount() const { return count; }
+
+        // Reading back a trace file. readHeader() throws if the stream is not
+        // a trace file; readRecord() returns false at the end of the file.
+        static void readHeader(istream& is) throw (runtime_error);
+        static bool readRecord(istream& is, FertilityTraceRecord& r) throw (runtime_error);
+
+    private:
+
+        string name;
+        ofstream file;
+        vector<FertilityTraceRecord> buffer;
+        unsigned long count;
+
+        int win_x1;
+        int win_y1;
+        int win_x2;
+        int win_y2;
+};
+
+#endif
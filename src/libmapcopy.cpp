@@ -0,0 +1,377 @@
+/*
+ * The contents of this file are subject to the Mozilla Public
+ * License Version 1.1 (the "License"); you may not use this file
+ * except in compliance with the License. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS
+ * IS" basis, WITHOUT WARRANTY OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * rights and limitations under the License.
+ *
+ * The Original Code is MapCopy, a copy utility for Civ2 maps and saved games.
+ *
+ * The Initial Developer of the Original Code is James Dustin Reichwein.
+ * Portions created by James Dustin Reichwein are
+ * Copyright (C) 2000,2005, James Dustin Reichwein.  All
+ * Rights Reserved.
+ *
+ * Contributor(s):
+ */
+
+
+// libmapcopy.cpp
+// Description:  The C interface to the MapCopy library. Each function
+//               catches every exception and turns it into a status code.
+//
+// Creation Date: Oct/18/2026
+//
+// Revision History:
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <cstring>
+#include <new>
+
+#define MC_BUILDING_LIBRARY
+#include "libmapcopy.h"
+#include "civ2sav.h"
+#include "copyjob.h"
+
+struct mc_game
+{
+    Civ2SavedGame game;
+};
+
+struct mc_context
+{
+    CopyContext context;
+};
+
+namespace
+{
+    // The message returned by mc_last_error()
+    thread_local string lastError;
+
+    // Thrown for errors in the arguments passed by the caller
+    class InvalidArgument : public runtime_error
+    {
+        public:
+        InvalidArgument(const string& message) : runtime_error(message) { }
+    };
+
+    // Called from a catch (...) block. Records the message of the exception
+    // being handled, and returns the matching status.
+    int failed()
+    {
+        try
+        {
+            throw;
+        }
+        catch (bad_alloc& e)
+        {
+            lastError = "Out of memory.";
+            return MC_OUT_OF_MEMORY;
+        }
+        catch (InvalidArgument& e)
+        {
+            lastError = e.what();
+            return MC_INVALID_ARGUMENT;
+        }
+        catch (exception& e)
+        {
+            lastError = e.what();
+            return MC_ERROR;
+        }
+        catch (int& e)
+        {
+            // CopyJob throws int(0) where mapcopy would show its help text
+            lastError = "No files given, or only help or version text asked for.";
+            return MC_INVALID_ARGUMENT;
+        }
+        catch (...)
+        {
+            lastError = "Unknown error.";
+            return MC_ERROR;
+        }
+    }
+
+    void checkHandle(const void *handle) throw (runtime_error)
+    {
+        if (handle == NULL) throw InvalidArgument("NULL handle.");
+    }
+
+    // Returns map n, counting from 1, checking that a layer of it fits in
+    // size bytes
+    const Civ2Map& getLayerMap(const mc_game *game, int map, int layer, size_t size)
+        throw (runtime_error)
+    {
+        checkHandle(game);
+        if (map < 1 || map > game->game.getNumMaps())
+        {
+            throw InvalidArgument("No such map.");
+        }
+        if (layer < 0 || layer >= MC_NUM_LAYERS) throw InvalidArgument("Unknown layer.");
+
+        const Civ2Map& m = game->game.getMap(map - 1);
+        if (size < (size_t) m.getArea()) throw InvalidArgument("Buffer is smaller than the map.");
+        return m;
+    }
+}
+
+const char *mc_version(void)
+{
+    return "1.2";
+}
+
+const char *mc_last_error(void)
+{
+    return lastError.c_str();
+}
+
+int mc_context_create(mc_context **context)
+{
+    try
+    {
+        checkHandle(context);
+        *context = new mc_context();
+        return MC_OK;
+    }
+    catch (...)
+    {
+        return failed();
+    }
+}
+
+void mc_context_free(mc_context *context)
+{
+    delete context;
+}
+
+int mc_game_load(const char *filename, mc_game **game)
+{
+    try
+    {
+        checkHandle(filename);
+        checkHandle(game);
+
+        SmartPointer<mc_game> g = new mc_game();
+        g->game.load(filename);
+        *game = g.releaseControl();
+        return MC_OK;
+    }
+    catch (...)
+    {
+        return failed();
+    }
+}
+
+int mc_game_load_memory(const void *data, size_t size, int map_only, mc_game **game)
+{
+    try
+    {
+        checkHandle(data);
+        checkHandle(game);
+
+        DustyUtil::memoryBuf buf(static_cast<const char *>(data), size);
+        istream is(&buf);
+
+        SmartPointer<mc_game> g = new mc_game();
+        g->game.load(is, map_only != 0);
+        *game = g.releaseControl();
+        return MC_OK;
+    }
+    catch (...)
+    {
+        return failed();
+    }
+}
+
+int mc_game_create_map(int width, int height, mc_game **game)
+{
+    try
+    {
+        checkHandle(game);
+        if (width <= 0 || height <= 0) throw InvalidArgument("Invalid map size.");
+
+        SmartPointer<mc_game> g = new mc_game();
+        g->game.createMP(width, height);
+        *game = g.releaseControl();
+        return MC_OK;
+    }
+    catch (...)
+    {
+        return failed();
+    }
+}
+
+void mc_game_free(mc_game *game)
+{
+    delete game;
+}
+
+int mc_game_save(const mc_game *game, const char *filename)
+{
+    try
+    {
+        checkHandle(game);
+        checkHandle(filename);
+
+        game->game.save(filename);
+        return MC_OK;
+    }
+    catch (...)
+    {
+        return failed();
+    }
+}
+
+int mc_game_save_memory(const mc_game *game, void *buffer, size_t size, size_t *needed)
+{
+    try
+    {
+        checkHandle(game);
+
+        ostringstream os(ios_base::out | ios_base::binary);
+        game->game.save(os);
+
+        string data = os.str();
+        if (needed != NULL) *needed = data.size();
+        if (buffer == NULL || size < data.size())
+        {
+            lastError = "Buffer is too small.";
+            return MC_BUFFER_TOO_SMALL;
+        }
+
+        memcpy(buffer, data.data(), data.size());
+        return MC_OK;
+    }
+    catch (...)
+    {
+        return failed();
+    }
+}
+
+int mc_game_get_info(const mc_game *game, mc_game_info *info)
+{
+    try
+    {
+        checkHandle(game);
+        checkHandle(info);
+
+        const Civ2SavedGame& g = game->game;
+        info->width = g.getWidth();
+        info->height = g.getHeight();
+        info->num_maps = g.getNumMaps();
+        info->squares = g.getMap(0).getArea();
+        info->map_only = g.isMapOnly() ? 1 : 0;
+        info->flat_earth = g.isFlatEarth() ? 1 : 0;
+        info->seed = g.getSeed();
+        info->version = g.getVersionString();
+        return MC_OK;
+    }
+    catch (...)
+    {
+        return failed();
+    }
+}
+
+int mc_layer_get(const mc_game *game, int map, int layer,
+                 unsigned char *buffer, size_t size)
+{
+    try
+    {
+        checkHandle(buffer);
+        const Civ2Map& m = getLayerMap(game, map, layer, size);
+        m.getLayer(Civ2Map::Layer(layer), buffer);
+        return MC_OK;
+    }
+    catch (...)
+    {
+        return failed();
+    }
+}
+
+int mc_layer_set(mc_game *game, int map, int layer,
+                 const unsigned char *buffer, size_t size)
+{
+    try
+    {
+        checkHandle(buffer);
+        getLayerMap(game, map, layer, size);
+        game->game.getMap(map - 1).setLayer(Civ2Map::Layer(layer), buffer);
+        return MC_OK;
+    }
+    catch (...)
+    {
+        return failed();
+    }
+}
+
+int mc_copy_games(mc_context *context, const mc_game *source, mc_game *dest,
+                  const char *options)
+{
+    try
+    {
+        checkHandle(context);
+        checkHandle(dest);
+
+        bool inPlace = (source == NULL || source == dest);
+        const Civ2SavedGame& one = inPlace ? dest->game : source->game;
+        Civ2SavedGame& two = dest->game;
+
+        vector<string> args;
+        if (options != NULL) DustyUtil::splitArguments(options, args);
+
+        CopyJob job;
+        try
+        {
+            job.parseGameOptions(args, one.isMapOnly(), two.isMapOnly(), inPlace);
+        }
+        catch (runtime_error& e)
+        {
+            throw InvalidArgument(e.what());
+        }
+
+        job.copyGames(context->context, one, two);
+        return MC_OK;
+    }
+    catch (...)
+    {
+        return failed();
+    }
+}
+
+int mc_run(mc_context *context, int argc, const char *const *argv)
+{
+    try
+    {
+        checkHandle(context);
+        checkHandle(argv);
+
+        vector<string> args;
+        for (int i = 0; i < argc; i++)
+        {
+            checkHandle(argv[i]);
+            args.push_back(argv[i]);
+        }
+
+        CopyJob job;
+        try
+        {
+            job.parseCommandLine(args);
+        }
+        catch (runtime_error& e)
+        {
+            throw InvalidArgument(e.what());
+        }
+
+        job.run(context->context);
+        return MC_OK;
+    }
+    catch (...)
+    {
+        return failed();
+    }
+}
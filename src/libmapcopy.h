@@ -0,0 +1,165 @@
+/*
+ * The contents of this file are subject to the Mozilla Public
+ * License Version 1.1 (the "License"); you may not use this file
+ * except in compliance with the License. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS
+ * IS" basis, WITHOUT WARRANTY OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * rights and limitations under the License.
+ *
+ * The Original Code is MapCopy, a copy utility for Civ2 maps and saved games.
+ *
+ * The Initial Developer of the Original Code is James Dustin Reichwein.
+ * Portions created by James Dustin Reichwein are
+ * Copyright (C) 2000,2005, James Dustin Reichwein.  All
+ * Rights Reserved.
+ *
+ * Contributor(s):
+ */
+
+/* libmapcopy.h
+ * Description:  The C interface to the MapCopy library, for programs that
+ *               want to load, change and copy maps without running
+ *               mapcopy.exe. It can be used from C, C++, or any language
+ *               that can call C functions.
+ *
+ * Creation Date: Oct/18/2026
+ *
+ * Revision History:
+ */
+
+#ifndef LIBMAPCOPY_H_
+#define LIBMAPCOPY_H_
+
+#include <stddef.h>
+
+#if defined(_WIN32)
+#  if defined(MC_BUILDING_LIBRARY)
+#    define MC_API __declspec(dllexport)
+#  elif defined(MC_SHARED)
+#    define MC_API __declspec(dllimport)
+#  else
+#    define MC_API
+#  endif
+#else
+#  define MC_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Every function that can fail returns one of these. When it is not MC_OK,
+ * mc_last_error() describes what went wrong. No function throws a C++
+ * exception.
+ */
+enum mc_status
+{
+    MC_OK = 0,
+    MC_ERROR = 1,              /* The file or copy failed */
+    MC_INVALID_ARGUMENT = 2,   /* A NULL handle, bad map number, bad option... */
+    MC_BUFFER_TOO_SMALL = 3,   /* See mc_game_save_memory() */
+    MC_OUT_OF_MEMORY = 4
+};
+
+/* The parts of each square that can be read or written in bulk. Terrain,
+ * improvements, visibility, body counter and city radius are the bytes
+ * stored in the file. Ownership and fertility are 0-15.
+ */
+enum mc_layer
+{
+    MC_LAYER_TERRAIN = 0,
+    MC_LAYER_IMPROVEMENTS,
+    MC_LAYER_VISIBILITY,
+    MC_LAYER_BODY_COUNTER,
+    MC_LAYER_CITY_RADIUS,
+    MC_LAYER_OWNERSHIP,
+    MC_LAYER_FERTILITY,
+    MC_NUM_LAYERS
+};
+
+/* A loaded map (.MP) or saved game (.SAV). Functions taking a const game
+ * only read it, and can be called from several threads at once, as long as
+ * no thread is changing it.
+ */
+typedef struct mc_game mc_game;
+
+/* What is shared between copies: loaded source files, fertility caches and
+ * so on. One context can be used by several threads at once.
+ */
+typedef struct mc_context mc_context;
+
+typedef struct mc_game_info
+{
+    int width;          /* In Civ2 coordinates, as in the map editor */
+    int height;
+    int num_maps;
+    int squares;        /* Squares per map, which is the size of a layer */
+    int map_only;       /* 1 for a .MP file, 0 for a .SAV file */
+    int flat_earth;
+    unsigned short seed;
+    const char *version;
+} mc_game_info;
+
+/* The version of the library, such as "1.2" */
+MC_API const char *mc_version(void);
+
+/* The message for the last call on this thread that did not return MC_OK.
+ * It stays valid until the next call on this thread.
+ */
+MC_API const char *mc_last_error(void);
+
+MC_API int mc_context_create(mc_context **context);
+MC_API void mc_context_free(mc_context *context);
+
+/* Load a game from a file, or from the contents of one in memory. map_only
+ * is 1 for the contents of a .MP file.
+ */
+MC_API int mc_game_load(const char *filename, mc_game **game);
+MC_API int mc_game_load_memory(const void *data, size_t size, int map_only,
+                               mc_game **game);
+
+/* Create an empty map, as for a new .MP file, of the given size */
+MC_API int mc_game_create_map(int width, int height, mc_game **game);
+
+MC_API void mc_game_free(mc_game *game);
+
+/* Save a game to a file, or into a buffer owned by the caller. If the
+ * buffer is too small, MC_BUFFER_TOO_SMALL is returned and *needed is set
+ * to the size required. buffer may be NULL to just find the size.
+ */
+MC_API int mc_game_save(const mc_game *game, const char *filename);
+MC_API int mc_game_save_memory(const mc_game *game, void *buffer, size_t size,
+                               size_t *needed);
+
+MC_API int mc_game_get_info(const mc_game *game, mc_game_info *info);
+
+/* Copy one layer of map n (counting from 1) to or from a buffer owned by
+ * the caller, which must hold at least mc_game_info.squares bytes, in the
+ * order squares are stored in the file.
+ */
+MC_API int mc_layer_get(const mc_game *game, int map, int layer,
+                        unsigned char *buffer, size_t size);
+MC_API int mc_layer_set(mc_game *game, int map, int layer,
+                        const unsigned char *buffer, size_t size);
+
+/* Copy from source into dest, with options as on the mapcopy command line,
+ * separated by spaces, such as "+f:CALC -v". If source is NULL, dest is
+ * modified in place. options may be NULL for the defaults. The files named
+ * by options such as +rules and +fcache are used as usual.
+ */
+MC_API int mc_copy_games(mc_context *context, const mc_game *source,
+                         mc_game *dest, const char *options);
+
+/* Run a copy between files, exactly like the mapcopy command line. argv[0]
+ * is not used.
+ */
+MC_API int mc_run(mc_context *context, int argc, const char *const *argv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -32,11 +32,27 @@
 // Feb/13/2005  JDR  Added options for resource supression
 // Feb/20/2005  JDR  1.2Beta1 release of ToT multi-map support
 // Jul/02/2005  JDR  1.2 final version.
+// Oct/18/2026       Moved the copy itself to copyjob.cpp. Added --batch.
+// Oct/18/2026       Added --to for copying one source into many files.
+// Oct/18/2026       Added --daemon and --client.
+// Oct/18/2026       Added --spool and --submit.
+// Oct/18/2026       Added --layer.
+// Oct/18/2026       Added --ops and --ops-file.
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <vector>
 #include "DustyUtil.h"
 #include "civ2sav.h"
+#include <list>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include "copyjob.h"
+#include "pipeline.h"
+#include "daemon.h"
+#include "bufpool.h"
+#include "spool.h"
 
 
 const char *versionText[] =
@@ -51,16 +67,40 @@ const char *helpText[] =
     "mapcopy [source] dest [ options ]",
     "  Copies the Civ2 map from file \"source\" to file \"dest\".",
     "  See readme.txt for more information.",
+    "mapcopy --layer what=source [--layer what=source ...] dest [ options ]",
+    "  Copies the layers named by what, such as t,rs or o, from each source into",
+    "  dest, loading every file once. The options then apply to dest in place.",
+    "mapcopy --ops \"step; step; ...\" dest [ options ]",
+    "mapcopy --ops-file steps.txt dest [ options ]",
+    "  Runs each step on dest in turn, loading and saving it once. A step is",
+    "  what=source, as for --layer, or an option such as f:CALC or rules:FILE.",
+    "mapcopy --batch jobs.txt [--threads n|r,c,w] [--memory MB]",
+    "  Runs the copies in jobs.txt, which has one mapcopy command line per line.",
+    "  --threads runs them on n threads per stage, or r reader, c copier and w",
+    "  writer threads, holding at most MB megabytes of files at once.",
+    "mapcopy source --to dest1 [dest2 ...] [ options ] [--threads ...] [--memory MB]",
+    "  Copies source into every dest, loading it only once. Each dest may be a",
+    "  wildcard pattern such as *.sav. The copies are run on several threads.",
+    "mapcopy --daemon socket [--threads n]",
+    "  Runs requests sent to the Unix domain socket \"socket\" by other programs.",
+    "mapcopy --client socket copy|fert|info|stats|shutdown [arguments]",
+    "  Sends one request to a daemon. See readme.txt for the requests.",
+    "mapcopy --submit dir jobs.txt",
+    "  Adds the copies in jobs.txt to the queue of spool directory dir.",
+    "mapcopy --spool dir [--node k/n] [--lease seconds] [--threads n] [--name id]",
+    "  Runs copies from spool directory dir, shared with other mapcopy processes.",
+    "  --node only runs the k'th of n parts of the jobs, split by destination.",
     "  Options: (+x turns option x on. -x turns option x off.) ",
     "    s[eed]          Copies the resource seed.",
     "    t[errain]       Copies the terrain data.",
     "    i[mprovement]   Copies terrain improvements.",
     "    v[isibility]    Copies terrain visibility.",
-    "    o[wnership]     Copies terrain owner ship.",
+    "    o[wnership][:CALC]",
+    "                    Copies terrain owner ship, or calculates it from cities.",
     "    rs[:SET|:CLEAR] Copies or sets resources supression.",
     "    cs              Copies civilization start locations from an MP file.",
-    "    bc              Copies \"body counter\" values for continents.",
-    "    cr              Copies \"city radius\" data for terrain.",
+    "    bc[:CALC]       Copies or calculates \"body counter\" values for continents.",
+    "    cr[:CALC]       Copies or calculates \"city radius\" data for terrain.",
     "    verb[ose][:DEV] Enables informative screen messages. Using 'DEV' results",
     "                    in a very verbose output meant for debugging mapcopy.",
     "    b[ackup]        Creates of a backup named \"dest.bak\". (on by default)",
@@ -70,244 +110,92 @@ const char *helpText[] =
     "    cv[:CURRENT]    Copies civ specific visible terrain improvement data.",
     "    sm:n or sm:ALL  Picks which map in a multi-map ToT file to copy from.",
     "    dm:n or dm:ALL  Picks which map in a multi-map ToT file to copy to.",
+    "    fcache:DIR      Keeps CALC/CALCALL fertility results in directory DIR.",
+    "    fcachemax:n     Limits the fertility cache to n kilobytes.",
+    "    scache:DIR      Keeps snapshots of loaded source files in directory DIR.",
+    "    scachemax:n     Limits the snapshot cache to n kilobytes.",
+    "    rules[n]:FILE   Calculates fertility with the terrain rules in a",
+    "                    rules.txt FILE, for all maps or only for map n.",
+    "    fert-trace:FILE Records how the fertility of each square is calculated",
+    "                    by CALC/CALCALL in FILE.",
+    "    fert-trace-window:x1,y1,x2,y2",
+    "                    Only records squares from x1,y1 to x2,y2.",
+    "    region:x1,y1,x2,y2",
+    "                    Only copies the source squares from x1,y1 to x2,y2.",
+    "    stamp:x,y       Copies the source to x,y of a destination of any size.",
+    "    skip            Does not save the destination if the copy changes nothing.",
+    "    memo:FILE       Remembers copies that change nothing in FILE, and skips",
+    "                    them without loading the files next time.",
     NULL
 };
 
-
-
-namespace
-{
-    enum OPTIONS { SEED = 0, TERRAIN, IMPROVEMENT, VISIBILITY, OWNERSHIP,
-                   CIV_START, BODY_COUNTER, CITY_RADIUS, VERBOSE, BACKUP,
-                   FERTILITY, CIV_VIEW, RESOURCE_SUP, NUM_OPTIONS };
-    enum OP_VALUE { OFF=0, ON=1, COPY=1, CALC, CALCALL, ADJUST, CURRENT, ZERO,
-                    SET, CLEAR, DEV };
-
-    // The options
-    OP_VALUE options[NUM_OPTIONS];
-
-    // Possible file type configurations
-    enum COPYTYPE { MP2MP=0, SAV2SAV, MP2SAV, SAV2MP, MP, SAV, NUM_TYPES };
-
-    // Default option values
-    OP_VALUE defaults[NUM_OPTIONS][NUM_TYPES] =
-    {
-        //                  MP->MP   SAV->SAV   MP->SAV   SAV->MP, MP,  SAV
-        /* seed */        { COPY,    COPY,      COPY,     COPY,    OFF, OFF},
-        /* terrain */     { COPY,    COPY,      COPY,     COPY,    OFF, OFF},
-        /* improvement */ { COPY,    OFF,       OFF,      OFF,     OFF, OFF},
-        /* visibility */  { COPY,    OFF,       OFF,      OFF,     OFF, OFF},
-        /* owenership */  { COPY,    OFF,       OFF,      OFF,     OFF, OFF},
-        /* civ_start  */  { COPY,    OFF,       OFF,      OFF,     OFF, OFF},
-        /* body_counter */{ COPY,    COPY,      COPY,     COPY,    OFF, OFF},
-        /* city_radius */ { COPY,    OFF,       OFF,      OFF,     OFF, OFF},
-        /* verbose */     { ON,      ON,        ON,       ON,      ON,  ON}, 
-        /* backup */      { ON,      ON,        ON,       ON,      ON,  ON}, 
-        /* fertility */   { COPY,    ADJUST,    CALC,     OFF,     OFF, OFF},
-        /* civ_view */    { OFF,     OFF,       OFF,      OFF,     OFF, OFF},
-        /* resource 
-           supression */  { COPY,    COPY,      COPY,     COPY,    OFF, OFF}
-    };
-
-
-    // The source and destination files
-    string sourceFile = "";
-    string destFile = "";
-
-    // The source and destination maps for ToT multimap saved games.
-    // Note 0 equals "all", -1 equals "default"
-    int sourceMap = -1;
-    int destMap = -1;
-
-    // The type of copy
-    COPYTYPE copy_type = MP2MP;
-
-    // The size used for the buffer used when backing up
-    unsigned int BACKUP_BUFFER_SIZE = 1024;
-}
-
-void setDefaults();
-void setMapDefaults(bool oneSupprtsMultiMaps, bool twoSupportsMultiMaps);
-void parseCommandLine(int argc, char *argv[]);
-int parseFileNames(int argc, char *argv[]);
-void parseOptions(int i, int argc, char *argv[]);
-void checkArgumentValidity();
+int parseBatchOptions(int argc, char *argv[]) throw (runtime_error);
+int runDaemon(int argc, char *argv[]) throw (runtime_error);
+int runSpool(int argc, char *argv[]) throw (runtime_error);
+bool parseRunOption(int& i, int argc, char *argv[], int threads[3],
+                    bool& pipelined, unsigned long& memoryMB) throw (runtime_error);
+int runBatch(const string& batchFile, const int *threads,
+             unsigned long memoryBudget) throw (runtime_error);
+int runFanOut(int argc, char *argv[]) throw (runtime_error);
+int runJobs(list<BatchJob>& jobs, CopyContext& context, const int *threads,
+            unsigned long memoryBudget, const string& label);
 void printText(const char *text[]);
 void printErrorMessage(const string message);
-void backupFile(string file) throw (runtime_error);
-void doMapCopy(const Civ2Map& source, Civ2Map& dest) throw(runtime_error);
-void logFileDetails(const Civ2SavedGame& file);
 
 int main(int argc, char *argv[])
 {
-    Civ2SavedGame sourceSavedGame;
-    Civ2SavedGame destSavedGame;
+    LogOutput::setOutputStream(cout);
 
-    // I'm using pointers for one and two so that for an inplace modification
-    // I can set the source (one) equal to the destination
-    Civ2SavedGame *one = &sourceSavedGame;
-    Civ2SavedGame *two = &destSavedGame;
+    // Jobs run on this thread, such as those of a batch run one at a time,
+    // reuse each other's buffers. Worker threads have pools of their own.
+    BufferPool::Scope pool(make_shared<BufferPool>());
 
     try
     {
-        // Setup default values for command line parameters, parse them,
-        // and check for their validity. 
-        parseCommandLine(argc, argv);
-        
-        // This tells the Civ2SavedGame objects whether to print detailed messages
-        if (options[VERBOSE]== ON || options[VERBOSE] == DEV)
+        if (argc >= 2 && string(argv[1]) == "--batch")
         {
-            LogOutput::setOutputStream(cout);
-            LogOutput::enableLevel(NORMAL);
-            if (options[VERBOSE] == DEV) LogOutput::enableLevel(DEBUG);
+            return parseBatchOptions(argc, argv);
         }
-            
-        if (options[BACKUP] == ON) backupFile(destFile);
-
-        // Load a source file if one is provided
-        if (copy_type != MP && copy_type != SAV) 
+        if (argc >= 2 && string(argv[1]) == "--daemon")
         {
-            LogOutput::log(NORMAL) << "Loading File: " << sourceFile << endl;
-            one->load(sourceFile);
-            logFileDetails(*one);
+            return runDaemon(argc, argv);
         }
-        else // An in-place modification
+        if (argc >= 2 && string(argv[1]) == "--client")
         {
-            one = two;
+            if (argc < 4) throw int(0);
+            return runClient(argv[2], vector<string>(argv + 3, argv + argc));
         }
-        if (fileExists(destFile))
+        if (argc >= 2 && string(argv[1]) == "--submit")
         {
-            LogOutput::log(NORMAL) << "Loading File: " << destFile << endl;
-            two->load(destFile);
-            logFileDetails(*two);
+            if (argc != 4) throw int(0);
+            int added = SpoolRunner::submit(argv[2], argv[3]);
+            cout << added << " jobs added to " << argv[2] << "." << endl;
+            return 0;
         }
-        else if (Civ2SavedGame::isMPFile(destFile))
+        if (argc >= 2 && string(argv[1]) == "--spool")
         {
-            LogOutput::log(NORMAL) << "Creating MP File: " << destFile << endl;
-            two->createMP(one->getWidth(), one->getHeight());
+            return runSpool(argc, argv);
         }
-        else
-        {
-            LogOutput::log(NORMAL) << "Creating SAV File: " << destFile << endl;
-            two->createSAV(one->getWidth(), one->getHeight());
-        }
-
-        // Confirm maps are the same size.
-        if (one->getWidth() != two->getWidth() ||
-            one->getHeight() != two->getHeight())
+        if (argc >= 3 && string(argv[2]) == "--to")
         {
-            throw runtime_error("Both maps must be the same size!");
+            return runFanOut(argc, argv);
         }
 
-        // Setup default for ToT to ToT copies to be "all"
-      
-        setMapDefaults(one->supportsMultiMaps(), two->supportsMultiMaps());
-
-        // Check for an ALL copy that would require a non-ToT saved game
-        // to support multiple maps
-        if (sourceMap == 0 && sourceMap > two->getNumMaps()&& two->supportsMultiMaps() == false)
-        {
-            throw runtime_error("Cannot create multiple maps in a non-ToT saved game.");
-        }
-
-        // Check for a map to map copy that would require a non-ToT saved game
-        // to support multiple maps
-        if(destMap > 1 && two->supportsMultiMaps() == false)
-        {
-            throw runtime_error("Cannot create multiple maps in a non-ToT saved game.");
-        }
-
-        // Check for a non-existant source map
-        if (sourceMap > one->getNumMaps()) 
-        {
-            throw runtime_error("Map specified with +sm does not exist within source file.");
-        }
-
-        // Check for a copy that creates a "gap" in the destination
-        if (destMap > two->getNumMaps() + 1) 
-        {
-            throw runtime_error("Cannot create a gap between maps in a ToT saved game.");
-        }
-
-        // Copy main resource seed.
-        if (options[SEED]==COPY) two->setSeed(one->getSeed());
-
-        // Copy civilization start positions
-        if (options[CIV_START] == COPY)
-        {
-            two->setCivStart(one->getCivStart());
-        }
-
-
-        // There are three types of copies.
-
-        // First type: Copying one source map into one destination map
-        if (sourceMap > 0 && destMap > 0)
-        {
-            // Note sourceMap and destMap are one based, while the indices
-            // used by addMap() and getMap() are zero based.
-
-            if (destMap > two->getNumMaps())
-            {
-                LogOutput::log(NORMAL) << "Adding map " << destMap << " to " << destFile << endl;
-
-                two->addMap(destMap  - 1); // Add additional map to destination
-                                          // if needed
-            }
-
-            LogOutput::log(NORMAL) << "Copying map " << sourceMap << " to " << destMap << endl;            
-
-            // Do the actual copy.
-            doMapCopy(one->getMap(sourceMap - 1), two->getMap(destMap - 1));
-
-        }
-        // Second type: Copying multiple source maps into the destination file
-        else if (sourceMap == 0 && destMap == 0)
-        {
-            for (int i = 0; i < one->getNumMaps(); i++)
-            {
-                if (i >= two->getNumMaps())
-                {
-                    LogOutput::log(NORMAL) << "Adding map " << i + 1 << " to " << destFile << endl;
-
-                    two->addMap(i); // Add additional map to destination
-                                   // if needed
-                }
-                LogOutput::log(NORMAL) << "Copying map " << i+1 << " to " << i+1 << endl;            
-                doMapCopy(one->getMap(i), two->getMap(i));
-            }
-        }
-        // Copying one source map over all maps in the destination file
-        else if (sourceMap != 0 && destMap == 0)
+        // Setup default values for command line parameters, parse them,
+        // and check for their validity. 
+        CopyJob job;
+        if (argc >= 2 && string(argv[1]) == "--layer")
         {
-            Civ2Map& source = one->getMap(sourceMap-1);
-            for (int i = 0; i < two->getNumMaps(); i++)
-            {
-                LogOutput::log(NORMAL) << "Copying map " << sourceMap << " to " << i + 1 << endl;  
-                doMapCopy(source, two->getMap(i));
-            }
+            job.parseLayerCommandLine(argc, argv);
         }
-        else
+        else if (argc >= 2 && (string(argv[1]) == "--ops" || string(argv[1]) == "--ops-file"))
         {
-            // Really with all the error checking this should never happen.
-            // Of course, that means it will probably happen the first
-            // time I run the program.
-            stringstream message;
-            message << "Unrecognized copy type. sm = " << sourceMap << " dm = " << destMap;
-            throw runtime_error(message.str());
+            job.parseOpsCommandLine(argc, argv);
         }
+        else job.parseCommandLine(argc, argv);
 
-        // if the destination does not support multiple maps, its main map
-        // seed should be set to that of its only map. This is because
-        // non-ToT saved game files (and .MPs) don't support a map specific
-        // resource seed
-        if (two->supportsMultiMaps() == false && options[SEED] == COPY)
-        {
-            two->setSeed(two->getMap(0).getSeed());
-        }
-                
-        // Save the results into the destination file
-        two->save(destFile);
+        CopyContext context;
+        job.run(context);
     }
     catch(exception& e)
     {
@@ -330,514 +218,346 @@ int main(int argc, char *argv[])
     return 0;
 }
 
-// Performs a copy between two Civ2Map objects
-void doMapCopy(const Civ2Map& source, Civ2Map& dest) throw(runtime_error)
+// Runs each copy job listed in a batch file, and reports which ones failed.
+// Each line holds the arguments for one job, exactly as they would be given
+// on the command line. Blank lines and lines starting with ';' are skipped.
+// A failed job does not stop the jobs after it.  Returns 0 if every job
+// succeeded, and 1 otherwise.
+//
+// If threads is NULL the jobs are run one at a time. Otherwise it holds the
+// number of reader, copier and writer threads for a CopyPipeline, and the
+// jobs in the pipeline are kept to memoryBudget bytes.
+int runBatch(const string& batchFile, const int *threads,
+             unsigned long memoryBudget) throw (runtime_error)
 {
-    // Set to true if a second pass through the map is needed
-    bool secondPassNeeded = false;
-
-    // Copy map specific resource seed
-    if (options[SEED] == COPY) dest.setSeed(source.getSeed());
-
-    // Iterate through map squares, copying info
-    // Note that due to the nature of Civ2 maps, not every combination
-    // of X and Y is valid.  Specifically, x+y must be even.
-    // Also note that this is going through the coordinate system as
-    // seen in Civ2, not in the MapEditor
-    for (int y = 0; y < dest.getHeight(); y++)
+    ifstream is(batchFile.c_str());
+    if (!is) throw runtime_error("Could not open batch file: " + batchFile);
+
+    list<BatchJob> jobs;
+
+    string line;
+    int lineNum = 0;
+    while (getline(is, line))
     {
-        for (int x = y % 2; x < dest.getWidth(); x+=2)
-        {
-            // Terrain includes terrain type, and the river flag
-            if (options[TERRAIN]==COPY)
-            {
-                dest.setRiver(x, y, source.isRiver(x, y));
-                dest.setTerrainType(x, y, source.getTerrainType(x, y));
-            }
-            if (options[IMPROVEMENT] == COPY)
-            {
-                dest.setImprovements(x, y, source.getImprovements(x, y));
-            }
-            // This governs what civs see what squares
-            if (options[VISIBILITY] == COPY)
-            {
-                dest.setVisibility(x, y, source.getVisibility(x, y));
-            }
-            if (options[OWNERSHIP] == COPY)
-            {
-                dest.setOwnership(x, y, source.getOwnership(x, y));
-            }
+        lineNum++;
 
-            // The body_counter is a # assigned to a continent. It
-            // can be calculated by the map editor by doing an analyze map
-            if (options[BODY_COUNTER] == COPY)
-            {
-                dest.setBodyCounter(x, y, source.getBodyCounter(x, y));
-            }
+        // args[0] stands in for the program name, like argv[0]
+        vector<string> args(1, "mapcopy");
 
-            if (options[CITY_RADIUS] == COPY)
+        jobs.emplace_back();
+        BatchJob& b = jobs.back();
+        b.line = lineNum;
+        b.parsed = false;
+        b.unchanged = false;
+
+        try
+        {
+            splitArguments(line, args);
+            if (args.size() < 2 || args[1][0] == ';')
             {
-                dest.setCityRadius(x, y, source.getCityRadius(x, y));
+                jobs.pop_back();
+                continue;
             }
 
-            // Fertility is tricky.
-            switch (options[FERTILITY])
+            b.description = args[1];
+            if (args.size() > 2 && args[2][0] != '-' && args[2][0] != '+')
             {
-                case COPY:
-                    dest.setFertility(x, y, source.getFertility(x, y));
-                    break;
+                b.description += " -> " + args[2];
+            }
 
-                case CALC:
-                    secondPassNeeded = true;
-                    break;
+            b.job.parseCommandLine(args);
+            b.parsed = true;
+        }
+        catch (exception& e)
+        {
+            b.error = e.what();
+        }
+        catch (int& e)
+        {
+            b.error = "No files given.";
+        }
+    }
 
-                case CALCALL:
-                    secondPassNeeded = true;
-                    break;
+    // Shared by all the jobs, so that they reuse each other's source files
+    // and fertility caches
+    CopyContext context;
 
-                case ADJUST:                      
-                    secondPassNeeded = true;
-                    break;
+    return runJobs(jobs, context, threads, memoryBudget, "Line");
+}
 
-                case ZERO:
-                    dest.setFertility(x, y, 0);
-                    break;
+// Copies one source file into many destination files:
+//     mapcopy source --to dest1 dest2 ... [options] [--threads ...] [--memory MB]
+// The destination list ends at the first argument starting with '+' or '-'.
+// The options are used for every copy. The source is loaded and checked
+// once before any copy is started, and is then shared by all of them. The
+// copies are run through a CopyPipeline, with one thread per processor in
+// each stage unless --threads is given.  Returns 0 if every copy succeeded,
+// and 1 otherwise.
+int runFanOut(int argc, char *argv[]) throw (runtime_error)
+{
+    string sourceFile = argv[1];
 
-                default:
-                    // Assume off, don't copy
-                    break;
-            }
+    vector<string> destFiles;
+    int i = 3;
+    for (; i < argc && argv[i][0] != '+' && argv[i][0] != '-'; i++)
+    {
+        if (!expandWildcards(argv[i], destFiles))
+        {
+            throw runtime_error(string("No files match: ") + argv[i]);
+        }
+    }
+    if (destFiles.empty()) throw runtime_error("No destination files given after --to.");
 
-            // "civ_view" is the improvement information that each civilization
-            // sees.  Each civilization only sees the terrain improvement info
-            // that was current when a unit was near that square.  Hence you
-            // need to reexplore to see what other civs have been up to.
+    int n = thread::hardware_concurrency();
+    if (n < 1) n = 1;
+    int threads[3] = { n, n, n };
+    bool pipelined = true;
+    unsigned long memoryMB = 256;
 
-            // If the civ_view option is CURRENT, each civilization will see
-            // the most current improvement information
-            switch(options[CIV_VIEW])
-            {
-                case CURRENT:
-                    dest.setCivView(x, y, Civ2Map::ALL,
-                                   dest.getImprovements(x, y));
-                    break;
-
-                case COPY:
-                    dest.setCivView(x, y, Civ2Map::WHITE,
-                                   source.getCivView(x, y, Civ2Map::WHITE));
-                    dest.setCivView(x, y, Civ2Map::GREEN,
-                                   source.getCivView(x, y, Civ2Map::GREEN));
-                    dest.setCivView(x, y, Civ2Map::BLUE,
-                                   source.getCivView(x, y, Civ2Map::BLUE));
-                    dest.setCivView(x, y, Civ2Map::YELLOW,
-                                   source.getCivView(x, y, Civ2Map::YELLOW));
-                    dest.setCivView(x, y, Civ2Map::CYAN,
-                                   source.getCivView(x, y, Civ2Map::CYAN));
-                    dest.setCivView(x, y, Civ2Map::ORANGE,
-                                   source.getCivView(x, y, Civ2Map::ORANGE));
-                    dest.setCivView(x, y, Civ2Map::PURPLE,
-                                   source.getCivView(x, y, Civ2Map::PURPLE));
-                    break;
-
-                default: // Assume off
-                    break;
-            } // end switch on civ view
-
-            // The resource supression flag allows a resource
-            // that would be there based on the resource seed to be removed
-            // Command line arguments allow it to be copied, cleared (making
-            // all resources visible), or set (making all resources disappear)
-            switch (options[RESOURCE_SUP])
-            {
-                case COPY:
-                    dest.setResourceHidden(x, y, source.isResourceHidden(x, y));
-                    break;
-                case CLEAR:
-                    dest.setResourceHidden(x, y, false);
-                    break;
-                case SET:
-                    dest.setResourceHidden(x, y, true);
-                    break;
-                default: // assume off
-                    break;
-            } // end switch on resource supression
-        } // end inner for
-    } // end outer for
-
-    // Do a second pass for fertility calculations. Since the calculations
-    // for a square depend on adjacent suqares, all squares be in their 
-    // final state before calculations can be made. Hence a second pass is used.
-    if (secondPassNeeded)
+    vector<string> options;
+    for (; i < argc; i++)
     {
-        for (int y = 0; y < dest.getHeight(); y++)
+        if (!parseRunOption(i, argc, argv, threads, pipelined, memoryMB))
         {
-            for (int x = y % 2; x < dest.getWidth(); x+=2)
-            {
-                switch (options[FERTILITY])
-                {
-                    case CALC:
-                        if (dest.getTerrainType(x, y) == GRASSLAND ||
-                            dest.getTerrainType(x, y) == PLAINS)
-                        {
-                            dest.calcFertility(x, y);
-                            dest.adjustFertility(x, y);
-                        }
-                        else dest.setFertility(x, y, 0);
-                        break;
-
-                    case CALCALL:
-                        if (dest.getTerrainType(x, y) != OCEAN)
-                        {
-                            dest.calcFertility(x, y);
-                            dest.adjustFertility(x, y);
-                        }
-                        else dest.setFertility(x, y, 0);
-                        break;
-
-                    case ADJUST:                      
-                        if (dest.getTerrainType(x, y) != OCEAN)
-                        {
-                            dest.setFertility(x, y, source.getFertility(x, y));
-                            dest.adjustFertility(x, y);
-                        }
-                        else dest.setFertility(x, y, 0);
-                        break;
-                    default:
-                        // No fertility calculations needed. 
-                        break;
-                } // end switch
-            } // end inner for loop
-        } // end outer for loop
-    } // end check for second pass
-}
-// end doMapCopy
+            options.push_back(argv[i]);
+        }
+    }
 
-// Parse the command line arguments, and verify them.
-void parseCommandLine(int argc, char *argv[])
-{
-    // First parse the file names on the command line
-    // Note that there may be one or two files.
-    int i = parseFileNames(argc, argv);
+    list<BatchJob> jobs;
+    for (int d = 0; d < destFiles.size(); d++)
+    {
+        jobs.emplace_back();
+        BatchJob& b = jobs.back();
+        b.line = d + 1;
+        b.description = destFiles[d];
+        b.parsed = false;
+        b.unchanged = false;
 
-    // The filenames determine what default values to use
-    setDefaults();
+        // A wildcard can easily match the source as well
+        if (destFiles[d] == sourceFile)
+        {
+            b.error = "This is the source file.";
+            continue;
+        }
 
-    // Now parse the command line options and verify them
-    parseOptions(i, argc, argv);
-    checkArgumentValidity();
-}
+        vector<string> args;
+        args.push_back(argv[0]);
+        args.push_back(sourceFile);
+        args.push_back(destFiles[d]);
+        args.insert(args.end(), options.begin(), options.end());
 
+        try
+        {
+            b.job.parseCommandLine(args);
+            b.parsed = true;
+        }
+        catch (exception& e)
+        {
+            b.error = e.what();
+        }
+    }
 
+    CopyContext context;
 
-// Parses the first two command line arguments, the source and
-// destination file names. The return value is the index of the next
-// unparsed parameter.  (2 or 3, depending on whether there are one
-// or two file names)
-int parseFileNames(int argc, char *argv[])
-{
-    // If too few parameters, singal main to print help text
-    if (argc < 2)
+    // Load the source up front, so a bad source is reported once rather
+    // than by every copy. The context keeps it loaded for the copies.
+    if (jobs.front().parsed && jobs.front().job.getOption(CopyJob::VERBOSE) != CopyJob::OFF)
     {
-        throw int(0);
+        LogOutput::enableLevel(NORMAL);
     }
+    context.getSource(sourceFile);
 
-    // The first argument should be the source file name
-    if (argv[1] != NULL)
-    {
-        sourceFile = argv[1];
-    }
-    else
-    {
-        // We must have at least one file name
-        throw runtime_error("Invalid source file name.");
-    }
+    return runJobs(jobs, context, threads, memoryMB * 1024 * 1024, "File");
+}
+
+// Runs a list of jobs, one at a time if threads is NULL and otherwise
+// through a CopyPipeline with the given number of reader, copier and writer
+// threads. Then reports the status of each job, starting each line with
+// label and the job's line number.  Returns 0 if every job succeeded, and 1
+// otherwise.
+int runJobs(list<BatchJob>& jobs, CopyContext& context, const int *threads,
+            unsigned long memoryBudget, const string& label)
+{
+    // Jobs with the same destination are done together, so that it is only
+    // loaded and saved once
+    list<JobGroup> groups;
+    groupJobs(jobs, groups);
 
-    // The second argument should be the destination file name
-    if (argv[2] != NULL && *(argv[2]) != '-' && *(argv[2]) != '+')
+    if (threads == NULL)
     {
-        destFile = argv[2];
+        for (list<JobGroup>::iterator g = groups.begin(); g != groups.end(); ++g)
+        {
+            g->run(context);
+        }
     }
     else
     {
-        // If there isn't a second filename, that means we're doing an inplace
-        // modification
-        destFile = sourceFile;
-        if (Civ2SavedGame::isMPFile(destFile)) copy_type = MP;
-        else copy_type = SAV;
-        return 2;
-    }
+        // Messages from jobs running at the same time would be jumbled
+        // together, so turn them off
+        context.setQuiet(true);
+        LogOutput::disableLevel(NORMAL);
+        LogOutput::disableLevel(DEBUG);
 
-    // Otherwise we are doing a file to file copy
-
-    // Figure out the type of copy
-    if (Civ2SavedGame::isMPFile(sourceFile))
-    {
-        if (Civ2SavedGame::isMPFile(destFile)) copy_type = MP2MP;
-        else copy_type = MP2SAV;
+        CopyPipeline pipeline(context, threads[0], threads[1], threads[2],
+                              memoryBudget);
+        pipeline.run(groups);
     }
-    else
+
+    // Report the status of every job
+    int failures = 0;
+    int skipped = 0;
+    for (list<BatchJob>::iterator i = jobs.begin(); i != jobs.end(); ++i)
     {
-        if (Civ2SavedGame::isMPFile(destFile)) copy_type = SAV2MP;
-        else copy_type = SAV2SAV;
+        cout << label << " " << i->line << ": ";
+        if (!i->error.empty()) cout << "FAILED  ";
+        else if (i->unchanged) cout << "SKIPPED ";
+        else cout << "OK      ";
+        cout << i->description;
+
+        if (!i->error.empty())
+        {
+            cout << ": " << i->error;
+            failures++;
+        }
+        else if (i->unchanged)
+        {
+            skipped++;
+        }
+        cout << endl;
     }
+    cout << jobs.size() << " jobs, " << failures << " failed, "
+         << skipped << " skipped as unchanged. "
+         << context.getSourceLoads() << " source files loaded, "
+         << context.getSourceHits() << " reused." << endl;
 
-    return 3;
+    return (failures == 0) ? 0 : 1;
 }
 
-// Sets the default option values based on the type of copy being performed
-void setDefaults()
+// Parses the options after "--batch jobs.txt" and runs the batch
+int parseBatchOptions(int argc, char *argv[]) throw (runtime_error)
 {
-    for (int i = 0; i<NUM_OPTIONS; i++)
-    {
-        options[i] = defaults[i][copy_type];
-    }
-}
+    if (argc < 3) throw int(0);
 
-// Set default values for sourceMap (+sm) and destMap (+dm) based on whether
-// the source and destination accept multiple maps
-void setMapDefaults(bool oneSupportsMultiMaps, bool twoSupportsMultiMaps)
-{
-    // An ALL to ALL copy is default if both maps support multiple maps,
-    // and the source and destination have not been set to a specific map
-    if (oneSupportsMultiMaps && twoSupportsMultiMaps)
+    int threads[3];
+    bool pipelined = false;
+    unsigned long memoryMB = 256;
+
+    for (int i = 3; i < argc; i++)
     {
-        if ( (sourceMap == -1 || sourceMap == 0) &&
-             (destMap == -1 || destMap == 0) )
+        if (!parseRunOption(i, argc, argv, threads, pipelined, memoryMB))
         {
-            sourceMap = 0;
-            destMap = 0;
-            return;
+            throw runtime_error(string("Unknown batch option: ") + argv[i]);
         }
     }
-    // In all other cases, these values default to 1
-    if (sourceMap == -1) sourceMap = 1;
-    if (destMap == -1) destMap = 1;
+
+    return runBatch(argv[2], pipelined ? threads : NULL, memoryMB * 1024 * 1024);
 }
 
-// Parse the command line options, starting from index
-void parseOptions(int index, int argc, char *argv[]) 
+// Parses "--daemon socket [--threads n]" and runs the daemon until it is
+// shut down
+int runDaemon(int argc, char *argv[]) throw (runtime_error)
 {
+    if (argc < 3) throw int(0);
 
-    // Now we loop through options
-    for (int i = index; i < argc; i++)
-    {
-        // Grab whether + is being used to turn an option on, or if - is
-        // being used to turn an option off. The on/off information is stored
-        // in value
-        OP_VALUE value;
+    int workers = thread::hardware_concurrency();
+    if (workers < 1) workers = 1;
 
-        if (argv[i] != NULL && strlen(argv[i]) >= 2)
-        {
-            if (*(argv[i]) == '-') value = OFF;
-            else if (*(argv[i]) == '+') value = ON;
-            else
-            {
-                throw runtime_error(string("Invalid command line option:") + argv[i]);
-            }
-        }
-        else
+    for (int i = 3; i < argc; i++)
+    {
+        string o = argv[i];
+        if (o == "--threads" && i + 1 < argc)
         {
-            throw runtime_error("Invalid command line option.");
+            workers = atoi(argv[++i]);
+            if (workers < 1) throw runtime_error(string("Invalid thread count: ") + argv[i]);
         }
+        else throw runtime_error("Unknown daemon option: " + o);
+    }
 
-        string o = argv[i] + 1;
-        convert_to_lower(o);
+    CopyDaemon daemon(argv[2], workers);
+    daemon.run();
+    return 0;
+}
 
-        if ( o == "s" || o == "seed")
-        {
-            options[SEED] = value;
-        }
-        else if ( o == "t" || o == "terrain")
-        {
-            options[TERRAIN] = value;
-        }
-        else if ( o == "i" || o == "improvement")
-        {
-            options[IMPROVEMENT] = value;
-        }
-        else if ( o == "v" || o == "visibility")
-        {
-            options[VISIBILITY] = value;
-        }
-        else if ( o == "o" || o == "ownership")
-        {
-            options[OWNERSHIP] = value;
-        }
-        else if ( o == "cs")
-        {
-            options[CIV_START] = value;
-        }
-        else if ( o == "bc") 
-        {
-            options[BODY_COUNTER] = value;
-        }
-        else if ( o == "cr") 
-        {
-            options[CITY_RADIUS] = value;
-        }
-        else if ( o.compare(0,4, "verb")==0 )
-        {
-            int colon = o.find_first_of(':');
-            if (colon != string::npos && o.compare(colon, string::npos, ":dev") == 0) options[VERBOSE]=DEV;
-            else options[VERBOSE] = value;
-        }
-        else if ( o == "b" || o == "backup")
-        {
-            options[BACKUP] = value;
-        }
-        else if (o == "cv")
-        {
-            options[CIV_VIEW] = value;
-        }
-        else if (o == "cv:current")
-        {
-            options[CIV_VIEW] = CURRENT;
-        }
-        else if ( o == "f" || o == "fertility")
-        {
-            options[FERTILITY] = value;
-        }
-        else if ( o.compare(0, 2, "f:") == 0 ||
-                  o.compare(0, 10, "fertility:") == 0 )
+// Parses "--spool dir [--node k/n] [--lease seconds] [--threads n] [--name id]"
+// and runs jobs from the spool directory until there are none left
+int runSpool(int argc, char *argv[]) throw (runtime_error)
+{
+    if (argc < 3) throw int(0);
+
+    int part = 1;
+    int parts = 1;
+    int lease = 60;
+    int workers = 1;
+    string name;
+
+    for (int i = 3; i < argc; i++)
+    {
+        string o = argv[i];
+        if (o == "--node" && i + 1 < argc)
         {
-            int colon = o.find_first_of(':');
-            if (o.compare(colon, string::npos, ":calc") == 0)    options[FERTILITY] = CALC;
-            else if (o.compare(colon, string::npos, ":calcall") == 0) options[FERTILITY] = CALCALL;
-            else if (o.compare(colon, string::npos, ":adjust") == 0)  options[FERTILITY] = ADJUST;
-            else if (o.compare(colon, string::npos, ":zero") == 0)    options[FERTILITY] = ZERO;
-            else
+            char extra;
+            if (sscanf(argv[++i], "%d/%d%c", &part, &parts, &extra) != 2 ||
+                parts < 1 || part < 1 || part > parts)
             {
-                throw runtime_error("Unknown Option: " + o);
+                throw runtime_error(string("Invalid node number: ") + argv[i]);
             }
         }
-        else if ( o == "rs")
-        {
-            options[RESOURCE_SUP] = value;
-        }
-        else if ( o == "rs:set" )
+        else if (o == "--lease" && i + 1 < argc)
         {
-            options[RESOURCE_SUP] = SET;
+            lease = atoi(argv[++i]);
+            if (lease < 1) throw runtime_error(string("Invalid lease time: ") + argv[i]);
         }
-        else if ( o == "rs:clear" )
+        else if (o == "--threads" && i + 1 < argc)
         {
-            options[RESOURCE_SUP] = CLEAR;
-        }
-        else if (o.compare(0, 3, "sm:") == 0 || 
-                 o.compare(0, 3, "dm:") == 0 )
-        {
-            int map_num = 0; // 0 is used for "all"
-            if (o.compare(2, string::npos, ":all") != 0)
-            {
-                // The value is not "all", convert to integer
-                if (o.size() <4)
-                {
-                    throw runtime_error("Missing map # for option " + o);
-                }
-                map_num = atoi(o.substr(3, string::npos).c_str());
-
-                if (map_num <1 || map_num > 4) 
-                {
-                    throw runtime_error("Invalid map # for option " + o);
-                }
-            }
-            if (o.compare(0, 3, "sm:") == 0) sourceMap = map_num;
-            else destMap = map_num;        
+            workers = atoi(argv[++i]);
+            if (workers < 1) throw runtime_error(string("Invalid thread count: ") + argv[i]);
         }
-        else
+        else if (o == "--name" && i + 1 < argc)
         {
-            throw runtime_error("Unknown Option: " +  o);
+            name = argv[++i];
         }
-    } // end for
+        else throw runtime_error("Unknown spool option: " + o);
+    }
 
+    // Nodes are numbered from 1 on the command line
+    SpoolRunner runner(argv[2], part - 1, parts, lease, workers);
+    if (!name.empty()) runner.setNodeName(name);
+    return runner.run();
 }
-// end parseOptions
 
-// Determines if the argument settings are valid for the current copy type
-void checkArgumentValidity() 
+// Parses a --threads or --memory option at argv[i], moving i past its
+// value. Returns false if argv[i] is neither.
+bool parseRunOption(int& i, int argc, char *argv[], int threads[3],
+                    bool& pipelined, unsigned long& memoryMB) throw (runtime_error)
 {
+    string o = argv[i];
 
-    // Check to see that files are specified
-    if (copy_type == MP || copy_type == SAV)
-    {
-        if (destFile.length()==0) throw int(0);
-    }
-    else if (sourceFile.length() == 0 || destFile.length() == 0)
+    if (o == "--threads" && i + 1 < argc)
     {
-        throw int(0);
-    }
+        string value = argv[++i];
+        char extra;
+        int n = sscanf(value.c_str(), "%d,%d,%d%c", &threads[0], &threads[1],
+                       &threads[2], &extra);
+        if (n == 1) threads[1] = threads[2] = threads[0];
+        else if (n != 3) throw runtime_error("Invalid thread counts: " + value);
 
-    // Validate multimap copies
-    if (sourceMap > 1) 
-    {
-        if (copy_type == MP || copy_type == MP2MP || copy_type == MP2SAV)
-        {
-            throw runtime_error("Invalid source map option: MP files only have one map.");
-        }
-    }
-    if (destMap != 1 && destMap != -1)
-    {
-        if (copy_type == MP || copy_type == MP2MP || copy_type == SAV2MP)
+        if (threads[0] < 1 || threads[1] < 1 || threads[2] < 1)
         {
-            throw runtime_error("Invalid dest map option: MP files only have one map.");
+            throw runtime_error("Invalid thread counts: " + value);
         }
+        pipelined = true;
     }
-    if (sourceMap == 0 && destMap != 0 && destMap != -1)
-    {
-        throw runtime_error("Invalid source map option: Cannot copy 'ALL' maps to a single map.");
-    }
-     
-
-    // Copying start positions is only valid for MP2MP copies
-    if (options[CIV_START] != OFF && copy_type != MP2MP)
-    {
-        throw runtime_error("Invalid cs option: Can only copy starting positions between .MP files!");
-    }
-
-    // Copying Civ View information is only acceptable for SAV2SAV copies,
-    // but it is possible to calculate the Civ View information if the
-    // destination is a SAV file.
-    if (options[CIV_VIEW] == COPY && copy_type != SAV2SAV)
-    {
-        throw runtime_error("Invalid cv option: Can only copy civ view data between .SAV files!");
-    }
-
-    if (options[CIV_VIEW] == CURRENT && copy_type != MP2SAV
-                                     && copy_type != SAV2SAV
-                                     && copy_type != SAV)
+    else if (o == "--memory" && i + 1 < argc)
     {
-        throw runtime_error("Invalid cs option: Can only calculate civ view data for .SAV destiantion files!");
+        long mb = atol(argv[++i]);
+        if (mb <= 0) throw runtime_error(string("Invalid memory budget: ") + argv[i]);
+        memoryMB = mb;
     }
+    else return false;
 
-    if (copy_type == MP || copy_type == SAV)
-    {
-        // Make sure destination file exists
-        if (!DustyUtil::fileExists(destFile))
-        {
-            throw runtime_error(string("File ") + destFile + " must exist for in place modification.");
-        }
-    }
+    return true;
 }
 
-// Display information about a saved game information
-void logFileDetails(const Civ2SavedGame& file)
-{
-    int width = file.getWidth();
-    int height = file.getHeight();
-    
-    if (file.isMapOnly())
-    {
-        LogOutput::log(NORMAL) << width << " by " << height << " MP file." << endl;
-    }
-    else
-    {
-        string shape = " round ";
-        if (file.isFlatEarth()) shape = " flat ";
-
-        LogOutput::log(NORMAL) << width << " by " << height << " " 
-                               << file.getVersionString() << shape << "earth SAV/SCN file with " 
-                               << file.getNumMaps() << " maps." << endl;
-    }
-}
 // Displays an array of strings, one line at a time. Stops when it hits a
 // NULL string
 void printText(const char *text[])
@@ -859,52 +579,3 @@ void printErrorMessage(string message)
     cout << message << endl;
     cout << "Type \"mapcopy /?\" or see the readme.txt file for help.\n";
 }
-
-void backupFile(string file) throw (runtime_error)
-{
-    ifstream theFile;
-    theFile.open(file.c_str(), ios::binary | ios::in);
-
-    if (!theFile)
-    {
-        // We assume the file doesn't exist, so can't be backed up
-        return;
-    }
-
-    LogOutput::log(NORMAL) << "Backing up '" << file << "'." << endl;
-
-    char *backup_buffer = new char[BACKUP_BUFFER_SIZE];
-
-    if (backup_buffer == NULL)
-    {
-        throw runtime_error("Insufficient memory for backup.");
-    }
-
-    string backupName = file + ".bak";
-
-    ofstream backupFile;
-
-    backupFile.open(backupName.c_str(), ios::binary);
-
-    if (!backupFile)
-    {
-        throw runtime_error(string("Error backing up file: ") + file +
-                            string(" to file: " + backupName));
-    }
-
-    while (theFile && backupFile)
-    {
-        theFile.read(backup_buffer, BACKUP_BUFFER_SIZE);
-        backupFile.write(backup_buffer, theFile.gcount());
-    }
-
-    delete[] backup_buffer;
-
-    if (!theFile.eof() || !backupFile)
-    {
-        throw runtime_error(string("Error backing up file: ") + file +
-                            string(" to file: " + backupName));
-    }
-}
-
-
@@ -0,0 +1,397 @@
+/*
+ * The contents of this file are subject to the Mozilla Public
+ * License Version 1.1 (the "License"); you may not use this file
+ * except in compliance with the License. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS
+ * IS" basis, WITHOUT WARRANTY OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * rights and limitations under the License.
+ *
+ * The Original Code is MapCopy, a copy utility for Civ2 maps and saved games.
+ *
+ * The Initial Developer of the Original Code is James Dustin Reichwein.
+ * Portions created by James Dustin Reichwein are
+ * Copyright (C) 2000,2005, James Dustin Reichwein.  All
+ * Rights Reserved.
+ *
+ * Contributor(s):
+ */
+
+
+// pipeline.cpp
+// Description:  Runs a batch of copy jobs on several threads at once.
+//
+// Creation Date: Oct/18/2026
+//
+// Revision History:
+
+#include <sstream>
+#include <thread>
+#include "pipeline.h"
+#include "bufpool.h"
+
+/////////////////////// JobGroup Methods ////////////////////////////////////
+
+void JobGroup::run(CopyContext& context)
+{
+    if (load(context) && copy(context)) save(context);
+}
+
+// Load the destination with the first job, and the source of every job
+bool JobGroup::load(CopyContext& context)
+{
+    for (int i = 0; i < jobs.size(); i++)
+    {
+        try
+        {
+            if (i == 0) jobs[i]->job.load(context);
+            else jobs[i]->job.loadSource(context);
+        }
+        catch (exception& e)
+        {
+            recover(context, i, e.what());
+            return false;
+        }
+    }
+    return true;
+}
+
+// Copy each job into the destination in turn
+bool JobGroup::copy(CopyContext& context)
+{
+    for (int i = 0; i < jobs.size(); i++)
+    {
+        try
+        {
+            if (i > 0) jobs[i]->job.takeDestination(jobs[i - 1]->job);
+            jobs[i]->job.copy(context);
+        }
+        catch (exception& e)
+        {
+            recover(context, i, e.what());
+            return false;
+        }
+    }
+    return true;
+}
+
+// Save the destination, which the last job now holds. If something else
+// changed the destination in the meantime, start over.
+void JobGroup::save(CopyContext& context)
+{
+    for (int attempt = 1; ; attempt++)
+    {
+        try
+        {
+            jobs.back()->job.save(context);
+
+            // Whether the destination was saved is up to the last job
+            for (int i = 0; i < jobs.size(); i++)
+            {
+                jobs[i]->unchanged = jobs.back()->job.isUnchanged();
+            }
+
+            unload();
+            return;
+        }
+        catch (DestinationChanged& e)
+        {
+            if (attempt >= MAX_ATTEMPTS)
+            {
+                fail(e.what());
+                return;
+            }
+
+            {
+                LogOutput::Scope logScope(jobs.front()->job.getLogSettings(context));
+                LogOutput::log(NORMAL) << e.what() << ". Copying again." << endl;
+            }
+            unload();
+            if (!load(context) || !copy(context)) return;
+        }
+        catch (exception& e)
+        {
+            fail(e.what());
+            return;
+        }
+    }
+}
+
+void JobGroup::unload()
+{
+    for (int i = 0; i < jobs.size(); i++) jobs[i]->job.unload();
+}
+
+// A job failed part way through the group, possibly after changing the
+// destination. Run the jobs before and after it again without it.
+void JobGroup::recover(CopyContext& context, int failed, const string& error)
+{
+    jobs[failed]->error = error;
+    unload();
+
+    JobGroup before;
+    before.jobs.assign(jobs.begin(), jobs.begin() + failed);
+    if (!before.jobs.empty()) before.run(context);
+
+    JobGroup after;
+    after.jobs.assign(jobs.begin() + failed + 1, jobs.end());
+    if (!after.jobs.empty()) after.run(context);
+}
+
+// Every job in the group failed, since none of their results were saved
+void JobGroup::fail(const string& error)
+{
+    for (int i = 0; i < jobs.size(); i++) jobs[i]->error = error;
+    unload();
+}
+
+void groupJobs(list<BatchJob>& jobs, list<JobGroup>& groups)
+{
+    // Where each file was last read and written, by position in the batch
+    map<string, int> lastRead;
+    map<string, int> lastWritten;
+
+    // The latest group for each destination, and the position of its first
+    // job
+    map<string, pair<JobGroup *, int> > latest;
+
+    // The fertility trace files, and the line of the job writing each
+    map<string, int> traces;
+
+    int position = 0;
+    for (list<BatchJob>::iterator i = jobs.begin(); i != jobs.end(); ++i)
+    {
+        if (!i->parsed) continue;
+
+        const CopyJob& job = i->job;
+
+        const string& trace = job.getFertTraceFile();
+        if (!trace.empty())
+        {
+            map<string, int>::iterator t = traces.find(trace);
+            if (t != traces.end())
+            {
+                stringstream message;
+                message << "The fertility trace " << trace
+                        << " is already written by job " << t->second << ".";
+                i->error = message.str();
+                continue;
+            }
+            traces[trace] = i->line;
+        }
+
+        position++;
+        const string& dest = job.getDestFile();
+        const string& source = job.getSourceFile();
+
+        map<string, pair<JobGroup *, int> >::iterator found = latest.find(dest);
+        bool join = (found != latest.end());
+        if (join)
+        {
+            JobGroup *group = found->second.first;
+            int start = found->second.second;
+
+            join = (job.isInPlace() || source != dest) &&
+                   lastRead[dest] < start && lastRead[dest + ".bak"] < start &&
+                   lastWritten[dest + ".bak"] < start &&
+                   (job.isInPlace() || lastWritten[source] < start) &&
+                   !job.usesMemo() && !group->jobs.front()->job.usesMemo() &&
+                   job.getOption(CopyJob::BACKUP) ==
+                       group->jobs.front()->job.getOption(CopyJob::BACKUP) &&
+                   job.getOption(CopyJob::SKIP_UNCHANGED) ==
+                       group->jobs.front()->job.getOption(CopyJob::SKIP_UNCHANGED);
+        }
+
+        if (join)
+        {
+            found->second.first->jobs.push_back(&(*i));
+        }
+        else
+        {
+            groups.push_back(JobGroup());
+            groups.back().jobs.push_back(&(*i));
+            latest[dest] = make_pair(&groups.back(), position);
+        }
+
+        if (!job.isInPlace()) lastRead[source] = position;
+        lastWritten[dest] = position;
+    }
+}
+
+/////////////////////// FileLocks Methods ///////////////////////////////////
+
+bool FileLocks::canLock(const vector<string>& reads, const vector<string>& writes) const
+{
+    for (int i = 0; i < reads.size(); i++)
+    {
+        if (writing.count(reads[i]) > 0) return false;
+    }
+
+    for (int i = 0; i < writes.size(); i++)
+    {
+        if (reading.count(writes[i]) > 0 || writing.count(writes[i]) > 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void FileLocks::lock(const vector<string>& reads, const vector<string>& writes)
+{
+    reading.insert(reads.begin(), reads.end());
+    writing.insert(writes.begin(), writes.end());
+}
+
+void FileLocks::unlock(const vector<string>& reads, const vector<string>& writes)
+{
+    for (int i = 0; i < reads.size(); i++) reading.erase(reading.find(reads[i]));
+    for (int i = 0; i < writes.size(); i++) writing.erase(writing.find(writes[i]));
+}
+
+/////////////////////// CopyPipeline Methods ////////////////////////////////
+
+// Each queue holds a couple of jobs per thread taking from it. The memory
+// budget is what really limits the number of jobs in the pipeline.
+CopyPipeline::CopyPipeline(CopyContext& c, int readers, int copiers, int writers,
+                           unsigned long memoryBudget)
+: context(c), num_readers(readers), num_copiers(copiers), num_writers(writers),
+  memory_budget(memoryBudget),
+  readQueue(2 * readers), copyQueue(2 * copiers), writeQueue(2 * writers),
+  running_jobs(0), running_bytes(0)
+{
+}
+
+void CopyPipeline::run(list<JobGroup>& groups)
+{
+    vector<thread> threads;
+    for (int i = 0; i < num_readers; i++) threads.push_back(thread(&CopyPipeline::readStage, this));
+    for (int i = 0; i < num_copiers; i++) threads.push_back(thread(&CopyPipeline::copyStage, this));
+    for (int i = 0; i < num_writers; i++) threads.push_back(thread(&CopyPipeline::writeStage, this));
+
+    vector<Work> work;
+    work.reserve(groups.size());
+
+    for (list<JobGroup>::iterator g = groups.begin(); g != groups.end(); ++g)
+    {
+        Work w;
+        w.group = &(*g);
+
+        // A loaded game takes about as much memory as its file. A
+        // destination that does not exist yet will be the size of the source.
+        const CopyJob& first = g->jobs.front()->job;
+        unsigned long destBytes = fileSize(first.getDestFile());
+        w.bytes = (destBytes > 0) ? destBytes : fileSize(first.getSourceFile());
+
+        for (int i = 0; i < g->jobs.size(); i++)
+        {
+            const CopyJob& job = g->jobs[i]->job;
+
+            if (!job.isInPlace())
+            {
+                w.reads.push_back(job.getSourceFile());
+                w.bytes += fileSize(job.getSourceFile());
+            }
+        }
+
+        w.writes.push_back(first.getDestFile());
+        if (first.getOption(CopyJob::BACKUP) == CopyJob::ON)
+        {
+            w.writes.push_back(first.getDestFile() + ".bak");
+        }
+
+        work.push_back(w);
+        start(&work.back());
+    }
+
+    // Shut the stages down in order, letting each one finish its work
+    readQueue.close();
+    for (int i = 0; i < num_readers; i++) threads[i].join();
+
+    copyQueue.close();
+    for (int i = 0; i < num_copiers; i++) threads[num_readers + i].join();
+
+    writeQueue.close();
+    for (int i = 0; i < num_writers; i++) threads[num_readers + num_copiers + i].join();
+}
+
+// Wait until a group can be started, and then give it to the readers
+void CopyPipeline::start(Work *w)
+{
+    {
+        unique_lock<mutex> guard(running_lock);
+        while (!canStart(*w)) jobFinished.wait(guard);
+
+        running_files.lock(w->reads, w->writes);
+        running_jobs++;
+        running_bytes += w->bytes;
+    }
+
+    readQueue.push(w);
+}
+
+// Whether a group can start alongside the groups already running. Must be
+// called with running_lock held.
+bool CopyPipeline::canStart(const Work& w) const
+{
+    if (running_jobs == 0) return true;
+
+    if (running_bytes + w.bytes > memory_budget) return false;
+
+    return running_files.canLock(w.reads, w.writes);
+}
+
+// Release what a group holds, and let groups waiting on it start
+void CopyPipeline::finish(Work *w)
+{
+    w->group->unload();
+
+    lock_guard<mutex> guard(running_lock);
+
+    running_files.unlock(w->reads, w->writes);
+    running_jobs--;
+    running_bytes -= w->bytes;
+
+    jobFinished.notify_all();
+}
+
+// A stage that finds a failed job has already run the rest of the group,
+// so the group is finished.
+// Readers and copiers allocate the buffers of the files they load or add
+// maps to, each from a pool of its own. The writers free them back into
+// those pools.
+void CopyPipeline::readStage()
+{
+    BufferPool::Scope pool(make_shared<BufferPool>());
+
+    Work *w;
+    while (readQueue.pop(w))
+    {
+        if (w->group->load(context)) copyQueue.push(w);
+        else finish(w);
+    }
+}
+
+void CopyPipeline::copyStage()
+{
+    BufferPool::Scope pool(make_shared<BufferPool>());
+
+    Work *w;
+    while (copyQueue.pop(w))
+    {
+        if (w->group->copy(context)) writeQueue.push(w);
+        else finish(w);
+    }
+}
+
+void CopyPipeline::writeStage()
+{
+    Work *w;
+    while (writeQueue.pop(w))
+    {
+        w->group->save(context);
+        finish(w);
+    }
+}
@@ -0,0 +1,246 @@
+/*
+ * The contents of this file are subject to the Mozilla Public
+ * License Version 1.1 (the "License"); you may not use this file
+ * except in compliance with the License. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS
+ * IS" basis, WITHOUT WARRANTY OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * rights and limitations under the License.
+ *
+ * The Original Code is MapCopy, a copy utility for Civ2 maps and saved games.
+ *
+ * The Initial Developer of the Original Code is James Dustin Reichwein.
+ * Portions created by James Dustin Reichwein are
+ * Copyright (C) 2000,2005, James Dustin Reichwein.  All
+ * Rights Reserved.
+ *
+ * Contributor(s):
+ */
+
+// pipeline.h
+// Description:  Runs a batch of copy jobs on several threads at once.
+//
+// Creation Date: Oct/18/2026
+//
+// Revision History:
+
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <string>
+#include <list>
+#include <deque>
+#include <set>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include "copyjob.h"
+
+using namespace std;
+
+// BatchJob
+// One line of a batch file: the job it describes, and how it turned out.
+struct BatchJob
+{
+    int line;
+    string description;
+
+    // False if the line could not be parsed, in which case error says why
+    // and job is not used.
+    bool parsed;
+    CopyJob job;
+
+    // Empty if the job succeeded
+    string error;
+
+    // True if the job succeeded without changing its destination, because
+    // of +skip or +memo
+    bool unchanged;
+};
+
+// JobGroup
+// Batch jobs with the same destination file that are carried out together:
+// the destination is loaded once, each job is copied into it in turn, and
+// it is saved once at the end. The backup is of the destination as it
+// was before the first job. See groupJobs().
+//
+// If a job fails, the jobs before it are carried out again as a group of
+// their own, and then the jobs after it, so the results are the same as
+// running the jobs one at a time. If the destination is changed by
+// something else while the group is running, the whole group is run again
+// with the new contents, up to MAX_ATTEMPTS times.
+class JobGroup
+{
+    public:
+
+        static const int MAX_ATTEMPTS = 3;
+
+        // The jobs, in batch file order
+        vector<BatchJob *> jobs;
+
+        // Carry out the group. Sets the error of any job that fails.
+        void run(CopyContext& context);
+
+        // The three steps of run(), which may be done on different threads.
+        // load() and copy() return false if a job failed, in which case the
+        // remaining work has already been done.
+        bool load(CopyContext& context);
+        bool copy(CopyContext& context);
+        void save(CopyContext& context);
+
+        void unload();
+
+    private:
+
+        void recover(CopyContext& context, int failed, const string& error);
+        void fail(const string& error);
+};
+
+// Puts the parsed jobs of a batch into groups, in the order they should be
+// started. A job joins the latest group with the same destination, as long
+// as that gives the same results as running the jobs in batch file order:
+// no job since the start of the group may have used the destination or its
+// backup, or written the job's source, and the job's source must not be the
+// destination. Jobs that do not join a group start a new one.
+//
+// Each job's fertility trace starts a new file, so only the first job that
+// names a trace file may write it. Later jobs naming the same file fail.
+void groupJobs(list<BatchJob>& jobs, list<JobGroup>& groups);
+
+// FileLocks
+// The files being read and written by the jobs in progress, for keeping
+// jobs that use the same files apart. Any number of jobs can read a file at
+// once, but a file being written cannot be used by any other job. Callers
+// must hold their own lock around it.
+class FileLocks
+{
+    public:
+
+        // Whether a job using these files can start alongside the others
+        bool canLock(const vector<string>& reads, const vector<string>& writes) const;
+
+        void lock(const vector<string>& reads, const vector<string>& writes);
+        void unlock(const vector<string>& reads, const vector<string>& writes);
+
+    private:
+
+        multiset<string> reading;
+        multiset<string> writing;
+};
+
+// BoundedQueue
+// A first in first out queue holding at most a fixed number of items, for
+// passing work between threads. push() waits while the queue is full, and
+// pop() waits while it is empty. Once close() is called, pop() returns false
+// as soon as the queue is empty.
+template <class T>
+class BoundedQueue
+{
+    public:
+
+        BoundedQueue(size_t maxItems) : capacity(maxItems), closed(false) {}
+
+        void push(const T& item)
+        {
+            unique_lock<mutex> guard(lock);
+            while (items.size() >= capacity) notFull.wait(guard);
+
+            items.push_back(item);
+            notEmpty.notify_one();
+        }
+
+        bool pop(T& item)
+        {
+            unique_lock<mutex> guard(lock);
+            while (items.empty() && !closed) notEmpty.wait(guard);
+
+            if (items.empty()) return false;
+
+            item = items.front();
+            items.pop_front();
+            notFull.notify_one();
+            return true;
+        }
+
+        void close()
+        {
+            lock_guard<mutex> guard(lock);
+            closed = true;
+            notEmpty.notify_all();
+        }
+
+    private:
+
+        deque<T> items;
+        size_t capacity;
+        bool closed;
+
+        mutex lock;
+        condition_variable notEmpty;
+        condition_variable notFull;
+};
+
+// CopyPipeline
+// Runs groups of batch jobs in three stages, each with its own threads:
+// readers back up the destinations and load the files (JobGroup::load()),
+// copiers do the copying and fertility calculations (JobGroup::copy()), and
+// writers save the results (JobGroup::save()). The stages are connected by
+// bounded queues, so reading and writing files overlaps with copying.
+//
+// Groups are started in order. A group is held back while an earlier group
+// that is still running writes a file it uses, or uses a file it writes,
+// so the results are the same as running the jobs one at a time. A group
+// is also held back while the files of the running groups would take more
+// than the memory budget, unless no other group is running.
+class CopyPipeline
+{
+    public:
+
+        CopyPipeline(CopyContext& context, int readers, int copiers, int writers,
+                     unsigned long memoryBudget);
+
+        // Run every group, setting the error of the jobs that fail. Returns
+        // when they are all finished.
+        void run(list<JobGroup>& groups);
+
+    private:
+
+        // A group in the pipeline, and the resources it holds
+        struct Work
+        {
+            JobGroup *group;
+            unsigned long bytes;
+            vector<string> reads;
+            vector<string> writes;
+        };
+
+        void readStage();
+        void copyStage();
+        void writeStage();
+
+        void start(Work *w);
+        void finish(Work *w);
+        bool canStart(const Work& w) const;
+
+        CopyContext& context;
+        int num_readers;
+        int num_copiers;
+        int num_writers;
+        unsigned long memory_budget;
+
+        BoundedQueue<Work *> readQueue;
+        BoundedQueue<Work *> copyQueue;
+        BoundedQueue<Work *> writeQueue;
+
+        // Files used by running groups, and the memory they are estimated to
+        // take. Guarded by running_lock.
+        FileLocks running_files;
+        int running_jobs;
+        unsigned long running_bytes;
+        mutex running_lock;
+        condition_variable jobFinished;
+};
+
+#endif
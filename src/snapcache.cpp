@@ -0,0 +1,411 @@
+/*
+ * The contents of this file are subject to the Mozilla Public
+ * License Version 1.1 (the "License"); you may not use this file
+ * except in compliance with the License. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS
+ * IS" basis, WITHOUT WARRANTY OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * rights and limitations under the License.
+ *
+ * The Original Code is MapCopy, a copy utility for Civ2 maps and saved games.
+ *
+ * The Initial Developer of the Original Code is James Dustin Reichwein.
+ * Portions created by James Dustin Reichwein are
+ * Copyright (C) 2000,2005, James Dustin Reichwein.  All
+ * Rights Reserved.
+ *
+ * Contributor(s):
+ */
+
+
+// snapcache.cpp
+// Description:  Keeps snapshots of loaded maps and saved games on disk, so
+//               unchanged files do not need to be parsed again.
+//
+// Creation Date: Oct/18/2026
+//
+// Revision History:
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <thread>
+
+#include "civ2sav.h"
+#include "snapcache.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/////////////////////// Civ2SnapshotCache Constants ////////////////////////////
+
+namespace
+{
+    // Name of the file listing the snapshots in least recently used order
+    const char *INDEX_FILE = "index.txt";
+
+    // Name of the file listing the stamp and digest of each loaded file.
+    // The name changed when the stamps gained sub-second times, so that
+    // stamps written by older versions are not misread.
+    const char *FILES_FILE = "stamps.txt";
+
+    // Snapshot files end with this, to tell them from the index files
+    const char *SNAPSHOT_SUFFIX = ".snap";
+}
+
+/////////////////////// Civ2SnapshotCache Methods /////////////////////////////
+
+// Opens a cache in the given directory, creating the directory if needed.
+// maxBytes is the limit on the total size of all snapshots.
+Civ2SnapshotCache::Civ2SnapshotCache(const string& directory,
+                                     unsigned long maxBytes)
+    throw (runtime_error)
+{
+    dir = directory;
+    max_bytes = maxBytes;
+    total_bytes = 0;
+    index_dirty = false;
+    hits = 0;
+    misses = 0;
+
+    if (!makeDirectory(dir))
+    {
+        throw runtime_error("Could not create snapshot cache directory: " + dir);
+    }
+
+    loadIndex();
+}
+
+// Write back any changes to the index. Errors are ignored, since a stale
+// index only costs a few cache misses.
+Civ2SnapshotCache::~Civ2SnapshotCache()
+{
+    try
+    {
+        flush();
+    }
+    catch (runtime_error& e)
+    {
+    }
+}
+
+// Load a file from its snapshot if the file has not changed since it was
+// last loaded through the cache
+bool Civ2SnapshotCache::lookup(const string& filename, const FileStamp& stamp,
+                               Civ2SavedGame& game)
+    throw (runtime_error)
+{
+    // A file changed this recently could change again without changing
+    // its stamp, so it has to be hashed
+    if (stamp.isRecent()) return false;
+
+    string name;
+    {
+        lock_guard<mutex> guard(cache_lock);
+
+        map<string, KnownFile>::iterator found = files.find(filename);
+        if (found == files.end() || found->second.stamp != stamp) return false;
+
+        name = found->second.digest;
+        if (by_name.find(name) == by_name.end()) return false;
+    }
+
+    if (!loadEntry(name, game)) return false;
+
+    lock_guard<mutex> guard(cache_lock);
+    map<string, list<Entry>::iterator>::iterator found = by_name.find(name);
+    if (found != by_name.end()) touch(found->second);
+    hits++;
+
+    LogOutput::log(DEBUG) << "Snapshot cache hit: " << filename << endl;
+    return true;
+}
+
+// Load a file from the snapshot of its contents, and remember its stamp
+bool Civ2SnapshotCache::lookup(const string& filename, const FileStamp& stamp,
+                               const Hash64& digest, Civ2SavedGame& game)
+    throw (runtime_error)
+{
+    string name = digest.toString();
+    {
+        lock_guard<mutex> guard(cache_lock);
+        if (by_name.find(name) == by_name.end()) return false;
+    }
+
+    if (!loadEntry(name, game)) return false;
+
+    lock_guard<mutex> guard(cache_lock);
+    map<string, list<Entry>::iterator>::iterator found = by_name.find(name);
+    if (found != by_name.end()) touch(found->second);
+
+    remember(filename, stamp, name);
+    hits++;
+
+    LogOutput::log(DEBUG) << "Snapshot cache hit: " << filename << " (" << name << ")" << endl;
+    return true;
+}
+
+// Stores the snapshot of a loaded file. As with the fertility cache, it is
+// written to a temporary file first, so that a partially written snapshot is
+// never loaded.
+void Civ2SnapshotCache::store(const string& filename, const FileStamp& stamp,
+                              const Hash64& digest, const Civ2SavedGame& game)
+    throw (runtime_error)
+{
+    string name = digest.toString();
+    string path = entryPath(name);
+    string tempPath;
+    unsigned long size;
+
+    {
+        lock_guard<mutex> guard(cache_lock);
+        misses++;
+
+        // The temporary file is named after the thread, since several may
+        // be storing the same snapshot at once
+        stringstream temp;
+        temp << path << "." << this_thread::get_id() << ".tmp";
+        tempPath = temp.str();
+    }
+
+    {
+        ofstream theFile(tempPath.c_str(), ios_base::out | ios_base::binary);
+        game.saveSnapshot(theFile);
+        size = theFile.tellp();
+        if (!theFile)
+        {
+            remove(tempPath.c_str());
+            throw runtime_error("Could not write snapshot cache entry: " + tempPath);
+        }
+    }
+
+    lock_guard<mutex> guard(cache_lock);
+
+    // rename() will not replace an existing file on all systems
+    remove(path.c_str());
+    if (rename(tempPath.c_str(), path.c_str()) != 0)
+    {
+        remove(tempPath.c_str());
+        throw runtime_error("Could not write snapshot cache entry: " + path);
+    }
+
+    map<string, list<Entry>::iterator>::iterator found = by_name.find(name);
+    if (found != by_name.end())
+    {
+        total_bytes -= found->second->size;
+        entries.erase(found->second);
+        by_name.erase(found);
+    }
+
+    Entry e;
+    e.name = name;
+    e.size = size;
+    entries.push_back(e);
+    by_name[name] = --entries.end();
+    total_bytes += e.size;
+
+    remember(filename, stamp, name);
+
+    LogOutput::log(DEBUG) << "Snapshot cache store: " << filename << " (" << name << ")" << endl;
+
+    evict();
+}
+
+// Remembers the stamp and digest a file was loaded with. A recent stamp is
+// not remembered, since the file could change again without changing its
+// stamp. The file's old stamp is forgotten instead.
+void Civ2SnapshotCache::remember(const string& filename, const FileStamp& stamp,
+                                 const string& digest)
+{
+    if (stamp.isRecent())
+    {
+        if (files.erase(filename) > 0) index_dirty = true;
+        return;
+    }
+
+    KnownFile& f = files[filename];
+    f.stamp = stamp;
+    f.digest = digest;
+    index_dirty = true;
+}
+
+// Writes the index files, if they have changed since they were read
+void Civ2SnapshotCache::flush() throw (runtime_error)
+{
+    lock_guard<mutex> guard(cache_lock);
+
+    if (!index_dirty) return;
+
+    string path = entryPath(INDEX_FILE);
+    string filesPath = entryPath(FILES_FILE);
+    {
+        ofstream theFile((path + ".tmp").c_str());
+        for (list<Entry>::iterator i = entries.begin(); i != entries.end(); i++)
+        {
+            theFile << i->name << " " << i->size << "\n";
+        }
+
+        // The name goes last, since it may contain spaces. Files whose
+        // snapshot has been evicted are dropped.
+        ofstream filesFile((filesPath + ".tmp").c_str());
+        for (map<string, KnownFile>::iterator i = files.begin(); i != files.end(); i++)
+        {
+            if (by_name.find(i->second.digest) == by_name.end()) continue;
+
+            const FileStamp& s = i->second.stamp;
+            filesFile << i->second.digest << " " << s.device << " " << s.inode << " "
+                      << s.mtime << " " << s.ctime << " " << s.size << " "
+                      << i->first << "\n";
+        }
+
+        if (!theFile || !filesFile)
+        {
+            throw runtime_error("Could not write snapshot cache index: " + path);
+        }
+    }
+
+    remove(path.c_str());
+    remove(filesPath.c_str());
+    if (rename((path + ".tmp").c_str(), path.c_str()) != 0 ||
+        rename((filesPath + ".tmp").c_str(), filesPath.c_str()) != 0)
+    {
+        throw runtime_error("Could not write snapshot cache index: " + path);
+    }
+    index_dirty = false;
+}
+
+////////////////////////// Private Helper Functions ///////////////////////////
+
+// Return the path of a file within the cache directory
+string Civ2SnapshotCache::entryPath(const string& name) const
+{
+    if (name == INDEX_FILE || name == FILES_FILE) return dir + "/" + name;
+    return dir + "/" + name + SNAPSHOT_SUFFIX;
+}
+
+// Read the index files. Missing files just mean an empty cache.
+void Civ2SnapshotCache::loadIndex()
+{
+    ifstream theFile(entryPath(INDEX_FILE).c_str());
+
+    Entry e;
+    while (theFile >> e.name >> e.size)
+    {
+        if (by_name.find(e.name) != by_name.end()) continue;
+
+        entries.push_back(e);
+        by_name[e.name] = --entries.end();
+        total_bytes += e.size;
+    }
+
+    ifstream filesFile(entryPath(FILES_FILE).c_str());
+
+    KnownFile f;
+    string filename;
+    f.stamp.exists = true;
+    while (filesFile >> f.digest >> f.stamp.device >> f.stamp.inode
+                     >> f.stamp.mtime >> f.stamp.ctime >> f.stamp.size)
+    {
+        filesFile.get();
+        if (!getline(filesFile, filename)) break;
+        files[filename] = f;
+    }
+}
+
+// Load a snapshot file into game. A missing or damaged snapshot is
+// forgotten. On systems that have it, the file is mapped into memory rather
+// than read.
+bool Civ2SnapshotCache::loadEntry(const string& name, Civ2SavedGame& game)
+{
+    string path = entryPath(name);
+
+    try
+    {
+#ifndef _WIN32
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw runtime_error("Snapshot is missing.");
+
+        struct stat info;
+        void *data = MAP_FAILED;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+        if (data == MAP_FAILED) throw runtime_error("Snapshot could not be mapped.");
+
+        memoryBuf buf((const char *) data, info.st_size);
+        istream is(&buf);
+        try
+        {
+            game.loadSnapshot(is);
+        }
+        catch (runtime_error& e)
+        {
+            munmap(data, info.st_size);
+            throw;
+        }
+        munmap(data, info.st_size);
+#else
+        ifstream theFile(path.c_str(), ios_base::binary);
+        if (!theFile) throw runtime_error("Snapshot is missing.");
+        game.loadSnapshot(theFile);
+#endif
+    }
+    catch (runtime_error& e)
+    {
+        LogOutput::log(DEBUG) << "Discarding bad snapshot cache entry " << name
+                              << ": " << e.what() << endl;
+        forget(name);
+        return false;
+    }
+
+    return true;
+}
+
+// Forget about a snapshot, deleting it if it still exists
+void Civ2SnapshotCache::forget(const string& name)
+{
+    lock_guard<mutex> guard(cache_lock);
+
+    map<string, list<Entry>::iterator>::iterator found = by_name.find(name);
+    if (found == by_name.end()) return;
+
+    remove(entryPath(name).c_str());
+    total_bytes -= found->second->size;
+    entries.erase(found->second);
+    by_name.erase(found);
+    index_dirty = true;
+}
+
+// Mark a snapshot as the most recently used
+void Civ2SnapshotCache::touch(list<Entry>::iterator i)
+{
+    entries.splice(entries.end(), entries, i);
+    index_dirty = true;
+}
+
+// Delete least recently used snapshots until the cache fits within max_bytes.
+// The remembered stamps of their files are left alone; they simply stop
+// finding anything.
+void Civ2SnapshotCache::evict()
+{
+    while (total_bytes > max_bytes && !entries.empty())
+    {
+        Entry& e = entries.front();
+
+        LogOutput::log(DEBUG) << "Snapshot cache evict: " << e.name << endl;
+
+        remove(entryPath(e.name).c_str());
+        total_bytes -= e.size;
+        by_name.erase(e.name);
+        entries.pop_front();
+        index_dirty = true;
+    }
+}
@@ -0,0 +1,138 @@
+/*
+ * The contents of this file are subject to the Mozilla Public
+ * License Version 1.1 (the "License"); you may not use this file
+ * except in compliance with the License. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS
+ * IS" basis, WITHOUT WARRANTY OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * rights and limitations under the License.
+ *
+ * The Original Code is MapCopy, a copy utility for Civ2 maps and saved games.
+ *
+ * The Initial Developer of the Original Code is James Dustin Reichwein.
+ * Portions created by James Dustin Reichwein are
+ * Copyright (C) 2000,2005, James Dustin Reichwein.  All
+ * Rights Reserved.
+ *
+ * Contributor(s):
+ */
+
+// snapcache.h
+// Description:  Keeps snapshots of loaded maps and saved games on disk, so
+//               unchanged files do not need to be parsed again.
+//
+// Creation Date: Oct/18/2026
+//
+// Revision History:
+
+#ifndef SNAPCACHE_H_
+#define SNAPCACHE_H_
+
+#include <string>
+#include <stdexcept>
+#include <list>
+#include <map>
+#include <mutex>
+#include "DustyUtil.h"
+
+using namespace std;
+using namespace DustyUtil;
+
+class Civ2SavedGame;
+
+// Civ2SnapshotCache
+// This class keeps a snapshot (see Civ2SavedGame::saveSnapshot()) of every
+// file loaded through it in a directory. Snapshots are keyed by a digest of
+// the file's contents, so copies of the same file share one snapshot.
+//
+// The cache also remembers the FileStamp each file had when it was last
+// loaded and the digest of its contents at the time. A file that still has
+// the same stamp is loaded straight from its snapshot, without reading the
+// file at all. A file that has changed has to be read and hashed, but is
+// still loaded from a snapshot if its new contents match one. So does a
+// file whose stamp is too recent to show a later change; such stamps are
+// never remembered.
+//
+// As with Civ2FertilityCache, the directory holds one file per snapshot and
+// an index listing them from least to most recently used. The least
+// recently used snapshots are deleted when the total size goes over the
+// limit. A second index file holds the remembered stamps. Both are written
+// back by flush() or when the cache is destroyed.
+//
+// One cache can be used by several threads at once.
+class Civ2SnapshotCache
+{
+    public:
+
+        Civ2SnapshotCache(const string& directory, unsigned long maxBytes)
+            throw (runtime_error);
+        ~Civ2SnapshotCache();
+
+        // Load a file from its snapshot, if it has the same stamp as the last
+        // time it was loaded through the cache. Returns false if not.
+        bool lookup(const string& filename, const FileStamp& stamp,
+                    Civ2SavedGame& game) throw (runtime_error);
+
+        // Load a file from the snapshot of its contents, given their digest.
+        // Returns false if there is no such snapshot.
+        bool lookup(const string& filename, const FileStamp& stamp,
+                    const Hash64& digest, Civ2SavedGame& game)
+            throw (runtime_error);
+
+        // Add a snapshot of a loaded file, evicting old snapshots if needed
+        void store(const string& filename, const FileStamp& stamp,
+                   const Hash64& digest, const Civ2SavedGame& game)
+            throw (runtime_error);
+
+        // Write the index files back to the cache directory
+        void flush() throw (runtime_error);
+
+        int getHits() const { return hits; }
+        int getMisses() const { return misses; }
+
+    private:
+
+        struct Entry
+        {
+            string name;
+            unsigned long size;
+        };
+
+        struct KnownFile
+        {
+            FileStamp stamp;
+            string digest;
+        };
+
+        void remember(const string& filename, const FileStamp& stamp,
+                      const string& digest);
+        string entryPath(const string& name) const;
+        void loadIndex();
+        bool loadEntry(const string& name, Civ2SavedGame& game);
+        void forget(const string& name);
+        void touch(list<Entry>::iterator i);
+        void evict();
+
+        string dir;
+        unsigned long max_bytes;
+        unsigned long total_bytes;
+
+        // Snapshots from least to most recently used, and an index into them
+        list<Entry> entries;
+        map<string, list<Entry>::iterator> by_name;
+
+        // The stamp and digest of each file loaded through the cache, by name
+        map<string, KnownFile> files;
+        bool index_dirty;
+
+        int hits;
+        int misses;
+
+        // Held while using entries, by_name, files or the counts. Snapshots
+        // are read without holding it.
+        mutex cache_lock;
+};
+
+#endif
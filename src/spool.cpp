@@ -0,0 +1,561 @@
+/*
+ * The contents of this file are subject to the Mozilla Public
+ * License Version 1.1 (the "License"); you may not use this file
+ * except in compliance with the License. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS
+ * IS" basis, WITHOUT WARRANTY OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * rights and limitations under the License.
+ *
+ * The Original Code is MapCopy, a copy utility for Civ2 maps and saved games.
+ *
+ * The Initial Developer of the Original Code is James Dustin Reichwein.
+ * Portions created by James Dustin Reichwein are
+ * Copyright (C) 2000,2005, James Dustin Reichwein.  All
+ * Rights Reserved.
+ *
+ * Contributor(s):
+ */
+
+
+// spool.cpp
+// Description:  Runs copy jobs from a spool directory shared by several
+//               mapcopy processes, possibly on different machines.
+//
+// Creation Date: Oct/18/2026
+//
+// Revision History:
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <thread>
+#include <chrono>
+
+#include "civ2sav.h"
+#include "spool.h"
+#include "bufpool.h"
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+/////////////////////////// SpoolRunner Constants //////////////////////////////
+
+namespace
+{
+    const char *QUEUE_DIR = "queue";
+    const char *TEMP_DIR = "tmp";
+    const char *CLAIMED_DIR = "claimed";
+    const char *DONE_DIR = "done";
+    const char *NODES_DIR = "nodes";
+    const char *DONE_LOG = "done.log";
+
+    // Job files end with this. In claimed/ it is followed by '@' and the
+    // name of the node holding the claim.
+    const char *JOB_SUFFIX = ".job";
+
+    // How long a worker waits before looking for jobs again, when the jobs
+    // left are being run by someone else
+    const int POLL_MILLISECONDS = 500;
+
+    // Splits "claimed/NAME.job@NODE" into NAME.job and NODE. Returns false
+    // for anything else.
+    bool splitClaim(const string& path, string& name, string& node)
+    {
+        string::size_type slash = path.find_last_of("\\/");
+        string file = (slash == string::npos) ? path : path.substr(slash + 1);
+
+        string::size_type at = file.find(string(JOB_SUFFIX) + "@");
+        if (at == string::npos) return false;
+
+        at += string(JOB_SUFFIX).size();
+        name = file.substr(0, at);
+        node = file.substr(at + 1);
+        return !node.empty();
+    }
+
+    string baseName(const string& path)
+    {
+        string::size_type slash = path.find_last_of("\\/");
+        return (slash == string::npos) ? path : path.substr(slash + 1);
+    }
+}
+
+/////////////////////////// SpoolRunner Methods ////////////////////////////////
+
+SpoolRunner::SpoolRunner(const string& directory, int part, int parts,
+                         int leaseSeconds, int workers) throw (runtime_error)
+{
+    if (parts < 1 || part < 0 || part >= parts)
+    {
+        throw runtime_error("Invalid spool node number.");
+    }
+    if (leaseSeconds < 1) throw runtime_error("Invalid lease time.");
+
+    spool_dir = directory;
+    this->part = part;
+    this->parts = parts;
+    lease_seconds = leaseSeconds;
+    num_workers = (workers < 1) ? 1 : workers;
+    stopping = false;
+    ran = failed = skipped = 0;
+
+    const char *subdirs[] = { QUEUE_DIR, CLAIMED_DIR, DONE_DIR, NODES_DIR };
+    if (!makeDirectory(spool_dir)) throw runtime_error("Could not create spool directory: " + spool_dir);
+    for (int i = 0; i < 4; i++)
+    {
+        if (!makeDirectory(spool_dir + "/" + subdirs[i]))
+        {
+            throw runtime_error("Could not create spool directory: " + spool_dir + "/" + subdirs[i]);
+        }
+    }
+
+    // The host name and process id, which is unique as long as hosts are
+    // named differently
+    const char *host = getenv("COMPUTERNAME");
+#ifndef _WIN32
+    char hostname[256];
+    if (gethostname(hostname, sizeof(hostname)) == 0)
+    {
+        hostname[sizeof(hostname) - 1] = '\0';
+        host = hostname;
+    }
+#endif
+    ostringstream name;
+    name << ((host != NULL && *host != '\0') ? host : "node") << "-" << getpid();
+    setNodeName(name.str());
+}
+
+// Node names end up in file names, so they can't contain path separators,
+// or '@' which separates them from the job name
+void SpoolRunner::setNodeName(const string& name) throw (runtime_error)
+{
+    if (name.empty() || name.find_first_of("@/\\: \t") != string::npos)
+    {
+        throw runtime_error("Invalid spool node name: " + name);
+    }
+    node_name = name;
+}
+
+int SpoolRunner::run() throw (runtime_error)
+{
+    // As in a threaded batch, messages from jobs running at the same time
+    // would be jumbled together
+    if (num_workers > 1)
+    {
+        context.setQuiet(true);
+        LogOutput::disableLevel(NORMAL);
+        LogOutput::disableLevel(DEBUG);
+    }
+
+    thread beat(&SpoolRunner::heartbeat, this);
+
+    vector<thread> workers;
+    for (int i = 0; i < num_workers; i++)
+    {
+        workers.push_back(thread(&SpoolRunner::worker, this));
+    }
+    for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+
+    {
+        lock_guard<mutex> guard(held_lock);
+        stopping = true;
+        stopHeartbeat.notify_all();
+    }
+    beat.join();
+
+    context.flushCaches();
+
+    cout << ran << " jobs, " << failed << " failed, "
+         << skipped << " skipped as unchanged. "
+         << context.getSourceLoads() << " source files loaded, "
+         << context.getSourceHits() << " reused." << endl;
+
+    return (failed == 0) ? 0 : 1;
+}
+
+// Each line of the batch file is written to a file of its own in tmp/, and
+// then renamed into queue/, so that no one can claim a half written job.
+// The names sort in the order the jobs were submitted.
+int SpoolRunner::submit(const string& directory, const string& batchFile)
+    throw (runtime_error)
+{
+    ifstream is(batchFile.c_str());
+    if (!is) throw runtime_error("Could not open batch file: " + batchFile);
+
+    const char *subdirs[] = { QUEUE_DIR, TEMP_DIR, CLAIMED_DIR, DONE_DIR, NODES_DIR };
+    if (!makeDirectory(directory)) throw runtime_error("Could not create spool directory: " + directory);
+    for (int i = 0; i < 5; i++)
+    {
+        if (!makeDirectory(directory + "/" + subdirs[i]))
+        {
+            throw runtime_error("Could not create spool directory: " + directory + "/" + subdirs[i]);
+        }
+    }
+
+    long now = (long) time(NULL);
+    int added = 0;
+    int lineNum = 0;
+    string line;
+    while (getline(is, line))
+    {
+        lineNum++;
+
+        vector<string> args;
+        splitArguments(line, args);
+        if (args.empty() || args[0][0] == ';') continue;
+
+        ostringstream name;
+        name << setfill('0') << setw(10) << now << "-" << setw(6) << getpid()
+             << "-" << setw(6) << lineNum << JOB_SUFFIX;
+
+        string temp = directory + "/" + TEMP_DIR + "/" + name.str();
+        string job = directory + "/" + QUEUE_DIR + "/" + name.str();
+        {
+            ofstream os(temp.c_str());
+            os << line << "\n";
+            if (!os) throw runtime_error("Could not write job file: " + temp);
+        }
+        if (rename(temp.c_str(), job.c_str()) != 0)
+        {
+            remove(temp.c_str());
+            throw runtime_error("Could not add job to queue: " + job);
+        }
+        added++;
+    }
+
+    return added;
+}
+
+////////////////////////// Private Helper Functions ///////////////////////////
+
+// Runs claimed jobs until there are none left
+void SpoolRunner::worker()
+{
+    BufferPool::Scope pool(make_shared<BufferPool>());
+
+    while (true)
+    {
+        Claim c;
+        ClaimResult result;
+        {
+            lock_guard<mutex> guard(claim_lock);
+            result = claim(c);
+        }
+
+        if (result == CLAIMED) runJob(c);
+        else if (result == NONE) break;
+        else this_thread::sleep_for(chrono::milliseconds(POLL_MILLISECONDS));
+    }
+}
+
+// Looks through the spool directory, in name order, for a job in this
+// process's part that can be claimed: one in the queue, or one whose claim
+// has expired. A job is passed over while a job before it, in any part,
+// uses the same files and is still queued or being run, here or elsewhere,
+// so the jobs that share a file are run in order. Returns BUSY if the jobs
+// left are all being run, or waiting for a job that is. Called with
+// claim_lock held.
+SpoolRunner::ClaimResult SpoolRunner::claim(Claim& c)
+{
+    vector<string> queued;
+    vector<string> claimed;
+    expandWildcards(spool_dir + "/" + QUEUE_DIR + "/*" + JOB_SUFFIX, queued);
+    expandWildcards(spool_dir + "/" + CLAIMED_DIR + "/*" + JOB_SUFFIX + "@*", claimed);
+
+    // Every job by name, with the path of its file
+    map<string, string> jobs;
+    for (size_t i = 0; i < queued.size(); i++) jobs[baseName(queued[i])] = queued[i];
+    for (size_t i = 0; i < claimed.size(); i++)
+    {
+        string name, node;
+        if (splitClaim(claimed[i], name, node)) jobs[name] = claimed[i];
+    }
+
+    // Files used by the jobs being run, plus those of the jobs passed over
+    FileLocks busy = files;
+    bool waiting = false;
+    long now = -1;
+
+    for (map<string, string>::iterator j = jobs.begin(); j != jobs.end(); ++j)
+    {
+        // A job that can't be read has just been renamed, by a process that
+        // claimed or finished it. Look again later, rather than pass it over
+        // while later jobs may use its files.
+        JobInfo info;
+        if (!getJobInfo(j->first, j->second, info)) return BUSY;
+
+        // Another part's job still holds its files, so a later job of ours
+        // that uses them waits for it to be run
+        if (!info.mine)
+        {
+            busy.lock(info.reads, info.writes);
+            continue;
+        }
+
+        // A job still claimed by someone, including this process
+        string name, node;
+        bool isClaimed = splitClaim(j->second, name, node);
+        if (isClaimed)
+        {
+            if (node != node_name)
+            {
+                if (now < 0) now = getSpoolTime();
+                FileStamp stamp = getFileStamp(j->second);
+                isClaimed = stamp.exists &&
+                            (now - (long) (stamp.mtime / NANOSECONDS) <= lease_seconds);
+            }
+
+            if (isClaimed)
+            {
+                busy.lock(info.reads, info.writes);
+                waiting = true;
+                continue;
+            }
+        }
+
+        if (!busy.canLock(info.reads, info.writes))
+        {
+            busy.lock(info.reads, info.writes);
+            waiting = true;
+            continue;
+        }
+
+        if (take(j->second, j->first, c))
+        {
+            if (!node.empty())
+            {
+                LogOutput::log(DEBUG) << "Reclaimed expired job " << j->first
+                                      << " from " << node << endl;
+            }
+            c.info = info;
+            files.lock(info.reads, info.writes);
+            return CLAIMED;
+        }
+
+        // Someone else got it first. It is probably being run now.
+        busy.lock(info.reads, info.writes);
+        waiting = true;
+    }
+
+    return waiting ? BUSY : NONE;
+}
+
+// Reads and parses a job file, unless it has been seen before. Returns false
+// if it could not be read, which happens when it is renamed while reading.
+bool SpoolRunner::getJobInfo(const string& name, const string& path, JobInfo& info)
+{
+    map<string, JobInfo>::iterator found = known_jobs.find(name);
+    if (found != known_jobs.end())
+    {
+        info = found->second;
+        return true;
+    }
+
+    ifstream is(path.c_str());
+    if (!is || !getline(is, info.line)) return false;
+
+    // args[0] stands in for the program name, like argv[0]
+    vector<string> args(1, "mapcopy");
+    string key = info.line;
+    try
+    {
+        splitArguments(info.line, args);
+        if (args.size() > 1) info.description = args[1];
+        if (args.size() > 2 && args[2][0] != '-' && args[2][0] != '+')
+        {
+            info.description += " -> " + args[2];
+        }
+
+        CopyJob job;
+        job.parseCommandLine(args);
+
+        if (!job.isInPlace()) info.reads.push_back(job.getSourceFile());
+        info.writes.push_back(job.getDestFile());
+        if (job.getOption(CopyJob::BACKUP) == CopyJob::ON)
+        {
+            info.writes.push_back(job.getDestFile() + ".bak");
+        }
+        key = job.getDestFile();
+    }
+    catch (exception& e)
+    {
+        // Run anyway, so the error ends up in the log
+    }
+    catch (int& e)
+    {
+    }
+
+    // Jobs that don't parse are partitioned by the whole line
+    Hash64 h;
+    h.addString(key);
+    info.mine = (h.getValue() % parts) == (unsigned long long) part;
+
+    known_jobs[name] = info;
+    return true;
+}
+
+// Claims a job by renaming its file into claimed/ under this node's name.
+// Only one rename of a file can succeed, so only one process gets the job.
+// An expired claim is touched first, so no one else takes it from us
+// between the rename and the first heartbeat.
+bool SpoolRunner::take(const string& from, const string& name, Claim& c)
+{
+    c.name = name;
+    c.path = spool_dir + "/" + CLAIMED_DIR + "/" + name + "@" + node_name;
+
+    string n, node;
+    if (splitClaim(from, n, node)) touchFile(from);
+
+    if (rename(from.c_str(), c.path.c_str()) != 0) return false;
+    touchFile(c.path);
+
+    lock_guard<mutex> guard(held_lock);
+    held.insert(c.path);
+    return true;
+}
+
+// The current time by the clock of the machine holding the spool
+// directory, which is what sets the modification times of the claims. It is
+// read from this node's file in nodes/, after touching it.
+long SpoolRunner::getSpoolTime()
+{
+    string path = spool_dir + "/" + NODES_DIR + "/" + node_name;
+    if (!touchFile(path))
+    {
+        ofstream os(path.c_str());
+    }
+
+    FileStamp stamp = getFileStamp(path);
+    return stamp.exists ? (long) (stamp.mtime / NANOSECONDS) : (long) time(NULL);
+}
+
+// Touches the claims held by this process every third of the lease time,
+// until run() is finished
+void SpoolRunner::heartbeat()
+{
+    int seconds = lease_seconds / 3;
+    if (seconds < 1) seconds = 1;
+
+    unique_lock<mutex> guard(held_lock);
+    while (!stopping)
+    {
+        stopHeartbeat.wait_for(guard, chrono::seconds(seconds));
+        if (stopping) break;
+
+        for (set<string>::iterator i = held.begin(); i != held.end(); )
+        {
+            if (touchFile(*i))
+            {
+                ++i;
+                continue;
+            }
+
+            // Someone decided this process was dead and took the job. The
+            // job is still finished, but not logged; see finish().
+            LogOutput::log(DEBUG) << "Lost the claim on " << *i << endl;
+            held.erase(i++);
+        }
+    }
+}
+
+void SpoolRunner::runJob(Claim& c)
+{
+    string error;
+    bool unchanged = false;
+    try
+    {
+        vector<string> args(1, "mapcopy");
+        splitArguments(c.info.line, args);
+        if (args.size() < 2) throw runtime_error("No files given.");
+
+        CopyJob job;
+        try
+        {
+            job.parseCommandLine(args);
+        }
+        catch (int& e)
+        {
+            throw runtime_error("No files given.");
+        }
+
+        try
+        {
+            job.run(context);
+        }
+        catch (exception& e)
+        {
+            job.unload();
+            throw;
+        }
+        unchanged = job.isUnchanged();
+    }
+    catch (exception& e)
+    {
+        error = e.what();
+    }
+
+    {
+        lock_guard<mutex> guard(claim_lock);
+        files.unlock(c.info.reads, c.info.writes);
+    }
+
+    if (!error.empty()) finish(c, "FAILED", error);
+    else if (unchanged) finish(c, "SKIPPED", "");
+    else finish(c, "OK", "");
+}
+
+// Moves a job to done/ and adds it to the completion log. If the claim was
+// lost to another process, that process will run the job again, so it is
+// not logged here.
+void SpoolRunner::finish(const Claim& c, const string& status, const string& error)
+{
+    string done = spool_dir + "/" + DONE_DIR + "/" + c.name;
+
+    lock_guard<mutex> guard(held_lock);
+    held.erase(c.path);
+
+    if (rename(c.path.c_str(), done.c_str()) != 0)
+    {
+        cout << "Job " << c.name << ": LOST    " << c.info.description << endl;
+        return;
+    }
+
+    ostringstream entry;
+    entry << c.name << " " << status << " " << node_name << ": " << c.info.description;
+    if (!error.empty()) entry << ": " << error;
+
+    // One write per entry, so that lines from different processes are not
+    // mixed together
+    string logPath = spool_dir + "/" + DONE_LOG;
+    FILE *log = fopen(logPath.c_str(), "a");
+    if (log != NULL)
+    {
+        fprintf(log, "%s\n", entry.str().c_str());
+        fclose(log);
+    }
+    else
+    {
+        LogOutput::log(NORMAL) << "Could not write to " << logPath << endl;
+    }
+
+    string padded = status;
+    padded.resize(8, ' ');
+    cout << "Job " << c.name << ": " << padded << c.info.description;
+    if (!error.empty()) cout << ": " << error;
+    cout << endl;
+
+    ran++;
+    if (!error.empty()) failed++;
+    else if (status == "SKIPPED") skipped++;
+}
@@ -0,0 +1,160 @@
+/*
+ * The contents of this file are subject to the Mozilla Public
+ * License Version 1.1 (the "License"); you may not use this file
+ * except in compliance with the License. You may obtain a copy of
+ * the License at http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS
+ * IS" basis, WITHOUT WARRANTY OF ANY KIND, either express or
+ * implied. See the License for the specific language governing
+ * rights and limitations under the License.
+ *
+ * The Original Code is MapCopy, a copy utility for Civ2 maps and saved games.
+ *
+ * The Initial Developer of the Original Code is James Dustin Reichwein.
+ * Portions created by James Dustin Reichwein are
+ * Copyright (C) 2000,2005, James Dustin Reichwein.  All
+ * Rights Reserved.
+ *
+ * Contributor(s):
+ */
+
+// spool.h
+// Description:  Runs copy jobs from a spool directory shared by several
+//               mapcopy processes, possibly on different machines.
+//
+// Creation Date: Oct/18/2026
+//
+// Revision History:
+
+#ifndef SPOOL_H_
+#define SPOOL_H_
+
+#include <string>
+#include <vector>
+#include <set>
+#include <stdexcept>
+#include <mutex>
+#include <condition_variable>
+#include <map>
+#include "copyjob.h"
+#include "pipeline.h"
+
+using namespace std;
+
+// The spool directory
+// A spool directory holds copy jobs waiting to be run, one per file, and
+// lets any number of mapcopy processes share them out between themselves
+// through the file system alone. Each job file holds one line of arguments,
+// the same as a line of a batch file. The directory has:
+//
+//     queue/NAME.job         Jobs waiting to be run
+//     claimed/NAME.job@NODE  Jobs being run by the process named NODE
+//     done/NAME.job          Finished jobs
+//     done.log               One line per finished job, with its result
+//
+// A process claims a job by renaming it from queue/ into claimed/ under its
+// own name. Renaming is atomic, so only one process can succeed. While it
+// runs the job it keeps touching the claimed file. A claim that has not been
+// touched for longer than the lease time belongs to a process that has died
+// or lost touch with the directory, and can be taken over by renaming it
+// again. A finished job is renamed into done/ and then logged.
+//
+// Each process can be given one part of the jobs, by a hash of the name of
+// their destination file, so all the jobs for one file are run by the same
+// process, in the order their names sort in.
+
+// SpoolRunner
+// Claims and runs the jobs of a spool directory until there are none left
+// for it, on a number of worker threads sharing one CopyContext.
+class SpoolRunner
+{
+    public:
+
+        // part and parts pick which jobs to run: those whose destination
+        // hashes to part, counting from 0, out of parts. leaseSeconds is
+        // how long a claim lasts without being touched.
+        SpoolRunner(const string& directory, int part, int parts,
+                    int leaseSeconds, int workers) throw (runtime_error);
+
+        // Run jobs until there are none left in this process's part, and
+        // none being run by other processes. Returns 0 if all the jobs run
+        // by this process succeeded, and 1 otherwise.
+        int run() throw (runtime_error);
+
+        // The name this process claims jobs under. Defaults to the host
+        // name and process id.
+        const string& getNodeName() const { return node_name; }
+        void setNodeName(const string& name) throw (runtime_error);
+
+        // Add the jobs in a batch file to the queue of a spool directory,
+        // creating the directory if needed. Returns the number added.
+        static int submit(const string& directory, const string& batchFile)
+            throw (runtime_error);
+
+    private:
+
+        // What claim() found
+        enum ClaimResult { CLAIMED, BUSY, NONE };
+
+        // A job file, as read from the spool directory
+        struct JobInfo
+        {
+            string line;
+            string description;
+            bool mine;
+            vector<string> reads;
+            vector<string> writes;
+        };
+
+        // A job claimed by this process
+        struct Claim
+        {
+            string name;      // NAME.job
+            string path;      // claimed/NAME.job@NODE
+            JobInfo info;
+        };
+
+        // Not copyable
+        SpoolRunner(const SpoolRunner&);
+        SpoolRunner& operator=(const SpoolRunner&);
+
+        ClaimResult claim(Claim& c);
+        bool getJobInfo(const string& name, const string& path, JobInfo& info);
+        bool take(const string& from, const string& name, Claim& c);
+        long getSpoolTime();
+        void worker();
+        void heartbeat();
+        void runJob(Claim& c);
+        void finish(const Claim& c, const string& status, const string& error);
+
+        string spool_dir;
+        string node_name;
+        int part;
+        int parts;
+        int lease_seconds;
+        int num_workers;
+
+        CopyContext context;
+
+        // The jobs seen so far, by name, so that each job file is only read
+        // and parsed once. Guarded by claim_lock.
+        map<string, JobInfo> known_jobs;
+
+        // Files used by the jobs in progress in this process. Guarded by
+        // claim_lock, since workers claim one at a time.
+        FileLocks files;
+        mutex claim_lock;
+
+        // Claims held by this process, kept alive by heartbeat(), and the
+        // results of the jobs it has run
+        set<string> held;
+        bool stopping;
+        int ran;
+        int failed;
+        int skipped;
+        mutex held_lock;
+        condition_variable stopHeartbeat;
+};
+
+#endif
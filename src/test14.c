@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libmapcopy.h"
+
+
+/* test driver for test 14, calculates fertility for a .MP file through the
+ * C interface of libmapcopy, loading and saving it through memory, and
+ * checks that layers can be read and written back and that errors come back
+ * as status codes. */
+
+static int fail(const char *what)
+{
+    printf("%s failed: %s\n", what, mc_last_error());
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *f;
+    long size;
+    unsigned char *data;
+    unsigned char *layer;
+    unsigned char *out;
+    size_t needed;
+    mc_context *context;
+    mc_game *game;
+    mc_game_info info;
+
+    if (argc != 3)
+    {
+        printf("Usage: test14 source.mp dest.mp\n");
+        return 1;
+    }
+
+    f = fopen(argv[1], "rb");
+    if (f == NULL) return 1;
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = (unsigned char *) malloc(size);
+    if (fread(data, 1, size, f) != (size_t) size) return 1;
+    fclose(f);
+
+    if (mc_context_create(&context) != MC_OK) return fail("mc_context_create");
+    if (mc_game_load_memory(data, size, 1, &game) != MC_OK) return fail("mc_game_load_memory");
+    free(data);
+
+    if (mc_game_get_info(game, &info) != MC_OK) return fail("mc_game_get_info");
+    if (!info.map_only || info.num_maps != 1) return fail("mc_game_get_info");
+
+    if (mc_copy_games(context, NULL, game, "+f:CALC") != MC_OK) return fail("mc_copy_games");
+
+    /* Reading and writing back every layer must leave the map as it was */
+    layer = (unsigned char *) malloc(info.squares);
+    for (int i = 0; i < MC_NUM_LAYERS; i++)
+    {
+        if (mc_layer_get(game, 1, i, layer, info.squares) != MC_OK) return fail("mc_layer_get");
+        if (mc_layer_set(game, 1, i, layer, info.squares) != MC_OK) return fail("mc_layer_set");
+    }
+
+    /* These must fail without throwing */
+    if (mc_layer_get(game, 2, MC_LAYER_TERRAIN, layer, info.squares) != MC_INVALID_ARGUMENT ||
+        mc_layer_get(game, 1, MC_LAYER_TERRAIN, layer, info.squares - 1) != MC_INVALID_ARGUMENT ||
+        mc_copy_games(context, NULL, game, "+f:NOSUCH") != MC_INVALID_ARGUMENT)
+    {
+        printf("bad arguments were accepted\n");
+        return 1;
+    }
+    free(layer);
+
+    if (mc_game_save_memory(game, NULL, 0, &needed) != MC_BUFFER_TOO_SMALL) return fail("mc_game_save_memory");
+    out = (unsigned char *) malloc(needed);
+    if (mc_game_save_memory(game, out, needed, &needed) != MC_OK) return fail("mc_game_save_memory");
+
+    f = fopen(argv[2], "wb");
+    if (f == NULL) return 1;
+    fwrite(out, 1, needed, f);
+    fclose(f);
+    free(out);
+
+    mc_game_free(game);
+    mc_context_free(context);
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libmapcopy.h"
+
+
+/* test driver for test 19, calculates the body counters of a map made by
+ * the Map Editor through the C interface of libmapcopy, and checks that
+ * they group the squares into the same bodies as the Map Editor's did. The
+ * bodies may be numbered differently. */
+
+#define OCEAN 10
+#define TYPE_MASK 0x0F          /* The terrain type, as the Map Editor reads it */
+#define BODY_MASK 0x3F          /* The upper two bits are the map position */
+#define NUM_BODIES 64
+
+static int fail(const char *what)
+{
+    printf("%s failed: %s\n", what, mc_last_error());
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned char *terrain;
+    unsigned char *editor;
+    unsigned char *calculated;
+    int editorToCalc[2][NUM_BODIES];
+    int calcToEditor[2][NUM_BODIES];
+    int different = 0;
+    mc_context *context;
+    mc_game *game;
+    mc_game_info info;
+
+    if (argc != 2)
+    {
+        printf("Usage: test19 editor.mp\n");
+        return 1;
+    }
+
+    if (mc_context_create(&context) != MC_OK) return fail("mc_context_create");
+    if (mc_game_load(argv[1], &game) != MC_OK) return fail("mc_game_load");
+    if (mc_game_get_info(game, &info) != MC_OK) return fail("mc_game_get_info");
+
+    terrain = (unsigned char *) malloc(info.squares);
+    editor = (unsigned char *) malloc(info.squares);
+    calculated = (unsigned char *) malloc(info.squares);
+
+    if (mc_layer_get(game, 1, MC_LAYER_TERRAIN, terrain, info.squares) != MC_OK ||
+        mc_layer_get(game, 1, MC_LAYER_BODY_COUNTER, editor, info.squares) != MC_OK)
+    {
+        return fail("mc_layer_get");
+    }
+
+    if (mc_copy_games(context, NULL, game, "+bc:CALC") != MC_OK) return fail("mc_copy_games");
+    if (mc_layer_get(game, 1, MC_LAYER_BODY_COUNTER, calculated, info.squares) != MC_OK)
+    {
+        return fail("mc_layer_get");
+    }
+
+    /* Land and ocean bodies are numbered separately. Each body of the Map
+     * Editor must be one calculated body, and the other way around. */
+    memset(editorToCalc, -1, sizeof(editorToCalc));
+    memset(calcToEditor, -1, sizeof(calcToEditor));
+    for (int i = 0; i < info.squares; i++)
+    {
+        int ocean = (terrain[i] & TYPE_MASK) == OCEAN;
+        int e = editor[i] & BODY_MASK;
+        int c = calculated[i] & BODY_MASK;
+
+        if (editorToCalc[ocean][e] < 0) editorToCalc[ocean][e] = c;
+        if (calcToEditor[ocean][c] < 0) calcToEditor[ocean][c] = e;
+
+        if (editorToCalc[ocean][e] != c || calcToEditor[ocean][c] != e)
+        {
+            printf("square %d: %s body %d of the Map Editor is %d, expected %d\n",
+                   i, ocean ? "ocean" : "land", e, c, editorToCalc[ocean][e]);
+            different++;
+        }
+    }
+
+    free(terrain);
+    free(editor);
+    free(calculated);
+    mc_game_free(game);
+    mc_context_free(context);
+    return (different == 0) ? 0 : 1;
+}
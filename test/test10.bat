@@ -65,6 +65,18 @@ copy perm\test_calcall.mp tc.mp > nul
 
 fc /B tc1.mp perm\tc1.mp > nul
 
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub6
+goto :fail
+
+:sub6
+set st=6
+
+..\mapcopy tc.mp tc2.mp +f:CALCALL +rules:perm\rules.txt -verbose -backup
+
+fc /B tc2.mp perm\tc1.mp > nul
+
 if errorlevel 2 goto fail
 if errorlevel 1 goto fail
 if errorlevel 0 goto passed
@@ -79,4 +91,4 @@ echo test10 passed
 
 
 :done
-del tf.mp tf2.mp tf3.mp tfc.sav tfc2.sav tc.mp tc1.mp
+del tf.mp tf2.mp tf3.mp tfc.sav tfc2.sav tc.mp tc1.mp tc2.mp
@@ -166,6 +166,21 @@ copy perm\tot_multiple1.sav . > nul
 
 fc /B tot_multiple1.sav perm\tot_multiple4.sav > nul
 
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub11
+
+goto :fail
+
+:sub11
+set st=11
+
+copy perm\tot_multiple1.sav tot_calc.sav > nul
+
+..\mapcopy tot_calc.sav +f:CALCALL +dm:ALL -verbose -b
+
+fc /B tot_calc.sav perm\tot_calc1.sav > nul
+
 if errorlevel 2 goto fail
 if errorlevel 1 goto fail
 if errorlevel 0 goto passed
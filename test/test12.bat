@@ -0,0 +1,174 @@
+@echo off
+
+set st=1
+
+copy perm\test_fert.mp tf.mp > nul
+copy perm\test_fert.mp tf2.mp > nul
+copy perm\test_fert_city.sav tfc.sav > nul
+copy perm\test_fert_city.sav tfc2.sav > nul
+copy perm\test_calcall.mp tc.mp > nul
+
+rem The last job in the batch fails on purpose, so the exit code must be 1
+..\mapcopy --batch perm\batch1.txt > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto sub2
+goto :fail
+
+:sub2
+set st=2
+
+fc /B tf0.mp perm\test_fert.mp > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub3
+goto :fail
+
+:sub3
+set st=3
+
+fc /B tf.mp perm\tf1.mp > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub4
+goto :fail
+
+:sub4
+set st=4
+
+fc /B tfc.sav perm\tfc1.sav > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub5
+goto :fail
+
+:sub5
+set st=5
+
+fc /B tfc2.sav perm\tfc1.sav > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub6
+goto :fail
+
+:sub6
+set st=6
+
+fc /B tf3.mp perm\test_fert.mp > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub7
+goto :fail
+
+:sub7
+set st=7
+
+fc /B tc1.mp perm\tc1.mp > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub8
+goto :fail
+
+:sub8
+set st=8
+
+rem Run the same batch again, on several threads
+del tf0.mp tf3.mp tc1.mp
+copy perm\test_fert.mp tf.mp > nul
+copy perm\test_fert.mp tf2.mp > nul
+copy perm\test_fert_city.sav tfc.sav > nul
+copy perm\test_fert_city.sav tfc2.sav > nul
+
+..\mapcopy --batch perm\batch1.txt --threads 2,2,2 --memory 1 > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto sub9
+goto :fail
+
+:sub9
+set st=9
+
+fc /B tfc2.sav perm\tfc1.sav > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub10
+goto :fail
+
+:sub10
+set st=10
+
+fc /B tc1.mp perm\tc1.mp > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub11
+goto :fail
+
+:sub11
+set st=11
+
+rem Copy one map into two saved games with --to and a wildcard
+copy perm\test_fert.mp tf.mp > nul
+copy perm\test_fert_city.sav tfx1.sav > nul
+copy perm\test_fert_city.sav tfx2.sav > nul
+
+..\mapcopy tf.mp --to tfx*.sav -backup > nul
+
+if errorlevel 1 goto fail
+
+fc /B tfx1.sav perm\tfc1.sav > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub12
+goto :fail
+
+:sub12
+set st=12
+
+fc /B tfx2.sav perm\tfc1.sav > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub13
+goto :fail
+
+:sub13
+set st=13
+
+rem Several jobs with the same destination, one of which fails
+copy perm\test_fert_city.sav tfx3.sav > nul
+
+..\mapcopy --batch perm\batch2.txt > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto sub14
+goto :fail
+
+:sub14
+set st=14
+
+fc /B tfx3.sav perm\tfc1.sav > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto passed
+goto :fail
+
+:fail
+echo test 12.%st% failed
+goto done
+
+:passed
+echo test12 passed
+
+
+:done
+del tf.mp tf0.mp tf2.mp tf3.mp tfc.sav tfc2.sav tc.mp tc1.mp tfx1.sav tfx2.sav tfx3.sav
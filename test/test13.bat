@@ -0,0 +1,101 @@
+@echo off
+
+set st=1
+
+copy perm\test_fert.mp tf.mp > nul
+copy perm\test_fert_city.sav tfx1.sav > nul
+copy perm\test_fert_city.sav tfx2.sav > nul
+
+rem The first copy stores a snapshot of tf.mp in the cache
+..\mapcopy tf.mp tfx1.sav +scache:tsnap -verbose -backup
+
+if errorlevel 1 goto fail
+
+fc /B tfx1.sav perm\tfc1.sav > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub2
+goto :fail
+
+:sub2
+set st=2
+
+rem The second copy loads tf.mp from the snapshot
+..\mapcopy tf.mp tfx2.sav +scache:tsnap -verbose -backup
+
+if errorlevel 1 goto fail
+
+fc /B tfx2.sav perm\tfc1.sav > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub3
+goto :fail
+
+:sub3
+set st=3
+
+rem Copying the same map again changes nothing, so with +skip the
+rem destination is neither backed up nor saved
+..\mapcopy tf.mp tfx1.sav +skip -verbose +backup
+
+if errorlevel 1 goto fail
+if exist tfx1.sav.bak goto fail
+
+fc /B tfx1.sav perm\tfc1.sav > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub4
+goto :fail
+
+:sub4
+set st=4
+
+rem The first copy adds itself to the memo, the second is skipped by it
+..\mapcopy tf.mp tfx1.sav +memo:tmemo.txt -verbose +backup
+..\mapcopy tf.mp tfx1.sav +memo:tmemo.txt -verbose +backup
+
+if errorlevel 1 goto fail
+if not exist tmemo.txt goto fail
+if exist tfx1.sav.bak goto fail
+
+fc /B tfx1.sav perm\tfc1.sav > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub5
+goto :fail
+
+:sub5
+set st=5
+
+rem Rewrite a cached source straight after storing it. It keeps its size,
+rem and likely its second, but must not be loaded from the old snapshot.
+copy perm\test_fert.mp tq.mp > nul
+..\mapcopy tq.mp tq1.mp +t +scache:tsnap -verbose -b
+..\mapcopy perm\test_calcall.mp tq.mp +t -verbose -b
+..\mapcopy tq.mp tq2.mp +t +scache:tsnap -verbose -b
+..\mapcopy tq.mp tq3.mp +t -verbose -b
+
+if errorlevel 1 goto fail
+
+fc /B tq2.mp tq3.mp > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto passed
+goto :fail
+
+:fail
+echo test 13.%st% failed
+goto done
+
+:passed
+echo test13 passed
+
+
+:done
+del tf.mp tfx1.sav tfx2.sav tmemo.txt tq*.mp
+rmdir /s /q tsnap
@@ -0,0 +1,24 @@
+@echo off
+
+set st=1
+
+rem test14.exe is built with "make -f Makefile.win test14.exe"
+..\test14 perm\test_fert.mp tf14.mp
+
+if errorlevel 1 goto fail
+if not errorlevel 0 goto fail
+
+fc /B tf14.mp perm\tf1.mp > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto passed
+
+:fail
+echo test 14.%st% failed
+goto done
+
+:passed
+echo test14 passed
+
+:done
@@ -0,0 +1,51 @@
+@echo off
+
+set st=1
+
+copy perm\test_fert.mp tf.mp > nul
+copy perm\test_fert_city.sav tfl1.sav > nul
+copy perm\test_fert_city.sav tfl2.sav > nul
+copy perm\test_fert_city.sav tfl3.sav > nul
+
+rem Taking the layers an MP to SAV copy takes, then calculating fertility,
+rem is the same as that copy
+..\mapcopy --layer s,t,bc,rs=tf.mp tfl1.sav +f:CALC -verbose -backup
+
+if errorlevel 1 goto fail
+
+fc /B tfl1.sav perm\tfc1.sav > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub2
+goto :fail
+
+:sub2
+set st=2
+
+rem Layers from two files in one run, and the same copies run one at a time
+..\mapcopy --layer t,rs=tf.mp --layer i,o,cv=perm\tfc1.sav tfl2.sav +f:CALC -verbose -backup
+
+if errorlevel 1 goto fail
+
+..\mapcopy tf.mp tfl3.sav -s -t -bc -f -rs +t +rs -verbose -backup
+..\mapcopy perm\tfc1.sav tfl3.sav -s -t -bc -f -rs +i +o +cv -verbose -backup
+..\mapcopy tfl3.sav +f:CALC -verbose -backup
+
+fc /B tfl2.sav tfl3.sav > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto passed
+goto :fail
+
+:fail
+echo test 15.%st% failed
+goto done
+
+:passed
+echo test15 passed
+
+
+:done
+del tf.mp tfl1.sav tfl2.sav tfl3.sav
@@ -0,0 +1,111 @@
+@echo off
+
+set st=1
+
+copy perm\test_fert.mp tf.mp > nul
+copy perm\test_fert_city.sav tfo1.sav > nul
+copy perm\test_fert_city.sav tfo2.sav > nul
+copy perm\test_fert_city.sav tfo3.sav > nul
+
+rem Copying the layers an MP to SAV copy takes and calculating fertility,
+rem fused into one pass, is the same as that copy
+..\mapcopy --ops "s,t,bc,rs=tf.mp; f:CALC" tfo1.sav -verbose -backup
+
+if errorlevel 1 goto fail
+
+fc /B tfo1.sav perm\tfc1.sav > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub2
+goto :fail
+
+:sub2
+set st=2
+
+rem A steps file, and the same steps run one at a time
+echo t,rs=tf.mp> tfo.txt
+echo rs:CLEAR>> tfo.txt
+echo f:CALCALL>> tfo.txt
+echo cv:CURRENT>> tfo.txt
+echo rules:perm\rules.txt>> tfo.txt
+
+..\mapcopy --ops-file tfo.txt tfo2.sav -verbose -backup
+
+if errorlevel 1 goto fail
+
+..\mapcopy tf.mp tfo3.sav -s -t -bc -f -rs +t +rs -verbose -backup
+..\mapcopy tfo3.sav +rs:CLEAR -verbose -backup
+..\mapcopy tfo3.sav +f:CALCALL +rules:perm\rules.txt -verbose -backup
+..\mapcopy tfo3.sav +cv:CURRENT -verbose -backup
+
+fc /B tfo2.sav tfo3.sav > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub3
+goto :fail
+
+:sub3
+set st=3
+
+rem Setting the resource suppression of every map of a ToT game, and then
+rem copying improvements into map 1 from an MP file, are not one pass
+copy perm\tot_multiple1.sav tfo4.sav > nul
+copy perm\tot_multiple1.sav tfo5.sav > nul
+copy perm\tot_map1.mp tfo.mp > nul
+
+..\mapcopy --ops "rs:SET; i=tfo.mp" tfo4.sav -verbose -backup
+
+if errorlevel 1 goto fail
+
+..\mapcopy tfo5.sav +rs:SET -verbose -backup
+..\mapcopy tfo.mp tfo5.sav -s -t -bc -f -rs +i -verbose -backup
+
+fc /B tfo4.sav tfo5.sav > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub4
+goto :fail
+
+:sub4
+set st=4
+
+rem A trace records the fertility calculated by a step
+copy perm\test_fert.mp tfo6.mp > nul
+copy perm\test_fert.mp tfo7.mp > nul
+
+..\mapcopy --ops "f:CALC" tfo6.mp +fert-trace:tfo6.bin -backup > nul
+
+if errorlevel 1 goto fail
+
+..\mapcopy tfo7.mp +f:CALC +fert-trace:tfo7.bin -backup > nul
+
+fc /B tfo6.bin tfo7.bin > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub5
+goto :fail
+
+:sub5
+set st=5
+
+rem A trace cannot record more than one calculation
+..\mapcopy --ops "f:CALC; rs:SET; f:CALCALL" tfo6.mp +fert-trace:tfo6.bin -backup | find "A fertility trace can only record one fertility calculation." > nul
+
+if errorlevel 1 goto fail
+if errorlevel 0 goto passed
+goto :fail
+
+:fail
+echo test 16.%st% failed
+goto done
+
+:passed
+echo test16 passed
+
+
+:done
+del tf.mp tfo.mp tfo.txt tfo1.sav tfo2.sav tfo3.sav tfo4.sav tfo5.sav tfo6.mp tfo7.mp tfo6.bin tfo7.bin
@@ -0,0 +1,55 @@
+@echo off
+
+set st=1
+
+copy perm\tf1.mp tr1.mp > nul
+copy perm\tf1.mp tr2.mp > nul
+copy perm\grass_round.mp tr3.mp > nul
+
+rem Recalculating fertility only around a region that wraps around the
+rem edge of a round map gives the same result as recalculating all of it
+..\mapcopy perm\tot_map1.mp tr1.mp -s -t -i -v -o -cs -bc -cr -f -cv -rs +t +i +f:CALC +region:90,10,99,30 -verbose -backup
+
+if errorlevel 1 goto fail
+
+..\mapcopy perm\tot_map1.mp tr2.mp -s -t -i -v -o -cs -bc -cr -f -cv -rs +t +i +region:90,10,99,30 -verbose -backup
+..\mapcopy tr2.mp +f:CALC -verbose -backup
+
+fc /B tr1.mp tr2.mp > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub2
+goto :fail
+
+:sub2
+set st=2
+
+rem Stamping a small map across the edge of a larger one, the same way
+..\mapcopy tr3.mp +f:CALC -verbose -backup
+copy tr3.mp tr4.mp > nul
+
+..\mapcopy perm\mount.mp tr3.mp +stamp:130,100 +f:CALC -verbose -backup
+
+if errorlevel 1 goto fail
+
+..\mapcopy perm\mount.mp tr4.mp +stamp:130,100 -f -verbose -backup
+..\mapcopy tr4.mp +f:CALC -verbose -backup
+
+fc /B tr3.mp tr4.mp > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto passed
+goto :fail
+
+:fail
+echo test 17.%st% failed
+goto done
+
+:passed
+echo test17 passed
+
+
+:done
+del tr1.mp tr2.mp tr3.mp tr4.mp
@@ -0,0 +1,70 @@
+@echo off
+
+set st=1
+
+copy perm\tot_single.sav tc1.sav > nul
+copy perm\tot_map1.mp tc1.mp > nul
+
+rem Clearing the city radius of a saved game and calculating it again from
+rem the city records gives back the city radius Civ2 saved
+..\mapcopy perm\tot_map1.mp tc1.sav -s -t -i -v -o -cs -bc -cr -f -cv -rs +cr -verbose -backup
+..\mapcopy tc1.sav +cr:CALC -verbose -backup
+
+if errorlevel 1 goto fail
+
+fc /B tc1.sav perm\tot_single.sav > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub2
+goto :fail
+
+:sub2
+set st=2
+
+rem The same for a map, whose cities are found from the improvements and
+rem the ownership of their squares
+..\mapcopy perm\tot_single.sav tc1.mp -s -t -i -v -o -cs -bc -cr -f -cv -rs +i +o +cr -verbose -backup
+copy tc1.mp tc2.mp > nul
+..\mapcopy perm\tot_map1.mp tc2.mp -s -t -i -v -o -cs -bc -cr -f -cv -rs +cr -verbose -backup
+..\mapcopy tc2.mp +cr:CALC -verbose -backup
+
+if errorlevel 1 goto fail
+
+fc /B tc1.mp tc2.mp > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub3
+goto :fail
+
+:sub3
+set st=3
+
+rem Calculating the ownership of a saved game and copying it into a map
+rem gives the same results as calculating it in the map
+copy perm\tot_single.sav tc2.sav > nul
+copy tc1.mp tc3.mp > nul
+..\mapcopy tc2.sav +o:CALC -verbose -backup
+..\mapcopy tc2.sav tc3.mp -s -t -i -v -o -cs -bc -cr -f -cv -rs +o -verbose -backup
+..\mapcopy tc1.mp +o:CALC -verbose -backup
+
+if errorlevel 1 goto fail
+
+fc /B tc1.mp tc3.mp > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto passed
+goto :fail
+
+:fail
+echo test 18.%st% failed
+goto done
+
+:passed
+echo test18 passed
+
+
+:done
+del tc1.sav tc2.sav tc1.mp tc2.mp tc3.mp
@@ -0,0 +1,64 @@
+@echo off
+
+set st=1
+
+copy perm\tot_map1.mp tb1.mp > nul
+copy perm\tot_multiple1.sav tb1.sav > nul
+copy perm\tot_multiple1.sav tb2.sav > nul
+
+rem Calculating the body counters of a map gives the expected results. The
+rem bodies of perm\tb1.mp are checked against the Map Editor's by test 19.3
+..\mapcopy tb1.mp +bc:CALC -verbose -backup
+
+if errorlevel 1 goto fail
+
+fc /B tb1.mp perm\tb1.mp > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub2
+goto :fail
+
+:sub2
+set st=2
+
+rem Calculating the body counters of every map of a ToT game at once gives
+rem the same results as calculating them one map at a time
+..\mapcopy tb1.sav +bc:CALC +dm:ALL -verbose -backup
+
+if errorlevel 1 goto fail
+
+..\mapcopy tb2.sav +bc:CALC +dm:1 -verbose -backup
+..\mapcopy tb2.sav +bc:CALC +dm:2 -verbose -backup
+..\mapcopy tb2.sav +bc:CALC +dm:3 -verbose -backup
+..\mapcopy tb2.sav +bc:CALC +dm:4 -verbose -backup
+
+fc /B tb1.sav tb2.sav > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub3
+goto :fail
+
+:sub3
+set st=3
+
+rem The calculated bodies group the squares of a map made by the Map Editor
+rem the same way as the Map Editor's own body counters, up to renumbering.
+rem test19.exe is built with "make -f Makefile.win test19.exe"
+..\test19 perm\tot_map1.mp
+
+if errorlevel 1 goto fail
+if errorlevel 0 goto passed
+goto :fail
+
+:fail
+echo test 19.%st% failed
+goto done
+
+:passed
+echo test19 passed
+
+
+:done
+del tb1.mp tb1.sav tb2.sav
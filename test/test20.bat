@@ -0,0 +1,94 @@
+@echo off
+
+set st=1
+
+copy perm\test_fert.mp tf.mp > nul
+copy perm\test_fert.mp tf2.mp > nul
+copy perm\test_fert_city.sav tfc.sav > nul
+copy perm\test_fert_city.sav tfc2.sav > nul
+copy perm\test_calcall.mp tc.mp > nul
+
+rem Run the batch from test 12 through a spool directory, split between two
+rem processes. tf.mp -> tf0.mp and the in-place change of tf.mp hash to
+rem different parts, so the second must wait for the first.
+..\mapcopy --submit spool perm\batch1.txt > nul
+
+if errorlevel 1 goto fail
+
+start /b ..\mapcopy --spool spool --node 1/2 > nul
+..\mapcopy --spool spool --node 2/2 > nul
+
+rem A second process for part 1 waits until the first has run all its jobs
+..\mapcopy --spool spool --node 1/2 > nul
+
+:sub2
+set st=2
+
+fc /B tf0.mp perm\test_fert.mp > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub3
+goto :fail
+
+:sub3
+set st=3
+
+fc /B tf.mp perm\tf1.mp > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub4
+goto :fail
+
+:sub4
+set st=4
+
+fc /B tfc.sav perm\tfc1.sav > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub5
+goto :fail
+
+:sub5
+set st=5
+
+fc /B tfc2.sav perm\tfc1.sav > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub6
+goto :fail
+
+:sub6
+set st=6
+
+fc /B tf3.mp perm\test_fert.mp > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub7
+goto :fail
+
+:sub7
+set st=7
+
+fc /B tc1.mp perm\tc1.mp > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto passed
+goto :fail
+
+:fail
+echo test 20.%st% failed
+goto done
+
+:passed
+echo test20 passed
+
+
+:done
+del tf.mp tf0.mp tf2.mp tf3.mp tfc.sav tfc2.sav tc.mp tc1.mp
+rmdir /s /q spool
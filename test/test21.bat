@@ -0,0 +1,75 @@
+@echo off
+
+set st=1
+
+rem Each cache entry of these 100 by 80 maps is 2024 bytes, so a 5 kilobyte
+rem cache holds two of them
+copy perm\test_fert.mp tf.mp > nul
+..\mapcopy tf.mp +f:CALC +fcache:fcache +fcachemax:5 -b > nul
+
+if errorlevel 1 goto fail
+
+fc /B tf.mp perm\tf1.mp > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub2
+goto :fail
+
+:sub2
+set st=2
+
+rem The same map again is found in the cache, and gives the same results as
+rem calculating it
+copy perm\test_fert.mp tf2.mp > nul
+..\mapcopy tf2.mp +f:CALC +fcache:fcache +fcachemax:5 -b | find "Using cached fertility" > nul
+
+if errorlevel 1 goto fail
+
+fc /B tf2.mp perm\tf1.mp > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub3
+goto :fail
+
+:sub3
+set st=3
+
+rem Add a second map, then use the first again so that the second is the
+rem least recently used
+copy perm\test_calcall.mp tc.mp > nul
+..\mapcopy tc.mp +f:CALC +fcache:fcache +fcachemax:5 -b > nul
+copy perm\test_fert.mp tf2.mp > nul
+..\mapcopy tf2.mp +f:CALC +fcache:fcache +fcachemax:5 -b | find "Using cached fertility" > nul
+
+if errorlevel 1 goto fail
+
+rem A third map fills the cache, which evicts the second map but not the first
+copy perm\tot_map1.mp tm.mp > nul
+..\mapcopy tm.mp +f:CALC +fcache:fcache +fcachemax:5 -b > nul
+copy perm\test_fert.mp tf2.mp > nul
+..\mapcopy tf2.mp +f:CALC +fcache:fcache +fcachemax:5 -b | find "Using cached fertility" > nul
+
+if errorlevel 1 goto fail
+
+:sub4
+set st=4
+
+copy perm\test_calcall.mp tc.mp > nul
+..\mapcopy tc.mp +f:CALC +fcache:fcache +fcachemax:5 -b | find "Using cached fertility" > nul
+
+if errorlevel 1 goto passed
+goto :fail
+
+:fail
+echo test 21.%st% failed
+goto done
+
+:passed
+echo test21 passed
+
+
+:done
+del tf.mp tf2.mp tc.mp tm.mp
+rmdir /s /q fcache
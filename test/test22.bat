@@ -0,0 +1,83 @@
+@echo off
+
+rem FertDump.exe is built with "make -f Makefile.win FertDump.exe"
+
+set st=1
+
+rem Tracing a calculation does not change its results
+copy perm\test_fert.mp tf.mp > nul
+..\mapcopy tf.mp +f:CALC +fert-trace:tft.bin -b > nul
+
+if errorlevel 1 goto fail
+
+fc /B tf.mp perm\tf1.mp > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub2
+goto :fail
+
+:sub2
+set st=2
+
+rem The adjusted fertility of every square in perm\tft1.txt matches
+rem perm\tf1.mp
+..\fertdump tft.bin > tft.txt
+fc /B tft.txt perm\tft1.txt > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub3
+goto :fail
+
+:sub3
+set st=3
+
+rem A window only records the squares inside it
+copy perm\test_fert.mp tf2.mp > nul
+..\mapcopy tf2.mp +f:CALC +fert-trace:tfw.bin +fert-trace-window:10,20,16,26 -b > nul
+..\fertdump tfw.bin > tfw.txt
+fc /B tfw.txt perm\tfw1.txt > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub4
+goto :fail
+
+:sub4
+set st=4
+
+rem FertDump can print a single square
+..\fertdump tft.bin 13 23 | find "1 13,23 2.67/1/0 8/10.5/0 16/15/0 13 13 13" > nul
+
+if errorlevel 1 goto fail
+if errorlevel 0 goto sub5
+goto :fail
+
+:sub5
+set st=5
+
+rem Only the first of several jobs may write a trace file
+copy perm\test_fert.mp tf3.mp > nul
+copy perm\test_fert.mp tf4.mp > nul
+..\mapcopy perm\test_fert.mp --to tf3.mp tf4.mp +f:CALC +fert-trace:tft2.bin -b | find "File 2: FAILED  tf4.mp: The fertility trace tft2.bin is already written by job 1." > nul
+
+if errorlevel 1 goto fail
+
+fc /B tf3.mp perm\tf1.mp > nul
+
+if errorlevel 2 goto fail
+if errorlevel 1 goto fail
+if errorlevel 0 goto passed
+goto :fail
+
+:fail
+echo test 22.%st% failed
+goto done
+
+:passed
+echo test22 passed
+
+
+:done
+del tf.mp tf2.mp tf3.mp tf4.mp tft.bin tft2.bin tfw.bin tft.txt tfw.txt
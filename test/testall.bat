@@ -18,4 +18,37 @@ echo Testing fertility...
 call test10.bat
 
 echo Testing ToT Multimap copies...
-call test11.bat
\ No newline at end of file
+call test11.bat
+
+echo Testing batch mode...
+call test12.bat
+
+echo Testing caches and unchanged copies...
+call test13.bat
+
+echo Testing the library interface...
+call test14.bat
+
+echo Testing layer merges...
+call test15.bat
+
+echo Testing operation scripts...
+call test16.bat
+
+echo Testing region copies and stamps...
+call test17.bat
+
+echo Testing city radius and ownership calculations...
+call test18.bat
+
+echo Testing body counter calculations...
+call test19.bat
+
+echo Testing a batch split between spool processes...
+call test20.bat
+
+echo Testing the fertility cache...
+call test21.bat
+
+echo Testing the fertility trace...
+call test22.bat